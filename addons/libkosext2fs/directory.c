@@ -4,6 +4,7 @@
    Copyright (C) 2013 Lawrence Sebald
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -17,6 +18,519 @@
    4-byte boundary as well. */
 #define DENT_SZ(n) (((n) + sizeof(ext2_dirent_t) + 4) & 0x01FC)
 
+/* Hashed (dir_index, or "HTree") directories. Block 0 of an indexed directory
+   starts with the usual "." and ".." entries, but ".." takes up the rest of the
+   block, hiding the root of the index from anything that doesn't know about it.
+   The index maps ranges of name hashes to the blocks of the directory that hold
+   those names, which are just ordinary directory blocks. Each index block
+   starts with a count/limit header, overlaid on the hash of the first entry
+   (whose hash is implicitly 0). We only read the index, we never update it; any
+   change to the directory clears EXT2_INDEX_FL instead, like older Linux
+   kernels do, and e2fsck -D will rebuild it. */
+typedef struct ext2_dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t hash_version;
+    uint8_t info_length;
+    uint8_t indirect_levels;
+    uint8_t unused_flags;
+} ext2_dx_root_info_t;
+
+typedef struct ext2_dx_entry {
+    uint32_t hash;
+    uint32_t block;
+} ext2_dx_entry_t;
+
+/* Offset of the root info in block 0 (right after "." and ".."'s name). */
+#define DX_ROOT_INFO_OFF    24
+
+/* Offset of the entries in an interior index block, after a fake, empty
+   directory entry covering the whole block. */
+#define DX_NODE_ENTRIES_OFF 8
+
+/* Index depth we'll deal with, including the root. */
+#define DX_MAX_LEVELS       3
+
+#define DX_HASH_LEGACY              0
+#define DX_HASH_HALF_MD4            1
+#define DX_HASH_TEA                 2
+#define DX_HASH_LEGACY_UNSIGNED     3
+#define DX_HASH_HALF_MD4_UNSIGNED   4
+#define DX_HASH_TEA_UNSIGNED        5
+
+#define dx_count(ents)  (((const uint16_t *)(ents))[1])
+#define dx_limit(ents)  (((const uint16_t *)(ents))[0])
+#define dx_block(ent)   ((ent)->block & 0x0FFFFFFF)
+
+static inline int dx_char(const char *s, int i, int uns) {
+    return uns ? (int)((const unsigned char *)s)[i] :
+        (int)((const signed char *)s)[i];
+}
+
+/* The original hash function used for indexed directories. */
+static uint32_t dx_hack_hash(const char *name, int len, int uns) {
+    uint32_t hash, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+    int i;
+
+    for(i = 0; i < len; ++i) {
+        hash = hash1 + (hash0 ^ (uint32_t)(dx_char(name, i, uns) * 7152373));
+
+        if(hash & 0x80000000)
+            hash -= 0x7FFFFFFF;
+
+        hash1 = hash0;
+        hash0 = hash;
+    }
+
+    return hash0 << 1;
+}
+
+/* Pack up to num * 4 bytes of the name into buf, padding with the length. */
+static void dx_str2hashbuf(const char *msg, int len, uint32_t *buf, int num,
+                           int uns) {
+    uint32_t pad, val;
+    int i;
+
+    pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    val = pad;
+
+    if(len > num * 4)
+        len = num * 4;
+
+    for(i = 0; i < len; ++i) {
+        val = (uint32_t)dx_char(msg, i, uns) + (val << 8);
+
+        if((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            --num;
+        }
+    }
+
+    if(--num >= 0)
+        *buf++ = val;
+
+    while(--num >= 0)
+        *buf++ = pad;
+}
+
+#define DX_ROL(x, n)    (((x) << (n)) | ((x) >> (32 - (n))))
+#define DX_F(x, y, z)   ((z) ^ ((x) & ((y) ^ (z))))
+#define DX_G(x, y, z)   (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_H(x, y, z)   ((x) ^ (y) ^ (z))
+#define DX_ROUND(f, a, b, c, d, x, s) \
+    (a += f(b, c, d) + (x), a = DX_ROL(a, s))
+#define DX_K2           013240474631UL
+#define DX_K3           015666365641UL
+
+static void dx_half_md4(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    DX_ROUND(DX_F, a, b, c, d, in[0], 3);
+    DX_ROUND(DX_F, d, a, b, c, in[1], 7);
+    DX_ROUND(DX_F, c, d, a, b, in[2], 11);
+    DX_ROUND(DX_F, b, c, d, a, in[3], 19);
+    DX_ROUND(DX_F, a, b, c, d, in[4], 3);
+    DX_ROUND(DX_F, d, a, b, c, in[5], 7);
+    DX_ROUND(DX_F, c, d, a, b, in[6], 11);
+    DX_ROUND(DX_F, b, c, d, a, in[7], 19);
+
+    DX_ROUND(DX_G, a, b, c, d, in[1] + DX_K2, 3);
+    DX_ROUND(DX_G, d, a, b, c, in[3] + DX_K2, 5);
+    DX_ROUND(DX_G, c, d, a, b, in[5] + DX_K2, 9);
+    DX_ROUND(DX_G, b, c, d, a, in[7] + DX_K2, 13);
+    DX_ROUND(DX_G, a, b, c, d, in[0] + DX_K2, 3);
+    DX_ROUND(DX_G, d, a, b, c, in[2] + DX_K2, 5);
+    DX_ROUND(DX_G, c, d, a, b, in[4] + DX_K2, 9);
+    DX_ROUND(DX_G, b, c, d, a, in[6] + DX_K2, 13);
+
+    DX_ROUND(DX_H, a, b, c, d, in[3] + DX_K3, 3);
+    DX_ROUND(DX_H, d, a, b, c, in[7] + DX_K3, 9);
+    DX_ROUND(DX_H, c, d, a, b, in[2] + DX_K3, 11);
+    DX_ROUND(DX_H, b, c, d, a, in[6] + DX_K3, 15);
+    DX_ROUND(DX_H, a, b, c, d, in[1] + DX_K3, 3);
+    DX_ROUND(DX_H, d, a, b, c, in[5] + DX_K3, 9);
+    DX_ROUND(DX_H, c, d, a, b, in[0] + DX_K3, 11);
+    DX_ROUND(DX_H, b, c, d, a, in[4] + DX_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+static void dx_tea(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+    int n;
+
+    for(n = 0; n < 16; ++n) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+/* Hash a name the way the index of a directory expects it to be. The low bit
+   is always clear, as the index uses it to mark hash collisions. */
+static uint32_t dx_hash(ext2_fs_t *fs, int version, const char *name,
+                        int len) {
+    uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    uint32_t in[8], hash;
+    int uns = version >= DX_HASH_LEGACY_UNSIGNED;
+
+    if(fs->sb.s_hash_seed[0] || fs->sb.s_hash_seed[1] ||
+       fs->sb.s_hash_seed[2] || fs->sb.s_hash_seed[3])
+        memcpy(buf, fs->sb.s_hash_seed, sizeof(buf));
+
+    switch(version) {
+        case DX_HASH_HALF_MD4:
+        case DX_HASH_HALF_MD4_UNSIGNED:
+            for(; len > 0; len -= 32, name += 32) {
+                dx_str2hashbuf(name, len, in, 8, uns);
+                dx_half_md4(buf, in);
+            }
+
+            hash = buf[1];
+            break;
+
+        case DX_HASH_TEA:
+        case DX_HASH_TEA_UNSIGNED:
+            for(; len > 0; len -= 16, name += 16) {
+                dx_str2hashbuf(name, len, in, 4, uns);
+                dx_tea(buf, in);
+            }
+
+            hash = buf[0];
+            break;
+
+        default:
+            hash = dx_hack_hash(name, len, uns);
+            break;
+    }
+
+    hash &= ~1;
+
+    /* The very last hash value is reserved to mark the end of a directory. */
+    if(hash == 0xFFFFFFFE)
+        hash = 0xFFFFFFFC;
+
+    return hash;
+}
+
+/* Look for a name in one directory block. */
+static ext2_dirent_t *search_block(ext2_fs_t *fs, uint8_t *buf, const char *fn,
+                                   size_t len, int *err) {
+    uint32_t off = 0;
+    ext2_dirent_t *dent;
+
+    while(off < fs->block_size) {
+        dent = (ext2_dirent_t *)(buf + off);
+
+        /* Make sure we don't trip and fall on a malformed entry. */
+        if(dent->rec_len < 8 || off + dent->rec_len > fs->block_size) {
+            *err = EIO;
+            return NULL;
+        }
+
+        if(dent->inode && dent->name_len == len &&
+           !memcmp(dent->name, fn, len))
+            return dent;
+
+        off += dent->rec_len;
+    }
+
+    return NULL;
+}
+
+/* Look up a name through the directory's index. Returns 0 and the entry, or an
+   errno value (ENOENT if it isn't there). Returns -1 if the index isn't one we
+   understand, in which case the directory should just be searched through. */
+static int dx_find(ext2_fs_t *fs, const struct ext2_inode *dir, const char *fn,
+                   size_t len, ext2_dirent_t **rv) {
+    struct {
+        uint32_t block;
+        uint32_t off;
+        uint16_t at;
+        uint16_t count;
+    } frames[DX_MAX_LEVELS];
+    const ext2_dx_root_info_t *info;
+    const ext2_dx_entry_t *ents;
+    uint8_t *buf;
+    uint32_t hash, blk = 0, off, bs = fs->block_size;
+    int version, levels, lvl, lo, hi, mid, err = 0;
+
+    if(!(buf = ext2_inode_read_block(fs, dir, 0, NULL, &err)))
+        return err;
+
+    info = (const ext2_dx_root_info_t *)(buf + DX_ROOT_INFO_OFF);
+    version = info->hash_version;
+    levels = info->indirect_levels;
+    off = DX_ROOT_INFO_OFF + info->info_length;
+
+    if(info->reserved_zero || version > DX_HASH_TEA || levels >= DX_MAX_LEVELS ||
+       (info->unused_flags & 1) || info->info_length < 8 || off + 16 > bs)
+        return -1;
+
+    if(fs->sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+        version += DX_HASH_LEGACY_UNSIGNED;
+
+    hash = dx_hash(fs, version, fn, (int)len);
+
+    /* Work down the index to the block the name would be in. */
+    for(lvl = 0; ; ++lvl) {
+        ents = (const ext2_dx_entry_t *)(buf + off);
+
+        if(dx_limit(ents) != (bs - off) / sizeof(ext2_dx_entry_t) ||
+           !dx_count(ents) || dx_count(ents) > dx_limit(ents))
+            return -1;
+
+        /* Find the last entry with a hash that isn't past ours. */
+        lo = 1;
+        hi = dx_count(ents) - 1;
+
+        while(lo <= hi) {
+            mid = (lo + hi) >> 1;
+
+            if(ents[mid].hash > hash)
+                hi = mid - 1;
+            else
+                lo = mid + 1;
+        }
+
+        frames[lvl].block = blk;
+        frames[lvl].off = off;
+        frames[lvl].at = lo - 1;
+        frames[lvl].count = dx_count(ents);
+        blk = dx_block(&ents[lo - 1]);
+
+        if(lvl == levels)
+            break;
+
+        if(!(buf = ext2_inode_read_block(fs, dir, blk, NULL, &err)))
+            return err;
+
+        off = DX_NODE_ENTRIES_OFF;
+    }
+
+    for(;;) {
+        if(!(buf = ext2_inode_read_block(fs, dir, blk, NULL, &err)))
+            return err;
+
+        if((*rv = search_block(fs, buf, fn, len, &err)))
+            return 0;
+        else if(err)
+            return err;
+
+        /* Names with the same hash can spill over into the next block, which
+           is marked by setting the low bit of its hash in the index. */
+        for(lvl = levels; lvl >= 0; --lvl) {
+            if(frames[lvl].at + 1 < frames[lvl].count)
+                break;
+        }
+
+        if(lvl < 0)
+            return ENOENT;
+
+        if(!(buf = ext2_inode_read_block(fs, dir, frames[lvl].block, NULL,
+                                         &err)))
+            return err;
+
+        ents = (const ext2_dx_entry_t *)(buf + frames[lvl].off);
+        ++frames[lvl].at;
+
+        if((ents[frames[lvl].at].hash & ~1) != hash)
+            return ENOENT;
+
+        blk = dx_block(&ents[frames[lvl].at]);
+
+        /* Go back down the leftmost side of that part of the tree. */
+        while(lvl < levels) {
+            if(!(buf = ext2_inode_read_block(fs, dir, blk, NULL, &err)))
+                return err;
+
+            ents = (const ext2_dx_entry_t *)(buf + DX_NODE_ENTRIES_OFF);
+
+            if(!dx_count(ents))
+                return EIO;
+
+            ++lvl;
+            frames[lvl].block = blk;
+            frames[lvl].off = DX_NODE_ENTRIES_OFF;
+            frames[lvl].at = 0;
+            frames[lvl].count = dx_count(ents);
+            blk = dx_block(&ents[0]);
+        }
+    }
+}
+
+/* Find an entry in a directory, using its index if it has one. Returns 0 and
+   the entry, or an errno value (ENOENT if it isn't there). */
+static int find_entry(ext2_fs_t *fs, const struct ext2_inode *dir,
+                      const char *fn, ext2_dirent_t **rv) {
+    uint32_t i, blocks;
+    uint8_t *buf;
+    size_t len = strlen(fn);
+    int err = 0;
+
+    if((dir->i_flags & EXT2_INDEX_FL) &&
+       (fs->sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        if((err = dx_find(fs, dir, fn, len, rv)) >= 0)
+            return err;
+
+        err = 0;
+    }
+
+    blocks = dir->i_size >> (10 + fs->sb.s_log_block_size);
+
+    for(i = 0; i < blocks; ++i) {
+        if(!(buf = ext2_inode_read_block(fs, dir, i, NULL, &err)))
+            return err;
+
+        if((*rv = search_block(fs, buf, fn, len, &err)))
+            return 0;
+        else if(err)
+            return err;
+    }
+
+    /* Didn't find it, oh well. */
+    return ENOENT;
+}
+
+/* Directory lookup cache. Entries are keyed on the inode number of the
+   directory and the name. Anything that changes a directory entry forgets
+   what was cached about that name, so this never gives a different answer
+   than searching the directory would. */
+int ext2_dcache_init(ext2_fs_t *fs, int count) {
+    uint32_t hash_sz = 1;
+    int i;
+
+    fs->dcache = NULL;
+    fs->dcache_hash = NULL;
+    TAILQ_INIT(&fs->dcache_lru);
+
+    if(count <= 0)
+        return 0;
+
+    while(hash_sz < (uint32_t)count)
+        hash_sz <<= 1;
+
+    if(!(fs->dcache = (ext2_dcache_ent_t *)malloc(sizeof(ext2_dcache_ent_t) *
+                                                  count)) ||
+       !(fs->dcache_hash = (struct ext2_dcache_list *)
+         malloc(sizeof(struct ext2_dcache_list) * hash_sz))) {
+        ext2_dcache_shutdown(fs);
+        return -ENOMEM;
+    }
+
+    fs->dcache_hash_mask = hash_sz - 1;
+
+    for(i = 0; i < (int)hash_sz; ++i) {
+        LIST_INIT(&fs->dcache_hash[i]);
+    }
+
+    for(i = 0; i < count; ++i) {
+        fs->dcache[i].name[0] = 0;
+        TAILQ_INSERT_TAIL(&fs->dcache_lru, fs->dcache + i, qentry);
+    }
+
+    return 0;
+}
+
+void ext2_dcache_shutdown(ext2_fs_t *fs) {
+    free(fs->dcache_hash);
+    free(fs->dcache);
+    fs->dcache = NULL;
+    fs->dcache_hash = NULL;
+    TAILQ_INIT(&fs->dcache_lru);
+}
+
+/* Hash the name, FNV-1a style. Returns 0 if the name is too long to be
+   cached. */
+static uint32_t dcache_hash(const char *fn, uint32_t parent) {
+    uint32_t hash = 0x811C9DC5 ^ parent;
+    int i;
+
+    for(i = 0; fn[i]; ++i) {
+        if(i == EXT2_DCACHE_NAME_LEN - 1)
+            return 0;
+
+        hash = (hash ^ (uint8_t)fn[i]) * 0x01000193;
+    }
+
+    return hash | 1;
+}
+
+static void dcache_drop(ext2_fs_t *fs, ext2_dcache_ent_t *ent) {
+    LIST_REMOVE(ent, hentry);
+    ent->name[0] = 0;
+    TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+    TAILQ_INSERT_HEAD(&fs->dcache_lru, ent, qentry);
+}
+
+static ext2_dcache_ent_t *dcache_find(ext2_fs_t *fs, const char *fn,
+                                      uint32_t parent, uint32_t hash) {
+    ext2_dcache_ent_t *ent;
+
+    LIST_FOREACH(ent, &fs->dcache_hash[hash & fs->dcache_hash_mask], hentry) {
+        if(ent->hash == hash && ent->parent == parent && !strcmp(ent->name, fn))
+            return ent;
+    }
+
+    return NULL;
+}
+
+static void dcache_insert(ext2_fs_t *fs, const char *fn, uint32_t parent,
+                          uint32_t hash, uint32_t inode) {
+    ext2_dcache_ent_t *ent = TAILQ_FIRST(&fs->dcache_lru);
+
+    if(ent->name[0])
+        LIST_REMOVE(ent, hentry);
+
+    strcpy(ent->name, fn);
+    ent->parent = parent;
+    ent->hash = hash;
+    ent->inode = inode;
+
+    LIST_INSERT_HEAD(&fs->dcache_hash[hash & fs->dcache_hash_mask], ent,
+                     hentry);
+    TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+    TAILQ_INSERT_TAIL(&fs->dcache_lru, ent, qentry);
+}
+
+/* Forget whatever is cached about fn in the directory dir. */
+static void dcache_forget(ext2_fs_t *fs, const struct ext2_inode *dir,
+                          const char *fn) {
+    uint32_t parent, hash;
+    ext2_dcache_ent_t *ent;
+
+    if(!fs->dcache)
+        return;
+
+    parent = ext2_inode_num(dir);
+
+    if((hash = dcache_hash(fn, parent)) &&
+       (ent = dcache_find(fs, fn, parent, hash)))
+        dcache_drop(fs, ent);
+}
+
+/* Forget everything cached about the directory with the given inode number. */
+static void dcache_forget_dir(ext2_fs_t *fs, uint32_t parent) {
+    ext2_dcache_ent_t *ent, *next;
+
+    if(!fs->dcache)
+        return;
+
+    for(ent = TAILQ_FIRST(&fs->dcache_lru); ent; ent = next) {
+        next = TAILQ_NEXT(ent, qentry);
+
+        if(ent->name[0] && ent->parent == parent)
+            dcache_drop(fs, ent);
+    }
+}
+
 int ext2_dir_is_empty(ext2_fs_t *fs, const struct ext2_inode *dir) {
     uint32_t off, i, blocks;
     ext2_dirent_t *dent;
@@ -58,39 +572,47 @@ int ext2_dir_is_empty(ext2_fs_t *fs, const struct ext2_inode *dir) {
 
 ext2_dirent_t *ext2_dir_entry(ext2_fs_t *fs, const struct ext2_inode *dir,
                               const char *fn) {
-    uint32_t off, i, blocks;
     ext2_dirent_t *dent;
-    uint8_t *buf;
-    size_t len = strlen(fn);
-    int err;
 
-    blocks = dir->i_blocks / (2 << fs->sb.s_log_block_size);
+    if(find_entry(fs, dir, fn, &dent))
+        return NULL;
 
-    for(i = 0; i < blocks; ++i) {
-        off = 0;
+    return dent;
+}
 
-        if(!(buf = ext2_inode_read_block(fs, dir, i, NULL, &err)))
-            return NULL;
+int ext2_dir_lookup(ext2_fs_t *fs, const struct ext2_inode *dir,
+                    const char *fn, uint32_t *inode_num) {
+    ext2_dirent_t *dent;
+    ext2_dcache_ent_t *ent;
+    uint32_t parent = 0, hash = 0;
+    int err;
 
-        while(off < fs->block_size) {
-            dent = (ext2_dirent_t *)(buf + off);
+    if(fs->dcache) {
+        parent = ext2_inode_num(dir);
 
-            /* Make sure we don't trip and fall on a malformed entry. */
-            if(!dent->rec_len)
-                return NULL;
+        if((hash = dcache_hash(fn, parent)) &&
+           (ent = dcache_find(fs, fn, parent, hash))) {
+            TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+            TAILQ_INSERT_TAIL(&fs->dcache_lru, ent, qentry);
 
-            if(dent->inode) {
-                /* Check if this what we're looking for. */
-                if(dent->name_len == len && !memcmp(dent->name, fn, len))
-                    return dent;
-            }
+            if(!ent->inode)
+                return -ENOENT;
 
-            off += dent->rec_len;
+            *inode_num = ent->inode;
+            return 0;
         }
     }
 
-    /* Didn't find it, oh well. */
-    return NULL;
+    err = find_entry(fs, dir, fn, &dent);
+
+    if(hash && (!err || err == ENOENT))
+        dcache_insert(fs, fn, parent, hash, err ? 0 : dent->inode);
+
+    if(err)
+        return -err;
+
+    *inode_num = dent->inode;
+    return 0;
 }
 
 int ext2_dir_rm_entry(ext2_fs_t *fs, struct ext2_inode *dir, const char *fn,
@@ -105,6 +627,8 @@ int ext2_dir_rm_entry(ext2_fs_t *fs, struct ext2_inode *dir, const char *fn,
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
         return -EROFS;
 
+    dcache_forget(fs, dir, fn);
+
     blocks = dir->i_blocks / (2 << fs->sb.s_log_block_size);
 
     for(i = 0; i < blocks; ++i) {
@@ -126,8 +650,10 @@ int ext2_dir_rm_entry(ext2_fs_t *fs, struct ext2_inode *dir, const char *fn,
             if(dent->inode) {
                 /* Check if this what we're looking for. */
                 if(dent->name_len == len && !memcmp(dent->name, fn, len)) {
-                    /* Return the inode number to the calling function. */
+                    /* Return the inode number to the calling function. If it
+                       was a directory, anything cached about it is stale. */
                     *inode = dent->inode;
+                    dcache_forget_dir(fs, dent->inode);
 
                     if(prev) {
                         /* Remove it from the chain and clear the entry. */
@@ -185,6 +711,8 @@ int ext2_dir_add_entry(ext2_fs_t *fs, struct ext2_inode *dir, const char *fn,
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
         return -EROFS;
 
+    dcache_forget(fs, dir, fn);
+
     blocks = dir->i_blocks / (2 << fs->sb.s_log_block_size);
 
     for(i = 0; i < blocks; ++i) {
@@ -326,6 +854,8 @@ int ext2_dir_redir_entry(ext2_fs_t *fs, struct ext2_inode *dir, const char *fn,
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
         return -EROFS;
 
+    dcache_forget(fs, dir, fn);
+
     blocks = dir->i_blocks / (2 << fs->sb.s_log_block_size);
 
     for(i = 0; i < blocks; ++i) {
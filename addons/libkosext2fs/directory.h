@@ -40,6 +40,12 @@ int ext2_dir_is_empty(ext2_fs_t *fs, const struct ext2_inode *dir);
 ext2_dirent_t *ext2_dir_entry(ext2_fs_t *fs, const struct ext2_inode *dir,
                               const char *fn);
 
+/* Look up the inode number of an entry in a directory. This goes through the
+   lookup cache, so it is the function to use to walk down paths. Returns 0 on
+   success or -ENOENT if there is no such entry. */
+int ext2_dir_lookup(ext2_fs_t *fs, const struct ext2_inode *dir,
+                    const char *fn, uint32_t *inode_num);
+
 /* Delete an entry from a directory. Note that this does nothing about cleaning
    up the inode, but it does tell you which inode you're going to need to clean
    up (or lower the reference count on). */
@@ -21,70 +21,66 @@
 
 static int initted = 0;
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(ext2_fs_t *fs, ext2_cache_t **cache, int block) {
-    int i;
-    ext2_cache_t *tmp;
-
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
+/* Move a block to the most recently used end of the LRU queue. */
+static inline void make_mru(ext2_fs_t *fs, ext2_cache_t *blk) {
+    TAILQ_REMOVE(&fs->bcache_lru, blk, qentry);
+    TAILQ_INSERT_TAIL(&fs->bcache_lru, blk, qentry);
+}
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+static ext2_cache_t *ext2_block_find(ext2_fs_t *fs, uint32_t bl) {
+    ext2_cache_t *blk;
 
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
+    LIST_FOREACH(blk, &fs->bcache_hash[bl & fs->bcache_hash_mask], hentry) {
+        if(blk->block == bl)
+            return blk;
     }
 
-    cache[fs->cache_size - 1] = tmp;
+    return NULL;
 }
 
 /* XXXX: This needs locking! */
 uint8_t *ext2_block_read(ext2_fs_t *fs, uint32_t bl, int *err) {
-    int i;
-    uint8_t *rv;
-    ext2_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == bl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
+    ext2_cache_t *blk;
+
+    /* See if we already have the block in question. */
+    if((blk = ext2_block_find(fs, bl))) {
+        make_mru(fs, blk);
+        return blk->data;
     }
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
+    /* Nope. Boot out the least recently used (or an invalid) block. */
+    blk = TAILQ_FIRST(&fs->bcache_lru);
 
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & EXT2_CACHE_FLAG_DIRTY) {
-            if(ext2_block_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
+    /* Make sure that if the block is dirty, we write it back out. */
+    if(blk->flags & EXT2_CACHE_FLAG_DIRTY) {
+        if(ext2_block_write_nc(fs, blk->block, blk->data)) {
+            /* XXXX: Uh oh... */
+            *err = EIO;
+            return NULL;
         }
+
+        TAILQ_REMOVE(&fs->bcache_dirty, blk, dentry);
     }
 
+    if(blk->flags & EXT2_CACHE_FLAG_VALID)
+        LIST_REMOVE(blk, hentry);
+
+    /* Mark it as invalid until we have the new data in it. It stays at the
+       head of the LRU queue if the read fails, so it'll be reused first. */
+    blk->flags = 0;
+
     /* Try to read the block in question. */
-    if(ext2_block_read_nc(fs, bl, cache[i]->data)) {
+    if(ext2_block_read_nc(fs, bl, blk->data)) {
         *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
         return NULL;
     }
 
-    cache[i]->block = bl;
-    cache[i]->flags = EXT2_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
+    blk->block = bl;
+    blk->flags = EXT2_CACHE_FLAG_VALID;
+    LIST_INSERT_HEAD(&fs->bcache_hash[bl & fs->bcache_hash_mask], blk, hentry);
+    make_mru(fs, blk);
 
-out:
-    return rv;
+    return blk->data;
 }
 
 int ext2_block_read_nc(ext2_fs_t *fs, uint32_t block_num, uint8_t *rv) {
@@ -105,6 +101,46 @@ int ext2_block_read_nc(ext2_fs_t *fs, uint32_t block_num, uint8_t *rv) {
     return 0;
 }
 
+int ext2_block_read_run(ext2_fs_t *fs, uint32_t block_num, uint32_t count,
+                        uint8_t *rv) {
+    int fs_per_block = fs->sb.s_log_block_size - fs->dev->l_block_size + 10;
+    ext2_cache_t *blk;
+    uint8_t *data;
+    uint32_t i;
+    int err;
+
+    if(fs->sb.s_blocks_count <= block_num ||
+       fs->sb.s_blocks_count - block_num < count)
+        return -EINVAL;
+
+    /* If the device's blocks are bigger than ours, there's no single request
+       that covers the run exactly, so just go a block at a time through the
+       cache like any other read. */
+    if(fs_per_block < 0) {
+        for(i = 0; i < count; ++i) {
+            if(!(data = ext2_block_read(fs, block_num + i, &err)))
+                return -err;
+
+            memcpy(rv + i * fs->block_size, data, fs->block_size);
+        }
+
+        return 0;
+    }
+
+    if(fs->dev->read_blocks(fs->dev, block_num << fs_per_block,
+                            count << fs_per_block, rv))
+        return -EIO;
+
+    /* The cache may hold newer copies of some of these that haven't been
+       written back yet. */
+    for(i = 0; i < count; ++i) {
+        if((blk = ext2_block_find(fs, block_num + i)))
+            memcpy(rv + i * fs->block_size, blk->data, fs->block_size);
+    }
+
+    return 0;
+}
+
 int ext2_block_write_nc(ext2_fs_t *fs, uint32_t block_num, const uint8_t *blk) {
     int fs_per_block = fs->sb.s_log_block_size - fs->dev->l_block_size + 10;
 
@@ -124,132 +160,185 @@ int ext2_block_write_nc(ext2_fs_t *fs, uint32_t block_num, const uint8_t *blk) {
 }
 
 int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num) {
-    int i;
-    ext2_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == block_num && cache[i]->flags) {
-            cache[i]->flags |= EXT2_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
+    ext2_cache_t *blk;
+
+    if(!(blk = ext2_block_find(fs, block_num)))
+        return -EINVAL;
+
+    if(!(blk->flags & EXT2_CACHE_FLAG_DIRTY)) {
+        blk->flags |= EXT2_CACHE_FLAG_DIRTY;
+        TAILQ_INSERT_TAIL(&fs->bcache_dirty, blk, dentry);
     }
 
-    return -EINVAL;
+    make_mru(fs, blk);
+    return 0;
 }
 
 int ext2_block_cache_wb(ext2_fs_t *fs) {
-    int i, err;
-    ext2_cache_t **cache = fs->bcache;
+    int err;
+    ext2_cache_t *blk;
 
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & EXT2_CACHE_FLAG_DIRTY) {
-            if((err = ext2_block_write_nc(fs, cache[i]->block, cache[i]->data)))
-                return err;
+    /* Only the dirty blocks need to be looked at, in the order they were first
+       dirtied. */
+    while((blk = TAILQ_FIRST(&fs->bcache_dirty))) {
+        if((err = ext2_block_write_nc(fs, blk->block, blk->data)))
+            return err;
 
-            cache[i]->flags &= ~EXT2_CACHE_FLAG_DIRTY;
-        }
+        blk->flags &= ~EXT2_CACHE_FLAG_DIRTY;
+        TAILQ_REMOVE(&fs->bcache_dirty, blk, dentry);
     }
-    
+
     return 0;
 }
 
-uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err) {
-    uint8_t *buf, *blk;
-    uint32_t index;
+/* Allocate up to count free blocks in a row from block group bg, looking from
+   index start within the group onwards (and then from the start of the group).
+   Returns the number of blocks allocated, 0 if the group has no free blocks, or
+   a negative error code. */
+static int alloc_run_bg(ext2_fs_t *fs, uint32_t bg, uint32_t start,
+                        uint32_t count, uint32_t *bn, int *err) {
+    uint32_t *bmap;
+    uint32_t index, i, end = fs->sb.s_blocks_per_group - 1;
+    uint32_t first = bg * fs->sb.s_blocks_per_group + fs->sb.s_first_data_block;
+
+    if(!fs->bg[bg].bg_free_blocks_count)
+        return 0;
+
+    if(!(bmap = (uint32_t *)ext2_block_read(fs, fs->bg[bg].bg_block_bitmap,
+                                            err)))
+        return -*err;
+
+    index = ext2_bit_find_zero(bmap, start, end);
+
+    if(index > end && start)
+        index = ext2_bit_find_zero(bmap, 0, end);
+
+    if(index > end || first + index >= fs->sb.s_blocks_count) {
+        /* We shouldn't get here... We should probably log an error and tell
+           the user to fsck though. */
+        dbglog(DBG_WARNING, "ext2_block_alloc: Block group %" PRIu32 " "
+               "indicates that it has free blocks, but doesn't appear to. "
+               "Please run fsck on this volume!\n", bg);
+        return 0;
+    }
+
+    if(count > fs->bg[bg].bg_free_blocks_count)
+        count = fs->bg[bg].bg_free_blocks_count;
+
+    /* Take as many of the blocks after that one as are free, then mark them all
+       as used in one go. */
+    i = 1;
+
+    while(i < count && index + i <= end &&
+          first + index + i < fs->sb.s_blocks_count &&
+          !ext2_bit_is_set(bmap, index + i))
+        ++i;
+
+    for(count = 0; count < i; ++count) {
+        ext2_bit_set(bmap, index + count);
+    }
+
+    ext2_block_mark_dirty(fs, fs->bg[bg].bg_block_bitmap);
+    fs->bg[bg].bg_free_blocks_count -= i;
+    fs->sb.s_free_blocks_count -= i;
+    fs->flags |= EXT2_FS_FLAG_SB_DIRTY;
+
+    *bn = first + index;
+    return (int)i;
+}
+
+int ext2_block_alloc_run(ext2_fs_t *fs, uint32_t goal, uint32_t count,
+                         uint32_t *bn, int *err) {
+    uint32_t bg, start, i;
+    int rv;
 
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW)) {
         *err = EROFS;
-        return NULL;
+        return -EROFS;
     }
 
     /* See if we have any free blocks at all... */
     if(!fs->sb.s_free_blocks_count) {
         *err = ENOSPC;
-        return NULL;
+        return -ENOSPC;
     }
 
-    /* See if we have any free blocks in the block group requested. */
-    if(fs->bg[bg].bg_free_blocks_count) {
-        if(!(buf = ext2_block_read(fs, fs->bg[bg].bg_block_bitmap, err)))
-            return NULL;
+    if(!count)
+        count = 1;
 
-        index = ext2_bit_find_zero((uint32_t *)buf, 0,
-                                   fs->sb.s_blocks_per_group - 1);
-        if(index < fs->sb.s_blocks_per_group) {
-            *bn = index + bg * fs->sb.s_blocks_per_group +
-                fs->sb.s_first_data_block;
+    if(goal < fs->sb.s_first_data_block || goal >= fs->sb.s_blocks_count)
+        goal = fs->sb.s_first_data_block;
 
-            if(!(blk = ext2_block_read(fs, *bn, err)))
-                return NULL;
+    bg = (goal - fs->sb.s_first_data_block) / fs->sb.s_blocks_per_group;
+    start = (goal - fs->sb.s_first_data_block) % fs->sb.s_blocks_per_group;
 
-            ext2_bit_set((uint32_t *)buf, index);
-            ext2_block_mark_dirty(fs, fs->bg[bg].bg_block_bitmap);
-            --fs->bg[bg].bg_free_blocks_count;
-            --fs->sb.s_free_blocks_count;
-            fs->flags |= EXT2_FS_FLAG_SB_DIRTY;
+    /* Look in the goal's block group first, then in each of the ones after it
+       in turn. */
+    for(i = 0; i < fs->bg_count; ++i) {
+        if((rv = alloc_run_bg(fs, bg, start, count, bn, err)))
+            return rv;
 
-            memset(blk, 0, fs->block_size);
-            ext2_block_mark_dirty(fs, *bn);
-            return blk;
-        }
+        if(++bg == fs->bg_count)
+            bg = 0;
 
-        /* We shouldn't get here... But, just in case, fall through. We should
-           probably log an error and tell the user to fsck though. */
-        dbglog(DBG_WARNING, "ext2_block_alloc: Block group %" PRIu32 " "
-               "indicates that it has free blocks, but doesn't appear to. "
-               "Please run fsck on this volume!\n", bg);
+        start = 0;
     }
 
-    /* Couldn't find a free block in the requested block group... Loop through
-       all the block groups looking for a free block. */
-    for(bg = 0; bg < fs->bg_count; ++bg) {
-        if(fs->bg[bg].bg_free_blocks_count) {
-            if(!(buf = ext2_block_read(fs, fs->bg[bg].bg_block_bitmap, err)))
-                return NULL;
+    /* Uh oh... We went through everything and didn't find any. That means the
+       data in the superblock is wrong. */
+    dbglog(DBG_WARNING, "ext2_block_alloc: Filesystem indicates that it has "
+           "free blocks, but doesn't appear to. Please run fsck on this "
+           "volume!\n");
+    *err = ENOSPC;
+    return -ENOSPC;
+}
 
-            index = ext2_bit_find_zero((uint32_t *)buf, 0,
-                                       fs->sb.s_blocks_per_group - 1);
-            if(index < fs->sb.s_blocks_per_group) {
-                *bn = index + bg * fs->sb.s_blocks_per_group +
-                    fs->sb.s_first_data_block;
+int ext2_block_free_run(ext2_fs_t *fs, uint32_t bn, uint32_t count) {
+    uint32_t *bmap;
+    uint32_t bg, index;
+    int err;
 
-                if(!(blk = ext2_block_read(fs, *bn, err)))
-                    return NULL;
+    for(; count; --count, ++bn) {
+        bg = (bn - fs->sb.s_first_data_block) / fs->sb.s_blocks_per_group;
+        index = (bn - fs->sb.s_first_data_block) % fs->sb.s_blocks_per_group;
 
-                ext2_bit_set((uint32_t *)buf, index);
-                ext2_block_mark_dirty(fs, fs->bg[bg].bg_block_bitmap);
-                --fs->bg[bg].bg_free_blocks_count;
-                --fs->sb.s_free_blocks_count;
-                fs->flags |= EXT2_FS_FLAG_SB_DIRTY;
+        if(!(bmap = (uint32_t *)ext2_block_read(fs, fs->bg[bg].bg_block_bitmap,
+                                                &err)))
+            return -err;
 
-                memset(blk, 0, fs->block_size);
-                ext2_block_mark_dirty(fs, *bn);
-                return blk;
-            }
+        ext2_bit_clear(bmap, index);
+        ext2_block_mark_dirty(fs, fs->bg[bg].bg_block_bitmap);
+        ++fs->bg[bg].bg_free_blocks_count;
+        ++fs->sb.s_free_blocks_count;
+        fs->flags |= EXT2_FS_FLAG_SB_DIRTY;
+    }
 
-            /* We shouldn't get here... But, just in case, fall through. We
-               should probably log an error and tell the user to fsck though. */
-            dbglog(DBG_WARNING, "ext2_block_alloc: Block group %" PRIu32 " "
-                   "indicates that it has free blocks, but doesn't appear to. "
-                   "Please run fsck on this volume!\n", bg);
-        }
+    return 0;
+}
+
+uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err) {
+    uint8_t *blk;
+
+    if(bg >= fs->bg_count)
+        bg = 0;
+
+    if(ext2_block_alloc_run(fs, bg * fs->sb.s_blocks_per_group +
+                            fs->sb.s_first_data_block, 1, bn, err) < 0)
+        return NULL;
+
+    if(!(blk = ext2_block_read(fs, *bn, err))) {
+        ext2_block_free_run(fs, *bn, 1);
+        return NULL;
     }
 
-    /* Uh oh... We went through everything and didn't find any. That means the
-       data in the superblock is wrong. */
-    dbglog(DBG_WARNING, "ext2_block_alloc: Filesystem indicates that it has "
-           "free blocks, but doesn't appear to. Please run fsck on this "
-           "volume!\n");
-    *err = ENOSPC;
-    return NULL;
+    memset(blk, 0, fs->block_size);
+    ext2_block_mark_dirty(fs, *bn);
+    return blk;
 }
 
 uint32_t ext2_block_size(const ext2_fs_t *fs) {
@@ -273,7 +362,7 @@ ext2_fs_t *ext2_fs_init(kos_blockdev_t *bd, uint32_t flags) {
 
 ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
     ext2_fs_t *rv;
-    uint32_t bc;
+    uint32_t bc, hash_sz;
     int j;
     int block_size;
 
@@ -408,42 +497,62 @@ ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
     }
 #endif /* EXT2FS_DEBUG */
 
-    /* Make space for the block cache. */
-    if(!(rv->bcache = (ext2_cache_t **)malloc(sizeof(ext2_cache_t *) *
-                                              cache_sz))) {
+    /* Make space for the block cache and its hash table, which has at least as
+       many buckets as there are blocks in the cache. */
+    if(cache_sz < 1)
+        cache_sz = 1;
+
+    hash_sz = 1;
+
+    while(hash_sz < (uint32_t)cache_sz)
+        hash_sz <<= 1;
+
+    if(!(rv->bcache = (ext2_cache_t *)malloc(sizeof(ext2_cache_t) *
+                                             cache_sz))) {
         free(rv->bg);
         free(rv);
         bd->shutdown(bd);
         return NULL;
     }
 
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j] = (ext2_cache_t *)malloc(sizeof(ext2_cache_t))))
-            goto out_cache;
+    if(!(rv->bcache_hash = (struct ext2_cache_list *)
+         malloc(sizeof(struct ext2_cache_list) * hash_sz))) {
+        j = 0;
+        goto out_bcache;
     }
 
+    rv->bcache_hash_mask = hash_sz - 1;
+
+    for(j = 0; j < (int)hash_sz; ++j) {
+        LIST_INIT(&rv->bcache_hash[j]);
+    }
+
+    TAILQ_INIT(&rv->bcache_lru);
+    TAILQ_INIT(&rv->bcache_dirty);
+
     for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j]->data = (uint8_t *)malloc(block_size)))
+        if(!(rv->bcache[j].data = (uint8_t *)malloc(block_size)))
             goto out_bcache;
 
-        rv->bcache[j]->flags = 0;
+        rv->bcache[j].flags = 0;
+        rv->bcache[j].block = 0;
+        TAILQ_INSERT_TAIL(&rv->bcache_lru, rv->bcache + j, qentry);
     }
 
     rv->cache_size = cache_sz;
 
+    /* The directory lookup cache is optional, so don't fail if it can't be
+       set up. */
+    ext2_dcache_init(rv, EXT2_DCACHE_ENTRIES);
+
     return rv;
 
 out_bcache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]->data);
-    }
-
-    j = cache_sz - 1;
-out_cache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]);
+    while(--j >= 0) {
+        free(rv->bcache[j].data);
     }
 
+    free(rv->bcache_hash);
     free(rv->bcache);
     free(rv->bg);
     free(rv);
@@ -505,11 +614,12 @@ void ext2_fs_shutdown(ext2_fs_t *fs) {
     ext2_fs_sync(fs);
 
     for(i = 0; i < fs->cache_size; ++i) {
-        free(fs->bcache[i]->data);
-        free(fs->bcache[i]);
+        free(fs->bcache[i].data);
     }
 
+    free(fs->bcache_hash);
     free(fs->bcache);
+    ext2_dcache_shutdown(fs);
     fs->dev->shutdown(fs->dev);
     free(fs->bg);
     free(fs);
@@ -50,6 +50,23 @@ __BEGIN_DECLS
 */
 #define EXT2_CACHE_BLOCKS       32
 
+/* Number of entries in the directory lookup cache of each mounted filesystem.
+   Each entry remembers which inode one name in one directory refers to (or that
+   the name isn't there), so that opening the same files over and over again
+   doesn't mean searching every directory along the way each time. Each entry
+   takes up a bit under 80 bytes. Set this to 0 to disable the cache entirely.
+*/
+#define EXT2_DCACHE_ENTRIES     64
+
+/* Number of blocks to set aside for a regular file each time it has to grow.
+   The first of them is used straight away and the rest are kept in a window
+   that the file takes its next blocks from, so that files written in small
+   pieces still end up contiguous on the disk, and the block bitmap only has to
+   be updated once per window. Any blocks left in the window are given back when
+   the file is closed. Set this to 1 to allocate blocks one at a time.
+*/
+#define EXT2_PREALLOC_BLOCKS    8
+
 /* End tunable filesystem parameters. */
 
 /* Convenience stuff, for in case you want to use this outside of KOS. */
@@ -100,6 +117,14 @@ void ext2_fs_shutdown(ext2_fs_t *fs);
 int ext2_block_read_nc(ext2_fs_t *fs, uint32_t block_num, uint8_t *rv);
 uint8_t *ext2_block_read(ext2_fs_t *fs, uint32_t block_num, int *err);
 
+/* Read count consecutive blocks straight into rv with a single request to the
+   block device, without putting them in the cache. Any of them that are
+   already cached are copied from there instead, so that dirty data wins. If
+   the device's blocks are bigger than the filesystem's, the blocks are read
+   one at a time through the cache instead. */
+int ext2_block_read_run(ext2_fs_t *fs, uint32_t block_num, uint32_t count,
+                        uint8_t *rv);
+
 int ext2_block_write_nc(ext2_fs_t *fs, uint32_t block_num, const uint8_t *blk);
 
 int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num);
@@ -110,6 +135,16 @@ int ext2_block_cache_wb(ext2_fs_t *fs);
 
 uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err);
 
+/* Allocate up to count contiguous blocks, as close after goal as possible, with
+   a single update to the block bitmap. The first block is returned in bn. The
+   blocks are neither read nor cleared. Returns the number of blocks allocated
+   (at least 1), or a negative error code (also set in err). */
+int ext2_block_alloc_run(ext2_fs_t *fs, uint32_t goal, uint32_t count,
+                         uint32_t *bn, int *err);
+
+/* Mark count blocks, starting at bn, as free. */
+int ext2_block_free_run(ext2_fs_t *fs, uint32_t bn, uint32_t count);
+
 __END_DECLS
 
 #endif /* !__EXT2_EXT2FS_H */
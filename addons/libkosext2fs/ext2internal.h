@@ -4,6 +4,8 @@
    Copyright (C) 2012, 2013 Lawrence Sebald
 */
 
+#include <sys/queue.h>
+
 #include "block.h"
 #include "superblock.h"
 
@@ -23,8 +25,39 @@ typedef struct ext2_cache {
     uint32_t flags;
     uint32_t block;
     uint8_t *data;
+
+    /* Hash table entry -- only valid while EXT2_CACHE_FLAG_VALID is set. */
+    LIST_ENTRY(ext2_cache) hentry;
+
+    /* LRU queue entry. Every cache block is always on the queue, with the least
+       recently used (or invalid) blocks at the head. */
+    TAILQ_ENTRY(ext2_cache) qentry;
+
+    /* Dirty list entry -- only valid while EXT2_CACHE_FLAG_DIRTY is set. */
+    TAILQ_ENTRY(ext2_cache) dentry;
 } ext2_cache_t;
 
+LIST_HEAD(ext2_cache_list, ext2_cache);
+TAILQ_HEAD(ext2_cache_queue, ext2_cache);
+
+/* Longest name (in bytes, including the NUL terminator) that the directory
+   lookup cache will remember. */
+#define EXT2_DCACHE_NAME_LEN    48
+
+/* An entry in the directory lookup cache. */
+typedef struct ext2_dcache_ent {
+    uint32_t parent;                    /* Inode number of the directory */
+    uint32_t hash;
+    uint32_t inode;                     /* 0 if the name isn't there */
+    char name[EXT2_DCACHE_NAME_LEN];    /* Empty if unused */
+
+    LIST_ENTRY(ext2_dcache_ent) hentry;
+    TAILQ_ENTRY(ext2_dcache_ent) qentry;
+} ext2_dcache_ent_t;
+
+LIST_HEAD(ext2_dcache_list, ext2_dcache_ent);
+TAILQ_HEAD(ext2_dcache_queue, ext2_dcache_ent);
+
 struct ext2fs_struct {
     kos_blockdev_t *dev;
     ext2_superblock_t sb;
@@ -33,9 +66,21 @@ struct ext2fs_struct {
     uint32_t bg_count;
     ext2_bg_desc_t *bg;
 
-    ext2_cache_t **bcache;
+    ext2_cache_t *bcache;
     int cache_size;
 
+    struct ext2_cache_list *bcache_hash;
+    uint32_t bcache_hash_mask;
+    struct ext2_cache_queue bcache_lru;
+    struct ext2_cache_queue bcache_dirty;
+
+    /* Directory lookup cache. dcache is NULL if it is disabled. Every entry
+       is always on the LRU queue, with unused ones at the head. */
+    ext2_dcache_ent_t *dcache;
+    struct ext2_dcache_list *dcache_hash;
+    uint32_t dcache_hash_mask;
+    struct ext2_dcache_queue dcache_lru;
+
     uint32_t flags;
     uint32_t mnt_flags;
 };
@@ -44,6 +89,10 @@ struct ext2fs_struct {
    device. */
 #define EXT2_FS_FLAG_SB_DIRTY   1
 
+/* Set up and tear down the directory lookup cache (in directory.c). */
+int ext2_dcache_init(ext2_fs_t *fs, int count);
+void ext2_dcache_shutdown(ext2_fs_t *fs);
+
 #ifdef EXT2_NOT_IN_KOS
 #include <stdio.h>
 #define DBG_DEBUG 0
@@ -79,7 +79,7 @@ static int create_empty_file(fs_ext2_fs_t *fs, const char *fn,
     *nd++ = 0;
 
     /* Find the parent of the directory we want to create. */
-    if((irv = ext2_inode_by_path(fs->fs, cp, &inode, &inode_num, 1, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &inode, &inode_num, 1))) {
         free(cp);
         return -irv;
     }
@@ -151,7 +151,7 @@ static void *fs_ext2_open(vfs_handler_t *vfs, const char *fn, int mode) {
 
     /* Find the object in question */
     if((rv = ext2_inode_by_path(mnt->fs, fn, &fh[fd].inode,
-                                &fh[fd].inode_num, 1, NULL))) {
+                                &fh[fd].inode_num, 1))) {
         fh[fd].inode_num = 0;
 
         if(rv == -ENOENT) {
@@ -231,7 +231,8 @@ static int fs_ext2_close(void *h) {
 
     mutex_lock(&ext2_mutex);
 
-    if(fd < MAX_EXT2_FILES && fh[fd].mode) {
+    /* Check the inode number, not the mode, since O_RDONLY is zero. */
+    if(fd < MAX_EXT2_FILES && fh[fd].inode_num) {
         ext2_inode_put(fh[fd].inode);
         fh[fd].inode_num = 0;
         fh[fd].mode = 0;
@@ -241,124 +242,146 @@ static int fs_ext2_close(void *h) {
     return 0;
 }
 
-static ssize_t fs_ext2_read(void *h, void *buf, size_t cnt) {
-    file_t fd = ((file_t)h) - 1;
-    ext2_fs_t *fs;
-    uint32_t bs, lbs, bo;
-    uint8_t *block;
-    uint8_t *bbuf = (uint8_t *)buf;
-    ssize_t rv;
-    uint64_t sz;
+/* Check that fd is an open file that can be read from (or written to, if
+   write is non-zero). Call with ext2_mutex held. */
+static int int_check_fd(file_t fd, int write) {
     int mode;
 
-    mutex_lock(&ext2_mutex);
-
     /* Check that the fd is valid */
     if(fd >= MAX_EXT2_FILES || !fh[fd].inode_num) {
-        mutex_unlock(&ext2_mutex);
         errno = EBADF;
         return -1;
     }
 
-    /* Make sure the fd is open for reading */
     mode = fh[fd].mode & O_MODE_MASK;
-    if(mode != O_RDONLY && mode != O_RDWR) {
-        mutex_unlock(&ext2_mutex);
-        errno = EBADF;
-        return -1;
+
+    if(write) {
+        /* Make sure the fd is open for writing */
+        if(mode != O_WRONLY && mode != O_RDWR) {
+            errno = EBADF;
+            return -1;
+        }
     }
+    else {
+        /* Make sure the fd is open for reading */
+        if(mode != O_RDONLY && mode != O_RDWR) {
+            errno = EBADF;
+            return -1;
+        }
 
-    /* Make sure we're not trying to read a directory with read */
-    if(fh[fd].mode & O_DIR) {
-        mutex_unlock(&ext2_mutex);
-        errno = EISDIR;
-        return -1;
+        /* Make sure we're not trying to read a directory with read */
+        if(fh[fd].mode & O_DIR) {
+            errno = EISDIR;
+            return -1;
+        }
     }
 
+    return 0;
+}
+
+/* Read from an open file at *ptr, advancing *ptr past what was read. Call with
+   ext2_mutex held, after checking the fd with int_check_fd(). */
+static ssize_t int_read(file_t fd, void *buf, size_t cnt, uint64_t *ptr) {
+    ext2_fs_t *fs;
+    uint32_t bs, lbs, bo, pblock;
+    uint8_t *block;
+    uint8_t *bbuf = (uint8_t *)buf;
+    ssize_t rv;
+    uint64_t sz;
+    int run, irv;
+
     /* Do we have enough left? */
     sz = ext2_inode_size(fh[fd].inode);
-    if((fh[fd].ptr + cnt) > sz)
-        cnt = sz - fh[fd].ptr;
+    if(*ptr >= sz)
+        return 0;
+
+    if(cnt > sz - *ptr)
+        cnt = sz - *ptr;
 
     fs = fh[fd].fs->fs;
     bs = ext2_block_size(fs);
     lbs = ext2_log_block_size(fs);
     rv = (ssize_t)cnt;
-    bo = fh[fd].ptr & ((1 << lbs) - 1);
+    bo = *ptr & ((1 << lbs) - 1);
 
     /* Handle the first block specially if we are offset within it. */
     if(bo) {
-        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
+        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, *ptr >> lbs,
                                            NULL, &errno))) {
-            mutex_unlock(&ext2_mutex);
             return -1;
         }
 
         if(cnt > bs - bo) {
             memcpy(bbuf, block + bo, bs - bo);
-            fh[fd].ptr += bs - bo;
+            *ptr += bs - bo;
             cnt -= bs - bo;
             bbuf += bs - bo;
         }
         else {
             memcpy(bbuf, block + bo, cnt);
-            fh[fd].ptr += cnt;
+            *ptr += cnt;
             cnt = 0;
         }
     }
 
     /* While we still have more to read, do it. */
     while(cnt) {
-        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
+        /* If there are at least a couple of whole blocks left, see if they're
+           contiguous on the disk. If so, read them straight into the caller's
+           buffer in one go rather than one block at a time through the
+           cache. */
+        if(cnt >= bs << 1) {
+            if((run = ext2_inode_map_run(fs, fh[fd].inode, *ptr >> lbs,
+                                         cnt >> lbs, &pblock)) < 0) {
+                errno = -run;
+                return -1;
+            }
+
+            if(run > 1) {
+                if((irv = ext2_block_read_run(fs, pblock, run, bbuf))) {
+                    errno = -irv;
+                    return -1;
+                }
+
+                *ptr += run << lbs;
+                cnt -= run << lbs;
+                bbuf += run << lbs;
+                continue;
+            }
+        }
+
+        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, *ptr >> lbs,
                                            NULL, &errno))) {
-            mutex_unlock(&ext2_mutex);
             return -1;
         }
 
         if(cnt > bs) {
             memcpy(bbuf, block, bs);
-            fh[fd].ptr += bs;
+            *ptr += bs;
             cnt -= bs;
             bbuf += bs;
         }
         else {
             memcpy(bbuf, block, cnt);
-            fh[fd].ptr += cnt;
+            *ptr += cnt;
             cnt = 0;
         }
     }
 
-    /* We're done, clean up and return. */
-    mutex_unlock(&ext2_mutex);
     return rv;
 }
 
-static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
-    file_t fd = ((file_t)h) - 1;
+/* Write to an open file at *ptr, advancing *ptr past what was written. Call
+   with ext2_mutex held, after checking the fd with int_check_fd(). */
+static ssize_t int_write(file_t fd, const void *buf, size_t cnt,
+                         uint64_t *ptr) {
     ext2_fs_t *fs;
     uint32_t bs, lbs, bo, bn;
     uint8_t *block;
     uint8_t *bbuf = (uint8_t *)buf;
     ssize_t rv;
     uint64_t sz;
-    int err, mode;
-
-    mutex_lock(&ext2_mutex);
-
-    /* Check that the fd is valid */
-    if(fd >= MAX_EXT2_FILES || !fh[fd].inode_num) {
-        mutex_unlock(&ext2_mutex);
-        errno = EBADF;
-        return -1;
-    }
-
-    /* Make sure the fd is open for writing */
-    mode = fh[fd].mode & O_MODE_MASK;
-    if(mode != O_WRONLY && mode != O_RDWR) {
-        mutex_unlock(&ext2_mutex);
-        errno = EBADF;
-        return -1;
-    }
+    int err;
 
     fs = fh[fd].fs->fs;
     bs = ext2_block_size(fs);
@@ -366,24 +389,18 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
     rv = (ssize_t)cnt;
     sz = ext2_inode_size(fh[fd].inode);
 
-    /* Reset the file pointer to the end of the file if we've got the append
-       flag set. */
-    if(fh[fd].mode & O_APPEND)
-        fh[fd].ptr = sz;
-
     /* If we have already moved beyond the end of the file with a seek
        operation, allocate any blank blocks we need to to satisfy that. */
-    if(fh[fd].ptr > sz) {
+    if(*ptr > sz) {
         /* Are we staying within the same block? */
-        if(((sz - 1) >> lbs) == ((fh[fd].ptr - 1) >> lbs)) {
+        if(((sz - 1) >> lbs) == ((*ptr - 1) >> lbs)) {
             if(!(block = ext2_inode_read_block(fs, fh[fd].inode,
-                                               (fh[fd].ptr - 1) >> lbs, &bn,
+                                               (*ptr - 1) >> lbs, &bn,
                                                &errno))) {
-                mutex_unlock(&ext2_mutex);
                 return -1;
             }
 
-            memset(block + (sz & (bs - 1)), 0, fh[fd].ptr - sz);
+            memset(block + (sz & (bs - 1)), 0, *ptr - sz);
             ext2_block_mark_dirty(fs, bn);
         }
         /* Nope, we need to allocate a new one... */
@@ -393,7 +410,6 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
                 if(!(block = ext2_inode_read_block(fs, fh[fd].inode,
                                                    (sz - 1) >> lbs,
                                                    &bn, &errno))) {
-                    mutex_unlock(&ext2_mutex);
                     return -1;
                 }
 
@@ -404,10 +420,9 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
             }
 
             /* The size should now be nicely at a block boundary... */
-            while(sz < fh[fd].ptr) {
+            while(sz < *ptr) {
                 if(!(block = ext2_inode_alloc_block(fs, fh[fd].inode,
                                                     sz >> lbs, &errno))) {
-                    mutex_unlock(&ext2_mutex);
                     return -1;
                 }
 
@@ -415,27 +430,26 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
             }
         }
 
-        ext2_inode_set_size(fh[fd].inode, fh[fd].ptr);
-        sz = fh[fd].ptr;
+        ext2_inode_set_size(fh[fd].inode, *ptr);
+        sz = *ptr;
     }
 
     /* Handle the first block specially if we are offset within it. */
-    if((bo = fh[fd].ptr & ((1 << lbs) - 1))) {
-        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
+    if((bo = *ptr & ((1 << lbs) - 1))) {
+        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, *ptr >> lbs,
                                            &bn, &errno))) {
-            mutex_unlock(&ext2_mutex);
             return -1;
         }
 
         if(cnt > bs - bo) {
             memcpy(block + bo, bbuf, bs - bo);
-            fh[fd].ptr += bs - bo;
+            *ptr += bs - bo;
             cnt -= bs - bo;
             bbuf += bs - bo;
         }
         else {
             memcpy(block + bo, bbuf, cnt);
-            fh[fd].ptr += cnt;
+            *ptr += cnt;
             cnt = 0;
         }
 
@@ -444,17 +458,15 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
 
     /* While we still have more to write, do it. */
     while(cnt) {
-        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
+        if(!(block = ext2_inode_read_block(fs, fh[fd].inode, *ptr >> lbs,
                                            &bn, &err))) {
             if(err != EINVAL) {
-                mutex_unlock(&ext2_mutex);
                 errno = err;
                 return -1;
             }
 
             if(!(block = ext2_inode_alloc_block(fs, fh[fd].inode,
-                                                fh[fd].ptr >> lbs, &errno))) {
-                mutex_unlock(&ext2_mutex);
+                                                *ptr >> lbs, &errno))) {
                 return -1;
             }
         }
@@ -464,24 +476,151 @@ static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
 
         if(cnt > bs) {
             memcpy(block, bbuf, bs);
-            fh[fd].ptr += bs;
+            *ptr += bs;
             cnt -= bs;
             bbuf += bs;
         }
         else {
             memcpy(block, bbuf, cnt);
-            fh[fd].ptr += cnt;
+            *ptr += cnt;
             cnt = 0;
         }
     }
 
     /* Update the file's size and modification time. */
-    if(fh[fd].ptr > sz)
-        ext2_inode_set_size(fh[fd].inode, fh[fd].ptr);
+    if(*ptr > sz)
+        ext2_inode_set_size(fh[fd].inode, *ptr);
 
     fh[fd].inode->i_mtime = time(NULL);
     ext2_inode_mark_dirty(fh[fd].inode);
 
+    return rv;
+}
+
+
+static ssize_t fs_ext2_read(void *h, void *buf, size_t cnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 0))
+        rv = int_read(fd, buf, cnt, &fh[fd].ptr);
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
+static ssize_t fs_ext2_write(void *h, const void *buf, size_t cnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 1)) {
+        /* Reset the file pointer to the end of the file if we've got the
+           append flag set. */
+        if(fh[fd].mode & O_APPEND)
+            fh[fd].ptr = ext2_inode_size(fh[fd].inode);
+
+        rv = int_write(fd, buf, cnt, &fh[fd].ptr);
+    }
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
+static ssize_t fs_ext2_pread(void *h, void *buf, size_t cnt, _off64_t offset) {
+    file_t fd = ((file_t)h) - 1;
+    uint64_t ptr = (uint64_t)offset;
+    ssize_t rv = -1;
+
+    if(offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 0))
+        rv = int_read(fd, buf, cnt, &ptr);
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
+static ssize_t fs_ext2_pwrite(void *h, const void *buf, size_t cnt,
+                              _off64_t offset) {
+    file_t fd = ((file_t)h) - 1;
+    uint64_t ptr = (uint64_t)offset;
+    ssize_t rv = -1;
+
+    if(offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 1))
+        rv = int_write(fd, buf, cnt, &ptr);
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
+static ssize_t fs_ext2_readv(void *h, const struct iovec *iov, int iovcnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1, n;
+    int i;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 0)) {
+        for(i = 0, rv = 0; i < iovcnt; ++i) {
+            if((n = int_read(fd, iov[i].iov_base, iov[i].iov_len,
+                             &fh[fd].ptr)) < 0) {
+                if(!rv)
+                    rv = -1;
+
+                break;
+            }
+
+            rv += n;
+
+            if((size_t)n < iov[i].iov_len)
+                break;
+        }
+    }
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
+static ssize_t fs_ext2_writev(void *h, const struct iovec *iov, int iovcnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1, n;
+    int i;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!int_check_fd(fd, 1)) {
+        if(fh[fd].mode & O_APPEND)
+            fh[fd].ptr = ext2_inode_size(fh[fd].inode);
+
+        for(i = 0, rv = 0; i < iovcnt; ++i) {
+            if((n = int_write(fd, iov[i].iov_base, iov[i].iov_len,
+                              &fh[fd].ptr)) < 0) {
+                if(!rv)
+                    rv = -1;
+
+                break;
+            }
+
+            rv += n;
+        }
+    }
+
     mutex_unlock(&ext2_mutex);
     return rv;
 }
@@ -657,8 +796,7 @@ static int int_rename(fs_ext2_fs_t *fs, const char *fn1, const char *fn2,
     *ent++ = 0;
 
     /* Look up the parent of the destination. */
-    if((irv = ext2_inode_by_path(fs->fs, cp, &dpinode, &dpinode_num, 1,
-                                 NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &dpinode, &dpinode_num, 1))) {
         free(cp);
         return irv;
     }
@@ -888,7 +1026,7 @@ static int fs_ext2_rename(vfs_handler_t *vfs, const char *fn1,
     mutex_lock(&ext2_mutex);
 
     /* Find the parent directory of the original object.*/
-    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -irv;
@@ -990,7 +1128,7 @@ static int fs_ext2_unlink(vfs_handler_t *vfs, const char *fn) {
     mutex_lock(&ext2_mutex);
 
     /* Find the parent directory of the object in question.*/
-    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -irv;
@@ -1124,7 +1262,7 @@ static int fs_ext2_mkdir(vfs_handler_t *vfs, const char *fn) {
     mutex_lock(&ext2_mutex);
 
     /* Find the parent of the directory we want to create. */
-    if((irv = ext2_inode_by_path(fs->fs, cp, &inode, &inode_num, 1, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &inode, &inode_num, 1))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -irv;
@@ -1235,7 +1373,7 @@ static int fs_ext2_rmdir(vfs_handler_t *vfs, const char *fn) {
     mutex_lock(&ext2_mutex);
 
     /* Find the parent directory of the object in question.*/
-    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, cp, &pinode, &inode_num, 1))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -irv;
@@ -1412,7 +1550,7 @@ static int fs_ext2_link(vfs_handler_t *vfs, const char *path1,
     mutex_lock(&ext2_mutex);
 
     /* Find the object in question */
-    if((rv = ext2_inode_by_path(fs->fs, path1, &inode, &inode_num, 2, NULL))) {
+    if((rv = ext2_inode_by_path(fs->fs, path1, &inode, &inode_num, 2))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -rv;
@@ -1429,7 +1567,7 @@ static int fs_ext2_link(vfs_handler_t *vfs, const char *path1,
     }
 
     /* Find the parent directory of the new link */
-    if((rv = ext2_inode_by_path(fs->fs, cp, &pinode, &pinode_num, 1, NULL))) {
+    if((rv = ext2_inode_by_path(fs->fs, cp, &pinode, &pinode_num, 1))) {
         ext2_inode_put(inode);
         mutex_unlock(&ext2_mutex);
         free(cp);
@@ -1542,7 +1680,7 @@ static int fs_ext2_symlink(vfs_handler_t *vfs, const char *path1,
     mutex_lock(&ext2_mutex);
 
     /* Find the parent directory of the new link */
-    if((rv = ext2_inode_by_path(fs->fs, cp, &pinode, &pinode_num, 1, NULL))) {
+    if((rv = ext2_inode_by_path(fs->fs, cp, &pinode, &pinode_num, 1))) {
         mutex_unlock(&ext2_mutex);
         free(cp);
         errno = -rv;
@@ -1659,7 +1797,7 @@ static ssize_t fs_ext2_readlink(vfs_handler_t *vfs, const char *path, char *buf,
     mutex_lock(&ext2_mutex);
 
     /* Find the object in question */
-    if((rv = ext2_inode_by_path(mnt->fs, path, &inode, &inode_num, 2, NULL))) {
+    if((rv = ext2_inode_by_path(mnt->fs, path, &inode, &inode_num, 2))) {
         errno = -rv;
         mutex_unlock(&ext2_mutex);
         return -1;
@@ -1703,7 +1841,7 @@ int fs_ext2_stat(vfs_handler_t *vfs, const char *path, struct stat *buf,
     mutex_lock(&ext2_mutex);
 
     /* Find the object in question */
-    if((irv = ext2_inode_by_path(fs->fs, path, &inode, &inode_num, rl, NULL))) {
+    if((irv = ext2_inode_by_path(fs->fs, path, &inode, &inode_num, rl))) {
         mutex_unlock(&ext2_mutex);
         errno = -irv;
         return -1;
@@ -1909,7 +2047,11 @@ static vfs_handler_t vh = {
     fs_ext2_total64,            /* total64 */
     fs_ext2_readlink,           /* readlink */
     fs_ext2_rewinddir,          /* rewinddir */
-    fs_ext2_fstat               /* fstat */
+    fs_ext2_fstat,              /* fstat */
+    fs_ext2_pread,              /* pread */
+    fs_ext2_pwrite,             /* pwrite */
+    fs_ext2_readv,              /* readv */
+    fs_ext2_writev              /* writev */
 };
 
 static int initted = 0;
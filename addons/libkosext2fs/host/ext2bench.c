@@ -0,0 +1,263 @@
+/* KallistiOS ##version##
+
+   ext2bench.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+/* Benchmarks for the libkosext2fs block cache, run on a host machine against
+   an image file, with the cache sized differently each time.
+
+   For each cache size, the filesystem is mounted with ext2_fs_init_ex() and
+   the following are timed through ext2_block_read(), each with the number of
+   block device operations it took:
+
+   - reading a set of blocks that fits exactly in the cache over and over, in
+     a shuffled order (so everything after the first pass is a hit),
+   - reading twice as many blocks as the cache holds round and round (so
+     every read misses and evicts the least recently used block),
+   - marking a few cached blocks dirty and writing them back with
+     ext2_block_cache_wb(), many times over.
+
+   The image can be made with something like "mke2fs -t ext2 -b 1024 img 64M",
+   and needs at least twice as many filesystem blocks as the biggest cache.
+   The dirty blocks are written back with the same data they were read with,
+   but the superblock is still updated when the filesystem is unmounted, so
+   don't use an image you care about.
+
+   Build it with "make -f Makefile.nonkos ext2bench". */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ext2fs.h"
+#include "fileblk.h"
+
+/* Number of reads done for each of the read benchmarks */
+#define HIT_READS       (1 << 20)
+#define MISS_READS      (1 << 16)
+
+/* Write back rounds, and the number of blocks dirtied in each of them */
+#define WB_ROUNDS       256
+#define WB_DIRTY        16
+
+static kos_blockdev_t dev;
+static ext2_fs_t *fs;
+
+static struct timespec t_start;
+static fileblk_stats_t st_start;
+
+static int mount(const char *fn, int cache_sz) {
+    if(fileblk_create(&dev, fn)) {
+        perror(fn);
+        return -1;
+    }
+
+    if(!(fs = ext2_fs_init_ex(&dev, EXT2FS_MNT_FLAG_RW, cache_sz))) {
+        fprintf(stderr, "Cannot mount %s\n", fn);
+        fileblk_destroy(&dev);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void unmount(void) {
+    ext2_fs_shutdown(fs);
+    fileblk_destroy(&dev);
+}
+
+static void bench_start(void) {
+    fileblk_stats(&dev, &st_start, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print how long each of the ops done since bench_start() took on average,
+   along with the device operations. */
+static void bench_end(const char *name, uint32_t ops) {
+    struct timespec t;
+    fileblk_stats_t st;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    fileblk_stats(&dev, &st, 1);
+
+    ns = (t.tv_sec - t_start.tv_sec) * 1e9 + (t.tv_nsec - t_start.tv_nsec);
+
+    printf("  %-14s %10.1f ns/op  reads %llu (%llu blocks) writes %llu "
+           "(%llu blocks)\n", name, ns / ops, (unsigned long long)st.reads,
+           (unsigned long long)st.read_blocks, (unsigned long long)st.writes,
+           (unsigned long long)st.write_blocks);
+}
+
+static int read_block(uint32_t bn) {
+    int err = 0;
+
+    if(!ext2_block_read(fs, bn, &err)) {
+        fprintf(stderr, "Cannot read block %lu: %s\n", (unsigned long)bn,
+                strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Fill order with first, ..., first + count - 1, in a shuffled order that's
+   the same from run to run. */
+static void shuffle(uint32_t *order, uint32_t first, uint32_t count) {
+    uint32_t i, j, tmp, seed = 1;
+
+    for(i = 0; i < count; ++i)
+        order[i] = first + i;
+
+    for(i = count - 1; i > 0; --i) {
+        seed = seed * 1103515245 + 12345;
+        j = (seed >> 8) % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+static int bench_hits(uint32_t first, uint32_t cache_sz, uint32_t *order) {
+    uint32_t i;
+
+    shuffle(order, first, cache_sz);
+
+    /* Get everything into the cache first. */
+    for(i = 0; i < cache_sz; ++i) {
+        if(read_block(order[i]))
+            return -1;
+    }
+
+    bench_start();
+
+    for(i = 0; i < HIT_READS; ++i) {
+        if(read_block(order[i % cache_sz]))
+            return -1;
+    }
+
+    bench_end("cached reads", HIT_READS);
+    return 0;
+}
+
+static int bench_misses(uint32_t first, uint32_t cache_sz) {
+    uint32_t i;
+
+    bench_start();
+
+    for(i = 0; i < MISS_READS; ++i) {
+        if(read_block(first + i % (cache_sz * 2)))
+            return -1;
+    }
+
+    bench_end("uncached reads", MISS_READS);
+    return 0;
+}
+
+static int bench_writeback(uint32_t first, uint32_t cache_sz, uint32_t *order) {
+    uint32_t i, j, n = cache_sz < WB_DIRTY ? cache_sz : WB_DIRTY;
+    int err;
+
+    shuffle(order, first, cache_sz);
+
+    for(i = 0; i < cache_sz; ++i) {
+        if(read_block(order[i]))
+            return -1;
+    }
+
+    bench_start();
+
+    for(i = 0; i < WB_ROUNDS; ++i) {
+        for(j = 0; j < n; ++j) {
+            if((err = ext2_block_mark_dirty(fs, order[(i * n + j) %
+                                                     cache_sz]))) {
+                fprintf(stderr, "Cannot mark block dirty: %s\n",
+                        strerror(-err));
+                return -1;
+            }
+        }
+
+        if((err = ext2_block_cache_wb(fs))) {
+            fprintf(stderr, "Cannot write back the cache: %s\n",
+                    strerror(err));
+            return -1;
+        }
+    }
+
+    bench_end("write back", WB_ROUNDS);
+    return 0;
+}
+
+static int run(const char *fn, uint32_t cache_sz) {
+    uint32_t first, blocks, *order;
+    int rv = -1;
+
+    if(mount(fn, (int)cache_sz))
+        return -1;
+
+    /* Stay clear of the superblock and block group descriptors at the start
+       of the filesystem, just in case. */
+    first = 64;
+    blocks = dev.count_blocks(&dev) >> (ext2_log_block_size(fs) - 9);
+
+    if(first + cache_sz * 2 > blocks) {
+        fprintf(stderr, "%s is too small for a %lu block cache\n", fn,
+                (unsigned long)cache_sz);
+        goto out;
+    }
+
+    if(!(order = (uint32_t *)malloc(cache_sz * sizeof(uint32_t)))) {
+        perror("malloc");
+        goto out;
+    }
+
+    printf("%lu cached blocks of %lu bytes:\n", (unsigned long)cache_sz,
+           (unsigned long)ext2_block_size(fs));
+
+    if(!bench_hits(first, cache_sz, order) &&
+       !bench_misses(first, cache_sz) &&
+       !bench_writeback(first, cache_sz, order))
+        rv = 0;
+
+    free(order);
+
+out:
+    unmount();
+    return rv;
+}
+
+int main(int argc, char *argv[]) {
+    static const uint32_t sizes[] = { 16, 64, 256, 1024, 4096 };
+    uint32_t sz;
+    int i;
+
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s image [cache_blocks ...]\n", argv[0]);
+        return 1;
+    }
+
+    if(argc == 2) {
+        for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i) {
+            if(run(argv[1], sizes[i]))
+                return 1;
+        }
+
+        return 0;
+    }
+
+    for(i = 2; i < argc; ++i) {
+        if(!(sz = (uint32_t)strtoul(argv[i], NULL, 0))) {
+            fprintf(stderr, "Bad cache size: %s\n", argv[i]);
+            return 1;
+        }
+
+        if(run(argv[1], sz))
+            return 1;
+    }
+
+    return 0;
+}
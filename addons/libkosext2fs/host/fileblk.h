@@ -0,0 +1,38 @@
+/* KallistiOS ##version##
+
+   fileblk.h
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+/* A kos_blockdev_t backed by an image file, for using libkosext2fs on a host
+   machine. Every call to read_blocks and write_blocks is counted, so that the
+   number of device operations done by the library can be reported. */
+
+#ifndef __EXT2_HOST_FILEBLK_H
+#define __EXT2_HOST_FILEBLK_H
+
+#include <stdint.h>
+
+#include "../ext2fs.h"
+
+typedef struct fileblk_stats {
+    uint64_t reads;             /* Calls to read_blocks */
+    uint64_t read_blocks;       /* Blocks read */
+    uint64_t writes;            /* Calls to write_blocks */
+    uint64_t write_blocks;      /* Blocks written */
+} fileblk_stats_t;
+
+/* Set up rv to read and write the given image file, using 512 byte blocks.
+   The file must already exist. Returns 0 on success, or -1 on error (with
+   errno set). */
+int fileblk_create(kos_blockdev_t *rv, const char *fn);
+
+/* Close the image file and free everything set up by fileblk_create(). The
+   library calls the device's shutdown function itself when unmounting (or when
+   mounting fails), so that doesn't release anything. */
+void fileblk_destroy(kos_blockdev_t *d);
+
+/* Fetch (and, if reset is non-zero, then clear) the device's counters. */
+void fileblk_stats(kos_blockdev_t *d, fileblk_stats_t *st, int reset);
+
+#endif /* !__EXT2_HOST_FILEBLK_H */
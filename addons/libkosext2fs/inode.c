@@ -64,6 +64,12 @@ static struct int_inode {
 
     /* What inode number is this? */
     uint32_t inode_num;
+
+    /* Preallocation window -- blocks that are already marked as in use in the
+       block bitmap, but not yet part of the file. The file takes its next
+       blocks from here while it grows in order. */
+    uint32_t prealloc_block;
+    uint32_t prealloc_count;
 } inodes[MAX_INODES];
 
 /* Head types */
@@ -95,6 +101,7 @@ void ext2_inode_init(void) {
         inodes[i].flags = 0;
         inodes[i].inode_num = 0;
         inodes[i].refcnt = 0;
+        inodes[i].prealloc_count = 0;
         TAILQ_INSERT_TAIL(&free_inodes, inodes + i, qentry);
     }
 }
@@ -138,6 +145,7 @@ ext2_inode_t *ext2_inode_get(ext2_fs_t *fs, uint32_t inode_num, int *err) {
     i->refcnt = 1;
     i->inode_num = inode_num;
     i->fs = fs;
+    i->prealloc_count = 0;
 
     /* Read the inode in from the block device. */
     if(!(rinode = ext2_inode_read(fs, inode_num))) {
@@ -163,6 +171,15 @@ ext2_inode_t *ext2_inode_get(ext2_fs_t *fs, uint32_t inode_num, int *err) {
     return &i->inode;
 }
 
+/* Give back any blocks left in an inode's preallocation window. */
+static void prealloc_discard(struct int_inode *inode) {
+    if(inode->prealloc_count) {
+        ext2_block_free_run(inode->fs, inode->prealloc_block,
+                            inode->prealloc_count);
+        inode->prealloc_count = 0;
+    }
+}
+
 void ext2_inode_put(ext2_inode_t *inode) {
     struct int_inode *iinode = (struct int_inode *)inode;
 
@@ -171,6 +188,9 @@ void ext2_inode_put(ext2_inode_t *inode) {
 
     /* Decrement the reference counter, and see if we've got the last one. */
     if(!--iinode->refcnt) {
+        /* Nobody has the file open anymore, so it isn't going to grow. */
+        prealloc_discard(iinode);
+
         /* Write it back out to the block cache if it was dirty. */
         if(iinode->flags & INODE_FLAG_DIRTY)
             /* XXXX: Should probably make sure this succeeds... */
@@ -190,6 +210,10 @@ void ext2_inode_put(ext2_inode_t *inode) {
 #endif
 }
 
+uint32_t ext2_inode_num(const ext2_inode_t *inode) {
+    return ((const struct int_inode *)inode)->inode_num;
+}
+
 void ext2_inode_retain(ext2_inode_t *inode) {
     struct int_inode *iinode = (struct int_inode *)inode;
 
@@ -549,6 +573,8 @@ int ext2_inode_free_all(ext2_fs_t *fs, ext2_inode_t *inode,
     struct int_inode *iinode = (struct int_inode *)inode;
     ext2_xattr_hdr_t *xattr;
 
+    prealloc_discard(iinode);
+
     /* Do a write-back on the block cache... */
     if((rv = ext2_block_cache_wb(fs)))
         return rv;
@@ -686,12 +712,49 @@ int ext2_inode_deref(ext2_fs_t *fs, uint32_t inode_num, int isdir) {
     return rv;
 }
 
+/* Allocate a block for an inode, as close to goal as possible, and clear it.
+   Regular files take their blocks from their preallocation window, which is
+   refilled with a run of blocks whenever it is empty or the file isn't growing
+   into it (it is being written to out of order, for instance). */
+static uint8_t *alloc_blk(ext2_fs_t *fs, struct int_inode *inode,
+                          uint32_t goal, uint32_t *bn, int *err) {
+    uint8_t *buf;
+    int cnt = 1;
+
+    if(inode->prealloc_count && inode->prealloc_block != goal)
+        prealloc_discard(inode);
+
+    if(inode->prealloc_count) {
+        *bn = inode->prealloc_block++;
+        --inode->prealloc_count;
+    }
+    else {
+        if((inode->inode.i_mode & 0xF000) == EXT2_S_IFREG)
+            cnt = EXT2_PREALLOC_BLOCKS;
+
+        if((cnt = ext2_block_alloc_run(fs, goal, cnt, bn, err)) < 0)
+            return NULL;
+
+        inode->prealloc_block = *bn + 1;
+        inode->prealloc_count = cnt - 1;
+    }
+
+    if(!(buf = ext2_block_read(fs, *bn, err))) {
+        ext2_block_free_run(fs, *bn, 1);
+        return NULL;
+    }
+
+    memset(buf, 0, fs->block_size);
+    ext2_block_mark_dirty(fs, *bn);
+    return buf;
+}
+
 static uint8_t *alloc_direct_blk(ext2_fs_t *fs, struct int_inode *inode,
-                                 uint32_t bg, uint32_t *rbn, int *err) {
+                                 uint32_t goal, uint32_t *rbn, int *err) {
     uint8_t *buf;
     uint32_t bn;
 
-    if(!(buf = ext2_block_alloc(fs, bg, &bn, err)))
+    if(!(buf = alloc_blk(fs, inode, goal, &bn, err)))
         return NULL;
 
     *rbn = bn;
@@ -702,19 +765,19 @@ static uint8_t *alloc_direct_blk(ext2_fs_t *fs, struct int_inode *inode,
 }
 
 static uint8_t *alloc_ind_blk(ext2_fs_t *fs, struct int_inode *inode,
-                              uint32_t bg, uint32_t *rbn, int *err) {
+                              uint32_t goal, uint32_t *rbn, int *err) {
     uint8_t *buf;
     uint32_t *buf32;
     uint32_t bn, bn2;
 
     /* Allocate the indirect block */
-    if(!(buf = ext2_block_alloc(fs, bg, &bn, err)))
+    if(!(buf = alloc_blk(fs, inode, goal, &bn, err)))
         return NULL;
 
     buf32 = (uint32_t *)buf;
 
     /* Allocate the direct block and update the inode */
-    if(!(buf = alloc_direct_blk(fs, inode, bg, &bn2, err))) {
+    if(!(buf = alloc_direct_blk(fs, inode, bn + 1, &bn2, err))) {
         mark_block_free(fs, bn);
         return NULL;
     }
@@ -728,19 +791,19 @@ static uint8_t *alloc_ind_blk(ext2_fs_t *fs, struct int_inode *inode,
 }
 
 static uint8_t *alloc_dind_blk(ext2_fs_t *fs, struct int_inode *inode,
-                               uint32_t bg, uint32_t *rbn, int *err) {
+                               uint32_t goal, uint32_t *rbn, int *err) {
     uint8_t *buf;
     uint32_t *buf32;
     uint32_t bn, bn2;
 
     /* Allocate the double indirect block */
-    if(!(buf = ext2_block_alloc(fs, bg, &bn, err)))
+    if(!(buf = alloc_blk(fs, inode, goal, &bn, err)))
         return NULL;
 
     buf32 = (uint32_t *)buf;
 
     /* Allocate the indirect and direct blocks and update the inode */
-    if(!(buf = alloc_ind_blk(fs, inode, bg, &bn2, err))) {
+    if(!(buf = alloc_ind_blk(fs, inode, bn + 1, &bn2, err))) {
         mark_block_free(fs, bn);
         return NULL;
     }
@@ -754,20 +817,20 @@ static uint8_t *alloc_dind_blk(ext2_fs_t *fs, struct int_inode *inode,
 }
 
 static uint8_t *alloc_tind_blk(ext2_fs_t *fs, struct int_inode *inode,
-                               uint32_t bg, uint32_t *rbn, int *err) {
+                               uint32_t goal, uint32_t *rbn, int *err) {
     uint8_t *buf;
     uint32_t *buf32;
     uint32_t bn, bn2;
 
     /* Allocate the double indirect block */
-    if(!(buf = ext2_block_alloc(fs, bg, &bn, err)))
+    if(!(buf = alloc_blk(fs, inode, goal, &bn, err)))
         return NULL;
 
     buf32 = (uint32_t *)buf;
 
     /* Allocate the double indirect, indirect, and direct blocks and update the
        inode */
-    if(!(buf = alloc_dind_blk(fs, inode, bg, &bn2, err))) {
+    if(!(buf = alloc_dind_blk(fs, inode, bn + 1, &bn2, err))) {
         mark_block_free(fs, bn);
         return NULL;
     }
@@ -785,7 +848,7 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
     struct int_inode *iinode = (struct int_inode *)inode;
     uint8_t *buf;
     uint32_t *ind, *ind2, *ind3;
-    uint32_t bg, ibn, ibn2, ibn3;
+    uint32_t goal, ibn, ibn2, ibn3;
     uint32_t blocks_per_ind = fs->block_size >> 2;
 
     /* Don't even bother if we're mounted read-only. */
@@ -798,14 +861,22 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
     if(inode->i_file_acl)
         blocks -= 1;
 
-    bg = (iinode->inode_num - 1) / fs->sb.s_inodes_per_group;
+    /* Try to put the new block right after the one before it in the file, or
+       at the start of the inode's block group if this is the first one. */
+    if(blocks && !ext2_inode_bmap(fs, inode, blocks - 1, &goal) && goal) {
+        ++goal;
+    }
+    else {
+        goal = (iinode->inode_num - 1) / fs->sb.s_inodes_per_group *
+            fs->sb.s_blocks_per_group + fs->sb.s_first_data_block;
+    }
 
     /* First, see if we have a slot in the direct blocks open still. */
     if(blocks < 12) {
-        return alloc_direct_blk(fs, iinode, bg, &inode->i_block[blocks], err);
+        return alloc_direct_blk(fs, iinode, goal, &inode->i_block[blocks], err);
     }
     else if(blocks == 12) {
-        return alloc_ind_blk(fs, iinode, bg, &inode->i_block[12], err);
+        return alloc_ind_blk(fs, iinode, goal, &inode->i_block[12], err);
     }
 
     blocks -= 12;
@@ -818,13 +889,13 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
         }
 
         /* Allocate the data block. */
-        if((buf = alloc_direct_blk(fs, iinode, bg, &ind[blocks], err)))
+        if((buf = alloc_direct_blk(fs, iinode, goal, &ind[blocks], err)))
             ext2_block_mark_dirty(fs, inode->i_block[12]);
 
         return buf;
     }
     else if(blocks == blocks_per_ind) {
-        return alloc_dind_blk(fs, iinode, bg, &inode->i_block[13], err);
+        return alloc_dind_blk(fs, iinode, goal, &inode->i_block[13], err);
     }
 
     blocks -= blocks_per_ind;
@@ -844,20 +915,20 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
                 return NULL;
 
             /* Allocate the data block. */
-            if((buf = alloc_direct_blk(fs, iinode, bg, &ind[blocks], err)))
+            if((buf = alloc_direct_blk(fs, iinode, goal, &ind[blocks], err)))
                 ext2_block_mark_dirty(fs, ind2[ibn]);
 
             return buf;
         }
         else {
-            if((buf = alloc_ind_blk(fs, iinode, bg, &ind2[ibn], err)))
+            if((buf = alloc_ind_blk(fs, iinode, goal, &ind2[ibn], err)))
                 ext2_block_mark_dirty(fs, inode->i_block[13]);
 
             return buf;
         }
     }
     else if(blocks == (blocks_per_ind * blocks_per_ind)) {
-        return alloc_tind_blk(fs, iinode, bg, &inode->i_block[14], err);
+        return alloc_tind_blk(fs, iinode, goal, &inode->i_block[14], err);
     }
 
     /* So, it comes to this... */
@@ -877,7 +948,7 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
         if(!(ind3 = (uint32_t *)ext2_block_read(fs, inode->i_block[14], err)))
             return NULL;
 
-        if((buf = alloc_dind_blk(fs, iinode, bg, &ind3[ibn3], err)))
+        if((buf = alloc_dind_blk(fs, iinode, goal, &ind3[ibn3], err)))
             ext2_block_mark_dirty(fs, inode->i_block[14]);
 
         return buf;
@@ -890,7 +961,7 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
         if(!(ind2 = (uint32_t *)ext2_block_read(fs, ind3[ibn3], err)))
             return NULL;
 
-        if((buf = alloc_ind_blk(fs, iinode, bg, &ind2[ibn2], err)))
+        if((buf = alloc_ind_blk(fs, iinode, goal, &ind2[ibn2], err)))
             ext2_block_mark_dirty(fs, ind3[ibn3]);
 
         return buf;
@@ -906,143 +977,18 @@ uint8_t *ext2_inode_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode,
         if(!(ind = (uint32_t *)ext2_block_read(fs, ind2[ibn2], err)))
             return NULL;
 
-        if((buf = alloc_direct_blk(fs, iinode, bg, &ind[ibn], err)))
+        if((buf = alloc_direct_blk(fs, iinode, goal, &ind[ibn], err)))
             ext2_block_mark_dirty(fs, ind2[ibn2]);
 
         return buf;
     }
 }
 
-static ext2_dirent_t *search_dir(uint8_t *buf, int block_size,
-                                 const char *token, int *err) {
-    int block_offset = 0;
-    ext2_dirent_t *dent;
-    char name[256];
-
-    while(block_offset < block_size) {
-        dent = (ext2_dirent_t *)(buf + block_offset);
-
-        /* Make sure we don't trip and fall on a malformed entry. */
-        if(!dent->rec_len) {
-            *err = -EIO;
-            return NULL;
-        }
-
-        if(dent->inode) {
-            /* See if this is what we're looking for. */
-            memcpy(name, dent->name, dent->name_len);
-            name[dent->name_len] = 0;
-
-            if(!strcmp(name, token))
-                return dent;
-        }
-
-        block_offset += dent->rec_len;
-    }
-
-    return NULL;
-}
-
-static ext2_dirent_t *search_indir(ext2_fs_t *fs, const uint32_t *iblock,
-                                   int block_size, const char *token,
-                                   int *err) {
-    uint8_t *buf;
-    int i, block_ents;
-    ext2_dirent_t *rv;
-
-    /* We're going to need this buffer... */
-    if(!(buf = (uint8_t *)malloc(block_size))) {
-        *err = -ENOMEM;
-        return NULL;
-    }
-
-    block_ents = block_size >> 2;
-
-    /* Search through each block until we get to the end. */
-    for(i = 0; i < block_ents && iblock[i]; ++i) {
-        if(ext2_block_read_nc(fs, iblock[i], buf)) {
-            free(buf);
-            *err = -EIO;
-            return NULL;
-        }
-
-        if((rv = search_dir(buf, block_size, token, err))) {
-            free(buf);
-            *err = 0;
-            return rv;
-        }
-        else if(*err) {
-            free(buf);
-            return NULL;
-        }
-    }
-
-    free(buf);
-    *err = 0;
-    return NULL;
-}
-
-static ext2_dirent_t *search_indir_23(ext2_fs_t *fs, const uint32_t *iblock,
-                                      int block_size, const char *token,
-                                      int *err, int triple) {
-    uint32_t *buf;
-    int i, block_ents;
-    ext2_dirent_t *rv;
-
-    /* We're going to need this buffer... */
-    if(!(buf = (uint32_t *)malloc(block_size))) {
-        *err = -ENOMEM;
-        return NULL;
-    }
-
-    block_ents = block_size >> 2;
-
-    if(!triple) {
-        /* Search through each indirect block until we get to the end. */
-        for(i = 0; i < block_ents && iblock[i]; ++i) {
-            if(ext2_block_read_nc(fs, iblock[i], (uint8_t *)buf)) {
-                free(buf);
-                *err = -EIO;
-                return NULL;
-            }
-
-            if((rv = search_indir(fs, buf, block_size, token, err))) {
-                free(buf);
-                *err = 0;
-                return rv;
-            }
-        }
-    }
-    else {
-        /* Search through each doubly-indirect block until we get to the end. */
-        for(i = 0; i < block_size && iblock[i]; ++i) {
-            if(ext2_block_read_nc(fs, iblock[i], (uint8_t *)buf)) {
-                free(buf);
-                *err = -EIO;
-                return NULL;
-            }
-
-            if((rv = search_indir_23(fs, buf, block_size, token, err, 0))) {
-                free(buf);
-                *err = 0;
-                return rv;
-            }
-        }
-    }
-
-    free(buf);
-    *err = 0;
-    return NULL;
-}
-
 int ext2_inode_by_path(ext2_fs_t *fs, const char *path, ext2_inode_t **rv,
-                       uint32_t *inode_num, int rlink, ext2_dirent_t **rdent) {
+                       uint32_t *inode_num, int rlink) {
     ext2_inode_t *inode, *last;
     char *ipath, *cxt, *token;
-    int blocks, i, block_size;
-    uint8_t *buf;
-    uint32_t *ib;
-    ext2_dirent_t *dent = NULL;
+    uint32_t ino = EXT2_ROOT_INO;
     int err = 0;
     size_t tmp_sz;
     char *symbuf;
@@ -1070,14 +1016,9 @@ int ext2_inode_by_path(ext2_fs_t *fs, const char *path, ext2_inode_t **rv,
         free(ipath);
         *rv = inode;
         *inode_num = EXT2_ROOT_INO;
-
-        if(rdent)
-            *rdent = NULL;
         return 0;
     }
 
-    block_size = fs->block_size;
-
     while(token) {
         last = inode;
 
@@ -1088,106 +1029,22 @@ int ext2_inode_by_path(ext2_fs_t *fs, const char *path, ext2_inode_t **rv,
             return -ENOTDIR;
         }
 
-        blocks = inode->i_blocks / (2 << fs->sb.s_log_block_size);
-
-        /* Run through any direct blocks in the inode. */
-        for(i = 0; i < blocks && inode->i_block[i] && i < 12; ++i) {
-            /* Grab the block, looking in the directory cache. */
-            if(!(buf = ext2_block_read(fs, inode->i_block[i], &err))) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return -EIO;
-            }
-
-            /* Search through the directory block */
-            if((dent = search_dir(buf, block_size, token, &err))) {
-                goto next_token;
-            }
-            else if(err) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return err;
-            }
-        }
-
-        /* Short circuit... */
-        if(!inode->i_block[i])
-            goto out;
-
-        /* Next, look through the indirect block. */
-        if(!(ib = (uint32_t *)ext2_block_read(fs, inode->i_block[12], &err))) {
-            free(ipath);
+        /* Look for the next component of the path. */
+        if((err = ext2_dir_lookup(fs, inode, token, &ino))) {
             ext2_inode_put(inode);
-            return -EIO;
-        }
 
-        if((dent = search_indir(fs, ib, block_size, token, &err))) {
-            goto next_token;
-        }
-        else if(err) {
-            free(ipath);
-            ext2_inode_put(inode);
-            return err;
-        }
-
-        /* Next, look through the doubly-indirect block. */
-        if(inode->i_block[13]) {
-            /* Grab the block, looking in the directory cache. */
-            if(!(ib = (uint32_t *)ext2_block_read(fs, inode->i_block[13],
-                                                  &err))) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return -EIO;
-            }
-
-            if((dent = search_indir_23(fs, ib, block_size, token, &err, 0))) {
-                goto next_token;
-            }
-            else if(err) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return err;
-            }
-        }
-
-        /* Finally, try the triply-indirect block... God help us if we actually
-           have to look all the way through one of these... */
-        if(inode->i_block[14]) {
-            /* Grab the block, looking in the directory cache. */
-            if(!(ib = (uint32_t *)ext2_block_read(fs, inode->i_block[14],
-                                                  &err))) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return -EIO;
-            }
-
-            if((dent = search_indir_23(fs, ib, block_size, token, &err, 1))) {
-                goto next_token;
-            }
-            else if(err) {
-                free(ipath);
-                ext2_inode_put(inode);
-                return err;
-            }
-        }
-
-out:
-        /* If we get here, we didn't find the next entry. Return that error. */
-        ext2_inode_put(inode);
+            /* If we didn't find the next entry, the error depends on whether
+               that was the last part of the path or not. */
+            if(err == -ENOENT && strtok_r(NULL, "/", &cxt))
+                err = -ENOTDIR;
 
-        if((token = strtok_r(NULL, "/", &cxt))) {
             free(ipath);
-            return -ENOTDIR;
-        }
-        else {
-            free(ipath);
-            return -ENOENT;
+            return err;
         }
 
-next_token:
         token = strtok_r(NULL, "/", &cxt);
 
-        if(!(inode = ext2_inode_get(fs, dent->inode, &err))) {
+        if(!(inode = ext2_inode_get(fs, ino, &err))) {
             free(ipath);
             ext2_inode_put(last);
             return err;
@@ -1267,40 +1124,21 @@ next_token:
 
     /* Well, looks like we have it, return the inode. */
     *rv = inode;
-    *inode_num = dent->inode;
+    *inode_num = ino;
     free(ipath);
-
-    if(rdent)
-        *rdent = dent;
     return 0;
 }
 
-uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
-                               uint32_t block_num, uint32_t *r_block,
-                               int *err) {
+int ext2_inode_bmap(ext2_fs_t *fs, const ext2_inode_t *inode,
+                    uint32_t block_num, uint32_t *r_block) {
     uint32_t blks_per_ind, ibn;
     uint32_t *iblock;
-    int shift = 1 + fs->sb.s_log_block_size;
-    uint64_t sz;
-
-    /* Grab the size */
-    if((inode->i_mode & 0xF000) == EXT2_S_IFREG)
-        sz = ext2_inode_size(inode);
-    else
-        sz = (uint64_t)inode->i_size;
-
-    /* Check to be sure we're not being asked to do something stupid... */
-    if((block_num << (shift + 9)) >= sz) {
-        *err = EINVAL;
-        return NULL;
-    }
+    int err;
 
     /* If we're reading a direct block, this is easy. */
     if(block_num < 12) {
-        if(r_block)
-            *r_block = inode->i_block[block_num];
-
-        return ext2_block_read(fs, inode->i_block[block_num], err);
+        *r_block = inode->i_block[block_num];
+        return 0;
     }
 
     blks_per_ind = fs->block_size >> 2;
@@ -1308,64 +1146,111 @@ uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
 
     /* Are we looking at the singly-indirect block? */
     if(block_num < blks_per_ind) {
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[12], err)))
-            return NULL;
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[12], &err)))
+            return -err;
 
-        if(r_block)
-            *r_block = iblock[block_num];
-
-        return ext2_block_read(fs, iblock[block_num], err);
+        *r_block = iblock[block_num];
+        return 0;
     }
 
     /* Ok, we're looking at at least a doubly-indirect block... */
     block_num -= blks_per_ind;
     if(block_num < (blks_per_ind * blks_per_ind)) {
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[13], err)))
-            return NULL;
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[13], &err)))
+            return -err;
 
         /* Figure out what entry we want in here... */
         ibn = block_num / blks_per_ind;
         block_num %= blks_per_ind;
 
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-            return NULL;
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+            return -err;
 
         /* Ok... Now we should be good to go. */
-        if(r_block)
-            *r_block = iblock[block_num];
-
-        return ext2_block_read(fs, iblock[block_num], err);
+        *r_block = iblock[block_num];
+        return 0;
     }
 
     /* Ugh... You're going to make me look at a triply-indirect block now? */
     block_num -= blks_per_ind * blks_per_ind;
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[14], err)))
-        return NULL;
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[14], &err)))
+        return -err;
 
     /* Figure out what entry we want in here... */
-    ibn = block_num / blks_per_ind;
-    block_num %= blks_per_ind;
+    ibn = block_num / (blks_per_ind * blks_per_ind);
+    block_num %= blks_per_ind * blks_per_ind;
 
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-        return NULL;
+    if(ibn >= blks_per_ind)
+        /* This really shouldn't happen... */
+        return -EIO;
+
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+        return -err;
 
     /* And in this one too... */
     ibn = block_num / blks_per_ind;
     block_num %= blks_per_ind;
 
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-        return NULL;
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+        return -err;
 
     /* Ok... Now we should be good to go. Finally. */
-    if(block_num < blks_per_ind) {
-        if(r_block)
-            *r_block = iblock[block_num];
+    *r_block = iblock[block_num];
+    return 0;
+}
+
+int ext2_inode_map_run(ext2_fs_t *fs, const ext2_inode_t *inode,
+                       uint32_t block_num, uint32_t max, uint32_t *r_block) {
+    uint32_t first, next;
+    int rv, cnt;
+
+    if((rv = ext2_inode_bmap(fs, inode, block_num, &first)))
+        return rv;
+
+    *r_block = first;
+
+    /* Holes never make a run, even if there are several in a row. */
+    if(!first)
+        return 1;
+
+    for(cnt = 1; (uint32_t)cnt < max; ++cnt) {
+        if((rv = ext2_inode_bmap(fs, inode, block_num + cnt, &next)))
+            return rv;
 
-        return ext2_block_read(fs, iblock[block_num], err);
+        if(next != first + cnt)
+            break;
     }
-    else {
-        /* This really shouldn't happen... */
-        *err = EIO;
+
+    return cnt;
+}
+
+uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
+                               uint32_t block_num, uint32_t *r_block,
+                               int *err) {
+    uint32_t pblock;
+    int shift = 1 + fs->sb.s_log_block_size;
+    int rv;
+    uint64_t sz;
+
+    /* Grab the size */
+    if((inode->i_mode & 0xF000) == EXT2_S_IFREG)
+        sz = ext2_inode_size(inode);
+    else
+        sz = (uint64_t)inode->i_size;
+
+    /* Check to be sure we're not being asked to do something stupid... */
+    if((block_num << (shift + 9)) >= sz) {
+        *err = EINVAL;
+        return NULL;
+    }
+
+    if((rv = ext2_inode_bmap(fs, inode, block_num, &pblock))) {
+        *err = -rv;
         return NULL;
     }
+
+    if(r_block)
+        *r_block = pblock;
+
+    return ext2_block_read(fs, pblock, err);
 }
@@ -122,10 +122,13 @@ void ext2_inode_init(void);
    the inode you get back with ext2_inode_put. */
 ext2_inode_t *ext2_inode_get(ext2_fs_t *fs, uint32_t inode_num, int *err);
 int ext2_inode_by_path(ext2_fs_t *fs, const char *path, ext2_inode_t **rv,
-                       uint32_t *inode_num, int rlink, ext2_dirent_t **rdent);
+                       uint32_t *inode_num, int rlink);
 
 void ext2_inode_put(ext2_inode_t *inode);
 
+/* Get the inode number of an inode that you have a reference to. */
+uint32_t ext2_inode_num(const ext2_inode_t *inode);
+
 /* Increment the reference count on an inode that you already have a reference
    to. */
 void ext2_inode_retain(ext2_inode_t *inode);
@@ -158,6 +161,17 @@ uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
                                uint32_t block_num, uint32_t *r_block,
                                int *err);
 
+/* Look up the filesystem block that holds a block of an inode's data. Holes
+   come back as block 0. Returns 0 or a negative error code. */
+int ext2_inode_bmap(ext2_fs_t *fs, const ext2_inode_t *inode,
+                    uint32_t block_num, uint32_t *r_block);
+
+/* Find how many blocks of an inode, starting at block_num and up to max, are
+   stored back to back on the disk, putting the first of them in r_block.
+   Returns the length of the run (at least 1) or a negative error code. */
+int ext2_inode_map_run(ext2_fs_t *fs, const ext2_inode_t *inode,
+                       uint32_t block_num, uint32_t max, uint32_t *r_block);
+
 /* In symlink.c */
 int ext2_resolve_symlink(ext2_fs_t *fs, ext2_inode_t *inode, char *rv,
                          size_t *rv_len);
@@ -93,8 +93,17 @@ typedef struct ext2_superblock {
 
     uint32_t s_default_mount_options;
     uint32_t s_first_meta_bg;
+    uint32_t s_mkfs_time;
+    uint32_t s_jnl_blocks[17];
 
-    uint8_t unused[760];
+    uint32_t s_blocks_count_hi;
+    uint32_t s_r_blocks_count_hi;
+    uint32_t s_free_blocks_count_hi;
+    uint16_t s_min_extra_isize;
+    uint16_t s_want_extra_isize;
+    uint32_t s_flags;
+
+    uint8_t unused[668];
 } __attribute__((packed)) ext2_superblock_t;
 
 /* s_state values */
@@ -106,6 +115,11 @@ typedef struct ext2_superblock {
 #define EXT2_ERRORS_RO          2
 #define EXT2_ERRORS_PANIC       3
 
+/* s_flags values */
+#define EXT2_FLAGS_SIGNED_HASH      0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH    0x0002
+#define EXT2_FLAGS_TEST_FILESYS     0x0004
+
 /* s_creator_os values */
 #define EXT2_OS_LINUX   0
 #define EXT2_OS_HURD    1
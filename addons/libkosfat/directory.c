@@ -310,7 +310,7 @@ static int fat_search_long(fat_fs_t *fs, const char *fn, uint32_t cluster,
             if(!memcmp(longname_buf, longname_buf2, fnlen * sizeof(uint16_t))) {
                 /* The next entry should be the dentry we want (that is to say,
                    the short name entry for this long name). */
-                if(i < max) {
+                if(i + 1 < max) {
                     if(cluster != cluster2) {
                         if(!(cl = fat_cluster_read(fs, cluster, &err))) {
                             dbglog(DBG_ERROR, "Error reading directory at "
@@ -380,8 +380,15 @@ static int fat_search_long(fat_fs_t *fs, const char *fn, uint32_t cluster,
             else {
                 skip = 1;
 
-                if(cluster2 != cluster)
-                    break;
+                /* If the long name ran over into the next cluster, keep going
+                   from where it ended in there. */
+                if(cluster2 != cluster) {
+                    if(!(cl = fat_cluster_read(fs, cluster, &err))) {
+                        dbglog(DBG_ERROR, "Error reading directory at cluster %"
+                               PRIu32 ": %s\n", cluster, strerror(err));
+                        return -EIO;
+                    }
+                }
             }
         }
 
@@ -400,6 +407,8 @@ static int fat_search_long(fat_fs_t *fs, const char *fn, uint32_t cluster,
             if(max2 <= 0)
                 done = 1;
         }
+
+        i = 0;
     }
 
     return -ENOENT;
@@ -484,6 +493,200 @@ static int is_component_short(const char *fn) {
     return 1;
 }
 
+/* Directory lookup cache. Entries are keyed on the first cluster of the
+   directory and the path component with ASCII letters folded to lowercase.
+   Both short and long names are matched without regard to case, so this
+   never gives a different answer than searching the directory would. */
+int fat_dcache_init(fat_fs_t *fs, int count) {
+    uint32_t hash_sz = 1;
+    int i;
+
+    fs->dcache = NULL;
+    fs->dcache_hash = NULL;
+    TAILQ_INIT(&fs->dcache_lru);
+
+    if(count <= 0)
+        return 0;
+
+    while(hash_sz < (uint32_t)count)
+        hash_sz <<= 1;
+
+    if(!(fs->dcache = (fat_dcache_ent_t *)malloc(sizeof(fat_dcache_ent_t) *
+                                                 count)) ||
+       !(fs->dcache_hash = (struct fat_dcache_list *)
+         malloc(sizeof(struct fat_dcache_list) * hash_sz))) {
+        fat_dcache_shutdown(fs);
+        return -ENOMEM;
+    }
+
+    fs->dcache_hash_mask = hash_sz - 1;
+
+    for(i = 0; i < (int)hash_sz; ++i) {
+        LIST_INIT(&fs->dcache_hash[i]);
+    }
+
+    for(i = 0; i < count; ++i) {
+        fs->dcache[i].name[0] = 0;
+        TAILQ_INSERT_TAIL(&fs->dcache_lru, fs->dcache + i, qentry);
+    }
+
+    return 0;
+}
+
+void fat_dcache_shutdown(fat_fs_t *fs) {
+    free(fs->dcache_hash);
+    free(fs->dcache);
+    fs->dcache = NULL;
+    fs->dcache_hash = NULL;
+    TAILQ_INIT(&fs->dcache_lru);
+}
+
+/* Fold the name into key and hash it, FNV-1a style. Returns 0 if the name is
+   too long to be cached. */
+static uint32_t dcache_key(const char *fn, uint32_t parent,
+                           char key[FAT_DCACHE_NAME_LEN]) {
+    uint32_t hash = 0x811C9DC5 ^ parent;
+    int i;
+
+    for(i = 0; fn[i]; ++i) {
+        if(i == FAT_DCACHE_NAME_LEN - 1)
+            return 0;
+
+        key[i] = (char)tolower((unsigned char)fn[i]);
+        hash = (hash ^ (uint8_t)key[i]) * 0x01000193;
+    }
+
+    key[i] = 0;
+    return hash | 1;
+}
+
+static void dcache_drop(fat_fs_t *fs, fat_dcache_ent_t *ent) {
+    LIST_REMOVE(ent, hentry);
+    ent->name[0] = 0;
+    TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+    TAILQ_INSERT_HEAD(&fs->dcache_lru, ent, qentry);
+}
+
+static fat_dcache_ent_t *dcache_find(fat_fs_t *fs, const char *key,
+                                     uint32_t parent, uint32_t hash) {
+    fat_dcache_ent_t *ent;
+
+    LIST_FOREACH(ent, &fs->dcache_hash[hash & fs->dcache_hash_mask], hentry) {
+        if(ent->hash == hash && ent->parent == parent && !strcmp(ent->name, key))
+            return ent;
+    }
+
+    return NULL;
+}
+
+static void dcache_insert(fat_fs_t *fs, const char *key, uint32_t parent,
+                          uint32_t hash, int err, const fat_dentry_t *dent,
+                          uint32_t cl, uint32_t off, uint32_t lcl,
+                          uint32_t loff) {
+    fat_dcache_ent_t *ent = TAILQ_FIRST(&fs->dcache_lru);
+
+    if(ent->name[0])
+        LIST_REMOVE(ent, hentry);
+
+    strcpy(ent->name, key);
+    ent->parent = parent;
+    ent->hash = hash;
+    ent->err = err;
+
+    if(!err) {
+        ent->dent = *dent;
+        ent->cl = cl;
+        ent->off = off;
+        ent->lcl = lcl;
+        ent->loff = loff;
+    }
+
+    LIST_INSERT_HEAD(&fs->dcache_hash[hash & fs->dcache_hash_mask], ent,
+                     hentry);
+    TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+    TAILQ_INSERT_TAIL(&fs->dcache_lru, ent, qentry);
+}
+
+/* Forget everything cached about the directory starting at parent. If neg_only
+   is set, only forget the names that weren't found in it. */
+static void dcache_forget_dir(fat_fs_t *fs, uint32_t parent, int neg_only) {
+    fat_dcache_ent_t *ent, *next;
+
+    if(!fs->dcache)
+        return;
+
+    for(ent = TAILQ_FIRST(&fs->dcache_lru); ent; ent = next) {
+        next = TAILQ_NEXT(ent, qentry);
+
+        if(ent->name[0] && ent->parent == parent && (ent->err || !neg_only))
+            dcache_drop(fs, ent);
+    }
+}
+
+/* Find the cached copies of the directory entry at cl/off. If dent is NULL,
+   forget about them, otherwise update them to match it. */
+static void dcache_update_ent(fat_fs_t *fs, uint32_t cl, uint32_t off,
+                              const fat_dentry_t *dent) {
+    fat_dcache_ent_t *ent, *next;
+
+    if(!fs->dcache)
+        return;
+
+    for(ent = TAILQ_FIRST(&fs->dcache_lru); ent; ent = next) {
+        next = TAILQ_NEXT(ent, qentry);
+
+        if(ent->name[0] && !ent->err && ent->cl == cl && ent->off == off) {
+            if(dent)
+                ent->dent = *dent;
+            else
+                dcache_drop(fs, ent);
+        }
+    }
+}
+
+/* Look up one path component in the directory starting at cluster parent. */
+static int fat_lookup(fat_fs_t *fs, const char *fn, uint32_t parent,
+                      fat_dentry_t *rv, uint32_t *rcl, uint32_t *roff,
+                      uint32_t *rlcl, uint32_t *rloff) {
+    char key[FAT_DCACHE_NAME_LEN], comp[11];
+    uint32_t hash = 0;
+    fat_dcache_ent_t *ent;
+    int err;
+
+    if(fs->dcache && (hash = dcache_key(fn, parent, key))) {
+        if((ent = dcache_find(fs, key, parent, hash))) {
+            TAILQ_REMOVE(&fs->dcache_lru, ent, qentry);
+            TAILQ_INSERT_TAIL(&fs->dcache_lru, ent, qentry);
+
+            if(ent->err)
+                return ent->err;
+
+            *rv = ent->dent;
+            *rcl = ent->cl;
+            *roff = ent->off;
+            *rlcl = ent->lcl;
+            *rloff = ent->loff;
+            return 0;
+        }
+    }
+
+    if(is_component_short(fn)) {
+        normalize_shortname(fn, comp);
+        *rlcl = 0;
+        *rloff = 0;
+        err = fat_search_dir(fs, comp, parent, rv, rcl, roff);
+    }
+    else {
+        err = fat_search_long(fs, fn, parent, rv, rcl, roff, rlcl, rloff);
+    }
+
+    if(hash && (!err || err == -ENOENT))
+        dcache_insert(fs, key, parent, hash, err, rv, *rcl, *roff, *rlcl,
+                      *rloff);
+
+    return err;
+}
+
 static int fat_find_child2(fat_fs_t *fs, const char fn[11],
                            fat_dentry_t *parent) {
     uint32_t cl;
@@ -497,31 +700,16 @@ static int fat_find_child2(fat_fs_t *fs, const char fn[11],
 int fat_find_child(fat_fs_t *fs, const char *fn, fat_dentry_t *parent,
                    fat_dentry_t *rv, uint32_t *rcl, uint32_t *roff,
                    uint32_t *rlcl, uint32_t *rloff) {
-    char *fnc = strdup(fn), comp[11];
     uint32_t cl;
-    int err;
 
     cl = parent->cluster_low | (parent->cluster_high << 16);
-
-    if(is_component_short(fnc)) {
-        normalize_shortname(fnc, comp);
-
-        err = fat_search_dir(fs, comp, cl, rv, rcl, roff);
-        *rlcl = 0;
-        *rloff = 0;
-    }
-    else {
-        err = fat_search_long(fs, fnc, cl, rv, rcl, roff, rlcl, rloff);
-    }
-
-    free(fnc);
-    return err;
+    return fat_lookup(fs, fn, cl, rv, rcl, roff, rlcl, rloff);
 }
 
 int fat_find_dentry(fat_fs_t *fs, const char *fn, fat_dentry_t *rv,
                     uint32_t *rcl, uint32_t *roff, uint32_t *rlcl,
                     uint32_t *rloff) {
-    char *fnc = strdup(fn), comp[11], *tmp, *tok;
+    char *fnc = strdup(fn), *tmp, *tok;
     int err = -ENOENT;
     fat_dentry_t cur;
     uint32_t cl, off, lcl = 0, loff = 0;
@@ -561,17 +749,8 @@ int fat_find_dentry(fat_fs_t *fs, const char *fn, fat_dentry_t *rv,
             fs->sb.fat_size));
     }
 
-    if(is_component_short(tok)) {
-        normalize_shortname(tok, comp);
-
-        if((err = fat_search_dir(fs, comp, cl, &cur, &cl, &off)) < 0)
-            goto out;
-    }
-    else {
-        if((err = fat_search_long(fs, tok, cl, &cur, &cl, &off, &lcl,
-                                  &loff)) < 0)
-            goto out;
-    }
+    if((err = fat_lookup(fs, tok, cl, &cur, &cl, &off, &lcl, &loff)) < 0)
+        goto out;
 
     tok = strtok_r(NULL, "/", &tmp);
 
@@ -584,19 +763,8 @@ int fat_find_dentry(fat_fs_t *fs, const char *fn, fat_dentry_t *rv,
 
         cl = cur.cluster_low | (cur.cluster_high << 16);
 
-        if(is_component_short(tok)) {
-            normalize_shortname(tok, comp);
-            lcl = loff = 0;
-
-            if((err = fat_search_dir(fs, comp, cl, &cur, &cl, &off)) < 0) {
-                goto out;
-            }
-        }
-        else {
-            if((err = fat_search_long(fs, tok, cl, &cur, &cl, &off, &lcl,
-                                      &loff)) < 0)
-                goto out;
-        }
+        if((err = fat_lookup(fs, tok, cl, &cur, &cl, &off, &lcl, &loff)) < 0)
+            goto out;
 
         tok = strtok_r(NULL, "/", &tmp);
     }
@@ -637,6 +805,13 @@ int fat_erase_dentry(fat_fs_t *fs, uint32_t cl, uint32_t off, uint32_t lcl,
     ent = (fat_dentry_t *)(buf + off);
     ent->name[0] = FAT_ENTRY_FREE;
 
+    /* Make sure the lookup cache forgets about it (and anything that was in it,
+       if it was a directory). */
+    dcache_update_ent(fs, cl, off, NULL);
+
+    if(ent->attr & FAT_ATTR_DIRECTORY)
+        dcache_forget_dir(fs, ent->cluster_low | (ent->cluster_high << 16), 0);
+
     fat_cluster_mark_dirty(fs, cl);
 
     /* If there is a long name chain, mark it all as free too... */
@@ -894,6 +1069,9 @@ static int fat_get_free_dentry(fat_fs_t *fs, uint32_t cluster, uint32_t *rcl,
                         soff = i << 5;
                     }
 
+                    /* The new cluster goes after this one, not whichever one
+                       we looked at before it. */
+                    old = cluster;
                     goto alloc_another;
                 }
             }
@@ -952,11 +1130,12 @@ static int fat_get_free_dentry(fat_fs_t *fs, uint32_t cluster, uint32_t *rcl,
        Attempt to allocate a new cluster, clear it out, and return a pointer to
        the beginning of it. */
 alloc_another:
-    if((j = fat_allocate_cluster(fs, &err)) == FAT_INVALID_CLUSTER) {
+    if((j = fat_allocate_cluster_near(fs, old, &err)) ==
+       FAT_INVALID_CLUSTER) {
         dbglog(DBG_ERROR, "Error allocating directory cluster: %s\n",
                strerror(err));
         *rv = NULL;
-        return err;
+        return -err;
     }
 
     /* Update the FAT chain. */
@@ -1287,6 +1466,9 @@ int fat_add_dentry(fat_fs_t *fs, const char *fn, fat_dentry_t *parent,
 
     cl = parent->cluster_low | (parent->cluster_high << 16);
 
+    /* Anything that wasn't found in the directory before might be now. */
+    dcache_forget_dir(fs, cl, 1);
+
     if(is_component_short(fn)) {
         normalize_shortname(fn, comp);
 
@@ -1383,6 +1565,7 @@ int fat_update_dentry(fat_fs_t *fs, fat_dentry_t *ent, uint32_t cluster,
 
     memcpy(cl + off, ent, sizeof(fat_dentry_t));
     fat_cluster_mark_dirty(fs, cluster);
+    dcache_update_ent(fs, cluster, off, ent);
     return 0;
 }
 
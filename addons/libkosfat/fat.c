@@ -14,28 +14,9 @@
 #include "fatfs.h"
 #include "fatinternal.h"
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(fat_fs_t *fs, fat_cache_t **cache, int block) {
-    int i;
-    fat_cache_t *tmp;
-
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
-
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
-
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
-    }
-
-    cache[fs->cache_size - 1] = tmp;
-}
-
-
 static int fat_fatblock_read_nc(fat_fs_t *fs, uint32_t bn, uint8_t *rv) {
-    if(fs->sb.fat_size <= bn)
+    if(bn < fs->sb.reserved_sectors ||
+       bn >= fs->sb.reserved_sectors + fs->sb.fat_size)
         return -EINVAL;
 
     if(fs->dev->read_blocks(fs->dev, bn, 1, rv))
@@ -46,7 +27,8 @@ static int fat_fatblock_read_nc(fat_fs_t *fs, uint32_t bn, uint8_t *rv) {
 
 static int fat_fatblock_write_nc(fat_fs_t *fs, uint32_t bn,
                                  const uint8_t *blk) {
-    if(fs->sb.fat_size <= bn)
+    if(bn < fs->sb.reserved_sectors ||
+       bn >= fs->sb.reserved_sectors + fs->sb.fat_size)
         return -EINVAL;
 
     if(fs->dev->write_blocks(fs->dev, bn, 1, blk))
@@ -55,88 +37,30 @@ static int fat_fatblock_write_nc(fat_fs_t *fs, uint32_t bn,
     return 0;
 }
 
-static uint8_t *fat_read_fatblock(fat_fs_t *fs, uint32_t block, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->fcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == block && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
-    }
+int fat_fatblock_cache_init(fat_fs_t *fs, int count) {
+    return fat_bcache_init(&fs->fcache, count, fs->sb.bytes_per_sector,
+                           &fat_fatblock_read_nc, &fat_fatblock_write_nc);
+}
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_fatblock_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
-        }
-    }
+static uint8_t *fat_read_fatblock(fat_fs_t *fs, uint32_t block, int *err) {
+    fat_cache_t *blk;
 
-    /* Try to read the block in question. */
-    if(fat_fatblock_read_nc(fs, block, cache[i]->data)) {
-        *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
+    if(!(blk = fat_bcache_get(fs, &fs->fcache, block, 1, err)))
         return NULL;
-    }
-
-    cache[i]->block = block;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
 
-out:
-    return rv;
+    return blk->data;
 }
 
 static int fat_fatblock_mark_dirty(fat_fs_t *fs, uint32_t bn) {
-    int i;
-    fat_cache_t **cache = fs->fcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == bn && cache[i]->flags) {
-            cache[i]->flags |= FAT_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
-    }
-
-    return -EINVAL;
+    return fat_bcache_mark_dirty(&fs->fcache, bn);
 }
 
 int fat_fatblock_cache_wb(fat_fs_t *fs) {
-    int i, err;
-    fat_cache_t **cache = fs->fcache;
-
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & FAT_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if((err = fat_fatblock_write_nc(fs, cache[i]->block,
-                                            cache[i]->data)))
-                return err;
-
-            cache[i]->flags &= ~FAT_CACHE_FLAG_DIRTY;
-        }
-    }
-
-    return 0;
+    return fat_bcache_wb(fs, &fs->fcache);
 }
 
 uint32_t fat_read_fat(fat_fs_t *fs, uint32_t cl, int *err) {
@@ -214,7 +138,7 @@ uint32_t fat_read_fat(fat_fs_t *fs, uint32_t cl, int *err) {
 }
 
 int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val) {
-    uint32_t sn, off;
+    uint32_t sn, off, ocl = cl, oval = val & 0x0FFFFFFF;
     uint8_t *blk, *blk2;
     int err;
 
@@ -308,6 +232,14 @@ int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val) {
             break;
     }
 
+    /* Keep the free cluster map in sync with the FAT, as far as it goes. */
+    if(fs->free_map && ocl < fs->free_map_next) {
+        if(oval)
+            fs->free_map[ocl >> 5] &= ~(1U << (ocl & 31));
+        else
+            fs->free_map[ocl >> 5] |= 1U << (ocl & 31);
+    }
+
     return 0;
 }
 
@@ -326,6 +258,160 @@ int fat_is_eof(fat_fs_t *fs, uint32_t cl) {
     return -1;
 }
 
+/* Number of blocks of the FAT to read at once when building the free cluster
+   map for a FAT16 or FAT32 filesystem. One read's worth is added to the map
+   each time a cluster is allocated, until it covers the whole FAT. */
+#define FAT_FREE_MAP_READ   16
+
+void fat_free_map_init(fat_fs_t *fs) {
+    fs->free_map = NULL;
+    fs->free_map_next = 0;
+    fs->flags &= ~FAT_FS_FLAG_NO_FREE_MAP;
+}
+
+void fat_free_map_shutdown(fat_fs_t *fs) {
+    free(fs->free_map);
+    fs->free_map = NULL;
+}
+
+/* Give up on the free cluster map, and go back to searching the FAT for the
+   rest of the time the filesystem is mounted. */
+static void free_map_drop(fat_fs_t *fs, int err) {
+    dbglog(DBG_WARNING, "fat_free_map: Couldn't build free cluster map: "
+           "%s\n", strerror(err));
+    fat_free_map_shutdown(fs);
+    fs->flags |= FAT_FS_FLAG_NO_FREE_MAP;
+}
+
+/* Is the free cluster map complete? */
+static inline int free_map_ready(fat_fs_t *fs) {
+    return fs->free_map && fs->free_map_next >= fs->sb.num_clusters + 2;
+}
+
+/* Mark a cluster that was allocated without going through fat_write_fat() as
+   in use, if the map has got that far. */
+static inline void free_map_taken(fat_fs_t *fs, uint32_t cl) {
+    if(fs->free_map && cl < fs->free_map_next)
+        fs->free_map[cl >> 5] &= ~(1U << (cl & 31));
+}
+
+/* Add the next part of the FAT to the free cluster map, allocating the map
+   first if this is the first time through. Rather than scanning the whole FAT
+   when the filesystem is mounted, this is done a bit at a time as clusters
+   are allocated, which keep searching the FAT itself until the map is done.
+   If there isn't enough memory for the map, or the FAT can't be read, we give
+   up on it. */
+static void free_map_step(fat_fs_t *fs) {
+    uint32_t last = fs->sb.num_clusters + 2, cl, val, sn, cnt, left, off, i;
+    uint32_t bps = fs->sb.bytes_per_sector;
+    fat_cache_t *blk;
+    int shift, err = 0;
+    uint8_t *buf;
+
+    if((fs->flags & FAT_FS_FLAG_NO_FREE_MAP) || free_map_ready(fs))
+        return;
+
+    if(!fs->free_map) {
+        if(!(fs->free_map = (uint32_t *)calloc((last + 31) >> 5,
+                                               sizeof(uint32_t)))) {
+            free_map_drop(fs, ENOMEM);
+            return;
+        }
+
+        fs->free_map_next = 0;
+    }
+
+    /* A FAT12 table is only a handful of blocks, so there's no point in doing
+       anything fancy with it. It all goes in at once. */
+    if(fs->sb.fs_type == FAT_FS_FAT12) {
+        for(cl = 2; cl < last; ++cl) {
+            if((val = fat_read_fat(fs, cl, &err)) == FAT_INVALID_CLUSTER) {
+                free_map_drop(fs, err);
+                return;
+            }
+
+            if(!val)
+                fs->free_map[cl >> 5] |= 1U << (cl & 31);
+        }
+
+        fs->free_map_next = last;
+        return;
+    }
+
+    /* Otherwise, read the table in big chunks straight from the device, rather
+       than pushing all of it through the FAT cache. Each chunk starts on a
+       block boundary, since free_map_next is always at one. */
+    if(!(buf = (uint8_t *)malloc(bps * FAT_FREE_MAP_READ))) {
+        free_map_drop(fs, ENOMEM);
+        return;
+    }
+
+    shift = fs->sb.fs_type == FAT_FS_FAT32 ? 2 : 1;
+    cl = fs->free_map_next;
+    sn = fs->sb.reserved_sectors + (cl << shift) / bps;
+    left = ((last << shift) + bps - 1) / bps - (cl << shift) / bps;
+    cnt = left < FAT_FREE_MAP_READ ? left : FAT_FREE_MAP_READ;
+
+    if(fs->dev->read_blocks(fs->dev, sn, cnt, buf)) {
+        free(buf);
+        free_map_drop(fs, EIO);
+        return;
+    }
+
+    /* Clusters have been allocated and freed since the filesystem was
+       mounted, so the FAT cache may well have newer copies of some of these
+       blocks than the device does. */
+    for(i = 0; i < cnt; ++i) {
+        if((blk = fat_bcache_find(&fs->fcache, sn + i)))
+            memcpy(buf + i * bps, blk->data, bps);
+    }
+
+    for(off = 0; off < cnt * bps && cl < last; off += 1 << shift, ++cl) {
+        if(shift == 2)
+            val = (buf[off] | (buf[off + 1] << 8) | (buf[off + 2] << 16) |
+                   (buf[off + 3] << 24)) & 0x0FFFFFFF;
+        else
+            val = buf[off] | (buf[off + 1] << 8);
+
+        if(!val && cl >= 2)
+            fs->free_map[cl >> 5] |= 1U << (cl & 31);
+    }
+
+    fs->free_map_next = cl;
+    free(buf);
+}
+
+/* Find the first free cluster in [cl, end) in the free cluster map. */
+static uint32_t free_map_find(fat_fs_t *fs, uint32_t cl, uint32_t end) {
+    uint32_t bits;
+
+    while(cl < end) {
+        if((bits = fs->free_map[cl >> 5] >> (cl & 31))) {
+            cl += __builtin_ctz(bits);
+            return cl < end ? cl : FAT_INVALID_CLUSTER;
+        }
+
+        cl = (cl | 31) + 1;
+    }
+
+    return FAT_INVALID_CLUSTER;
+}
+
+/* Allocate a cluster that's known to be free by putting an end of chain
+   marker in for it. */
+static uint32_t fat_claim_cluster(fat_fs_t *fs, uint32_t cl, int *err) {
+    int rv;
+
+    if((rv = fat_write_fat(fs, cl, 0x0FFFFFFF)) < 0) {
+        *err = -rv;
+        return FAT_INVALID_CLUSTER;
+    }
+
+    fs->sb.last_alloc_cluster = cl;
+    --fs->sb.free_clusters;
+    return cl;
+}
+
 uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err) {
     uint32_t sn, off, val;
     uint8_t *blk;
@@ -341,6 +427,23 @@ uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err) {
     i = fs->sb.last_alloc_cluster + 1;
     last = fs->sb.num_clusters + 2;
 
+    /* The FSinfo sector might not have had a valid hint for us... */
+    if(i < 2 || i >= last)
+        i = 2;
+
+    /* If we have the free cluster map, this is easy. */
+    free_map_step(fs);
+
+    if(free_map_ready(fs)) {
+        if((cl = free_map_find(fs, i, last)) == FAT_INVALID_CLUSTER &&
+           (cl = free_map_find(fs, 2, i)) == FAT_INVALID_CLUSTER) {
+            *err = ENOSPC;
+            return FAT_INVALID_CLUSTER;
+        }
+
+        return fat_claim_cluster(fs, cl, err);
+    }
+
     /* Search for a free cluster in the FAT...
        There are optimized versions here for FAT32 and FAT16. Perhaps I'll write
        one for FAT12 at some point too... */
@@ -370,6 +473,7 @@ retry_fat32:
                     /* Mark the block as dirty so it can get flushed to the
                        backing store at some point. */
                     fat_fatblock_mark_dirty(fs, sn);
+                    free_map_taken(fs, i);
 
                     fs->sb.last_alloc_cluster = i;
                     --fs->sb.free_clusters;
@@ -422,6 +526,7 @@ retry_fat16:
                     /* Mark the block as dirty so it can get flushed to the
                        backing store at some point. */
                     fat_fatblock_mark_dirty(fs, sn);
+                    free_map_taken(fs, i);
 
                     fs->sb.last_alloc_cluster = i;
                     return i;
@@ -457,10 +562,13 @@ retry_fat16:
                 ++i) {
                 if(!(cl = fat_read_fat(fs, i, err))) {
                     /* Allocate it by adding in an end of chain marker. */
-                    if((*err = fat_write_fat(fs, i, 0x0FFF)) < 0)
+                    if((*err = fat_write_fat(fs, i, 0x0FFF)) < 0) {
+                        *err = -*err;
                         return FAT_INVALID_CLUSTER;
+                    }
 
                     fs->sb.last_alloc_cluster = i;
+                    return i;
                 }
                 else if(cl == FAT_INVALID_CLUSTER) {
                     return cl;
@@ -470,10 +578,13 @@ retry_fat16:
             for(i = 2; i < fs->sb.last_alloc_cluster + 1; ++i) {
                 if(!(cl = fat_read_fat(fs, i, err))) {
                     /* Allocate it by adding in an end of chain marker. */
-                    if((*err = fat_write_fat(fs, i, 0x0FFF)) < 0)
+                    if((*err = fat_write_fat(fs, i, 0x0FFF)) < 0) {
+                        *err = -*err;
                         return FAT_INVALID_CLUSTER;
+                    }
 
                     fs->sb.last_alloc_cluster = i;
+                    return i;
                 }
                 else if(cl == FAT_INVALID_CLUSTER) {
                     return cl;
@@ -492,6 +603,32 @@ retry_fat16:
     return val;
 }
 
+/* Allocate a cluster, preferring the one right after cl so that files that are
+   written sequentially end up contiguous on the disk. */
+uint32_t fat_allocate_cluster_near(fat_fs_t *fs, uint32_t cl, int *err) {
+    uint32_t val;
+
+    if(!(fs->mnt_flags & FAT_MNT_FLAG_RW)) {
+        *err = EROFS;
+        return FAT_INVALID_CLUSTER;
+    }
+
+    if(++cl >= 2 && cl < fs->sb.num_clusters + 2) {
+        if(fs->free_map && cl < fs->free_map_next) {
+            if(fs->free_map[cl >> 5] & (1U << (cl & 31)))
+                return fat_claim_cluster(fs, cl, err);
+        }
+        else {
+            if((val = fat_read_fat(fs, cl, err)) == FAT_INVALID_CLUSTER)
+                return val;
+            else if(!val)
+                return fat_claim_cluster(fs, cl, err);
+        }
+    }
+
+    return fat_allocate_cluster(fs, err);
+}
+
 /* This function could be made better/more optimized... However, it takes the
    simplest/most clear approach to this for now. */
 int fat_erase_chain(fat_fs_t *fs, uint32_t cluster) {
@@ -15,112 +15,206 @@
 #include "bpb.h"
 #include "fatinternal.h"
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(fat_fs_t *fs, fat_cache_t **cache, int block) {
-    int i;
-    fat_cache_t *tmp;
+/* Move a block to the most recently used end of the LRU queue. */
+static inline void make_mru(fat_bcache_t *c, fat_cache_t *blk) {
+    TAILQ_REMOVE(&c->lru, blk, qentry);
+    TAILQ_INSERT_TAIL(&c->lru, blk, qentry);
+}
+
+int fat_bcache_init(fat_bcache_t *c, int count, uint32_t block_size,
+                    fat_cache_rd_t read_nc, fat_cache_wr_t write_nc) {
+    uint32_t hash_sz = 1;
+    int j;
 
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
+    /* The hash table has at least as many buckets as there are blocks. */
+    if(count < 1)
+        count = 1;
+
+    while(hash_sz < (uint32_t)count)
+        hash_sz <<= 1;
+
+    c->size = 0;
+    c->read_nc = read_nc;
+    c->write_nc = write_nc;
+    c->hash_mask = hash_sz - 1;
+    c->hash = NULL;
+    c->sort = NULL;
+    TAILQ_INIT(&c->lru);
+    TAILQ_INIT(&c->dirty);
+
+    if(!(c->blocks = (fat_cache_t *)malloc(sizeof(fat_cache_t) * count)))
+        return -ENOMEM;
+
+    if(!(c->hash = (struct fat_cache_list *)
+         malloc(sizeof(struct fat_cache_list) * hash_sz)) ||
+       !(c->sort = (fat_cache_t **)malloc(sizeof(fat_cache_t *) * count))) {
+        fat_bcache_shutdown(c);
+        return -ENOMEM;
+    }
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+    for(j = 0; j < (int)hash_sz; ++j) {
+        LIST_INIT(&c->hash[j]);
+    }
+
+    for(j = 0; j < count; ++j) {
+        if(!(c->blocks[j].data = (uint8_t *)malloc(block_size))) {
+            fat_bcache_shutdown(c);
+            return -ENOMEM;
+        }
 
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
+        c->blocks[j].flags = 0;
+        c->blocks[j].block = 0;
+        TAILQ_INSERT_TAIL(&c->lru, c->blocks + j, qentry);
+        ++c->size;
     }
 
-    cache[fs->cache_size - 1] = tmp;
+    return 0;
 }
 
-/* XXXX: This needs locking! */
-uint8_t *fat_cluster_read(fat_fs_t *fs, uint32_t cl, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
+void fat_bcache_shutdown(fat_bcache_t *c) {
+    int j;
+
+    for(j = 0; j < c->size; ++j) {
+        free(c->blocks[j].data);
     }
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_cluster_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
+    free(c->sort);
+    free(c->hash);
+    free(c->blocks);
+    c->blocks = NULL;
+    c->hash = NULL;
+    c->sort = NULL;
+    c->size = 0;
+}
+
+fat_cache_t *fat_bcache_find(fat_bcache_t *c, uint32_t block) {
+    fat_cache_t *blk;
+
+    LIST_FOREACH(blk, &c->hash[block & c->hash_mask], hentry) {
+        if(blk->block == block)
+            return blk;
+    }
+
+    return NULL;
+}
+
+/* Look up a block in the cache, bringing it in if it isn't there already. If
+   read is zero, the old contents of the block on the device are not read in,
+   since the caller is going to overwrite all of them. */
+fat_cache_t *fat_bcache_get(fat_fs_t *fs, fat_bcache_t *c, uint32_t block,
+                            int read, int *err) {
+    fat_cache_t *blk;
+
+    /* See if we already have the block in question. */
+    if((blk = fat_bcache_find(c, block))) {
+        make_mru(c, blk);
+        return blk;
+    }
+
+    /* Nope. Boot out the least recently used (or an invalid) block. */
+    blk = TAILQ_FIRST(&c->lru);
+
+    /* Make sure that if the block is dirty, we write it back out. */
+    if(blk->flags & FAT_CACHE_FLAG_DIRTY) {
+        if(c->write_nc(fs, blk->block, blk->data)) {
+            /* XXXX: Uh oh... */
+            *err = EIO;
+            return NULL;
         }
+
+        TAILQ_REMOVE(&c->dirty, blk, dentry);
     }
 
+    if(blk->flags & FAT_CACHE_FLAG_VALID)
+        LIST_REMOVE(blk, hentry);
+
+    /* Mark it as invalid until we have the new data in it. It stays at the
+       head of the LRU queue if the read fails, so it'll be reused first. */
+    blk->flags = 0;
+
     /* Try to read the block in question. */
-    if(fat_cluster_read_nc(fs, cl, cache[i]->data)) {
+    if(read && c->read_nc(fs, block, blk->data)) {
         *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
         return NULL;
     }
 
-    cache[i]->block = cl;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
+    blk->block = block;
+    blk->flags = FAT_CACHE_FLAG_VALID;
+    LIST_INSERT_HEAD(&c->hash[block & c->hash_mask], blk, hentry);
+    make_mru(c, blk);
 
-out:
-    return rv;
+    return blk;
 }
 
-uint8_t *fat_cluster_clear(fat_fs_t *fs, uint32_t cl, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
+int fat_bcache_mark_dirty(fat_bcache_t *c, uint32_t block) {
+    fat_cache_t *blk;
+
+    if(!(blk = fat_bcache_find(c, block)))
+        return -EINVAL;
+
+    if(!(blk->flags & FAT_CACHE_FLAG_DIRTY)) {
+        blk->flags |= FAT_CACHE_FLAG_DIRTY;
+        TAILQ_INSERT_TAIL(&c->dirty, blk, dentry);
     }
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_cluster_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
-        }
+    make_mru(c, blk);
+    return 0;
+}
+
+static int bcache_cmp(const void *a, const void *b) {
+    uint32_t x = (*(fat_cache_t * const *)a)->block;
+    uint32_t y = (*(fat_cache_t * const *)b)->block;
+
+    return x < y ? -1 : x > y;
+}
+
+int fat_bcache_wb(fat_fs_t *fs, fat_bcache_t *c) {
+    fat_cache_t *blk;
+    int i, cnt = 0, err;
+
+    /* Only the dirty blocks need to be looked at. Write them out in order of
+       where they are on the device, so that the device sees one sweep across
+       the disk rather than a bunch of seeking back and forth. */
+    TAILQ_FOREACH(blk, &c->dirty, dentry) {
+        c->sort[cnt++] = blk;
+    }
+
+    qsort(c->sort, cnt, sizeof(fat_cache_t *), bcache_cmp);
+
+    for(i = 0; i < cnt; ++i) {
+        blk = c->sort[i];
+
+        if((err = c->write_nc(fs, blk->block, blk->data)))
+            return err;
+
+        blk->flags &= ~FAT_CACHE_FLAG_DIRTY;
+        TAILQ_REMOVE(&c->dirty, blk, dentry);
     }
 
+    return 0;
+}
+
+/* XXXX: This needs locking! */
+uint8_t *fat_cluster_read(fat_fs_t *fs, uint32_t cl, int *err) {
+    fat_cache_t *blk;
+
+    if(!(blk = fat_bcache_get(fs, &fs->bcache, cl, 1, err)))
+        return NULL;
+
+    return blk->data;
+}
+
+uint8_t *fat_cluster_clear(fat_fs_t *fs, uint32_t cl, int *err) {
+    fat_cache_t *blk;
+
     /* Don't bother reading the cluster from disk, since we're erasing it
        anyway... */
-    cache[i]->block = cl;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID | FAT_CACHE_FLAG_DIRTY;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
+    if(!(blk = fat_bcache_get(fs, &fs->bcache, cl, 0, err)))
+        return NULL;
 
-out:
-    memset(rv, 0, fs->sb.bytes_per_sector * fs->sb.sectors_per_cluster);
-    return rv;
+    fat_bcache_mark_dirty(&fs->bcache, cl);
+    memset(blk->data, 0, fs->sb.bytes_per_sector * fs->sb.sectors_per_cluster);
+    return blk->data;
 }
 
 int fat_cluster_read_nc(fat_fs_t *fs, uint32_t cluster, uint8_t *rv) {
@@ -180,41 +274,15 @@ int fat_cluster_write_nc(fat_fs_t *fs, uint32_t cluster, const uint8_t *blk) {
 }
 
 int fat_cluster_mark_dirty(fat_fs_t *fs, uint32_t cluster) {
-    int i;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cluster && cache[i]->flags) {
-            cache[i]->flags |= FAT_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
-    }
-
-    return -EINVAL;
+    return fat_bcache_mark_dirty(&fs->bcache, cluster);
 }
 
 int fat_cluster_cache_wb(fat_fs_t *fs) {
-    int i, err;
-    fat_cache_t **cache = fs->bcache;
-
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & FAT_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if((err = fat_cluster_write_nc(fs, cache[i]->block,
-                                           cache[i]->data)))
-                return err;
-
-            cache[i]->flags &= ~FAT_CACHE_FLAG_DIRTY;
-        }
-    }
-
-    return 0;
+    return fat_bcache_wb(fs, &fs->bcache);
 }
 
 static inline uint32_t ilog2(uint32_t i) {
@@ -264,8 +332,7 @@ fat_fs_t *fat_fs_init(kos_blockdev_t *bd, uint32_t flags) {
 fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
                          int fcache_sz) {
     fat_fs_t *rv;
-    int j;
-    int block_size, cluster_size;
+    int cluster_size;
 
     if(bd->init(bd)) {
         return NULL;
@@ -277,6 +344,7 @@ fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
     }
 
     rv->dev = bd;
+    rv->flags = 0;
     rv->mnt_flags = flags & FAT_MNT_VALID_FLAGS_MASK;
 
     if(rv->mnt_flags != flags) {
@@ -297,85 +365,32 @@ fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
     fat_print_superblock(&rv->sb);
 #endif
 
-    block_size = rv->sb.bytes_per_sector;
     cluster_size = rv->sb.bytes_per_sector * rv->sb.sectors_per_cluster;
 
-    /* Make space for the block cache. */
-    if(!(rv->bcache = (fat_cache_t **)malloc(sizeof(fat_cache_t *) *
-                                             cache_sz))) {
+    /* Make space for the block cache and the FAT block cache. */
+    if(fat_bcache_init(&rv->bcache, cache_sz, cluster_size,
+                       &fat_cluster_read_nc, &fat_cluster_write_nc)) {
         free(rv);
         bd->shutdown(bd);
         return NULL;
     }
 
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j] = (fat_cache_t *)malloc(sizeof(fat_cache_t)))) {
-            goto out_cache;
-        }
-    }
-
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j]->data = (uint8_t *)malloc(cluster_size))) {
-            goto out_bcache;
-        }
-
-        rv->bcache[j]->flags = 0;
-    }
-
-    rv->cache_size = cache_sz;
-
-    /* Make space for the FAT block cache. */
-    if(!(rv->fcache = (fat_cache_t **)malloc(sizeof(fat_cache_t *) *
-                                             fcache_sz))) {
-        goto out_bcache;
-    }
-
-    for(j = 0; j < fcache_sz; ++j) {
-        if(!(rv->fcache[j] = (fat_cache_t *)malloc(sizeof(fat_cache_t)))) {
-            goto out_fcache;
-        }
+    if(fat_fatblock_cache_init(rv, fcache_sz)) {
+        fat_bcache_shutdown(&rv->bcache);
+        free(rv);
+        bd->shutdown(bd);
+        return NULL;
     }
 
-    for(j = 0; j < fcache_sz; ++j) {
-        if(!(rv->fcache[j]->data = (uint8_t *)malloc(block_size))) {
-            goto out_fcache2;
-        }
+    /* Set up the directory lookup cache. Like the free cluster map below, the
+       filesystem works fine without it if we run out of memory here. */
+    fat_dcache_init(rv, FAT_DCACHE_ENTRIES);
 
-        rv->fcache[j]->flags = 0;
-    }
+    /* The free cluster map gets built as clusters are allocated, so there's
+       nothing to read in for it yet. */
+    fat_free_map_init(rv);
 
-    rv->fcache_size = fcache_sz;
     return rv;
-
-out_fcache2:
-    for(; j >= 0; --j) {
-        free(rv->fcache[j]->data);
-    }
-
-    j = fcache_sz - 1;
-
-out_fcache:
-    for(; j >= 0; --j) {
-        free(rv->fcache[j]);
-    }
-
-    free(rv->fcache);
-
-out_bcache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]->data);
-    }
-
-    j = cache_sz - 1;
-out_cache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]);
-    }
-
-    free(rv->bcache);
-    free(rv);
-    bd->shutdown(bd);
-    return NULL;
 }
 
 int fat_fs_sync(fat_fs_t *fs) {
@@ -414,23 +429,13 @@ int fat_fs_sync(fat_fs_t *fs) {
 }
 
 void fat_fs_shutdown(fat_fs_t *fs) {
-    int i;
-
     /* Sync the filesystem back to the block device, if needed. */
     fat_fs_sync(fs);
 
-    for(i = 0; i < fs->cache_size; ++i) {
-        free(fs->bcache[i]->data);
-        free(fs->bcache[i]);
-    }
-
-    free(fs->bcache);
-
-    for(i = 0; i < fs->fcache_size; ++i) {
-        free(fs->fcache[i]->data);
-        free(fs->fcache[i]);
-    }
-
+    fat_bcache_shutdown(&fs->bcache);
+    fat_bcache_shutdown(&fs->fcache);
+    fat_free_map_shutdown(fs);
+    fat_dcache_shutdown(fs);
     fs->dev->shutdown(fs->dev);
     free(fs);
 }
@@ -48,6 +48,15 @@ __BEGIN_DECLS
 */
 #define FAT_FCACHE_BLOCKS       8
 
+/* Number of entries in the directory lookup cache of each mounted filesystem.
+   Each entry remembers the result of looking up one path component in one
+   directory (including if it wasn't there), so that opening the same files
+   over and over again doesn't mean reading through (and decoding the long
+   names in) every directory along the way each time. Each entry takes up a bit
+   over 100 bytes. Set this to 0 to disable the cache entirely.
+*/
+#define FAT_DCACHE_ENTRIES      64
+
 /* End tunable filesystem parameters. */
 
 /* Convenience stuff, for in case you want to use this outside of KOS. */
@@ -121,6 +130,7 @@ uint32_t fat_read_fat(fat_fs_t *fs, uint32_t cl, int *err);
 int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val);
 int fat_is_eof(fat_fs_t *fs, uint32_t cl);
 uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err);
+uint32_t fat_allocate_cluster_near(fat_fs_t *fs, uint32_t cl, int *err);
 int fat_erase_chain(fat_fs_t *fs, uint32_t cluster);
 
 __END_DECLS
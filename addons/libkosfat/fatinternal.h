@@ -9,8 +9,10 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/queue.h>
 
 #include "bpb.h"
+#include "directory.h"
 
 #define FAT_CACHE_FLAG_VALID    1
 #define FAT_CACHE_FLAG_DIRTY    2
@@ -19,17 +21,85 @@ typedef struct fat_cache {
     uint32_t flags;
     uint32_t block;
     uint8_t *data;
+
+    /* Hash table entry -- only valid while FAT_CACHE_FLAG_VALID is set. */
+    LIST_ENTRY(fat_cache) hentry;
+
+    /* LRU queue entry. Every cache block is always on the queue, with the least
+       recently used (or invalid) blocks at the head. */
+    TAILQ_ENTRY(fat_cache) qentry;
+
+    /* Dirty list entry -- only valid while FAT_CACHE_FLAG_DIRTY is set. */
+    TAILQ_ENTRY(fat_cache) dentry;
 } fat_cache_t;
 
+LIST_HEAD(fat_cache_list, fat_cache);
+TAILQ_HEAD(fat_cache_queue, fat_cache);
+
+/* Functions used to move a cache block to and from the block device. */
+typedef int (*fat_cache_rd_t)(fat_fs_t *fs, uint32_t block, uint8_t *data);
+typedef int (*fat_cache_wr_t)(fat_fs_t *fs, uint32_t block,
+                              const uint8_t *data);
+
+/* A block cache. The same code is used for both the cluster cache and the FAT
+   block cache, just with different block sizes and write-back functions. */
+typedef struct fat_bcache {
+    fat_cache_t *blocks;
+    int size;
+
+    struct fat_cache_list *hash;
+    uint32_t hash_mask;
+    struct fat_cache_queue lru;
+    struct fat_cache_queue dirty;
+
+    /* Scratch space for sorting the dirty blocks on write-back. */
+    fat_cache_t **sort;
+
+    fat_cache_rd_t read_nc;
+    fat_cache_wr_t write_nc;
+} fat_bcache_t;
+
+/* Longest path component (in bytes, including the NUL terminator) that the
+   directory lookup cache will remember. */
+#define FAT_DCACHE_NAME_LEN     48
+
+/* An entry in the directory lookup cache. */
+typedef struct fat_dcache_ent {
+    uint32_t parent;                /* First cluster of the directory */
+    uint32_t hash;
+    int err;                        /* 0 if found, -ENOENT if not */
+    fat_dentry_t dent;
+    uint32_t cl, off, lcl, loff;    /* Where dent (and its long name) live */
+    char name[FAT_DCACHE_NAME_LEN]; /* Case-folded name, empty if unused */
+
+    LIST_ENTRY(fat_dcache_ent) hentry;
+    TAILQ_ENTRY(fat_dcache_ent) qentry;
+} fat_dcache_ent_t;
+
+LIST_HEAD(fat_dcache_list, fat_dcache_ent);
+TAILQ_HEAD(fat_dcache_queue, fat_dcache_ent);
+
 struct fatfs_struct {
     kos_blockdev_t *dev;
     fat_superblock_t sb;
 
-    fat_cache_t **bcache;
-    int cache_size;
+    fat_bcache_t bcache;
+    fat_bcache_t fcache;
 
-    fat_cache_t **fcache;
-    int fcache_size;
+    /* One bit per cluster, set if the cluster is free. Built a piece at a
+       time as clusters are allocated, and kept up to date by fat_write_fat().
+       Only clusters below free_map_next are in it so far; until it covers
+       all of them, allocation searches the FAT itself. NULL if it hasn't been
+       started, or if we had to give up on it. */
+    uint32_t *free_map;
+    uint32_t free_map_next;
+
+    /* Directory lookup cache. dcache is NULL if it is disabled. Every entry
+       is always on the LRU queue, with unused ones at the head. */
+    fat_dcache_ent_t *dcache;
+    struct fat_dcache_list *dcache_hash;
+    uint32_t dcache_hash_mask;
+    struct fat_dcache_queue dcache_lru;
 
     uint32_t flags;
     uint32_t mnt_flags;
@@ -38,6 +108,30 @@ struct fatfs_struct {
 /* The BPB/FSinfo blocks need to be written back to the block device... */
 #define FAT_FS_FLAG_SB_DIRTY   1
 
+/* The free cluster map couldn't be built, so don't try again. */
+#define FAT_FS_FLAG_NO_FREE_MAP 2
+
+/* Block cache handling (in fatfs.c). */
+int fat_bcache_init(fat_bcache_t *c, int count, uint32_t block_size,
+                    fat_cache_rd_t read_nc, fat_cache_wr_t write_nc);
+void fat_bcache_shutdown(fat_bcache_t *c);
+fat_cache_t *fat_bcache_find(fat_bcache_t *c, uint32_t block);
+fat_cache_t *fat_bcache_get(fat_fs_t *fs, fat_bcache_t *c, uint32_t block,
+                            int read, int *err);
+int fat_bcache_mark_dirty(fat_bcache_t *c, uint32_t block);
+int fat_bcache_wb(fat_fs_t *fs, fat_bcache_t *c);
+
+/* Set up the FAT block cache (in fat.c). */
+int fat_fatblock_cache_init(fat_fs_t *fs, int count);
+
+/* Set up and tear down the directory lookup cache (in directory.c). */
+int fat_dcache_init(fat_fs_t *fs, int count);
+void fat_dcache_shutdown(fat_fs_t *fs);
+
+/* Set up and tear down the free cluster map (in fat.c). */
+void fat_free_map_init(fat_fs_t *fs);
+void fat_free_map_shutdown(fat_fs_t *fs);
+
 #ifdef FAT_NOT_IN_KOS
 #include <stdio.h>
 #define DBG_DEBUG 0
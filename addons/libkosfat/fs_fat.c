@@ -47,6 +47,13 @@ LIST_HEAD(fat_list, fs_fat_fs);
 static struct fat_list fat_fses;
 static mutex_t fat_mutex;
 
+/* A run of a file's clusters that are stored one after another on the disk. */
+typedef struct fat_extent {
+    uint32_t order;         /* Position of the first cluster in the file */
+    uint32_t cluster;       /* First cluster on the disk */
+    uint32_t count;         /* Number of clusters */
+} fat_extent_t;
+
 static struct {
     int opened;
     fat_dentry_t dentry;
@@ -60,6 +67,14 @@ static struct {
     uint32_t ptr;
     dirent_t dent;
     fs_fat_fs_t *fs;
+
+    /* Map of the first extent_mapped clusters of the file's chain, built as
+       the chain gets walked, so that seeking back over that part of the file
+       doesn't need to read the FAT again. */
+    fat_extent_t *extents;
+    int extent_count;
+    int extent_max;
+    uint32_t extent_mapped;
 } fh[MAX_FAT_FILES];
 
 static uint16_t longname_buf[256];
@@ -137,23 +152,116 @@ static int fat_create_entry(fat_fs_t *fs, const char *fn, uint8_t attr,
     return 0;
 }
 
+static void extent_clear(int fd) {
+    free(fh[fd].extents);
+    fh[fd].extents = NULL;
+    fh[fd].extent_count = fh[fd].extent_max = 0;
+    fh[fd].extent_mapped = 0;
+}
+
+/* Note that cluster number order of the file lives at cl on the disk. The map
+   only ever grows at its end, so anything else is ignored. Running out of
+   memory isn't fatal, it just means the map stops growing. */
+static void extent_add(int fd, uint32_t order, uint32_t cl) {
+    fat_extent_t *ext;
+    int cnt = fh[fd].extent_count, max;
+
+    if(order != fh[fd].extent_mapped || cl < 2)
+        return;
+
+    if(cnt) {
+        ext = &fh[fd].extents[cnt - 1];
+
+        if(ext->cluster + ext->count == cl) {
+            ++ext->count;
+            ++fh[fd].extent_mapped;
+            return;
+        }
+    }
+
+    if(cnt == fh[fd].extent_max) {
+        max = cnt ? cnt << 1 : 8;
+
+        if(!(ext = (fat_extent_t *)realloc(fh[fd].extents,
+                                           max * sizeof(fat_extent_t))))
+            return;
+
+        fh[fd].extents = ext;
+        fh[fd].extent_max = max;
+    }
+
+    ext = &fh[fd].extents[cnt];
+    ext->order = order;
+    ext->cluster = cl;
+    ext->count = 1;
+    ++fh[fd].extent_count;
+    ++fh[fd].extent_mapped;
+}
+
+/* Look up a cluster in the map. The caller must make sure that order is less
+   than extent_mapped. */
+static uint32_t extent_lookup(int fd, uint32_t order) {
+    int lo = 0, hi = fh[fd].extent_count - 1, mid;
+    const fat_extent_t *ext = fh[fd].extents;
+
+    while(lo < hi) {
+        mid = (lo + hi + 1) >> 1;
+
+        if(ext[mid].order <= order)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return ext[lo].cluster + (order - ext[lo].order);
+}
+
+/* Throw away the maps of any handles open on a file whose chain has been cut
+   short, and make them look their position up again. */
+static void extent_invalidate(fs_fat_fs_t *mnt, uint32_t dcl, uint32_t doff) {
+    int i;
+
+    for(i = 0; i < MAX_FAT_FILES; ++i) {
+        if(fh[i].opened && fh[i].fs == mnt && fh[i].dentry_cluster == dcl &&
+           fh[i].dentry_offset == doff) {
+            extent_clear(i);
+            fh[i].cluster = fh[i].dentry.cluster_low |
+                (fh[i].dentry.cluster_high << 16);
+            fh[i].cluster_order = 0;
+            fh[i].mode |= 0x80000000;
+        }
+    }
+}
+
 static int advance_cluster(fat_fs_t *fs, int fd, uint32_t order, int write) {
     uint32_t clo, cl, cl2;
     int err;
 
-    cl = fh[fd].cluster;
-    clo = fh[fd].cluster_order;
+    /* If we've been over this part of the file before, we already know where
+       the cluster is. */
+    if(order < fh[fd].extent_mapped) {
+        fh[fd].cluster = extent_lookup(fd, order);
+        fh[fd].cluster_order = order;
+        fh[fd].mode &= ~0x80000000;
+        return 0;
+    }
 
-    /* Are we moving forward or backward? */
-    if(clo > order) {
-        /* If moving backward, we have to start from the beginning of the file
-           and advance forward. */
+    /* Otherwise, pick up the chain where the map ends (or at the start of the
+       file), and map it as we go. Since the map only covers clusters that were
+       in the chain already, appending to the file never invalidates it. */
+    if(fh[fd].extent_mapped) {
+        clo = fh[fd].extent_mapped - 1;
+        cl = extent_lookup(fd, clo);
+    }
+    else {
         clo = 0;
         cl = fh[fd].dentry.cluster_low | (fh[fd].dentry.cluster_high << 16);
-        fh[fd].cluster = cl;
-        fh[fd].cluster_order = clo;
+        extent_add(fd, 0, cl);
     }
 
+    fh[fd].cluster = cl;
+    fh[fd].cluster_order = clo;
+
     /* At this point, we're definitely moving forward, if at all... */
     while(clo < order) {
         /* Read the FAT for the current cluster to see where we're going
@@ -174,7 +282,7 @@ static int advance_cluster(fat_fs_t *fs, int fd, uint32_t order, int write) {
             }
             else {
                 /* Allocate a new cluster */
-                cl2 = fat_allocate_cluster(fs, &err);
+                cl2 = fat_allocate_cluster_near(fs, cl, &err);
 
                 if(cl2 == FAT_INVALID_CLUSTER) {
                     return -err;
@@ -196,6 +304,7 @@ static int advance_cluster(fat_fs_t *fs, int fd, uint32_t order, int write) {
 
         cl = cl2;
         ++clo;
+        extent_add(fd, clo, cl);
     }
 
     fh[fd].cluster = cl;
@@ -324,6 +433,9 @@ static void *fs_fat_open(vfs_handler_t *vfs, const char *fn, int mode) {
         fat_cluster_clear(mnt->fs, cl, &rv);
         fh[fd].dentry.size = 0;
 
+        /* Anyone else with the file open can't trust their maps anymore. */
+        extent_invalidate(mnt, fh[fd].dentry_cluster, fh[fd].dentry_offset);
+
         if((rv = fat_update_dentry(mnt->fs, &fh[fd].dentry,
                                    fh[fd].dentry_cluster,
                                    fh[fd].dentry_offset)) < 0) {
@@ -341,6 +453,9 @@ created:
     fh[fd].cluster = fh[fd].dentry.cluster_low |
         (fh[fd].dentry.cluster_high << 16);
     fh[fd].cluster_order = 0;
+    fh[fd].extents = NULL;
+    fh[fd].extent_count = fh[fd].extent_max = 0;
+    fh[fd].extent_mapped = 0;
     fh[fd].opened = 1;
 
     mutex_unlock(&fat_mutex);
@@ -354,6 +469,7 @@ static int fs_fat_close(void *h) {
     mutex_lock(&fat_mutex);
 
     if(fd < MAX_FAT_FILES && fh[fd].opened) {
+        extent_clear(fd);
         fh[fd].opened = 0;
         fh[fd].dentry_offset = fh[fd].dentry_cluster = 0;
         fh[fd].dentry_lcl = fh[fd].dentry_loff = 0;
@@ -367,49 +483,62 @@ static int fs_fat_close(void *h) {
     return rv;
 }
 
-static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
-    file_t fd = ((file_t)h) - 1;
-    fat_fs_t *fs;
-    uint32_t bs, bo;
-    uint8_t *block;
-    uint8_t *bbuf = (uint8_t *)buf;
-    ssize_t rv;
-    uint64_t sz, cl;
+/* Check that fd is an open file that can be read from (or written to, if
+   write is non-zero). Call with fat_mutex held. */
+static int int_check_fd(file_t fd, int write) {
     int mode;
 
-    mutex_lock(&fat_mutex);
-
     /* Check that the fd is valid */
     if(fd >= MAX_FAT_FILES || !fh[fd].opened) {
-        mutex_unlock(&fat_mutex);
         errno = EBADF;
         return -1;
     }
 
-    fs = fh[fd].fs->fs;
-
-    /* Make sure the fd is open for reading */
     mode = fh[fd].mode & O_MODE_MASK;
-    if(mode != O_RDONLY && mode != O_RDWR) {
-        mutex_unlock(&fat_mutex);
-        errno = EBADF;
-        return -1;
+
+    if(write) {
+        /* Make sure the fd is open for writing */
+        if(mode != O_WRONLY && mode != O_RDWR) {
+            errno = EBADF;
+            return -1;
+        }
     }
+    else {
+        /* Make sure the fd is open for reading */
+        if(mode != O_RDONLY && mode != O_RDWR) {
+            errno = EBADF;
+            return -1;
+        }
 
-    /* Make sure we're not trying to read a directory with read */
-    if(fh[fd].mode & O_DIR) {
-        mutex_unlock(&fat_mutex);
-        errno = EISDIR;
-        return -1;
+        /* Make sure we're not trying to read a directory with read */
+        if(fh[fd].mode & O_DIR) {
+            errno = EISDIR;
+            return -1;
+        }
     }
 
+    return 0;
+}
+
+/* Read from an open file at its file pointer. Call with fat_mutex held, after
+   checking the fd with int_check_fd(). */
+static ssize_t int_read(file_t fd, void *buf, size_t cnt) {
+    fat_fs_t *fs = fh[fd].fs->fs;
+    uint32_t bs, bo;
+    uint8_t *block;
+    uint8_t *bbuf = (uint8_t *)buf;
+    ssize_t rv;
+    uint64_t sz, cl;
+    int mode;
+
     /* Did we hit the end of the file? */
     sz = fh[fd].dentry.size;
 
-    if(fat_is_eof(fs, fh[fd].cluster) || fh[fd].ptr >= sz) {
-        mutex_unlock(&fat_mutex);
+    /* If there's been a seek, the cluster will be sorted out below; it may
+       well have been left at the end of the chain by an earlier read. */
+    if(fh[fd].ptr >= sz ||
+       (!(fh[fd].mode & 0x80000000) && fat_is_eof(fs, fh[fd].cluster)))
         return 0;
-    }
 
     /* Do we have enough left? */
     if((fh[fd].ptr + cnt) > sz)
@@ -424,11 +553,9 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
         mode = advance_cluster(fs, fd, fh[fd].ptr / bs, 0);
 
         if(mode == -EDOM) {
-            mutex_unlock(&fat_mutex);
             return 0;
         }
         else if(mode < 0) {
-            mutex_unlock(&fat_mutex);
             errno = -mode;
             return -1;
         }
@@ -437,7 +564,6 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
     /* Handle the first block specially if we are offset within it. */
     if(bo) {
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &errno))) {
-            mutex_unlock(&fat_mutex);
             return -1;
         }
 
@@ -450,11 +576,9 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
             cl = fat_read_fat(fs, fh[fd].cluster, &errno);
 
             if(cl == FAT_INVALID_CLUSTER) {
-                mutex_unlock(&fat_mutex);
                 return -1;
             }
             else if(fat_is_eof(fs, cl)) {
-                mutex_unlock(&fat_mutex);
                 errno = EIO;
                 return -1;
             }
@@ -471,7 +595,6 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
                 cl = fat_read_fat(fs, fh[fd].cluster, &errno);
 
                 if(cl == FAT_INVALID_CLUSTER) {
-                    mutex_unlock(&fat_mutex);
                     return -1;
                 }
 
@@ -486,7 +609,6 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
     /* While we still have more to read, do it. */
     while(cnt) {
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &errno))) {
-            mutex_unlock(&fat_mutex);
             return -1;
         }
 
@@ -499,11 +621,9 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
             cl = fat_read_fat(fs, fh[fd].cluster, &errno);
 
             if(cl == FAT_INVALID_CLUSTER) {
-                mutex_unlock(&fat_mutex);
                 return -1;
             }
             else if(fat_is_eof(fs, cl)) {
-                mutex_unlock(&fat_mutex);
                 errno = EIO;
                 return -1;
             }
@@ -520,7 +640,6 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
                 cl = fat_read_fat(fs, fh[fd].cluster, &errno);
 
                 if(cl == FAT_INVALID_CLUSTER) {
-                    mutex_unlock(&fat_mutex);
                     return -1;
                 }
 
@@ -532,41 +651,21 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
         }
     }
 
-    /* We're done, clean up and return. */
-    mutex_unlock(&fat_mutex);
     return rv;
 }
 
-static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
-    file_t fd = ((file_t)h) - 1;
+/* Write to an open file at its file pointer. Call with fat_mutex held, after
+   checking the fd with int_check_fd(). */
+static ssize_t int_write(file_t fd, const void *buf, size_t cnt) {
     fat_fs_t *fs;
     uint32_t bs, bo;
     uint8_t *block;
     uint8_t *bbuf = (uint8_t *)buf;
     ssize_t rv;
-    int mode, err;
-
-    mutex_lock(&fat_mutex);
-
-    /* Check that the fd is valid */
-    if(fd >= MAX_FAT_FILES || !fh[fd].opened) {
-        mutex_unlock(&fat_mutex);
-        errno = EBADF;
-        return -1;
-    }
-
-    /* Make sure the fd is open for reading */
-    mode = fh[fd].mode & O_MODE_MASK;
-    if(mode != O_WRONLY && mode != O_RDWR) {
-        mutex_unlock(&fat_mutex);
-        errno = EBADF;
-        return -1;
-    }
+    int mode = fh[fd].mode & O_MODE_MASK, err;
 
-    if(!cnt) {
-        mutex_unlock(&fat_mutex);
+    if(!cnt)
         return 0;
-    }
 
     fs = fh[fd].fs->fs;
     bs = fat_cluster_size(fs);
@@ -577,7 +676,6 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
        a cluster boundary)? */
     if((fh[fd].mode & 0x80000000)) {
         if((err = advance_cluster(fs, fd, fh[fd].ptr / bs, 1)) < 0) {
-            mutex_unlock(&fat_mutex);
             errno = -err;
             return -1;
         }
@@ -586,7 +684,6 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
     /* Are we starting our write in the middle of a block? */
     if(bo) {
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &err))) {
-            mutex_unlock(&fat_mutex);
             errno = err;
             return -1;
         }
@@ -602,7 +699,6 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
 
             if((err = advance_cluster(fs, fd, fh[fd].cluster_order + 1,
                                       1)) < 0) {
-                mutex_unlock(&fat_mutex);
                 errno = -err;
                 return -1;
             }
@@ -624,7 +720,6 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
     /* While we still have more to write, do it. */
     while(cnt) {
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &err))) {
-            mutex_unlock(&fat_mutex);
             errno = err;
             return -1;
         }
@@ -639,7 +734,6 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
 
             if((err = advance_cluster(fs, fd, fh[fd].cluster_order + 1,
                                       1)) < 0) {
-                mutex_unlock(&fat_mutex);
                 errno = -err;
                 return -1;
             }
@@ -674,7 +768,145 @@ static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
     /* Update the file's modification timestamp. */
     fat_update_mtime(&fh[fd].dentry);
 
-    /* We're done, clean up and return. */
+    return rv;
+}
+
+
+static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1;
+
+    mutex_lock(&fat_mutex);
+
+    if(!int_check_fd(fd, 0))
+        rv = int_read(fd, buf, cnt);
+
+    mutex_unlock(&fat_mutex);
+    return rv;
+}
+
+static ssize_t fs_fat_write(void *h, const void *buf, size_t cnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1;
+
+    mutex_lock(&fat_mutex);
+
+    if(!int_check_fd(fd, 1))
+        rv = int_write(fd, buf, cnt);
+
+    mutex_unlock(&fat_mutex);
+    return rv;
+}
+
+/* Do a read or write at the given offset, without disturbing the file
+   pointer. The position in the cluster chain is saved and restored along with
+   the pointer itself, and the extent map keeps the jump there and back from
+   having to walk the FAT again. Call with fat_mutex held. */
+static ssize_t int_pio(file_t fd, void *buf, size_t cnt, _off64_t offset,
+                       int write) {
+    uint32_t ptr, cl, order, seeked;
+    ssize_t rv;
+    int err;
+
+    if(int_check_fd(fd, write))
+        return -1;
+
+    if(offset < 0 || offset > 0xFFFFFFFFLL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ptr = fh[fd].ptr;
+    cl = fh[fd].cluster;
+    order = fh[fd].cluster_order;
+    seeked = fh[fd].mode & 0x80000000;
+
+    fh[fd].ptr = (uint32_t)offset;
+    fh[fd].mode |= 0x80000000;
+
+    if(write)
+        rv = int_write(fd, buf, cnt);
+    else
+        rv = int_read(fd, buf, cnt);
+
+    err = errno;
+    fh[fd].ptr = ptr;
+    fh[fd].cluster = cl;
+    fh[fd].cluster_order = order;
+    fh[fd].mode = (fh[fd].mode & ~0x80000000) | seeked;
+    errno = err;
+
+    return rv;
+}
+
+static ssize_t fs_fat_pread(void *h, void *buf, size_t cnt, _off64_t offset) {
+    ssize_t rv;
+
+    mutex_lock(&fat_mutex);
+    rv = int_pio(((file_t)h) - 1, buf, cnt, offset, 0);
+    mutex_unlock(&fat_mutex);
+
+    return rv;
+}
+
+static ssize_t fs_fat_pwrite(void *h, const void *buf, size_t cnt,
+                             _off64_t offset) {
+    ssize_t rv;
+
+    mutex_lock(&fat_mutex);
+    rv = int_pio(((file_t)h) - 1, (void *)buf, cnt, offset, 1);
+    mutex_unlock(&fat_mutex);
+
+    return rv;
+}
+
+static ssize_t fs_fat_readv(void *h, const struct iovec *iov, int iovcnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1, n;
+    int i;
+
+    mutex_lock(&fat_mutex);
+
+    if(!int_check_fd(fd, 0)) {
+        for(i = 0, rv = 0; i < iovcnt; ++i) {
+            if((n = int_read(fd, iov[i].iov_base, iov[i].iov_len)) < 0) {
+                if(!rv)
+                    rv = -1;
+
+                break;
+            }
+
+            rv += n;
+
+            if((size_t)n < iov[i].iov_len)
+                break;
+        }
+    }
+
+    mutex_unlock(&fat_mutex);
+    return rv;
+}
+
+static ssize_t fs_fat_writev(void *h, const struct iovec *iov, int iovcnt) {
+    file_t fd = ((file_t)h) - 1;
+    ssize_t rv = -1, n;
+    int i;
+
+    mutex_lock(&fat_mutex);
+
+    if(!int_check_fd(fd, 1)) {
+        for(i = 0, rv = 0; i < iovcnt; ++i) {
+            if((n = int_write(fd, iov[i].iov_base, iov[i].iov_len)) < 0) {
+                if(!rv)
+                    rv = -1;
+
+                break;
+            }
+
+            rv += n;
+        }
+    }
+
     mutex_unlock(&fat_mutex);
     return rv;
 }
@@ -1334,7 +1566,11 @@ static vfs_handler_t vh = {
     fs_fat_total64,             /* total64 */
     NULL,                       /* readlink */
     fs_fat_rewinddir,           /* rewinddir */
-    fs_fat_fstat                /* fstat */
+    fs_fat_fstat,               /* fstat */
+    fs_fat_pread,               /* pread */
+    fs_fat_pwrite,              /* pwrite */
+    fs_fat_readv,               /* readv */
+    fs_fat_writev               /* writev */
 };
 
 static int initted = 0;
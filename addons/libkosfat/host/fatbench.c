@@ -0,0 +1,554 @@
+/* KallistiOS ##version##
+
+   fatbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+/* Benchmarks for libkosfat, run on a host machine against an image file.
+
+   The image is formatted as a fresh FAT32 volume, then the following are
+   timed in turn, each with the number of block device operations it took:
+
+   - writing one big file a cluster at a time,
+   - reading it back (after remounting, so the caches start out cold),
+   - reading single clusters at random offsets in it, walking the FAT chain
+     from the start of the file each time like a seek would,
+   - creating a deep tree of directories with files in each, and looking
+     up every one of those files by its full path (again, cold),
+   - filling the volume up one cluster at a time, freeing every other one,
+     and then allocating clusters with fat_allocate_cluster() on the
+     resulting fragmented volume.
+
+   Build it with "make -f Makefile.nonkos fatbench". */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../fatfs.h"
+#include "../directory.h"
+#include "fileblk.h"
+
+#define SECTOR_SIZE     512
+#define RESERVED        32
+#define NUM_FATS        2
+#define ROOT_CLUSTER    2
+
+static kos_blockdev_t dev;
+static fat_fs_t *fs;
+
+static struct timespec t_start;
+static fileblk_stats_t st_start;
+
+/* Little endian helpers for building the boot sector. */
+static void put16(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static int write_sector(int fd, uint32_t s, const uint8_t *buf) {
+    return pwrite(fd, buf, SECTOR_SIZE, (off_t)s * SECTOR_SIZE) == SECTOR_SIZE ?
+        0 : -1;
+}
+
+/* Create a blank FAT32 volume of the given size in the image file. */
+static int format(const char *fn, uint32_t size_mb, uint32_t spc) {
+    uint8_t boot[SECTOR_SIZE], info[SECTOR_SIZE], fat[SECTOR_SIZE];
+    uint32_t total = size_mb * 2048, fatsz, clusters, i;
+    int fd;
+
+    /* The usual formula for the FAT size, from Microsoft's FAT spec. */
+    fatsz = (total - RESERVED + (256 * spc + NUM_FATS) / 2 - 1) /
+        ((256 * spc + NUM_FATS) / 2);
+    clusters = (total - RESERVED - NUM_FATS * fatsz) / spc;
+
+    if(clusters <= 65524) {
+        fprintf(stderr, "Volume too small for FAT32 with %u sectors per "
+                "cluster\n", (unsigned)spc);
+        return -1;
+    }
+
+    if((fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ||
+       ftruncate(fd, (off_t)total * SECTOR_SIZE) < 0) {
+        perror(fn);
+        return -1;
+    }
+
+    memset(boot, 0, sizeof(boot));
+    boot[0] = 0xEB;
+    boot[1] = 0x58;
+    boot[2] = 0x90;
+    memcpy(boot + 3, "KOSFATBN", 8);
+    put16(boot + 11, SECTOR_SIZE);
+    boot[13] = (uint8_t)spc;
+    put16(boot + 14, RESERVED);
+    boot[16] = NUM_FATS;
+    boot[21] = 0xF8;
+    put16(boot + 24, 32);
+    put16(boot + 26, 64);
+    put32(boot + 32, total);
+    put32(boot + 36, fatsz);
+    put32(boot + 44, ROOT_CLUSTER);
+    put16(boot + 48, 1);
+    put16(boot + 50, 6);
+    boot[64] = 0x80;
+    boot[66] = 0x29;
+    put32(boot + 67, 0x4B4F5346);
+    memcpy(boot + 71, "FATBENCH   ", 11);
+    memcpy(boot + 82, "FAT32   ", 8);
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+
+    memset(info, 0, sizeof(info));
+    put32(info, 0x41615252);
+    put32(info + 484, 0x61417272);
+    put32(info + 488, clusters - 1);
+    put32(info + 492, ROOT_CLUSTER);
+    put32(info + 508, 0xAA550000);
+
+    /* Reserved clusters, plus the end of the root directory's chain. */
+    memset(fat, 0, sizeof(fat));
+    put32(fat, 0x0FFFFFF8);
+    put32(fat + 4, 0x0FFFFFFF);
+    put32(fat + 8, 0x0FFFFFFF);
+
+    if(write_sector(fd, 0, boot) || write_sector(fd, 1, info) ||
+       write_sector(fd, 6, boot) || write_sector(fd, 7, info)) {
+        perror(fn);
+        close(fd);
+        return -1;
+    }
+
+    for(i = 0; i < NUM_FATS; ++i) {
+        if(write_sector(fd, RESERVED + i * fatsz, fat)) {
+            perror(fn);
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+
+    printf("Formatted %s: %u MB, %u byte clusters, %u clusters\n", fn,
+           (unsigned)size_mb, (unsigned)(spc * SECTOR_SIZE),
+           (unsigned)clusters);
+    return 0;
+}
+
+static int mount(const char *fn) {
+    if(fileblk_create(&dev, fn)) {
+        perror(fn);
+        return -1;
+    }
+
+    if(!(fs = fat_fs_init(&dev, FAT_MNT_FLAG_RW))) {
+        fprintf(stderr, "Cannot mount %s\n", fn);
+        fileblk_destroy(&dev);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void unmount(void) {
+    fat_fs_shutdown(fs);
+    fileblk_destroy(&dev);
+}
+
+static int remount(const char *fn) {
+    unmount();
+    return mount(fn);
+}
+
+static void bench_start(void) {
+    fileblk_stats(&dev, &st_start, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print the time taken since bench_start(), how many things were done per
+   second (and MB/s, if bytes is non-zero), and the device operations. */
+static void bench_end(const char *name, uint32_t ops, uint64_t bytes) {
+    struct timespec t;
+    fileblk_stats_t st;
+    double ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    fileblk_stats(&dev, &st, 1);
+
+    ms = (t.tv_sec - t_start.tv_sec) * 1000.0 +
+        (t.tv_nsec - t_start.tv_nsec) / 1000000.0;
+
+    printf("%-24s %10.2f ms %12.0f ops/s", name, ms,
+           ms > 0 ? ops * 1000.0 / ms : 0.0);
+
+    if(bytes)
+        printf(" %9.2f MB/s", ms > 0 ? bytes / ms / 1000.0 : 0.0);
+    else
+        printf("%15s", "");
+
+    printf("  reads %llu (%llu blocks) writes %llu (%llu blocks)\n",
+           (unsigned long long)st.reads, (unsigned long long)st.read_blocks,
+           (unsigned long long)st.writes, (unsigned long long)st.write_blocks);
+}
+
+static void root_dentry(fat_dentry_t *ent) {
+    uint32_t cl, off, lcl, loff;
+
+    fat_find_dentry(fs, "/", ent, &cl, &off, &lcl, &loff);
+}
+
+static uint32_t dentry_cluster(const fat_dentry_t *ent) {
+    return ent->cluster_low | ((uint32_t)ent->cluster_high << 16);
+}
+
+/* Create a directory in the given parent, filling in rv with its dentry. This
+   does the same as mkdir() in fs_fat. */
+static int make_dir(fat_dentry_t *parent, const char *name, fat_dentry_t *rv) {
+    uint32_t cl, dcl, off, lcl, loff, pcl = dentry_cluster(parent);
+    uint8_t *buf;
+    int err;
+
+    if((cl = fat_allocate_cluster(fs, &err)) == FAT_INVALID_CLUSTER)
+        return -err;
+
+    if(!fat_cluster_clear(fs, cl, &err))
+        return -err;
+
+    if((err = fat_add_dentry(fs, name, parent, FAT_ATTR_DIRECTORY, cl, &dcl,
+                             &off, &lcl, &loff)) < 0)
+        return err;
+
+    /* Adding the dentry may have pushed the new cluster out of the cache, so
+       get it again before putting in "." and "..". */
+    if(!(buf = fat_cluster_read(fs, cl, &err)))
+        return -err;
+
+    if(pcl == ROOT_CLUSTER)
+        pcl = 0;
+
+    fat_add_raw_dentry((fat_dentry_t *)buf, ".          ", FAT_ATTR_DIRECTORY,
+                       cl);
+    fat_add_raw_dentry((fat_dentry_t *)(buf + sizeof(fat_dentry_t)),
+                       "..         ", FAT_ATTR_DIRECTORY, pcl);
+    fat_cluster_mark_dirty(fs, cl);
+
+    memset(rv, 0, sizeof(fat_dentry_t));
+    rv->attr = FAT_ATTR_DIRECTORY;
+    rv->cluster_low = (uint16_t)cl;
+    rv->cluster_high = (uint16_t)(cl >> 16);
+
+    return 0;
+}
+
+static void fill_pattern(uint8_t *buf, uint32_t len, uint32_t n) {
+    uint32_t i;
+
+    for(i = 0; i < len; i += 4)
+        put32(buf + i, n * 0x9E3779B9 + i);
+}
+
+/* Write a file of the given number of clusters to the root directory, and
+   return its first cluster. */
+static uint32_t bench_seq_write(uint32_t count) {
+    fat_dentry_t root, ent;
+    uint32_t first, cl, prev, i, dcl, off, lcl, loff, cs = fat_cluster_size(fs);
+    uint8_t *buf;
+    int err;
+
+    root_dentry(&root);
+    bench_start();
+
+    if((first = fat_allocate_cluster(fs, &err)) == FAT_INVALID_CLUSTER)
+        goto fail;
+
+    for(i = 0, cl = first; i < count; ++i) {
+        if(i) {
+            prev = cl;
+
+            if((cl = fat_allocate_cluster_near(fs, prev, &err)) ==
+               FAT_INVALID_CLUSTER || (err = -fat_write_fat(fs, prev, cl)))
+                goto fail;
+        }
+
+        if(!(buf = fat_cluster_clear(fs, cl, &err)))
+            goto fail;
+
+        fill_pattern(buf, cs, i);
+    }
+
+    if((err = -fat_add_dentry(fs, "sequential.bin", &root, FAT_ATTR_ARCHIVE,
+                              first, &dcl, &off, &lcl, &loff)))
+        goto fail;
+
+    if((err = -fat_get_dentry(fs, dcl, off, &ent)))
+        goto fail;
+
+    ent.size = count * cs;
+
+    if((err = -fat_update_dentry(fs, &ent, dcl, off)) ||
+       (err = -fat_fs_sync(fs)))
+        goto fail;
+
+    bench_end("sequential write", count, (uint64_t)count * cs);
+    return first;
+
+fail:
+    fprintf(stderr, "sequential write: %s\n", strerror(err));
+    return FAT_INVALID_CLUSTER;
+}
+
+static int bench_seq_read(uint32_t first, uint32_t count) {
+    uint8_t *buf, *exp;
+    uint32_t cl = first, i, cs = fat_cluster_size(fs), bad = 0;
+    int err = 0;
+
+    if(!(exp = (uint8_t *)malloc(cs)))
+        return -1;
+
+    bench_start();
+
+    for(i = 0; i < count; ++i) {
+        if(!(buf = fat_cluster_read(fs, cl, &err)))
+            break;
+
+        fill_pattern(exp, cs, i);
+
+        if(memcmp(buf, exp, cs))
+            ++bad;
+
+        if(i + 1 < count &&
+           (cl = fat_read_fat(fs, cl, &err)) == FAT_INVALID_CLUSTER)
+            break;
+    }
+
+    bench_end("sequential read", count, (uint64_t)count * cs);
+    free(exp);
+
+    if(i < count || bad) {
+        fprintf(stderr, "sequential read: %u of %u clusters bad (%s)\n",
+                (unsigned)(bad + count - i), (unsigned)count, strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int bench_random_seek(uint32_t first, uint32_t count, uint32_t seeks) {
+    uint8_t *buf;
+    uint32_t i, j, n, cl = first, bad = 0;
+    int err = 0;
+
+    bench_start();
+
+    for(i = 0; i < seeks; ++i) {
+        n = (uint32_t)rand() % count;
+
+        for(j = 0, cl = first; j < n; ++j) {
+            if((cl = fat_read_fat(fs, cl, &err)) == FAT_INVALID_CLUSTER)
+                break;
+        }
+
+        if(cl == FAT_INVALID_CLUSTER || !(buf = fat_cluster_read(fs, cl, &err)))
+            break;
+
+        /* Check the first word of the cluster, to make sure we got there. */
+        if(buf[0] != (uint8_t)(n * 0x9E3779B9))
+            ++bad;
+    }
+
+    bench_end("random seek", seeks, 0);
+
+    if(i < seeks || bad) {
+        fprintf(stderr, "random seek: %u of %u seeks bad (%s)\n",
+                (unsigned)(bad + seeks - i), (unsigned)seeks, strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Create a chain of depth nested directories, each with files files in it,
+   and then look every file up by its full path, rounds times over. */
+static int bench_dirs(const char *fn, int depth, int files, int rounds) {
+    fat_dentry_t dir, sub, ent;
+    char name[64], *path;
+    size_t plen = 0;
+    uint32_t dcl, off, lcl, loff;
+    int d, f, r, err = 0, missing = 0;
+
+    if(!(path = (char *)malloc(depth * 32 + 64)))
+        return -1;
+
+    root_dentry(&dir);
+    bench_start();
+
+    for(d = 0; d < depth; ++d) {
+        for(f = 0; f < files; ++f) {
+            sprintf(name, "a file with a long name %d.dat", f);
+
+            if((err = fat_add_dentry(fs, name, &dir, FAT_ATTR_ARCHIVE, 0, &dcl,
+                                     &off, &lcl, &loff)) < 0)
+                goto fail;
+        }
+
+        sprintf(name, "Directory Level %d", d);
+
+        if((err = make_dir(&dir, name, &sub)) < 0)
+            goto fail;
+
+        dir = sub;
+    }
+
+    if((err = fat_fs_sync(fs)) < 0)
+        goto fail;
+
+    bench_end("directory create", depth * (files + 1), 0);
+
+    if(remount(fn)) {
+        free(path);
+        return -1;
+    }
+
+    bench_start();
+
+    for(r = 0; r < rounds; ++r) {
+        for(d = 0, plen = 0; d < depth; ++d) {
+            for(f = 0; f < files; ++f) {
+                sprintf(path + plen, "/a file with a long name %d.dat", f);
+
+                if(fat_find_dentry(fs, path, &ent, &dcl, &off, &lcl, &loff))
+                    ++missing;
+            }
+
+            plen += sprintf(path + plen, "/Directory Level %d", d);
+        }
+    }
+
+    bench_end("directory lookup", rounds * depth * files, 0);
+    free(path);
+
+    if(missing) {
+        fprintf(stderr, "directory lookup: %d lookups failed\n", missing);
+        return -1;
+    }
+
+    return 0;
+
+fail:
+    fprintf(stderr, "directory create: %s\n", strerror(-err));
+    free(path);
+    return -1;
+}
+
+/* Fill up the volume, free every other cluster, and time allocations on what
+   is left. */
+static int bench_alloc_frag(void) {
+    uint32_t *cls = NULL, *tmp, cnt = 0, max = 0, i, cl;
+    int err = 0;
+
+    bench_start();
+
+    while((cl = fat_allocate_cluster(fs, &err)) != FAT_INVALID_CLUSTER) {
+        if(cnt == max) {
+            max = max ? max * 2 : 4096;
+
+            if(!(tmp = (uint32_t *)realloc(cls, max * sizeof(uint32_t)))) {
+                free(cls);
+                return -1;
+            }
+
+            cls = tmp;
+        }
+
+        cls[cnt++] = cl;
+    }
+
+    bench_end("allocate (filling)", cnt, 0);
+
+    if(err != ENOSPC) {
+        fprintf(stderr, "allocate: %s\n", strerror(err));
+        free(cls);
+        return -1;
+    }
+
+    for(i = 0; i < cnt; i += 2)
+        fat_erase_chain(fs, cls[i]);
+
+    fat_fs_sync(fs);
+    bench_start();
+
+    for(i = 0; i < cnt; i += 2) {
+        if(fat_allocate_cluster(fs, &err) == FAT_INVALID_CLUSTER)
+            break;
+    }
+
+    bench_end("allocate (fragmented)", i / 2, 0);
+    free(cls);
+
+    if(i < cnt) {
+        fprintf(stderr, "allocate (fragmented): %s\n", strerror(err));
+        return -1;
+    }
+
+    return fat_fs_sync(fs) ? -1 : 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-s size_mb] [-c sectors_per_cluster] "
+            "[-f file_mb] [-n seeks] [-d depth] [-e entries] image\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t size_mb = 128, spc = 2, file_mb = 16, seeks = 2000, count, first;
+    int depth = 16, entries = 64, opt, rv = 0;
+
+    while((opt = getopt(argc, argv, "s:c:f:n:d:e:")) != -1) {
+        switch(opt) {
+            case 's': size_mb = (uint32_t)atoi(optarg); break;
+            case 'c': spc = (uint32_t)atoi(optarg); break;
+            case 'f': file_mb = (uint32_t)atoi(optarg); break;
+            case 'n': seeks = (uint32_t)atoi(optarg); break;
+            case 'd': depth = atoi(optarg); break;
+            case 'e': entries = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc - 1 || !spc || (spc & (spc - 1)) || spc > 128 ||
+       depth < 1 || entries < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    srand(1);
+
+    if(format(argv[optind], size_mb, spc) || mount(argv[optind]))
+        return 1;
+
+    count = (file_mb << 20) / fat_cluster_size(fs);
+
+    if((first = bench_seq_write(count)) == FAT_INVALID_CLUSTER ||
+       remount(argv[optind]) || bench_seq_read(first, count) ||
+       remount(argv[optind]) || bench_random_seek(first, count, seeks))
+        rv = 1;
+
+    if(!rv && bench_dirs(argv[optind], depth, entries, 4))
+        rv = 1;
+
+    if(!rv && bench_alloc_frag())
+        rv = 1;
+
+    unmount();
+    return rv;
+}
@@ -0,0 +1,135 @@
+/* KallistiOS ##version##
+
+   fileblk.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fileblk.h"
+
+#define FILEBLK_L_BLOCK_SIZE    9
+
+typedef struct fileblk_data {
+    int fd;
+    uint32_t block_count;
+    fileblk_stats_t stats;
+} fileblk_data_t;
+
+static int fileblk_init(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int fileblk_shutdown(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int fileblk_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                               void *buf) {
+    fileblk_data_t *data = (fileblk_data_t *)d->dev_data;
+    size_t len = count << FILEBLK_L_BLOCK_SIZE;
+
+    if(block + count > data->block_count) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    ++data->stats.reads;
+    data->stats.read_blocks += count;
+
+    if(pread(data->fd, buf, len, (off_t)(block << FILEBLK_L_BLOCK_SIZE)) !=
+       (ssize_t)len) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fileblk_write_blocks(kos_blockdev_t *d, uint64_t block,
+                                size_t count, const void *buf) {
+    fileblk_data_t *data = (fileblk_data_t *)d->dev_data;
+    size_t len = count << FILEBLK_L_BLOCK_SIZE;
+
+    if(block + count > data->block_count) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    ++data->stats.writes;
+    data->stats.write_blocks += count;
+
+    if(pwrite(data->fd, buf, len, (off_t)(block << FILEBLK_L_BLOCK_SIZE)) !=
+       (ssize_t)len) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint32_t fileblk_count_blocks(kos_blockdev_t *d) {
+    fileblk_data_t *data = (fileblk_data_t *)d->dev_data;
+
+    return data->block_count;
+}
+
+int fileblk_create(kos_blockdev_t *rv, const char *fn) {
+    fileblk_data_t *data;
+    struct stat st;
+    int fd;
+
+    if((fd = open(fn, O_RDWR)) < 0)
+        return -1;
+
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if(!(data = (fileblk_data_t *)calloc(1, sizeof(fileblk_data_t)))) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    data->fd = fd;
+    data->block_count = (uint32_t)(st.st_size >> FILEBLK_L_BLOCK_SIZE);
+
+    memset(rv, 0, sizeof(kos_blockdev_t));
+    rv->dev_data = data;
+    rv->l_block_size = FILEBLK_L_BLOCK_SIZE;
+    rv->init = &fileblk_init;
+    rv->shutdown = &fileblk_shutdown;
+    rv->read_blocks = &fileblk_read_blocks;
+    rv->write_blocks = &fileblk_write_blocks;
+    rv->count_blocks = &fileblk_count_blocks;
+
+    return 0;
+}
+
+void fileblk_destroy(kos_blockdev_t *d) {
+    fileblk_data_t *data = (fileblk_data_t *)d->dev_data;
+
+    close(data->fd);
+    free(data);
+    d->dev_data = NULL;
+}
+
+void fileblk_stats(kos_blockdev_t *d, fileblk_stats_t *st, int reset) {
+    fileblk_data_t *data = (fileblk_data_t *)d->dev_data;
+
+    *st = data->stats;
+
+    if(reset)
+        memset(&data->stats, 0, sizeof(fileblk_stats_t));
+}
@@ -46,6 +46,7 @@ __BEGIN_DECLS
 #include <kos/mutex.h>
 #include <kos/cond.h>
 #include <kos/genwait.h>
+#include <kos/mempool.h>
 #include <kos/library.h>
 #include <kos/net.h>
 #include <kos/nmmgr.h>
@@ -30,6 +30,7 @@ __BEGIN_DECLS
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/queue.h>
 
 /** \defgroup vfs_blockdev  Block Devices
     \brief                  VFS driver for accessing block devices
@@ -131,6 +132,171 @@ typedef struct kos_blockdev {
     int (*flush)(struct kos_blockdev *d);
 } kos_blockdev_t;
 
+/** \brief  Wrap a block device with readahead and write-behind buffering.
+
+    This function creates a new block device that sits on top of an existing
+    one. Reads from the new device are watched for sequential access, and once
+    that is seen, the following blocks are read in ahead of time by a worker
+    thread. Small writes are held on to for as long as they stay contiguous and
+    are then written out together by the worker thread in one call to the
+    underlying device's write_blocks function.
+
+    The new device takes over the one it wraps: its init and shutdown functions
+    call the ones of the underlying device, and dev should not be used on its
+    own afterwards. Any errors in writing out buffered data are reported by the
+    next call to flush (or by shutdown, which flushes the device).
+
+    \param  rv              Used to return the new block device. Must be
+                            non-NULL.
+    \param  dev             The block device to wrap. Must be non-NULL. The
+                            structure is copied, so it does not need to stay
+                            around after this call.
+    \param  ra_blocks       The number of blocks to read ahead at a time. Two
+                            buffers of this size are allocated. Pass 0 to
+                            disable readahead.
+    \param  wb_blocks       The largest number of blocks to collect before
+                            writing them out. Two buffers of this size are
+                            allocated. Pass 0 to disable write-behind.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EFAULT - rv or dev was NULL \n
+    \em     ENOMEM - out of memory
+*/
+int blockdev_ra_create(kos_blockdev_t *rv, const kos_blockdev_t *dev,
+                       size_t ra_blocks, size_t wb_blocks);
+
+/** \brief  Create a block device backed by a file.
+
+    This function creates a block device that reads and writes the contents of
+    a file on any mounted filesystem, such as a disc or disk image on an SD
+    card or in a romdisk. The file is opened by this function and closed when
+    the device is shut down. Any partial block at the end of the file is not
+    part of the device.
+
+    \param  rv              Used to return the block device. Must be non-NULL.
+    \param  fn              The file to use. Must be non-NULL.
+    \param  mode            The mode to open the file with (O_RDONLY or
+                            O_RDWR). For O_RDONLY, writing to the device
+                            fails with errno set to EROFS.
+    \param  l_block_size    Log base 2 of the block size to use.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EFAULT - rv or fn was NULL \n
+    \em     ENOMEM - out of memory \n
+    Any error from opening the file.
+*/
+int blockdev_file_create(kos_blockdev_t *rv, const char *fn, int mode,
+                         uint32_t l_block_size);
+
+/** \brief  Status of an asynchronous request that hasn't completed yet. */
+#define BLOCKDEV_REQ_PENDING    -1
+
+/** \brief  An asynchronous block device request.
+
+    This structure describes one read or write to be done in the background by
+    a request queue (see blockdev_queue_create()). The caller owns the memory
+    for the request and its buffer, and must not touch either of them from the
+    time the request is submitted until it has completed.
+
+    \headerfile kos/blockdev.h
+*/
+typedef struct kos_blockdev_req {
+    /** \brief  Queue handle. Used internally by the request queue. */
+    STAILQ_ENTRY(kos_blockdev_req) entry;
+
+    uint64_t block;         /**< \brief The first block to read or write. */
+    size_t count;           /**< \brief The number of blocks. */
+    void *buf;              /**< \brief The buffer to read into/write from. */
+    int write;              /**< \brief Non-zero for a write request. */
+
+    /** \brief  Completion callback (optional).
+
+        If not NULL, this function is called from the queue's worker thread
+        once the request has been done, before the request is marked as being
+        complete. The request no longer counts towards the queue's depth by
+        then, so the callback can submit another request to the same queue
+        (or this one again, in which case it stays pending) even if the queue
+        was full. It must not wait on any request.
+
+        \param  req         The request that was completed.
+        \param  status      0 on success, or an errno value on failure.
+    */
+    void (*callback)(struct kos_blockdev_req *req, int status);
+
+    void *data;             /**< \brief User data for the callback. */
+
+    /** \brief  Request status. BLOCKDEV_REQ_PENDING until the request has
+                completed, then 0 on success or an errno value on failure. */
+    volatile int status;
+} kos_blockdev_req_t;
+
+struct kos_blockdev_queue;
+
+/** \brief  An asynchronous request queue for a block device.
+
+    This is an opaque type. Requests submitted to the queue are done in order,
+    one at a time, by a worker thread. If the device's read_blocks and
+    write_blocks functions sleep while the hardware does its work (as is the
+    case for G1 ATA devices in DMA mode), the submitting thread is free to do
+    other things in the meantime.
+*/
+typedef struct kos_blockdev_queue kos_blockdev_queue_t;
+
+/** \brief  Create a request queue for a block device.
+
+    The block device must already have been initialized, and it stays owned by
+    the caller: destroying the queue does not shut down the device. If the
+    device is also used directly while the queue exists, its functions must be
+    safe to call from more than one thread.
+
+    \param  dev             The block device to queue requests for.
+    \param  depth           The largest number of requests that may be queued
+                            (including the one being worked on) at once.
+    \return                 The new queue on success, NULL on failure (with
+                            errno set to ENOMEM or EINVAL).
+*/
+kos_blockdev_queue_t *blockdev_queue_create(kos_blockdev_t *dev, size_t depth);
+
+/** \brief  Destroy a request queue.
+
+    This function waits for every request on the queue to complete, then frees
+    the queue.
+
+    \param  q               The queue to destroy.
+*/
+void blockdev_queue_destroy(kos_blockdev_queue_t *q);
+
+/** \brief  Submit a request to a queue.
+
+    This function adds the request to the end of the queue and returns without
+    waiting for it to be done. Use blockdev_queue_wait() or the request's
+    callback to find out when it has been.
+
+    \param  q               The queue to submit to.
+    \param  req             The request to submit.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EAGAIN - the queue is full \n
+    \em     EINVAL - the request is for zero blocks or has no buffer
+*/
+int blockdev_queue_submit(kos_blockdev_queue_t *q, kos_blockdev_req_t *req);
+
+/** \brief  Wait for a request to complete.
+
+    \param  q               The queue the request was submitted to.
+    \param  req             The request to wait on.
+    \retval 0               If the request was completed successfully.
+    \retval -1              If the request failed. errno is set to the error
+                            the request failed with.
+*/
+int blockdev_queue_wait(kos_blockdev_queue_t *q, kos_blockdev_req_t *req);
+
 /** @} */
 
 __END_DECLS
@@ -33,6 +33,7 @@ __BEGIN_DECLS
 #include <sys/queue.h>
 #include <stdarg.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <kos/nmmgr.h>
 
@@ -203,6 +204,25 @@ typedef struct vfs_handler {
 
     /** \brief Get status information on an already opened file. */
     int (*fstat)(void *hnd, struct stat *st);
+
+    /* Positional and scatter/gather I/O. These are all optional: if they are
+       not provided, fs_pread() and friends emulate them with the functions
+       above. */
+
+    /** \brief Read from a given offset in a previously opened file, without
+               moving the file pointer */
+    ssize_t (*pread)(void *hnd, void *buffer, size_t cnt, _off64_t offset);
+
+    /** \brief Write to a given offset in a previously opened file, without
+               moving the file pointer */
+    ssize_t (*pwrite)(void *hnd, const void *buffer, size_t cnt,
+                      _off64_t offset);
+
+    /** \brief Read into several buffers from a previously opened file */
+    ssize_t (*readv)(void *hnd, const struct iovec *iov, int iovcnt);
+
+    /** \brief Write from several buffers to a previously opened file */
+    ssize_t (*writev)(void *hnd, const struct iovec *iov, int iovcnt);
 } vfs_handler_t;
 
 /** \brief  The number of distinct file descriptors that can be in use at a
@@ -304,6 +324,76 @@ ssize_t fs_read(file_t hnd, void *buffer, size_t cnt);
 */
 ssize_t fs_write(file_t hnd, const void *buffer, size_t cnt);
 
+/** \brief   Read from a given offset in an opened file.
+
+    This function reads into the specified buffer from the file, starting at
+    the given offset rather than at the file pointer. The file pointer is not
+    moved, so several threads may read from the same file descriptor at once
+    without having to coordinate their seeks. This is equivalent to the
+    standard POSIX function pread().
+
+    If the filesystem does not support this directly, it is emulated by seeking
+    to the offset, reading, and seeking back. In that case, the operation is
+    not atomic with respect to any fs_read() or fs_seek() calls on the same
+    file descriptor from other threads.
+
+    \param  hnd             The file descriptor to read from.
+    \param  buffer          The buffer to read into.
+    \param  cnt             The size of the buffer (or the number of bytes
+                            requested).
+    \param  offset          The offset in the file to read from.
+
+    \return                 The number of bytes read, or -1 on error. Note that
+                            this may not be the full number of bytes requested.
+*/
+ssize_t fs_pread(file_t hnd, void *buffer, size_t cnt, _off64_t offset);
+
+/** \brief   Write to a given offset in an opened file.
+
+    This function writes the specified buffer into the file, starting at the
+    given offset rather than at the file pointer, and without moving the file
+    pointer. This is equivalent to the standard POSIX function pwrite(). The
+    same caveats apply to filesystems that do not support this directly as
+    for fs_pread().
+
+    \param  hnd             The file descriptor to write into.
+    \param  buffer          The data to write into the file.
+    \param  cnt             The size of the buffer, in bytes.
+    \param  offset          The offset in the file to write at.
+
+    \return                 The number of bytes written, or -1 on failure.
+*/
+ssize_t fs_pwrite(file_t hnd, const void *buffer, size_t cnt,
+                  _off64_t offset);
+
+/** \brief   Read from an opened file into several buffers.
+
+    This function reads from the file at the current file pointer, filling
+    each of the buffers in turn. This is equivalent to the standard POSIX
+    function readv().
+
+    \param  hnd             The file descriptor to read from.
+    \param  iov             The buffers to read into.
+    \param  iovcnt          The number of buffers (at most IOV_MAX).
+
+    \return                 The number of bytes read, or -1 on error.
+*/
+ssize_t fs_readv(file_t hnd, const struct iovec *iov, int iovcnt);
+
+/** \brief   Write to an opened file from several buffers.
+
+    This function writes each of the buffers in turn into the file at the
+    current file pointer. This is equivalent to the standard POSIX function
+    writev().
+
+    \param  hnd             The file descriptor to write into.
+    \param  iov             The buffers to write from.
+    \param  iovcnt          The number of buffers (at most IOV_MAX).
+
+    \return                 The number of bytes written, or -1 on error.
+*/
+ssize_t fs_writev(file_t hnd, const struct iovec *iov, int iovcnt);
+
 /** \brief   Seek to a new position within a file.
 
     This function moves the file pointer to the specified position within the
@@ -60,7 +60,8 @@ int fs_ramdisk_attach(const char * fn, void * obj, size_t size);
 
     This function retrieves the block of memory associated with the file,
     removing it from the ramdisk. You are responsible for freeing obj when you
-    are done with it.
+    are done with it. Files written through the VFS are stored in pages, which
+    are copied into a single block of memory by this function.
 
     \param  fn              The name of the file to look for.
     \param  obj             A pointer to return the address of the object in.
@@ -19,6 +19,11 @@
     mount itself on /rd. You can also mount additional images that you load
     from some other source on whatever mountpoint you want.
 
+    Images made with genromfs -z store most files compressed in independent
+    64KB chunks, which are decompressed on demand as they are read. Such files
+    cannot be mmapped; use genromfs -Z to keep the ones you need to map stored
+    as is.
+
     \author Megan Potter
 */
 
@@ -67,6 +72,44 @@ void fs_romdisk_shutdown(void);
 */
 int fs_romdisk_mount(const char * mountpoint, const uint8 *img, int own_buffer);
 
+/** \defgroup romdisk_mount_flags  Romdisk Mount Flags
+    \brief                         Flags for fs_romdisk_mount_ex()
+    \ingroup                       vfs_romdisk
+
+    @{
+*/
+/** \brief  Don't build a name index for the image.
+
+    By default, a hash table of every entry in the image is built at mount
+    time so that path lookups don't have to scan each directory along the way.
+    The table takes 12 bytes per entry (rounded up to a power of two, times
+    two). Set this flag to skip it and fall back to scanning directories.
+
+    Images made with genromfs -i carry a prebuilt table, which is used in
+    place regardless of this flag, since it costs no memory.
+*/
+#define FS_ROMDISK_MNT_NOINDEX  0x00000001
+/** @} */
+
+/** \brief  Mount a ROMFS image as a new filesystem, with flags.
+
+    This function works just like fs_romdisk_mount(), but allows the caller to
+    control how the image is mounted.
+
+    \param  mountpoint      The directory to mount this romdisk on
+    \param  img             The ROMFS image
+    \param  own_buffer      If 0, you are still responsible for img, and must
+                            free it if appropriate. If non-zero, img will be
+                            freed when it is unmounted
+    \param  flags           Mount flags (see \ref romdisk_mount_flags)
+    \retval 0               On success
+    \retval -1              If fs_romdisk_init not called
+    \retval -2              If img is invalid
+    \retval -3              If a malloc fails
+*/
+int fs_romdisk_mount_ex(const char * mountpoint, const uint8 *img,
+                        int own_buffer, uint32 flags);
+
 /** \brief  Unmount a ROMFS image.
 
     This function unmounts a ROMFS image that has been previously mounted with
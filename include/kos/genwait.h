@@ -145,6 +145,47 @@ void genwait_check_timeouts(uint64 now);
 */
 uint64 genwait_next_timeout(void);
 
+/** \brief  Sleep queue statistics for one genwait hash bucket.
+
+    This structure is filled in by genwait_bucket_stats() and can be used to
+    find objects whose addresses hash together and make wakeups slow.
+
+    \headerfile kos/genwait.h
+*/
+typedef struct genwait_bucket_stats {
+    uint32_t waiters;       /**< \brief Threads currently sleeping here */
+    uint32_t max_waiters;   /**< \brief Longest the chain has ever been */
+    uint32_t wakes;         /**< \brief Wake calls that searched this chain */
+    uint32_t scan_steps;    /**< \brief Total entries visited by those calls */
+} genwait_bucket_stats_t;
+
+/** \brief  Retrieve the number of genwait sleep queue buckets.
+
+    \return                 The number of buckets in the sleep queue table,
+                            (1 << GENWAIT_TABLE_BITS).
+*/
+size_t genwait_bucket_count(void);
+
+/** \brief  Retrieve the statistics for one genwait sleep queue bucket.
+
+    \param  bucket          The bucket to look at, from 0 to
+                            genwait_bucket_count() - 1
+    \param  stats           Where to store the statistics
+    \retval 0               On success
+    \retval -1              On error (errno will be set)
+
+    \par    Error Conditions:
+    \em     EINVAL - bucket is out of range or stats is NULL
+*/
+int genwait_bucket_stats(size_t bucket, genwait_bucket_stats_t *stats);
+
+/** \brief  Reset the genwait sleep queue statistics.
+
+    This clears the wake and scan counters of every bucket, and resets the
+    maximum chain lengths to the current chain lengths.
+*/
+void genwait_stats_reset(void);
+
 /** \cond */
 /* Initialize the genwait system */
 int genwait_init(void);
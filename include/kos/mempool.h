@@ -0,0 +1,120 @@
+/* KallistiOS ##version##
+
+   include/kos/mempool.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/** \file    kos/mempool.h
+    \brief   Fixed-size object pools.
+    \ingroup system_allocator
+
+    This file provides a simple pool allocator for small objects of a single
+    size that get allocated and freed often, such as file handles or queued
+    network packets. Objects are carved out of larger slabs obtained from
+    malloc() and, once freed, are kept on a free list in the pool instead of
+    going back to the heap. After a pool has warmed up, allocating and freeing
+    objects from it never touches the main heap (or its lock).
+
+    The free list is only ever touched with interrupts disabled, so pools may
+    be used from any thread as well as from interrupt context (as long as the
+    pool does not need to grow while inside an interrupt and malloc() is not
+    safe to call there).
+*/
+
+#ifndef __KOS_MEMPOOL_H
+#define __KOS_MEMPOOL_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** \defgroup mempool_flags Pool Flags
+    \brief                  Flags for a memory pool
+    \ingroup                system_allocator
+
+    @{
+*/
+#define MEMPOOL_POISON  0x00000001  /**< \brief Poison freed objects */
+/** @} */
+
+/** \brief  A fixed-size object pool.
+
+    The members of this structure are private, other than the statistics
+    fields which may be read at any time. Pools should be set up either with
+    MEMPOOL_INITIALIZER() or mempool_init().
+
+    \headerfile kos/mempool.h
+*/
+typedef struct mempool {
+    size_t obj_size;        /**< \brief Size of each object (rounded up) */
+    size_t slab_objs;       /**< \brief Objects to allocate per slab */
+    size_t max_objs;        /**< \brief Most objects ever allowed (0 = any) */
+    uint32_t flags;         /**< \brief Pool flags */
+
+    void *free_list;        /**< \brief Free objects */
+    void *slabs;            /**< \brief Slabs owned by the pool */
+
+    size_t total;           /**< \brief Objects carved out so far */
+    size_t in_use;          /**< \brief Objects currently allocated */
+    size_t high_water;      /**< \brief Most objects allocated at once */
+} mempool_t;
+
+/** \brief  Initializer for a statically allocated pool.
+
+    \param  size            The size of each object, in bytes.
+    \param  per_slab        How many objects to allocate at a time.
+    \param  max             The maximum number of objects the pool may ever
+                            hold, or 0 for no limit.
+    \param  flags           Pool flags (see \ref mempool_flags).
+*/
+#define MEMPOOL_INITIALIZER(size, per_slab, max, flags) \
+    { (((size) < sizeof(void *) ? sizeof(void *) : (size)) + 7) & ~7, \
+      (per_slab), (max), (flags), NULL, NULL, 0, 0, 0 }
+
+/** \brief  Initialize a memory pool.
+
+    No memory is allocated until the first object is requested.
+
+    \param  pool            The pool to initialize.
+    \param  obj_size        The size of each object, in bytes.
+    \param  per_slab        How many objects to allocate from the heap at a
+                            time when the pool runs dry.
+    \param  max_objs        The maximum number of objects the pool may ever
+                            hold, or 0 for no limit.
+    \param  flags           Pool flags (see \ref mempool_flags).
+    \retval 0               On success.
+    \retval -1              On error (errno will be set to EINVAL).
+*/
+int mempool_init(mempool_t *pool, size_t obj_size, size_t per_slab,
+                 size_t max_objs, uint32_t flags);
+
+/** \brief  Destroy a memory pool.
+
+    This releases all of the memory held by the pool. Every object allocated
+    from the pool must have been freed already.
+
+    \param  pool            The pool to destroy.
+*/
+void mempool_destroy(mempool_t *pool);
+
+/** \brief  Allocate an object from a pool.
+
+    \param  pool            The pool to allocate from.
+    \return                 The new (uninitialized) object, or NULL on failure
+                            (errno will be set to ENOMEM).
+*/
+void *mempool_alloc(mempool_t *pool);
+
+/** \brief  Return an object to its pool.
+
+    \param  pool            The pool the object was allocated from.
+    \param  obj             The object to free. NULL is ignored.
+*/
+void mempool_free(mempool_t *pool, void *obj);
+
+__END_DECLS
+
+#endif  /* __KOS_MEMPOOL_H */
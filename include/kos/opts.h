@@ -124,11 +124,51 @@ __BEGIN_DECLS
 #define FS_ROMDISK_MAX_FILES 16
 #endif
 
-/** \brief  The maximum number of ramdisk files that can be open at a time. */
+/** \brief  The number of decompressed chunks the romdisk keeps cached.
+
+    Files in images made with genromfs -z are decompressed one 64KB chunk at a
+    time into a small LRU cache shared by all open files. Each entry costs 64KB
+    of RAM once compressed files are in use.
+*/
+#ifndef FS_ROMDISK_CACHE_CHUNKS
+#define FS_ROMDISK_CACHE_CHUNKS 4
+#endif
+
+/** \brief  The number of ramdisk file handles to start out with. The handle
+            table doubles in size whenever it runs out. */
 #ifndef FS_RAMDISK_MAX_FILES
 #define FS_RAMDISK_MAX_FILES 8
 #endif
 
+/** \brief  The size of the pages that ramdisk files are stored in, in bytes.
+            Must be a power of two. */
+#ifndef FS_RAMDISK_PAGE_SIZE
+#define FS_RAMDISK_PAGE_SIZE 4096
+#endif
+
+/** \brief  The most blocks that the PVR memory pool can be split into.
+
+    Every texture allocated with pvr_mem_malloc() takes up a block, as does
+    each stretch of free space between them. Bookkeeping for all of them is
+    allocated in main RAM when the PVR is initialized, at a bit under 32 bytes
+    each, so that pvr_mem_malloc() and pvr_mem_free() never use the heap.
+*/
+#ifndef PVR_MEM_MAX_BLOCKS
+#define PVR_MEM_MAX_BLOCKS 2048
+#endif
+
+/** \brief  The number of genwait sleep queue buckets, as a power of two.
+
+    Objects being waited on are hashed into (1 << GENWAIT_TABLE_BITS) sleep
+    queues. Programs with a large number of waiters on distinct objects may
+    want to raise this to shorten the chains that each wakeup has to scan.
+    It has to be between 1 and 31.
+    \see   genwait_bucket_stats()
+*/
+#ifndef GENWAIT_TABLE_BITS
+#define GENWAIT_TABLE_BITS 7
+#endif
+
 /** @} */
 
 __END_DECLS
@@ -139,8 +139,16 @@ typedef __attribute__((aligned(32))) struct kthread {
     /** \brief  Run/Wait queue handle. Once again, not a function. */
     TAILQ_ENTRY(kthread) thdq;
 
-    /** \brief  Timer queue handle (if applicable). Also not a function. */
-    TAILQ_ENTRY(kthread) timerq;
+    /** \brief  Timer queue handle (if applicable). Also not a function.
+
+        The timer queue is a pairing heap, so each queued thread links to its
+        first child, its next sibling, and either its previous sibling or its
+        parent (if it is the first child). */
+    struct {
+        struct kthread *child;      /**< \brief First child in the heap */
+        struct kthread *sibling;    /**< \brief Next sibling in the heap */
+        struct kthread *prev;       /**< \brief Previous sibling or parent */
+    } timerq;
 
     /** \brief  Kernel thread id. */
     tid_t tid;
@@ -234,6 +234,49 @@ void malloc_stats(void);
 */
 int malloc_irq_safe(void);
 
+/** \brief  Per-thread small allocation cache statistics.
+
+    Small allocations are served from a per-thread cache of recently freed
+    blocks before falling back to the locked main heap. This structure reports
+    how well that cache is doing, summed over every thread (including threads
+    that have already exited).
+
+    \see    malloc_cache_stats()
+*/
+typedef struct malloc_cache_stats {
+    uint32 hits;        /**< \brief Allocations served from a thread cache */
+    uint32 misses;      /**< \brief Allocations that had to refill a cache */
+    uint32 frees;       /**< \brief Frees that went into a thread cache */
+    uint32 flushes;     /**< \brief Times a full cache returned blocks */
+} malloc_cache_stats_t;
+
+/** \brief  Set up the per-thread allocation caches.
+
+    This is called by thd_init() once thread-local storage is ready, and
+    should not be called by anything else. Until it has been, every
+    allocation goes straight to the main heap.
+
+    \retval     0           On success.
+    \retval     -1          If the TLS key for the caches couldn't be made.
+*/
+int malloc_cache_init(void);
+
+/** \brief  Retrieve the per-thread allocation cache statistics.
+
+    \param  stats           Where to store the statistics.
+
+    \note                   Blocks sitting in a thread cache are still counted
+                            as allocated by mallinfo() and malloc_stats().
+*/
+void malloc_cache_stats(malloc_cache_stats_t *stats);
+
+/** \brief  Return the calling thread's cached blocks to the main heap.
+
+    This is done automatically when a thread exits, but may be useful before
+    calling malloc_trim() or checking mallinfo().
+*/
+void malloc_cache_flush(void);
+
 /** \brief Only available with KM_DBG
 */
 int mem_check_block(void *p);
@@ -10,8 +10,8 @@
     \ingroup vfs_posix
 
     This file contains definitions for vector I/O operations, as specified by
-    the POSIX 2008 specification. Full vector-based I/O is not supported for
-    file operations, but the stuff in here is still useful elsewhere.
+    the POSIX 2008 specification. readv() and writev() go through the VFS, so
+    they work on any file descriptor.
 
     \author Lawrence Sebald
 */
@@ -41,6 +41,14 @@ struct iovec {
 /** \brief  Old alias for the maximum length of an iovec. */
 #define UIO_MAXIOV IOV_MAX
 
+/** \brief  Read from a file descriptor into several buffers.
+    \see    fs_readv() */
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+/** \brief  Write to a file descriptor from several buffers.
+    \see    fs_writev() */
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
 /** @} */
 
 __END_DECLS
@@ -36,6 +36,9 @@ ISO9660 systems, as these were used as references as well.
 #include <kos/mutex.h>
 #include <kos/fs.h>
 #include <kos/opts.h>
+#include <kos/blockdev.h>
+
+#include <sys/queue.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -45,8 +48,8 @@ ISO9660 systems, as these were used as references as well.
 #include <malloc.h>
 #include <errno.h>
 
-static int init_percd(void);
-static int percd_done;
+struct iso_mnt;
+static int init_percd(struct iso_mnt *mnt);
 
 /********************************************************************************/
 /* Low-level Joliet utils */
@@ -144,8 +147,6 @@ static int isjoliet(char * p) {
     return 0;
 }
 
-static int joliet;
-
 /********************************************************************************/
 /* Low-level ISO utils */
 
@@ -187,197 +188,403 @@ static uint32 iso_733(const uint8 *from) {
 
 
 /********************************************************************************/
-/* Low-level block caching routines. This implements a simple queue-based
-   LRU/MRU caching system. Whenever a block is requested, it will be placed
-   on the MRU end of the queue. As more blocks are loaded than can fit in
-   the cache, blocks are deleted from the LRU end. */
-
-/* Holds the data for one cache block, and a pointer to the next one.
-   As sectors are read from the disc, they are added to the front of
-   this cache. As the cache fills up, sectors are removed from the end
-   of it. */
-typedef struct {
+/* Low-level block caching routines. This implements a hashed LRU/MRU caching
+   system. Whenever a block is requested, it will be placed on the MRU end of
+   the queue. As more blocks are loaded than can fit in the cache, blocks are
+   deleted from the LRU end. Blocks are also kept in a small hash table keyed
+   on their sector number, so finding a block doesn't mean walking the whole
+   cache. */
+
+/* Holds the data for one cache block. As sectors are read from the disc, they
+   are added to the MRU end of the cache. As the cache fills up, sectors are
+   removed from the LRU end of it. */
+typedef struct cache_block {
+    TAILQ_ENTRY(cache_block) lru;   /* LRU list entry */
+    LIST_ENTRY(cache_block) hash;   /* Hash bucket entry */
     uint32  sector;         /* CD sector */
-    uint8   data[2048];     /* Sector data */
+    uint8   *data;          /* Sector data (2048 bytes) */
 } cache_block_t;
 
-/* List of cache blocks (ordered least recently used to most recently) */
+TAILQ_HEAD(cache_lru, cache_block);
+LIST_HEAD(cache_bucket, cache_block);
+
+typedef struct {
+    cache_block_t       *blocks;
+    uint8               *data;
+    int                 count;
+    struct cache_bucket *hash;
+    uint32              hash_mask;
+    struct cache_lru    lru;    /* Ordered least recently used to most */
+} iso_cache_t;
+
+/* One mounted filesystem. The GD-ROM drive is always mounted on /cd, and
+   disc images can be mounted elsewhere from any block device. */
+typedef struct iso_mnt {
+    LIST_ENTRY(iso_mnt) entry;
+    vfs_handler_t   *vfsh;
+    kos_blockdev_t  *dev;       /* NULL for the GD-ROM drive */
+    iso_cache_t     icache;     /* inode cache */
+    iso_cache_t     dcache;     /* data cache */
+    uint32          session_base;   /* Root FS session location (in sectors) */
+    iso_dirent_t    root_dirent;
+    int             joliet;
+    volatile int    percd_done;
+} iso_mnt_t;
+
+LIST_HEAD(iso_mnt_list, iso_mnt);
+
+/* Default cache sizes (in sectors) */
 #define NUM_CACHE_BLOCKS 16
-static cache_block_t *icache[NUM_CACHE_BLOCKS];     /* inode cache */
-static cache_block_t *dcache[NUM_CACHE_BLOCKS];     /* data cache */
+#define NUM_RA_BLOCKS    8
+
+/* Cache sizes for new mounts */
+static int icache_count = NUM_CACHE_BLOCKS;
+static int dcache_count = NUM_CACHE_BLOCKS;
+
+/* Readahead size (in sectors) and the buffer to do it with */
+static int ra_count;
+static uint8 *ra_buf;
 
 /* Cache modification mutex */
 static mutex_t cache_mutex;
 
-/* Clears all cache blocks */
-static void bclear_cache(cache_block_t **cache) {
-    int i;
+static void bfree_cache(iso_cache_t *cache) {
+    free(cache->hash);
+    free(cache->blocks);
+    free(cache->data);
+    memset(cache, 0, sizeof(iso_cache_t));
+}
 
-    mutex_lock(&cache_mutex);
+/* Allocate space for a cache with the given number of blocks. The cache needs
+   to be reset with breset_cache before it is used. */
+static int balloc_cache(iso_cache_t *cache, int count) {
+    int buckets;
+
+    /* Round the hash table size up to a power of two. */
+    for(buckets = 1; buckets < count; buckets <<= 1) ;
+
+    cache->blocks = (cache_block_t *)malloc(count * sizeof(cache_block_t));
+    cache->data = (uint8 *)memalign(32, count * 2048);
+    cache->hash = (struct cache_bucket *)malloc(buckets *
+                                                sizeof(struct cache_bucket));
+
+    if(!cache->blocks || !cache->data || !cache->hash) {
+        bfree_cache(cache);
+        return -1;
+    }
+
+    cache->count = count;
+    cache->hash_mask = buckets - 1;
+
+    return 0;
+}
+
+/* Empties out a cache. Call with the cache mutex held. */
+static void breset_cache(iso_cache_t *cache) {
+    uint32 i;
 
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++)
-        cache[i]->sector = (uint32)-1;
+    TAILQ_INIT(&cache->lru);
 
+    for(i = 0; i <= cache->hash_mask; i++)
+        LIST_INIT(&cache->hash[i]);
+
+    for(i = 0; i < (uint32)cache->count; i++) {
+        cache->blocks[i].sector = (uint32)-1;
+        cache->blocks[i].data = cache->data + i * 2048;
+        TAILQ_INSERT_TAIL(&cache->lru, &cache->blocks[i], lru);
+    }
+}
+
+/* Clears all cache blocks */
+static void bclear_cache(iso_cache_t *cache) {
+    mutex_lock(&cache_mutex);
+    breset_cache(cache);
     mutex_unlock(&cache_mutex);
 }
 
-/* Graduate a block from its current position to the MRU end of the cache */
-static void bgrad_cache(cache_block_t **cache, int block) {
-    int     i;
-    cache_block_t   *tmp;
+/* Look up a sector in the cache. Returns NULL if it isn't there. */
+static cache_block_t *bfind_cache(iso_cache_t *cache, uint32 sector) {
+    cache_block_t *b;
+
+    LIST_FOREACH(b, &cache->hash[sector & cache->hash_mask], hash) {
+        if(b->sector == sector)
+            return b;
+    }
+
+    return NULL;
+}
+
+/* Take the LRU block out of the cache, to be refilled by the caller. */
+static cache_block_t *bevict_cache(iso_cache_t *cache) {
+    cache_block_t *b = TAILQ_FIRST(&cache->lru);
+
+    if(b->sector != (uint32)-1) {
+        LIST_REMOVE(b, hash);
+        b->sector = (uint32)-1;
+    }
+
+    return b;
+}
+
+/* Put a freshly filled block into the hash table and at the MRU end. */
+static void binsert_cache(iso_cache_t *cache, cache_block_t *b,
+                          uint32 sector) {
+    b->sector = sector;
+    LIST_INSERT_HEAD(&cache->hash[sector & cache->hash_mask], b, hash);
+    TAILQ_REMOVE(&cache->lru, b, lru);
+    TAILQ_INSERT_TAIL(&cache->lru, b, lru);
+}
+
+/* Read sectors from the disc, dealing with a disc change if we see one. For
+   a disc image, the sector numbers are relative to the start of the image and
+   get converted to device blocks. */
+static int bread_sectors(iso_mnt_t *mnt, void *buf, uint32 sector,
+                         int count) {
+    kos_blockdev_t *dev = mnt->dev;
+    uint32 shift;
+    int rv;
+
+    if(dev) {
+        shift = 11 - dev->l_block_size;
+        return dev->read_blocks(dev, (uint64_t)sector << shift,
+                                (size_t)count << shift, buf);
+    }
 
-    /* Don't try it with the end block */
-    if(block < 0 || block >= (NUM_CACHE_BLOCKS - 1)) return;
+    rv = cdrom_read_sectors(buf, sector + 150, count);
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+    if(rv < 0) {
+        //dbglog(DBG_ERROR, "fs_iso9660: can't read_sectors for %d: %d\n",
+        //  sector+150, rv);
+        if(rv == ERR_DISC_CHG || rv == ERR_NO_DISC) {
+            init_percd(mnt);
+        }
 
-    for(i = block; i < (NUM_CACHE_BLOCKS - 1); i++)
-        cache[i] = cache[i + 1];
+        return -1;
+    }
 
-    cache[NUM_CACHE_BLOCKS - 1] = tmp;
+    return 0;
 }
 
 /* Pulls the requested sector into a cache block and returns the cache
-   block index. Note that the sector in question may already be in the
-   cache, in which case it just returns the containing block. */
-static void iso_break_all(void);
-static int bread_cache(cache_block_t **cache, uint32 sector) {
-    int i, j, rv;
+   block. Note that the sector in question may already be in the cache, in
+   which case it just returns the containing block. If the sector has to be
+   read and count is more than one, up to count sectors are read in starting
+   from the requested one, and all of them are added to the cache. */
+static cache_block_t *bread_cache(iso_mnt_t *mnt, iso_cache_t *cache,
+                                  uint32 sector, int count) {
+    cache_block_t *b;
+    int i;
 
-    rv = -1;
     mutex_lock(&cache_mutex);
 
-    /* Look for a pre-existing cache block */
-    for(i = NUM_CACHE_BLOCKS - 1; i >= 0; i--) {
-        if(cache[i]->sector == sector) {
-            bgrad_cache(cache, i);
-            rv = NUM_CACHE_BLOCKS - 1;
-            goto bread_exit;
-        }
+    /* No cache means no reading anything either */
+    if(!cache->count) {
+        b = NULL;
+        goto bread_exit;
     }
 
-    /* If not, look for an open cache slot; if we find one, use it */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        if(cache[i]->sector == (uint32)-1) break;
+    /* Look for a pre-existing cache block */
+    if((b = bfind_cache(cache, sector))) {
+        TAILQ_REMOVE(&cache->lru, b, lru);
+        TAILQ_INSERT_TAIL(&cache->lru, b, lru);
+        goto bread_exit;
     }
 
-    /* If we didn't find one, kick an LRU block out of cache */
-    if(i >= NUM_CACHE_BLOCKS) {
-        i = 0;
+    /* Don't read ahead over anything we've already got, and don't read in so
+       much that the blocks we're reading push each other out. */
+    if(count > ra_count)
+        count = ra_count;
+
+    if(count > cache->count / 2)
+        count = cache->count / 2;
+
+    for(i = 1; i < count; i++) {
+        if(bfind_cache(cache, sector + i))
+            break;
     }
 
-    /* Load the requested block */
-    j = cdrom_read_sectors(cache[i]->data, sector + 150, 1);
+    count = i;
 
-    if(j < 0) {
-        //dbglog(DBG_ERROR, "fs_iso9660: can't read_sectors for %d: %d\n",
-        //  sector+150, j);
-        if(j == ERR_DISC_CHG || j == ERR_NO_DISC) {
-            init_percd();
+    if(count <= 1) {
+        /* Load the requested block straight into the LRU block */
+        b = bevict_cache(cache);
+
+        if(bread_sectors(mnt, b->data, sector, 1) < 0) {
+            b = NULL;
+            goto bread_exit;
         }
 
-        rv = -1;
+        binsert_cache(cache, b, sector);
         goto bread_exit;
     }
 
-    cache[i]->sector = sector;
+    /* Read all of them at once, then split them up into cache blocks. The
+       requested one goes in last, so it ends up most recently used. */
+    if(bread_sectors(mnt, ra_buf, sector, count) < 0) {
+        b = NULL;
+        goto bread_exit;
+    }
 
-    /* Move it to the most-recently-used position */
-    bgrad_cache(cache, i);
-    rv = NUM_CACHE_BLOCKS - 1;
+    for(i = count - 1; i >= 0; i--) {
+        b = bevict_cache(cache);
+        memcpy(b->data, ra_buf + i * 2048, 2048);
+        binsert_cache(cache, b, sector + i);
+    }
 
-    /* Return the new cache block index */
+    /* Return the cache block */
 bread_exit:
     mutex_unlock(&cache_mutex);
-    return rv;
+    return b;
 }
 
-/* read data block */
-static int bdread(uint32 sector) {
-    return bread_cache(dcache, sector);
+/* read data block, reading ahead by up to count sectors */
+static cache_block_t *bdread(iso_mnt_t *mnt, uint32 sector, int count) {
+    return bread_cache(mnt, &mnt->dcache, sector, count);
 }
 
 /* read inode block */
-static int biread(uint32 sector) {
-    return bread_cache(icache, sector);
+static cache_block_t *biread(iso_mnt_t *mnt, uint32 sector) {
+    return bread_cache(mnt, &mnt->icache, sector, 1);
 }
 
 /* Clear both caches */
-static void bclear(void) {
-    bclear_cache(dcache);
-    bclear_cache(icache);
+static void bclear(iso_mnt_t *mnt) {
+    bclear_cache(&mnt->dcache);
+    bclear_cache(&mnt->icache);
 }
 
-/********************************************************************************/
-/* Higher-level ISO9660 primitives */
+/* Set up both caches of a mount, using the current sizes. */
+static int binit(iso_mnt_t *mnt) {
+    memset(&mnt->icache, 0, sizeof(iso_cache_t));
+    memset(&mnt->dcache, 0, sizeof(iso_cache_t));
+
+    if(balloc_cache(&mnt->icache, icache_count) < 0 ||
+       balloc_cache(&mnt->dcache, dcache_count) < 0) {
+        bfree_cache(&mnt->icache);
+        bfree_cache(&mnt->dcache);
+        return -1;
+    }
+
+    breset_cache(&mnt->icache);
+    breset_cache(&mnt->dcache);
+    return 0;
+}
+
+/* The GD-ROM drive's mount */
+static iso_mnt_t cd_mnt;
+
+int fs_iso9660_set_cache(int inode_blocks, int data_blocks, int readahead) {
+    iso_cache_t ni, nd;
+    uint8 *nra = NULL;
+
+    if(inode_blocks < 1 || data_blocks < 1 || readahead < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&ni, 0, sizeof(iso_cache_t));
+    memset(&nd, 0, sizeof(iso_cache_t));
+
+    /* Set up the new caches before touching the old ones, so that if we run
+       out of memory, nothing has changed. */
+    if(balloc_cache(&ni, inode_blocks) < 0 ||
+       balloc_cache(&nd, data_blocks) < 0 ||
+       (readahead > 1 && !(nra = (uint8 *)memalign(32, readahead * 2048)))) {
+        bfree_cache(&ni);
+        bfree_cache(&nd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    mutex_lock(&cache_mutex);
 
-/* Root FS session location (in sectors) */
-static uint32 session_base = 0;
+    bfree_cache(&cd_mnt.icache);
+    bfree_cache(&cd_mnt.dcache);
+    free(ra_buf);
 
-/* Root directory extent and size in bytes */
-static uint32 root_extent = 0, root_size = 0;
+    cd_mnt.icache = ni;
+    cd_mnt.dcache = nd;
+    ra_buf = nra;
+    ra_count = readahead;
+    icache_count = inode_blocks;
+    dcache_count = data_blocks;
+    breset_cache(&cd_mnt.icache);
+    breset_cache(&cd_mnt.dcache);
 
-/* Root dirent */
-static iso_dirent_t root_dirent;
+    mutex_unlock(&cache_mutex);
+
+    return 0;
+}
 
+/********************************************************************************/
+/* Higher-level ISO9660 primitives */
+
+static void iso_reset_mnt(iso_mnt_t *mnt);
 
 /* Per-disc initialization; this is done every time it's discovered that
-   a new CD has been inserted. */
-static int init_percd(void) {
-    int     i, blk;
+   a new CD has been inserted (and once when a disc image is mounted). */
+static int init_percd(iso_mnt_t *mnt) {
+    int     i;
+    cache_block_t *blk = NULL;
     CDROM_TOC   toc;
 
-    dbglog(DBG_NOTICE, "fs_iso9660: disc change detected\n");
+    if(!mnt->dev)
+        dbglog(DBG_NOTICE, "fs_iso9660: disc change detected\n");
 
     /* Start off with no cached blocks and no open files*/
-    iso_reset();
+    iso_reset_mnt(mnt);
 
-    /* Locate the root session */
-    if((i = cdrom_reinit()) != 0) {
-        dbglog(DBG_ERROR, "fs_iso9660:init_percd: cdrom_reinit returned %d\n", i);
-        return -1;
+    if(mnt->dev) {
+        /* A disc image is just the one session, starting at the beginning of
+           the device. */
+        mnt->session_base = 150;
     }
+    else {
+        /* Locate the root session */
+        if((i = cdrom_reinit()) != 0) {
+            dbglog(DBG_ERROR, "fs_iso9660:init_percd: cdrom_reinit returned %d\n", i);
+            return -1;
+        }
 
-    if((i = cdrom_read_toc(&toc, 0)) != 0)
-        return i;
+        if((i = cdrom_read_toc(&toc, 0)) != 0)
+            return i;
 
-    if(!(session_base = cdrom_locate_data_track(&toc)))
-        return -1;
+        if(!(mnt->session_base = cdrom_locate_data_track(&toc)))
+            return -1;
+    }
 
     /* Check for joliet extensions */
-    joliet = 0;
+    mnt->joliet = 0;
 
     for(i = 1; i <= 3; i++) {
-        blk = biread(session_base + i + 16 - 150);
+        blk = biread(mnt, mnt->session_base + i + 16 - 150);
 
-        if(blk < 0) return blk;
+        if(!blk) return -1;
 
-        if(memcmp((char *)icache[blk]->data, "\02CD001", 6) == 0) {
-            joliet = isjoliet((char *)icache[blk]->data + 88);
-            dbglog(DBG_NOTICE, "  (joliet level %d extensions detected)\n", joliet);
+        if(memcmp((char *)blk->data, "\02CD001", 6) == 0) {
+            mnt->joliet = isjoliet((char *)blk->data + 88);
+            dbglog(DBG_NOTICE, "  (joliet level %d extensions detected)\n",
+                   mnt->joliet);
 
-            if(joliet) break;
+            if(mnt->joliet) break;
         }
     }
 
     /* If that failed, go after standard/RockRidge ISO */
-    if(!joliet) {
+    if(!mnt->joliet) {
         /* Grab and check the volume descriptor */
-        blk = biread(session_base + 16 - 150);
+        blk = biread(mnt, mnt->session_base + 16 - 150);
 
-        if(blk < 0) return i;
+        if(!blk) return -1;
 
-        if(memcmp((char*)icache[blk]->data, "\01CD001", 6)) {
+        if(memcmp((char*)blk->data, "\01CD001", 6)) {
             dbglog(DBG_ERROR, "fs_iso9660: disc is not iso9660\r\n");
             return -1;
         }
     }
 
     /* Locate the root directory */
-    memcpy(&root_dirent, icache[blk]->data + 156, sizeof(iso_dirent_t));
-    root_extent = iso_733(root_dirent.extent);
-    root_size = iso_733(root_dirent.size);
+    memcpy(&mnt->root_dirent, blk->data + 156, sizeof(iso_dirent_t));
 
     return 0;
 }
@@ -414,6 +621,7 @@ static int fncompare(const char *isofn, int isosize, const char *normalfn) {
 /* Locate an ISO9660 object in the given directory; this can be a directory or
    a file, it works fine for either one. Pass in:
 
+   mnt:     the filesystem to look in
    fn:      object filename (relative to the passed directory)
    dir:     0 if looking for a file, 1 if looking for a dir
    dir_extent:  directory extent to start with
@@ -422,9 +630,10 @@ static int fncompare(const char *isofn, int isosize, const char *normalfn) {
    It will return a pointer to a transient dirent buffer (i.e., don't
    expect this buffer to stay around much longer than the call itself).
  */
-static iso_dirent_t *find_object(const char *fn, int dir,
+static iso_dirent_t *find_object(iso_mnt_t *mnt, const char *fn, int dir,
                                  uint32 dir_extent, uint32 dir_size) {
-    int     i, c;
+    int     i;
+    cache_block_t *c;
     iso_dirent_t    *de;
 
     /* RockRidge */
@@ -441,22 +650,22 @@ static iso_dirent_t *find_object(const char *fn, int dir,
     uint8       * ucsname = (uint8 *)rrname;
 
     /* If this is a Joliet CD, then UCSify the name */
-    if(joliet)
+    if(mnt->joliet)
         utf2ucs(ucsname, (uint8 *)fn);
 
     while(size_left > 0) {
-        c = biread(dir_extent);
+        c = biread(mnt, dir_extent);
 
-        if(c < 0) return NULL;
+        if(!c) return NULL;
 
         for(i = 0; i < 2048 && i < size_left;) {
             /* Locate the current dirent */
-            de = (iso_dirent_t *)(icache[c]->data + i);
+            de = (iso_dirent_t *)(c->data + i);
 
             if(!de->length) break;
 
             /* Try the Joliet filename if the CD is a Joliet disc */
-            if(joliet) {
+            if(mnt->joliet) {
                 if(!ucscompare((uint8 *)de->name, ucsname, de->name_len)) {
                     if(!((dir << 1) ^ de->flags))
                         return de;
@@ -525,6 +734,7 @@ static iso_dirent_t *find_object(const char *fn, int dir,
    and expecting a fully qualified path name. This is analogous to find_object
    but it searches with the path in mind.
 
+   mnt:     the filesystem to look in
    fn:      object filename (relative to the passed directory)
    dir:     0 if looking for a file, 1 if looking for a dir
    dir_extent:  directory extent to start with
@@ -533,7 +743,8 @@ static iso_dirent_t *find_object(const char *fn, int dir,
    It will return a pointer to a transient dirent buffer (i.e., don't
    expect this buffer to stay around much longer than the call itself).
  */
-static iso_dirent_t *find_object_path(const char *fn, int dir, iso_dirent_t *start) {
+static iso_dirent_t *find_object_path(iso_mnt_t *mnt, const char *fn, int dir,
+                                      iso_dirent_t *start) {
     char        *cur;
 
     /* If the object is in a sub-tree, traverse the trees looking
@@ -542,7 +753,8 @@ static iso_dirent_t *find_object_path(const char *fn, int dir, iso_dirent_t *sta
         if(cur != fn) {
             /* Note: trailing path parts don't matter since find_object
                only compares based on the FN length on the disc. */
-            start = find_object(fn, 1, iso_733(start->extent), iso_733(start->size));
+            start = find_object(mnt, fn, 1, iso_733(start->extent),
+                                iso_733(start->size));
 
             if(start == NULL) return NULL;
         }
@@ -552,7 +764,8 @@ static iso_dirent_t *find_object_path(const char *fn, int dir, iso_dirent_t *sta
 
     /* Locate the file in the resulting directory */
     if(*fn) {
-        start = find_object(fn, dir, iso_733(start->extent), iso_733(start->size));
+        start = find_object(mnt, fn, dir, iso_733(start->extent),
+                            iso_733(start->size));
         return start;
     }
     else {
@@ -569,12 +782,14 @@ static iso_dirent_t *find_object_path(const char *fn, int dir, iso_dirent_t *sta
 /* File handles.. I could probably do this with a linked list, but I'm just
    too lazy right now. =) */
 static struct {
+    iso_mnt_t   *mnt;       /* The filesystem the file is on */
     uint32      first_extent;   /* First sector */
     int     dir;        /* >0 if a directory */
     uint32      ptr;        /* Current read position in bytes */
     uint32      size;       /* Length of file in bytes */
     dirent_t    dirent;     /* A static dirent to pass back to clients */
     int     broken;     /* >0 if the CD has been swapped out since open */
+    uint32      next_sect;  /* Sector a sequential read would hit next */
 } fh[FS_CD_MAX_FILES];
 
 /* Mutex for file handles */
@@ -584,13 +799,15 @@ static mutex_t fh_mutex;
    is changed so that we don't accidentally try to keep on doing stuff
    with the old info. As files are closed and re-opened, the broken flag
    will be cleared. */
-static void iso_break_all(void) {
+static void iso_break_all(iso_mnt_t *mnt) {
     int i;
 
     mutex_lock(&fh_mutex);
 
-    for(i = 0; i < FS_CD_MAX_FILES; i++)
-        fh[i].broken = 1;
+    for(i = 0; i < FS_CD_MAX_FILES; i++) {
+        if(fh[i].mnt == mnt)
+            fh[i].broken = 1;
+    }
 
     mutex_unlock(&fh_mutex);
 }
@@ -599,21 +816,20 @@ static void iso_break_all(void) {
 static void * iso_open(vfs_handler_t * vfs, const char *fn, int mode) {
     file_t      fd;
     iso_dirent_t    *de;
-
-    (void)vfs;
+    iso_mnt_t   *mnt = (iso_mnt_t *)vfs->privdata;
 
     /* Make sure they don't want to open things as writeable */
     if((mode & O_MODE_MASK) != O_RDONLY)
         return 0;
 
     /* Do this only when we need to (this is still imperfect) */
-    if(!percd_done && init_percd() < 0)
+    if(!mnt->percd_done && init_percd(mnt) < 0)
         return 0;
 
-    percd_done = 1;
+    mnt->percd_done = 1;
 
     /* Find the file we want */
-    de = find_object_path(fn, (mode & O_DIR) ? 1 : 0, &root_dirent);
+    de = find_object_path(mnt, fn, (mode & O_DIR) ? 1 : 0, &mnt->root_dirent);
 
     if(!de) return 0;
 
@@ -632,11 +848,13 @@ static void * iso_open(vfs_handler_t * vfs, const char *fn, int mode) {
         return 0;
 
     /* Fill in the file handle and return the fd */
+    fh[fd].mnt = mnt;
     fh[fd].first_extent = iso_733(de->extent);
     fh[fd].dir = (mode & O_DIR) ? 1 : 0;
     fh[fd].ptr = 0;
     fh[fd].size = iso_733(de->size);
     fh[fd].broken = 0;
+    fh[fd].next_sect = fh[fd].first_extent;
 
     return (void *)fd;
 }
@@ -655,7 +873,9 @@ static int iso_close(void * h) {
 
 /* Read from a file */
 static ssize_t iso_read(void * h, void *buf, size_t bytes) {
-    int rv, toread, thissect, c;
+    int rv, toread, thissect, count;
+    uint32 sector;
+    cache_block_t *c;
     uint8 * outbuf;
     file_t fd = (file_t)h;
 
@@ -676,41 +896,46 @@ static ssize_t iso_read(void * h, void *buf, size_t bytes) {
 
         /* How much more can we read in the current sector? */
         thissect = 2048 - (fh[fd].ptr % 2048);
+        sector = fh[fd].first_extent + fh[fd].ptr / 2048;
 
         /* If we're on a sector boundary and we have more than one
-           full sector to read, then short-circuit the cache here
-           and use the multi-sector reads from the CD unit (this
-           should theoretically be a lot faster) */
-        /* XXX This code isn't actually faster, but I'm leaving it
-           here commented out in case we could find a better use
-           for it later than speed (i.e., preventing thread context
-           switches). */
-        /* if(thissect == 2048 && toread >= 2048) {
-            // Round it off to an even sector count
-            thissect = toread / 2048;
-            toread = thissect * 2048;
-
-            printf("cdrom: short-circuit read for %d sectors\n",
-                thissect);
-
-            // Do the read
-            if(cdrom_read_sectors(outbuf,
-                fh[fd].first_extent + fh[fd].ptr/2048 + 150,
-                thissect) < 0)
-            {
-                // Something went wrong...
+           full sector to read, then skip the cache and read all of the
+           full sectors straight into the caller's buffer at once. That
+           way a big read costs one command to the drive, rather than
+           one per sector. */
+        if(thissect == 2048 && toread >= 2048) {
+            count = toread / 2048;
+            toread = count * 2048;
+
+            if(bread_sectors(fh[fd].mnt, outbuf, sector, count) < 0)
                 return -1;
-            }
-        } else { */
-        toread = (toread > thissect) ? thissect : toread;
 
-        /* Do the read */
-        c = bdread(fh[fd].first_extent + fh[fd].ptr / 2048);
+            fh[fd].next_sect = sector + count;
+        }
+        else {
+            toread = (toread > thissect) ? thissect : toread;
 
-        if(c < 0) return -1;
+            /* If the file is being read through in order, read ahead in it
+               while we're going to the disc anyway. */
+            if(sector == fh[fd].next_sect)
+                count = (fh[fd].size - fh[fd].ptr + 2047) / 2048;
+            else
+                count = 1;
 
-        memcpy(outbuf, dcache[c]->data + (fh[fd].ptr % 2048), toread);
-        /* } */
+            /* Do the read */
+            c = bdread(fh[fd].mnt, sector, count);
+
+            if(!c) return -1;
+
+            memcpy(outbuf, c->data + (fh[fd].ptr % 2048), toread);
+
+            /* Only count this sector as done once we've read to the end of
+               it. */
+            if(toread == thissect)
+                fh[fd].next_sect = sector + 1;
+            else
+                fh[fd].next_sect = sector;
+        }
 
         /* Adjust pointers */
         outbuf += toread;
@@ -812,7 +1037,7 @@ static void fn_postprocess(char *fnin) {
 
 /* Read a directory entry */
 static dirent_t *iso_readdir(void * h) {
-    int     c;
+    cache_block_t *c;
     iso_dirent_t    *de;
 
     /* RockRidge */
@@ -829,16 +1054,16 @@ static dirent_t *iso_readdir(void * h) {
 
     /* Scan forwards until we find the next valid entry, an
        end-of-entry mark, or run out of dir size. */
-    c = -1;
+    c = NULL;
     de = NULL;
 
     while(fh[fd].ptr < fh[fd].size) {
         /* Get the current dirent block */
-        c = biread(fh[fd].first_extent + fh[fd].ptr / 2048);
+        c = biread(fh[fd].mnt, fh[fd].first_extent + fh[fd].ptr / 2048);
 
-        if(c < 0) return NULL;
+        if(!c) return NULL;
 
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c->data + (fh[fd].ptr % 2048));
 
         if(de->length) break;
 
@@ -851,14 +1076,14 @@ static dirent_t *iso_readdir(void * h) {
     /* If we're at the first, skip the two blank entries */
     if(!de->name[0] && de->name_len == 1) {
         fh[fd].ptr += de->length;
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c->data + (fh[fd].ptr % 2048));
         fh[fd].ptr += de->length;
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c->data + (fh[fd].ptr % 2048));
 
         if(!de->length) return NULL;
     }
 
-    if(joliet) {
+    if(fh[fd].mnt->joliet) {
         ucs2utfn((uint8 *)fh[fd].dirent.name, (uint8 *)de->name, de->name_len);
     }
     else {
@@ -915,10 +1140,14 @@ static int iso_rewinddir(void * h) {
     return 0;
 }
 
+static void iso_reset_mnt(iso_mnt_t *mnt) {
+    iso_break_all(mnt);
+    bclear(mnt);
+    mnt->percd_done = 0;
+}
+
 int iso_reset(void) {
-    iso_break_all();
-    bclear();
-    percd_done = 0;
+    iso_reset_mnt(&cd_mnt);
     return 0;
 }
 
@@ -941,7 +1170,7 @@ static void iso_vblank(uint32 evt, void *data) {
 
     if(iso_last_status != status) {
         if(status == CD_STATUS_OPEN || status == CD_STATUS_NO_DISC)
-            percd_done = 0;
+            cd_mnt.percd_done = 0;
 
         iso_last_status = status;
     }
@@ -990,9 +1219,13 @@ static int iso_fstat(void *h, struct stat *st) {
 
     memset(st, 0, sizeof(struct stat));
 
+    if(fh[fd].mnt == &cd_mnt)
+        st->st_dev = 'c' | ('d' << 8);
+    else
+        st->st_dev = (dev_t)((ptr_t)fh[fd].mnt->vfsh);
+
     if(fh[fd].dir) {
         st->st_size = 0;
-        st->st_dev = 'c' | ('d' << 8);
         st->st_mode = S_IFDIR | S_IRUSR | S_IRGRP | S_IROTH | S_IXUSR |
             S_IXGRP | S_IXOTH;
         st->st_nlink = 1;
@@ -1000,7 +1233,6 @@ static int iso_fstat(void *h, struct stat *st) {
     }
     else {
         st->st_size = fh[fd].size;
-        st->st_dev = 'c' | ('d' << 8);
         st->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH | S_IXUSR |
             S_IXGRP | S_IXOTH;
         st->st_nlink = 1;
@@ -1052,10 +1284,125 @@ static vfs_handler_t vh = {
     iso_fstat
 };
 
+/* Mounted disc images */
+static struct iso_mnt_list iso_mnts;
+static mutex_t mnt_mutex;
+
+/* These two functions borrow heavily from the same functions in fs_fat */
+int fs_iso9660_mount(const char *mp, kos_blockdev_t *dev) {
+    iso_mnt_t *mnt;
+    vfs_handler_t *vfsh;
+
+    if(!dev || dev->l_block_size > 11) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(dev->init(dev))
+        return -1;
+
+    /* Create a mount structure */
+    if(!(mnt = (iso_mnt_t *)calloc(1, sizeof(iso_mnt_t)))) {
+        dbglog(DBG_DEBUG, "fs_iso9660: out of memory creating fs structure\n");
+        errno = ENOMEM;
+        goto out_dev;
+    }
+
+    mnt->dev = dev;
+
+    if(binit(mnt) < 0) {
+        dbglog(DBG_DEBUG, "fs_iso9660: out of memory creating block cache\n");
+        errno = ENOMEM;
+        goto out_mnt;
+    }
+
+    /* Make sure it actually holds an ISO9660 filesystem */
+    if(init_percd(mnt) < 0) {
+        dbglog(DBG_DEBUG, "fs_iso9660: device does not contain a valid "
+               "ISO9660 FS.\n");
+        errno = EINVAL;
+        goto out_cache;
+    }
+
+    mnt->percd_done = 1;
+
+    /* Create a VFS structure */
+    if(!(vfsh = (vfs_handler_t *)malloc(sizeof(vfs_handler_t)))) {
+        dbglog(DBG_DEBUG, "fs_iso9660: out of memory creating vfs handler\n");
+        errno = ENOMEM;
+        goto out_cache;
+    }
+
+    memcpy(vfsh, &vh, sizeof(vfs_handler_t));
+    strcpy(vfsh->nmmgr.pathname, mp);
+    vfsh->privdata = mnt;
+    mnt->vfsh = vfsh;
+
+    mutex_lock(&mnt_mutex);
+
+    /* Register with the VFS */
+    if(nmmgr_handler_add(&vfsh->nmmgr)) {
+        mutex_unlock(&mnt_mutex);
+        dbglog(DBG_DEBUG, "fs_iso9660: couldn't add fs to nmmgr\n");
+        free(vfsh);
+        errno = EBUSY;
+        goto out_cache;
+    }
+
+    /* Add it to our list */
+    LIST_INSERT_HEAD(&iso_mnts, mnt, entry);
+    mutex_unlock(&mnt_mutex);
+
+    return 0;
+
+out_cache:
+    bfree_cache(&mnt->icache);
+    bfree_cache(&mnt->dcache);
+out_mnt:
+    free(mnt);
+out_dev:
+    dev->shutdown(dev);
+    return -1;
+}
+
+static void iso_unmount(iso_mnt_t *mnt) {
+    LIST_REMOVE(mnt, entry);
+    nmmgr_handler_remove(&mnt->vfsh->nmmgr);
+
+    /* Anything still open on it is done for */
+    iso_break_all(mnt);
+
+    mutex_lock(&cache_mutex);
+    bfree_cache(&mnt->icache);
+    bfree_cache(&mnt->dcache);
+    mutex_unlock(&cache_mutex);
+
+    mnt->dev->shutdown(mnt->dev);
+    free(mnt->vfsh);
+    free(mnt);
+}
+
+int fs_iso9660_unmount(const char *mp) {
+    iso_mnt_t *i;
+
+    /* Find the fs in question */
+    mutex_lock(&mnt_mutex);
+
+    LIST_FOREACH(i, &iso_mnts, entry) {
+        if(!strcmp(mp, i->vfsh->nmmgr.pathname)) {
+            iso_unmount(i);
+            mutex_unlock(&mnt_mutex);
+            return 0;
+        }
+    }
+
+    mutex_unlock(&mnt_mutex);
+    errno = ENOENT;
+    return -1;
+}
+
 /* Initialize the file system */
 void fs_iso9660_init(void) {
-    int i;
-
     /* Reset fd's */
     memset(fh, 0, sizeof(fh));
 
@@ -1065,16 +1412,18 @@ void fs_iso9660_init(void) {
     /* Init thread mutexes */
     mutex_init(&cache_mutex, MUTEX_TYPE_NORMAL);
     mutex_init(&fh_mutex, MUTEX_TYPE_NORMAL);
+    mutex_init(&mnt_mutex, MUTEX_TYPE_NORMAL);
+    LIST_INIT(&iso_mnts);
 
     /* Allocate cache block space */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        icache[i] = malloc(sizeof(cache_block_t));
-        icache[i]->sector = -1;
-        dcache[i] = malloc(sizeof(cache_block_t));
-        dcache[i]->sector = -1;
-    }
-
-    percd_done = 0;
+    if(fs_iso9660_set_cache(NUM_CACHE_BLOCKS, NUM_CACHE_BLOCKS,
+                            NUM_RA_BLOCKS) < 0)
+        dbglog(DBG_ERROR, "fs_iso9660: can't allocate block cache\n");
+
+    cd_mnt.dev = NULL;
+    cd_mnt.vfsh = &vh;
+    cd_mnt.percd_done = 0;
+    vh.privdata = &cd_mnt;
     iso_last_status = -1;
 
     /* Register with the vblank */
@@ -1086,20 +1435,27 @@ void fs_iso9660_init(void) {
 
 /* De-init the file system */
 void fs_iso9660_shutdown(void) {
-    int i;
-
     /* De-register with vblank */
     vblank_handler_remove(iso_vblank_hnd);
 
+    /* Unmount any disc images */
+    mutex_lock(&mnt_mutex);
+
+    while(!LIST_EMPTY(&iso_mnts))
+        iso_unmount(LIST_FIRST(&iso_mnts));
+
+    mutex_unlock(&mnt_mutex);
+
     /* Dealloc cache block space */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        free(icache[i]);
-        free(dcache[i]);
-    }
+    bfree_cache(&cd_mnt.icache);
+    bfree_cache(&cd_mnt.dcache);
+    free(ra_buf);
+    ra_buf = NULL;
 
     /* Free muteces */
     mutex_destroy(&cache_mutex);
     mutex_destroy(&fh_mutex);
+    mutex_destroy(&mnt_mutex);
 
     nmmgr_handler_remove(&vh.nmmgr);
 }
@@ -8,35 +8,23 @@
 #include <assert.h>
 #include <dc/pvr.h>
 #include "pvr_internal.h"
+#include "pvr_mem_tlsf.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include <malloc.h> /* For the struct mallinfo defs */
-
+#include <arch/spinlock.h>
 #include <kos/opts.h>
 
 /*
 
-This module basically serves as a KOS-friendly front end and support routines
-for the pvr_mem_core module, which is a dlmalloc-derived malloc for use with
-the PVR memory pool.
-
-I was originally going to make a totally separate thing that could be used
-to generically manage any memory pool, but then I realized what a gruelling
-and thankless task that would be when starting with dlmalloc, so we have this
-instead. ^_^;
+This module serves as a KOS-friendly front end and support routines for the
+pvr_mem_tlsf module, which does the actual work of handing out blocks of the
+PVR memory pool. That allocator keeps all of its bookkeeping in main RAM, so
+allocating and freeing textures never has to touch video RAM at all.
 
 */
 
-/* Bring in some prototypes from pvr_mem_core.c */
-/* We can't directly include its header because of name clashes with
-   the real malloc header */
-extern void * pvr_int_malloc(size_t bytes);
-extern void pvr_int_free(void *ptr);
-extern struct mallinfo pvr_int_mallinfo();
-extern void pvr_int_mem_reset();
-extern void pvr_int_malloc_stats();
-
-
 #ifdef PVR_KM_DBG
 
 #include <kos/thread.h>
@@ -62,41 +50,39 @@ static pvr_ptr_t pvr_mem_base = NULL;
     assert_msg(pvr_mem_base != NULL, \
                "pvr_mem_* used, but PVR hasn't been initialized yet")
 
-/* Used in pvr_mem_core.c */
-void * pvr_int_sbrk(size_t amt) {
-    uint32 old, n;
-
-    /* Are we valid? */
-    CHECK_MEM_BASE;
-
-    /* Try to increment it */
-    old = (uint32)pvr_mem_base;
-    n = old + amt;
-
-    /* Did we run over? */
-    if(n > PVR_RAM_INT_TOP)
-        return (void *) - 1;
-
-    /* Nope, everything's cool */
-    pvr_mem_base = (pvr_ptr_t)n;
-    return (pvr_ptr_t)old;
-}
+/* The allocator for the pool, and a lock to go with it. All of the
+   allocator's bookkeeping is set up by pvr_mem_reset(), so allocating and
+   freeing never go near the main heap and only take a short, bounded time.
+   A spinlock is plenty for that, and unlike a mutex it doesn't stop
+   pvr_mem_* from being used in an interrupt. */
+static pvr_tlsf_t pvr_mem_pool;
+static spinlock_t pvr_mem_lock = SPINLOCK_INITIALIZER;
+
+#ifdef PVR_MALLOC_DEBUG
+#define CHECK_POOL \
+    assert_msg(pvr_tlsf_check(&pvr_mem_pool) == 0, \
+               "PVR memory pool is corrupted")
+#else
+#define CHECK_POOL
+#endif
 
-/* Allocate a chunk of memory from texture space; the returned value
-   will be relative to the base of texture memory (zero-based) */
-pvr_ptr_t pvr_mem_malloc(size_t size) {
+static pvr_ptr_t pvr_mem_alloc_int(size_t size, size_t align, uint32 ra) {
     uint32 rv32;
 #ifdef PVR_KM_DBG
-    uint32      ra = arch_get_ret_addr();
     memctl_t    * ctl;
 #endif  /* PVR_KM_DBG */
 
+    (void)ra;
+
     CHECK_MEM_BASE;
 
-    rv32 = (uint32)pvr_int_malloc(size);
-    assert_msg((rv32 & 0x1f) == 0,
-               "dlmalloc's alignment is broken; "
-               "please make a bug report");
+    spinlock_lock(&pvr_mem_lock);
+    rv32 = pvr_tlsf_alloc(&pvr_mem_pool, size, align);
+    CHECK_POOL;
+    spinlock_unlock(&pvr_mem_lock);
+
+    if(!rv32)
+        return NULL;
 
 #ifdef PVR_KM_DBG
     ctl = malloc(sizeof(memctl_t));
@@ -115,6 +101,29 @@ pvr_ptr_t pvr_mem_malloc(size_t size) {
     return (pvr_ptr_t)rv32;
 }
 
+/* Allocate a chunk of memory from texture space; the returned value
+   will be relative to the base of texture memory (zero-based) */
+pvr_ptr_t pvr_mem_malloc(size_t size) {
+#ifdef PVR_KM_DBG
+    return pvr_mem_alloc_int(size, 0, arch_get_ret_addr());
+#else
+    return pvr_mem_alloc_int(size, 0, 0);
+#endif  /* PVR_KM_DBG */
+}
+
+/* Same as above, but with the chunk aligned to a given boundary */
+pvr_ptr_t pvr_mem_malloc_aligned(size_t size, size_t align) {
+    /* Not a power of two? */
+    if(align & (align - 1))
+        return NULL;
+
+#ifdef PVR_KM_DBG
+    return pvr_mem_alloc_int(size, align, arch_get_ret_addr());
+#else
+    return pvr_mem_alloc_int(size, align, 0);
+#endif  /* PVR_KM_DBG */
+}
+
 /* Free a previously allocated chunk of memory */
 void pvr_mem_free(pvr_ptr_t chunk) {
 #ifdef PVR_KM_DBG
@@ -125,6 +134,10 @@ void pvr_mem_free(pvr_ptr_t chunk) {
 
     CHECK_MEM_BASE;
 
+    /* Like free(), freeing NULL does nothing */
+    if(chunk == NULL)
+        return;
+
 #ifdef PVR_KM_DBG_VERBOSE
     printf("Thread %d/%08lx freeing block @ %08lx\n",
            thd_current->tid, ra, (uint32)chunk);
@@ -151,7 +164,14 @@ void pvr_mem_free(pvr_ptr_t chunk) {
 
 #endif  /* PVR_KM_DBG */
 
-    pvr_int_free((void *)chunk);
+    spinlock_lock(&pvr_mem_lock);
+
+    if(pvr_tlsf_free(&pvr_mem_pool, (uint32)chunk) < 0)
+        dbglog(DBG_ERROR, "pvr_mem_free: block %08lx isn't allocated\n",
+               (uint32)chunk);
+
+    CHECK_POOL;
+    spinlock_unlock(&pvr_mem_lock);
 }
 
 /* Check the memory block list to see what's allocated */
@@ -171,37 +191,74 @@ void pvr_mem_print_list(void) {
 }
 
 /* Return the number of bytes available still in the memory pool */
-static uint32 pvr_mem_available_int(void) {
-    struct mallinfo mi = pvr_int_mallinfo();
-
-    /* This magic formula is modeled after mstats() */
-    return mi.arena - mi.uordblks;
-}
-
 uint32 pvr_mem_available(void) {
+    uint32 rv;
+
     CHECK_MEM_BASE;
 
-    return pvr_mem_available_int() + 
-        (PVR_RAM_INT_TOP - (uint32)pvr_mem_base);
+    spinlock_lock(&pvr_mem_lock);
+    rv = pvr_mem_pool.size - pvr_mem_pool.used_bytes;
+    spinlock_unlock(&pvr_mem_lock);
+
+    return rv;
 }
 
 /* Reset the memory pool, equivalent to freeing all textures currently
    residing in RAM. This _must_ be done on a mode change, configuration
    change, etc. */
 void pvr_mem_reset(void) {
-    if(!pvr_state.valid)
-        pvr_mem_base = NULL;
-    else {
-        pvr_mem_base = (pvr_ptr_t)(PVR_RAM_INT_BASE + pvr_state.texture_base);
-        pvr_int_mem_reset();
+    pvr_tlsf_t old, pool;
+    pvr_ptr_t new_base = NULL;
+    uint32 base;
+
+    /* Set the new pool up before taking the lock, so that the heap is never
+       touched while holding it. */
+    memset(&pool, 0, sizeof(pool));
+
+    if(pvr_state.valid) {
+        base = (PVR_RAM_INT_BASE + pvr_state.texture_base +
+                PVR_TLSF_ALIGN - 1) & ~(PVR_TLSF_ALIGN - 1);
+
+        if(pvr_tlsf_init(&pool, base, PVR_RAM_INT_TOP - base,
+                         PVR_MEM_MAX_BLOCKS) < 0)
+            dbglog(DBG_ERROR, "pvr_mem_reset: out of memory\n");
+        else
+            new_base = (pvr_ptr_t)base;
     }
+
+    spinlock_lock(&pvr_mem_lock);
+    old = pvr_mem_pool;
+    pvr_mem_pool = pool;
+    pvr_mem_base = new_base;
+    spinlock_unlock(&pvr_mem_lock);
+
+    pvr_tlsf_destroy(&old);
 }
 
 /* Print some statistics (like mallocstats) */
 void pvr_mem_stats(void) {
+    pvr_tlsf_stats_t st;
+
+    CHECK_MEM_BASE;
+
+    spinlock_lock(&pvr_mem_lock);
+    pvr_tlsf_stats(&pvr_mem_pool, &st);
+    spinlock_unlock(&pvr_mem_lock);
+
     printf("pvr_mem_stats():\n");
-    pvr_int_malloc_stats();
-    printf("max sbrk base: %08lx\n", (uint32)pvr_mem_base);
+    printf("pool size:     %10lu bytes at %08lx\n", st.total,
+           (uint32)pvr_mem_base);
+    printf("in use:        %10lu bytes in %lu blocks\n", st.used,
+           st.used_blocks);
+    printf("free:          %10lu bytes in %lu blocks\n", st.free,
+           st.free_blocks);
+    printf("largest free:  %10lu bytes\n", st.largest_free);
+
+    /* How much of the free space can't be had in one piece */
+    printf("fragmentation: %10lu%%\n", st.free ?
+           100 - (uint32)((uint64)st.largest_free * 100 / st.free) : 0);
+    printf("high water:    %10lu bytes\n", st.high_water);
+    printf("bookkeeping:   %10lu bytes of main RAM\n", st.overhead);
 #ifdef PVR_KM_DBG
     pvr_mem_print_list();
 #endif
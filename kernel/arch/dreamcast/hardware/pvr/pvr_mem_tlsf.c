@@ -0,0 +1,476 @@
+/* KallistiOS ##version##
+
+   pvr_mem_tlsf.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/*
+
+This is the allocator behind pvr_mem_malloc(). It's a TLSF ("two-level
+segregated fit") allocator, which finds a free block of the right size in
+constant time using two levels of bitmaps: the first level splits the free
+blocks up by power of two, and the second splits each power of two range into
+PVR_TLSF_SL_COUNT lists. Freed blocks are merged with their neighbours right
+away, so there are never two free blocks next to each other.
+
+Unlike a normal malloc, nothing about the blocks is stored in the memory being
+handed out. Video RAM is slow to get at from the CPU, and anything written
+there by the allocator would also be in the way of textures. Instead, each
+block has a small descriptor in main RAM with its address, its size, and
+links to the blocks on either side of it. A fixed number of descriptors is
+allocated up front, along with a fixed-size hash table that used blocks are
+kept in, keyed on their address, so that pvr_tlsf_free() can find them from
+the pointer alone. Once the allocator is set up, it never calls malloc.
+
+Since the pool is never touched, blocks can be aligned to anything the caller
+likes without wasting more than the padding in front of them, and that
+padding goes back in the free lists.
+
+This file only uses standard C, so that it can be built on a host machine and
+run through randomized alloc/free traces. Locking is left to the caller.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pvr_mem_tlsf.h"
+
+/* A block of the pool, either free or used. */
+typedef struct pvr_tlsf_block {
+    uint32_t addr;                          /* Start of the block */
+    uint32_t size;                          /* Size of the block */
+    uint32_t is_free;                       /* Non-zero if the block is free */
+
+    /* Blocks on either side of this one in the pool */
+    struct pvr_tlsf_block *prev_phys;
+    struct pvr_tlsf_block *next_phys;
+
+    /* Free list links for free blocks. For used blocks, next is the hash
+       chain, and for spare descriptors it's the spare list. */
+    struct pvr_tlsf_block *prev;
+    struct pvr_tlsf_block *next;
+} pvr_tlsf_block_t;
+
+#define ALIGN_UP(x, a)  (((x) + ((a) - 1)) & ~((a) - 1))
+
+/* Index of the highest set bit. x must not be 0. */
+static inline int fls32(uint32_t x) {
+    return 31 - __builtin_clz(x);
+}
+
+/* Index of the lowest set bit. x must not be 0. */
+static inline int ffs32(uint32_t x) {
+    return __builtin_ctz(x);
+}
+
+/* Figure out which list a block of the given size belongs in. */
+static void mapping_insert(uint32_t size, int *fl, int *sl) {
+    int f;
+
+    if(size < (1 << PVR_TLSF_FL_SHIFT)) {
+        *fl = 0;
+        *sl = size >> PVR_TLSF_ALIGN_SHIFT;
+    }
+    else {
+        f = fls32(size);
+        *sl = (size >> (f - PVR_TLSF_SL_SHIFT)) ^ PVR_TLSF_SL_COUNT;
+        *fl = f - PVR_TLSF_FL_SHIFT + 1;
+    }
+}
+
+/* Figure out the first list that only has blocks of at least the given size
+   in it. */
+static void mapping_search(uint32_t size, int *fl, int *sl) {
+    if(size >= (1 << PVR_TLSF_FL_SHIFT))
+        size += (1 << (fls32(size) - PVR_TLSF_SL_SHIFT)) - 1;
+
+    mapping_insert(size, fl, sl);
+}
+
+static void free_insert(pvr_tlsf_t *t, pvr_tlsf_block_t *b) {
+    int fl, sl;
+
+    mapping_insert(b->size, &fl, &sl);
+
+    b->is_free = 1;
+    b->prev = NULL;
+    b->next = t->free[fl][sl];
+
+    if(b->next)
+        b->next->prev = b;
+
+    t->free[fl][sl] = b;
+    t->fl_bitmap |= 1 << fl;
+    t->sl_bitmap[fl] |= 1 << sl;
+}
+
+static void free_remove(pvr_tlsf_t *t, pvr_tlsf_block_t *b) {
+    int fl, sl;
+
+    mapping_insert(b->size, &fl, &sl);
+
+    if(b->prev)
+        b->prev->next = b->next;
+    else
+        t->free[fl][sl] = b->next;
+
+    if(b->next)
+        b->next->prev = b->prev;
+
+    if(!t->free[fl][sl]) {
+        t->sl_bitmap[fl] &= ~(1 << sl);
+
+        if(!t->sl_bitmap[fl])
+            t->fl_bitmap &= ~(1 << fl);
+    }
+
+    b->is_free = 0;
+}
+
+/* Find a free block of at least the given size, or NULL if there isn't one.
+   The block is left in its free list. */
+static pvr_tlsf_block_t *free_find(pvr_tlsf_t *t, uint32_t size) {
+    uint32_t map;
+    int fl, sl;
+
+    mapping_search(size, &fl, &sl);
+
+    if(fl >= PVR_TLSF_FL_COUNT)
+        return NULL;
+
+    /* Anything left in this power of two range? */
+    map = t->sl_bitmap[fl] & (~0U << sl);
+
+    if(!map) {
+        /* Nope, so take the smallest list from a bigger range. */
+        map = t->fl_bitmap & (~0U << (fl + 1));
+
+        if(!map)
+            return NULL;
+
+        fl = ffs32(map);
+        map = t->sl_bitmap[fl];
+    }
+
+    return t->free[fl][ffs32(map)];
+}
+
+static inline uint32_t used_hash(const pvr_tlsf_t *t, uint32_t addr) {
+    return ((addr >> PVR_TLSF_ALIGN_SHIFT) * 2654435761U) >>
+        (32 - t->used_bits);
+}
+
+static void used_insert(pvr_tlsf_t *t, pvr_tlsf_block_t *b) {
+    uint32_t h;
+
+    h = used_hash(t, b->addr);
+    b->next = t->used[h];
+    t->used[h] = b;
+
+    ++t->used_count;
+    t->used_bytes += b->size;
+}
+
+/* Find a used block by its address and take it out of the table. */
+static pvr_tlsf_block_t *used_remove(pvr_tlsf_t *t, uint32_t addr) {
+    pvr_tlsf_block_t **p, *b;
+
+    for(p = &t->used[used_hash(t, addr)]; (b = *p); p = &b->next) {
+        if(b->addr == addr) {
+            *p = b->next;
+            --t->used_count;
+            t->used_bytes -= b->size;
+            return b;
+        }
+    }
+
+    return NULL;
+}
+
+/* Make sure there are at least two spare block descriptors, which is all
+   that an allocation can need. */
+static inline int spare_reserve(pvr_tlsf_t *t) {
+    return t->spare && t->spare->next ? 0 : -1;
+}
+
+static pvr_tlsf_block_t *spare_get(pvr_tlsf_t *t) {
+    pvr_tlsf_block_t *b = t->spare;
+
+    t->spare = b->next;
+    return b;
+}
+
+static void spare_put(pvr_tlsf_t *t, pvr_tlsf_block_t *b) {
+    b->next = t->spare;
+    t->spare = b;
+}
+
+/* Split the block in two, leaving the first size bytes in b, and return the
+   rest as a new block. The caller has to have reserved a descriptor. */
+static pvr_tlsf_block_t *block_split(pvr_tlsf_t *t, pvr_tlsf_block_t *b,
+                                     uint32_t size) {
+    pvr_tlsf_block_t *n = spare_get(t);
+
+    n->addr = b->addr + size;
+    n->size = b->size - size;
+    n->is_free = 0;
+    n->prev_phys = b;
+    n->next_phys = b->next_phys;
+
+    if(n->next_phys)
+        n->next_phys->prev_phys = n;
+
+    b->next_phys = n;
+    b->size = size;
+
+    return n;
+}
+
+/* Merge the block after b into b. */
+static void block_absorb(pvr_tlsf_t *t, pvr_tlsf_block_t *b) {
+    pvr_tlsf_block_t *n = b->next_phys;
+
+    b->size += n->size;
+    b->next_phys = n->next_phys;
+
+    if(b->next_phys)
+        b->next_phys->prev_phys = b;
+
+    spare_put(t, n);
+}
+
+int pvr_tlsf_init(pvr_tlsf_t *t, uint32_t base, uint32_t size,
+                  uint32_t max_blocks) {
+    uint32_t i;
+
+    memset(t, 0, sizeof(pvr_tlsf_t));
+
+    if(size >= (1U << 24))
+        size = (1U << 24) - PVR_TLSF_ALIGN;
+
+    /* There's no point in more descriptors than the pool has room for
+       blocks, and an allocation needs two to hand. */
+    if(max_blocks > (size >> PVR_TLSF_ALIGN_SHIFT) + 1)
+        max_blocks = (size >> PVR_TLSF_ALIGN_SHIFT) + 1;
+
+    if(max_blocks < 2)
+        max_blocks = 2;
+
+    t->base = base;
+    t->size = size & ~(PVR_TLSF_ALIGN - 1);
+    t->max_blocks = max_blocks;
+
+    /* Have a hash bucket for every two descriptors. Since free blocks are
+       never next to each other, at least about half of the descriptors in use
+       are for used blocks. */
+    t->used_bits = 1;
+
+    while((1U << t->used_bits) < max_blocks / 2)
+        ++t->used_bits;
+
+    t->used = (pvr_tlsf_block_t **)calloc(1 << t->used_bits,
+                                          sizeof(pvr_tlsf_block_t *));
+    t->blocks = (pvr_tlsf_block_t *)malloc(max_blocks *
+                                           sizeof(pvr_tlsf_block_t));
+
+    if(!t->used || !t->blocks) {
+        pvr_tlsf_destroy(t);
+        return -1;
+    }
+
+    for(i = max_blocks; i > 0; --i)
+        spare_put(t, &t->blocks[i - 1]);
+
+    /* Start out with the whole pool in one free block. */
+    if(t->size) {
+        t->first = spare_get(t);
+        t->first->addr = base;
+        t->first->size = t->size;
+        t->first->prev_phys = t->first->next_phys = NULL;
+        free_insert(t, t->first);
+    }
+
+    return 0;
+}
+
+void pvr_tlsf_destroy(pvr_tlsf_t *t) {
+    free(t->blocks);
+    free(t->used);
+    memset(t, 0, sizeof(pvr_tlsf_t));
+}
+
+uint32_t pvr_tlsf_alloc(pvr_tlsf_t *t, uint32_t size, uint32_t align) {
+    pvr_tlsf_block_t *b, *n;
+    uint32_t pad;
+
+    if(align < PVR_TLSF_ALIGN)
+        align = PVR_TLSF_ALIGN;
+
+    if(!size)
+        size = 1;
+
+    /* Anything this big can't possibly fit, and would overflow below. */
+    if(size > t->size || align > t->size)
+        return 0;
+
+    size = ALIGN_UP(size, PVR_TLSF_ALIGN);
+
+    /* Look for a block that'll fit however it happens to be aligned. */
+    pad = align - PVR_TLSF_ALIGN;
+
+    if(!(b = free_find(t, size + pad)) || spare_reserve(t) < 0)
+        return 0;
+
+    free_remove(t, b);
+
+    /* Put any padding in front of the block back in the free lists. Its
+       neighbour in front can't be free, since it would have been merged with
+       this block already. */
+    pad = ALIGN_UP(b->addr, align) - b->addr;
+
+    if(pad) {
+        n = block_split(t, b, pad);
+        free_insert(t, b);
+        b = n;
+    }
+
+    /* Likewise for anything left over at the end. */
+    if(b->size > size)
+        free_insert(t, block_split(t, b, size));
+
+    used_insert(t, b);
+
+    if(b->addr + b->size > t->high_water)
+        t->high_water = b->addr + b->size;
+
+    return b->addr;
+}
+
+int pvr_tlsf_free(pvr_tlsf_t *t, uint32_t addr) {
+    pvr_tlsf_block_t *b, *p;
+
+    if(!(b = used_remove(t, addr)))
+        return -1;
+
+    /* Merge with whatever's free on either side. */
+    if((p = b->prev_phys) && p->is_free) {
+        free_remove(t, p);
+        block_absorb(t, p);
+        b = p;
+    }
+
+    if(b->next_phys && b->next_phys->is_free) {
+        free_remove(t, b->next_phys);
+        block_absorb(t, b);
+    }
+
+    free_insert(t, b);
+
+    return 0;
+}
+
+void pvr_tlsf_stats(const pvr_tlsf_t *t, pvr_tlsf_stats_t *st) {
+    const pvr_tlsf_block_t *b;
+    int fl, sl;
+
+    memset(st, 0, sizeof(pvr_tlsf_stats_t));
+
+    st->total = t->size;
+    st->used = t->used_bytes;
+    st->used_blocks = t->used_count;
+    st->high_water = t->high_water ? t->high_water - t->base : 0;
+    st->overhead = sizeof(pvr_tlsf_t) +
+        t->max_blocks * sizeof(pvr_tlsf_block_t) +
+        (t->used ? (1U << t->used_bits) * sizeof(pvr_tlsf_block_t *) : 0);
+
+    for(fl = 0; fl < PVR_TLSF_FL_COUNT; ++fl) {
+        for(sl = 0; sl < PVR_TLSF_SL_COUNT; ++sl) {
+            for(b = t->free[fl][sl]; b; b = b->next) {
+                st->free += b->size;
+                ++st->free_blocks;
+
+                if(b->size > st->largest_free)
+                    st->largest_free = b->size;
+            }
+        }
+    }
+}
+
+int pvr_tlsf_check(const pvr_tlsf_t *t) {
+    const pvr_tlsf_block_t *b, *p = NULL;
+    uint32_t addr = t->base, nfree = 0, nused = 0, used = 0;
+    int fl, sl;
+
+    /* Walk the pool from one end to the other. */
+    for(b = t->first; b; p = b, b = b->next_phys) {
+        if(b->addr != addr || b->prev_phys != p || !b->size ||
+           (b->size & (PVR_TLSF_ALIGN - 1)))
+            return -1;
+
+        if(b->is_free) {
+            /* Free blocks should have been merged. */
+            if(p && p->is_free)
+                return -2;
+
+            ++nfree;
+        }
+        else {
+            ++nused;
+            used += b->size;
+
+            if(b->addr + b->size > t->high_water)
+                return -3;
+        }
+
+        addr += b->size;
+    }
+
+    if(addr != t->base + t->size)
+        return -4;
+
+    if(nused != t->used_count || used != t->used_bytes)
+        return -5;
+
+    /* Make sure that everything in the free lists belongs there. */
+    for(fl = 0; fl < PVR_TLSF_FL_COUNT; ++fl) {
+        if(!!t->sl_bitmap[fl] != !!(t->fl_bitmap & (1 << fl)))
+            return -6;
+
+        for(sl = 0; sl < PVR_TLSF_SL_COUNT; ++sl) {
+            if(!t->free[fl][sl] != !(t->sl_bitmap[fl] & (1 << sl)))
+                return -7;
+
+            for(p = NULL, b = t->free[fl][sl]; b; p = b, b = b->next) {
+                int bfl, bsl;
+
+                mapping_insert(b->size, &bfl, &bsl);
+
+                if(!b->is_free || b->prev != p || bfl != fl || bsl != sl)
+                    return -8;
+
+                if(!nfree--)
+                    return -9;
+            }
+        }
+    }
+
+    if(nfree)
+        return -9;
+
+    /* And that every used block can be found. */
+    for(fl = 0, nused = 0; fl < (1 << t->used_bits); ++fl) {
+        for(b = t->used[fl]; b; b = b->next) {
+            if(b->is_free || used_hash(t, b->addr) != (uint32_t)fl)
+                return -10;
+
+            ++nused;
+        }
+    }
+
+    if(nused != t->used_count)
+        return -10;
+
+    return 0;
+}
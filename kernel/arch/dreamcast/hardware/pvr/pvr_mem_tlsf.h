@@ -0,0 +1,98 @@
+/* KallistiOS ##version##
+
+   pvr_mem_tlsf.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/* Private interface to the PVR texture memory allocator core. See the top
+   of pvr_mem_tlsf.c for how it works. Nothing in here depends on the rest of
+   KOS, so that the allocator can be built and exercised on a host machine. */
+
+#ifndef __PVR_MEM_TLSF_H
+#define __PVR_MEM_TLSF_H
+
+#include <stdint.h>
+
+/* Every block starts on, and is a multiple of, this many bytes. */
+#define PVR_TLSF_ALIGN_SHIFT    5
+#define PVR_TLSF_ALIGN          (1 << PVR_TLSF_ALIGN_SHIFT)
+
+/* Second level lists per first level list, as a power of two. */
+#define PVR_TLSF_SL_SHIFT       4
+#define PVR_TLSF_SL_COUNT       (1 << PVR_TLSF_SL_SHIFT)
+
+/* Blocks smaller than this all go in first level list 0. */
+#define PVR_TLSF_FL_SHIFT       (PVR_TLSF_SL_SHIFT + PVR_TLSF_ALIGN_SHIFT)
+
+/* Enough first level lists for a pool of less than 16MB. */
+#define PVR_TLSF_FL_COUNT       (24 - PVR_TLSF_FL_SHIFT + 1)
+
+struct pvr_tlsf_block;
+
+/* An allocator instance. All of this lives in main RAM. */
+typedef struct pvr_tlsf {
+    uint32_t base;                          /* Start of the pool */
+    uint32_t size;                          /* Size of the pool */
+
+    uint32_t fl_bitmap;                     /* Non-empty first level lists */
+    uint32_t sl_bitmap[PVR_TLSF_FL_COUNT];  /* Non-empty second level lists */
+    struct pvr_tlsf_block *free[PVR_TLSF_FL_COUNT][PVR_TLSF_SL_COUNT];
+
+    struct pvr_tlsf_block *first;           /* Block at the start of the pool */
+
+    struct pvr_tlsf_block **used;           /* Hash table of used blocks */
+    uint32_t used_bits;                     /* log2 of the buckets in it */
+    uint32_t used_count;                    /* Number of used blocks */
+    uint32_t used_bytes;                    /* Bytes in used blocks */
+    uint32_t high_water;                    /* Highest end of a used block */
+
+    struct pvr_tlsf_block *blocks;          /* All of the block descriptors */
+    uint32_t max_blocks;                    /* Number of them */
+    struct pvr_tlsf_block *spare;           /* Unused block descriptors */
+} pvr_tlsf_t;
+
+/* Statistics about an allocator, as filled in by pvr_tlsf_stats(). */
+typedef struct pvr_tlsf_stats {
+    uint32_t total;             /* Size of the pool */
+    uint32_t used;              /* Bytes in used blocks */
+    uint32_t used_blocks;       /* Number of used blocks */
+    uint32_t free;              /* Bytes in free blocks */
+    uint32_t free_blocks;       /* Number of free blocks */
+    uint32_t largest_free;      /* Size of the largest free block */
+    uint32_t high_water;        /* Highest end of a used block, less base */
+    uint32_t overhead;          /* Main RAM used for bookkeeping */
+} pvr_tlsf_stats_t;
+
+/* Set up an allocator for the pool at [base, base + size). base must be
+   non-zero and aligned to PVR_TLSF_ALIGN; size is rounded down to a multiple
+   of it (and cut down to fit under 16MB). The pool can be split into at most
+   max_blocks blocks, used and free, and all of the bookkeeping for them is
+   allocated here, so nothing after this touches the heap. Returns 0 on
+   success, or -1 if out of memory. */
+int pvr_tlsf_init(pvr_tlsf_t *t, uint32_t base, uint32_t size,
+                  uint32_t max_blocks);
+
+/* Free all of the bookkeeping for an allocator. */
+void pvr_tlsf_destroy(pvr_tlsf_t *t);
+
+/* Allocate a block of at least size bytes, starting on a multiple of align
+   (which must be a power of two; anything under PVR_TLSF_ALIGN is treated as
+   PVR_TLSF_ALIGN). Returns the address of the block, or 0 if there's no free
+   block big enough or the pool is already split into max_blocks blocks. */
+uint32_t pvr_tlsf_alloc(pvr_tlsf_t *t, uint32_t size, uint32_t align);
+
+/* Free a block returned by pvr_tlsf_alloc(). Returns 0 on success, or -1 if
+   addr isn't the start of a used block. */
+int pvr_tlsf_free(pvr_tlsf_t *t, uint32_t addr);
+
+/* Fill in statistics about an allocator. This walks the free lists, so it
+   isn't meant to be called all that often. */
+void pvr_tlsf_stats(const pvr_tlsf_t *t, pvr_tlsf_stats_t *st);
+
+/* Check the allocator's structures for consistency. Returns 0 if everything
+   is in order, or the (negative) number of the first check that failed. This
+   walks every block, so it's only meant for debugging. */
+int pvr_tlsf_check(const pvr_tlsf_t *t);
+
+#endif /* __PVR_MEM_TLSF_H */
@@ -32,6 +32,7 @@ __BEGIN_DECLS
 #include <arch/types.h>
 #include <kos/limits.h>
 #include <kos/fs.h>
+#include <kos/blockdev.h>
 
 /** \addtogroup gdrom
     @{
@@ -47,6 +48,73 @@ __BEGIN_DECLS
 */
 int iso_reset(void);
 
+/** \brief  Resize the ISO9660 block caches.
+
+    This function replaces the block caches of the ISO9660 driver with new ones
+    of the given sizes. Anything that was in the old caches is dropped. By
+    default, both caches hold 16 sectors, and up to 8 sectors are read ahead.
+
+    Readahead is only done for files that are being read through in order, and
+    only for reads that don't cover whole sectors (reads of whole sectors go
+    straight from the disc to the caller's buffer). No more than half of the
+    data cache is ever filled by one readahead.
+
+    \param  inode_blocks    The number of sectors to cache for directories.
+    \param  data_blocks     The number of sectors to cache for file data.
+    \param  readahead       The most sectors to read at once when reading
+                            ahead. 1 disables readahead.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - one of the sizes was less than 1 \n
+    \em     ENOMEM - out of memory (the old caches are left as they were)
+
+    \note   Don't call this while anything is being read from the disc. Disc
+            images that are already mounted keep the cache sizes they were
+            mounted with.
+*/
+int fs_iso9660_set_cache(int inode_blocks, int data_blocks, int readahead);
+
+/** \brief  Mount an ISO9660 disc image from a block device.
+
+    This function mounts a disc image (such as a .iso file on an SD card) on
+    the given mount point. The image is expected to hold a single session,
+    starting at the beginning of the device. The block size of the device may
+    be anything up to the 2048 byte sector size of the image.
+
+    The device will be initialized by this function, and will be shut down
+    when the image is unmounted. The caller must keep the device structure
+    around until then. The image uses block caches of the size last given to
+    fs_iso9660_set_cache().
+
+    \param  mp              The path to mount the image on.
+    \param  dev             The block device holding the image.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - dev was NULL, its block size is too big, or it doesn't
+                     hold an ISO9660 filesystem \n
+    \em     ENOMEM - out of memory \n
+    \em     EBUSY - the mount point could not be registered
+*/
+int fs_iso9660_mount(const char *mp, kos_blockdev_t *dev);
+
+/** \brief  Unmount an ISO9660 disc image.
+
+    Any files still open on the image are broken by this function, and will
+    fail any further operations on them other than closing them.
+
+    \param  mp              The path the image was mounted on.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     ENOENT - no image was mounted on mp
+*/
+int fs_iso9660_unmount(const char *mp);
+
 /* \cond */
 void fs_iso9660_init(void);
 void fs_iso9660_shutdown(void);
@@ -1674,8 +1674,10 @@ void pvr_fog_table_custom(float tbl1[]);
     \brief                   Memory management API for VRAM
     \ingroup                 pvr_vram
 
-    PVR memory management in KOS uses a modified dlmalloc; see the
-    source file pvr_mem_core.c for more info. 
+    PVR memory management in KOS uses a TLSF allocator that keeps all of its
+    bookkeeping in main RAM, so that allocating and freeing memory never has
+    to touch VRAM. Both take constant time, regardless of how many blocks are
+    allocated. See the source file pvr_mem_tlsf.c for more info.
 */
 
 /** \brief   Allocate a chunk of memory from texture space.
@@ -1692,6 +1694,21 @@ void pvr_fog_table_custom(float tbl1[]);
 */
 pvr_ptr_t pvr_mem_malloc(size_t size);
 
+/** \brief   Allocate an aligned chunk of memory from texture space.
+    \ingroup pvr_mem_mgmt
+
+    This function works like pvr_mem_malloc(), except that the returned
+    memory will be aligned to the given boundary. Any memory skipped over to
+    get there stays available for other allocations.
+
+    \param  size            The amount of memory to allocate
+    \param  align           The alignment required, in bytes. Must be a power
+                            of two. Anything less than 32 is treated as 32.
+
+    \return                 A pointer to the memory on success, NULL on error
+*/
+pvr_ptr_t pvr_mem_malloc_aligned(size_t size, size_t align);
+
 /** \brief   Free a block of allocated memory in the PVR RAM pool.
     \ingroup pvr_mem_mgmt
 
@@ -1726,8 +1743,10 @@ void pvr_mem_print_list(void);
 /** \brief   Print statistics about the PVR RAM pool.
     \ingroup pvr_mem_mgmt
 
-    This prints out statistics like what malloc_stats() provides. Also, if
-    KM_DBG is enabled in pvr_mem.c, it prints the list of allocated blocks.
+    This prints out statistics like what malloc_stats() provides, including
+    the size of the largest free block and how fragmented the free space is.
+    Also, if KM_DBG is enabled in pvr_mem.c, it prints the list of allocated
+    blocks.
 */
 void pvr_mem_stats(void);
 
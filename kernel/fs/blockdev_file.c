@@ -0,0 +1,158 @@
+/* KallistiOS ##version##
+
+   blockdev_file.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/* A block device backed by a file on some other filesystem. This is mainly
+   here so that disc and disk images (an .iso on the SD card, a FAT image in
+   the romdisk, ...) can be mounted like any other device. Every request just
+   turns into a seek and a read or write on the file. */
+
+#include <kos/blockdev.h>
+#include <kos/fs.h>
+#include <kos/mutex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* The type of the dev_data in the block device structure */
+typedef struct file_devdata {
+    file_t fd;
+    uint64_t block_count;
+    mutex_t lock;
+} file_devdata_t;
+
+static int fileb_init(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int fileb_shutdown(kos_blockdev_t *d) {
+    file_devdata_t *data = (file_devdata_t *)d->dev_data;
+
+    fs_close(data->fd);
+    mutex_destroy(&data->lock);
+    free(data);
+
+    return 0;
+}
+
+static int fileb_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                             void *buf) {
+    file_devdata_t *data = (file_devdata_t *)d->dev_data;
+    size_t len = count << d->l_block_size;
+    int rv = 0;
+
+    if(block + count > data->block_count) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    mutex_lock(&data->lock);
+
+    if(fs_seek64(data->fd, (_off64_t)(block << d->l_block_size),
+                 SEEK_SET) < 0 ||
+       fs_read(data->fd, buf, len) != (ssize_t)len) {
+        errno = EIO;
+        rv = -1;
+    }
+
+    mutex_unlock(&data->lock);
+
+    return rv;
+}
+
+static int fileb_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                              const void *buf) {
+    file_devdata_t *data = (file_devdata_t *)d->dev_data;
+    size_t len = count << d->l_block_size;
+    int rv = 0;
+
+    if(block + count > data->block_count) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    mutex_lock(&data->lock);
+
+    if(fs_seek64(data->fd, (_off64_t)(block << d->l_block_size),
+                 SEEK_SET) < 0 ||
+       fs_write(data->fd, buf, len) != (ssize_t)len) {
+        errno = EIO;
+        rv = -1;
+    }
+
+    mutex_unlock(&data->lock);
+
+    return rv;
+}
+
+/* Used in place of fileb_write_blocks for files that were opened read-only */
+static int fileb_write_blocks_ro(kos_blockdev_t *d, uint64_t block,
+                                 size_t count, const void *buf) {
+    (void)d;
+    (void)block;
+    (void)count;
+    (void)buf;
+
+    errno = EROFS;
+    return -1;
+}
+
+static uint64_t fileb_count_blocks(kos_blockdev_t *d) {
+    file_devdata_t *data = (file_devdata_t *)d->dev_data;
+
+    return data->block_count;
+}
+
+static int fileb_flush(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static kos_blockdev_t file_blockdev = {
+    NULL,                   /* dev_data */
+    9,                      /* l_block_size (filled in at creation) */
+    &fileb_init,            /* init */
+    &fileb_shutdown,        /* shutdown */
+    &fileb_read_blocks,     /* read_blocks */
+    &fileb_write_blocks,    /* write_blocks */
+    &fileb_count_blocks,    /* count_blocks */
+    &fileb_flush            /* flush */
+};
+
+int blockdev_file_create(kos_blockdev_t *rv, const char *fn, int mode,
+                         uint32_t l_block_size) {
+    file_devdata_t *data;
+    file_t fd;
+
+    if(!rv || !fn) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if((fd = fs_open(fn, mode)) == FILEHND_INVALID)
+        return -1;
+
+    if(!(data = (file_devdata_t *)malloc(sizeof(file_devdata_t)))) {
+        fs_close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    data->fd = fd;
+    data->block_count = fs_total64(fd) >> l_block_size;
+    mutex_init(&data->lock, MUTEX_TYPE_NORMAL);
+
+    memcpy(rv, &file_blockdev, sizeof(kos_blockdev_t));
+    rv->dev_data = data;
+    rv->l_block_size = l_block_size;
+
+    /* Don't let anyone write to a file that was opened read-only */
+    if((mode & O_MODE_MASK) == O_RDONLY)
+        rv->write_blocks = &fileb_write_blocks_ro;
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/* KallistiOS ##version##
+
+   blockdev_queue.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/* Asynchronous request queues for block devices. Requests are kept in a FIFO
+   and worked through in order by a worker thread, which calls the device's
+   own read_blocks/write_blocks functions. For devices that go to sleep while
+   the hardware works (G1 ATA in DMA mode waits on a semaphore that the DMA
+   completion IRQ signals), that leaves the CPU free for whoever submitted the
+   request. */
+
+#include <kos/blockdev.h>
+#include <kos/mutex.h>
+#include <kos/cond.h>
+#include <kos/thread.h>
+#include <kos/worker_thread.h>
+#include <sys/queue.h>
+#include <stdlib.h>
+#include <errno.h>
+
+struct kos_blockdev_queue {
+    kos_blockdev_t *dev;
+    kthread_worker_t *worker;
+    mutex_t lock;
+    condvar_t cv;
+
+    STAILQ_HEAD(req_queue, kos_blockdev_req) reqs;
+    size_t depth;
+    size_t count;                   /* Queued plus in progress */
+    kos_blockdev_req_t *active;     /* Request whose callback is running */
+};
+
+static void queue_worker(void *d) {
+    kos_blockdev_queue_t *q = (kos_blockdev_queue_t *)d;
+    kos_blockdev_t *dev = q->dev;
+    kos_blockdev_req_t *req;
+    int rv;
+
+    for(;;) {
+        mutex_lock(&q->lock);
+
+        if(!(req = STAILQ_FIRST(&q->reqs))) {
+            mutex_unlock(&q->lock);
+            break;
+        }
+
+        STAILQ_REMOVE_HEAD(&q->reqs, entry);
+        mutex_unlock(&q->lock);
+
+        /* Clear errno first, so that a device that fails without setting it
+           doesn't leave us reporting whatever was in there from before. */
+        errno = 0;
+
+        if(req->write)
+            rv = dev->write_blocks(dev, req->block, req->count, req->buf);
+        else
+            rv = dev->read_blocks(dev, req->block, req->count, req->buf);
+
+        if(rv)
+            rv = errno ? errno : EIO;
+
+        /* Give up the request's place in the queue before calling back, so
+           that the callback can submit more requests (this one included) even
+           if the queue is full. */
+        mutex_lock(&q->lock);
+        --q->count;
+        q->active = req;
+        mutex_unlock(&q->lock);
+
+        /* The callback goes before the status is set, since once it is the
+           caller is free to do whatever it likes with the request. */
+        if(req->callback)
+            req->callback(req, rv);
+
+        mutex_lock(&q->lock);
+
+        /* If the callback submitted the request again, it isn't done yet. */
+        if(q->active == req)
+            req->status = rv;
+
+        q->active = NULL;
+        cond_broadcast(&q->cv);
+        mutex_unlock(&q->lock);
+    }
+}
+
+kos_blockdev_queue_t *blockdev_queue_create(kos_blockdev_t *dev,
+                                            size_t depth) {
+    kos_blockdev_queue_t *q;
+    kthread_t *thd;
+
+    if(!dev || !depth) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if(!(q = (kos_blockdev_queue_t *)malloc(sizeof(kos_blockdev_queue_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    q->dev = dev;
+    q->depth = depth;
+    q->count = 0;
+    q->active = NULL;
+    STAILQ_INIT(&q->reqs);
+    mutex_init(&q->lock, MUTEX_TYPE_NORMAL);
+    cond_init(&q->cv);
+
+    if(!(q->worker = thd_worker_create(queue_worker, q))) {
+        cond_destroy(&q->cv);
+        mutex_destroy(&q->lock);
+        free(q);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thd = thd_worker_get_thread(q->worker);
+    thd_set_label(thd, "[blockdev_queue]");
+
+    return q;
+}
+
+void blockdev_queue_destroy(kos_blockdev_queue_t *q) {
+    mutex_lock(&q->lock);
+
+    while(q->count || q->active)
+        cond_wait(&q->cv, &q->lock);
+
+    mutex_unlock(&q->lock);
+
+    thd_worker_destroy(q->worker);
+    cond_destroy(&q->cv);
+    mutex_destroy(&q->lock);
+    free(q);
+}
+
+int blockdev_queue_submit(kos_blockdev_queue_t *q, kos_blockdev_req_t *req) {
+    if(!req->count || !req->buf) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mutex_lock(&q->lock);
+
+    if(q->count >= q->depth) {
+        mutex_unlock(&q->lock);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    req->status = BLOCKDEV_REQ_PENDING;
+    STAILQ_INSERT_TAIL(&q->reqs, req, entry);
+    ++q->count;
+
+    if(q->active == req)
+        q->active = NULL;
+
+    mutex_unlock(&q->lock);
+
+    thd_worker_wakeup(q->worker);
+
+    return 0;
+}
+
+int blockdev_queue_wait(kos_blockdev_queue_t *q, kos_blockdev_req_t *req) {
+    int rv;
+
+    mutex_lock(&q->lock);
+
+    while(req->status == BLOCKDEV_REQ_PENDING)
+        cond_wait(&q->cv, &q->lock);
+
+    rv = req->status;
+    mutex_unlock(&q->lock);
+
+    if(rv) {
+        errno = rv;
+        return -1;
+    }
+
+    return 0;
+}
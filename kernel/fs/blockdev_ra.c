@@ -0,0 +1,509 @@
+/* KallistiOS ##version##
+
+   blockdev_ra.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/* A stackable block device that sits on top of another one (the SD card, a G1
+   ATA device, a disk image, ...) and makes it look a bit less synchronous to
+   the filesystem above it.
+
+   Reads are watched for sequential access. Once two reads in a row line up,
+   a worker thread starts pulling in the next window of blocks in the
+   background. There are two windows, so that one of them can be refilled
+   while the caller is still working its way through the other.
+
+   Small writes are collected in a buffer for as long as they stay contiguous,
+   and then handed off to the worker thread to be written out with a single
+   write_blocks call. Errors from those background writes are reported by the
+   next call to flush().
+
+   There are two locks here. The state lock covers everything in the device
+   data. The I/O lock serializes access to the underlying device, and may be
+   taken while holding the state lock, but never the other way around. */
+
+#include <kos/blockdev.h>
+#include <kos/mutex.h>
+#include <kos/cond.h>
+#include <kos/thread.h>
+#include <kos/worker_thread.h>
+#include <kos/dbglog.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* Number of readahead windows per device. */
+#define RA_WINDOWS      2
+
+/* States for a readahead window. */
+#define RA_EMPTY        0
+#define RA_QUEUED       1
+#define RA_BUSY         2
+#define RA_VALID        3
+
+/* States for the write-behind buffer that is handed to the worker. */
+#define WB_EMPTY        0
+#define WB_QUEUED       1
+#define WB_BUSY         2
+
+typedef struct ra_window {
+    uint64_t start;
+    size_t count;
+    int state;
+    uint8_t *buf;
+} ra_window_t;
+
+typedef struct wb_buf {
+    uint64_t start;
+    size_t count;
+    int state;
+    uint8_t *buf;
+} wb_buf_t;
+
+/* The type of the dev_data in the block device structure */
+typedef struct ra_devdata {
+    kos_blockdev_t dev;             /* The device we're sitting on top of */
+    kthread_worker_t *worker;
+    mutex_t lock;
+    mutex_t io_lock;
+    condvar_t cv;
+
+    uint64_t block_count;
+    uint64_t next_seq;              /* Where a sequential read would start */
+    size_t ra_max;
+    size_t wb_max;
+
+    ra_window_t ra[RA_WINDOWS];
+    wb_buf_t wb_fill;               /* Being filled by write_blocks */
+    wb_buf_t wb_out;                /* Handed off to the worker */
+    int wb_err;
+} ra_devdata_t;
+
+static inline int overlaps(uint64_t s1, size_t c1, uint64_t s2, size_t c2) {
+    return s1 < s2 + c2 && s2 < s1 + c1;
+}
+
+static void ra_worker(void *d) {
+    ra_devdata_t *data = (ra_devdata_t *)d;
+    kos_blockdev_t *dev = &data->dev;
+    ra_window_t *w;
+    int i, rv, err;
+
+    mutex_lock(&data->lock);
+
+    for(;;) {
+        /* Writes always go first, so that anything we read back in will see
+           them. */
+        if(data->wb_out.state == WB_QUEUED) {
+            data->wb_out.state = WB_BUSY;
+            mutex_unlock(&data->lock);
+
+            mutex_lock(&data->io_lock);
+            rv = dev->write_blocks(dev, data->wb_out.start, data->wb_out.count,
+                                   data->wb_out.buf);
+            err = errno;
+            mutex_unlock(&data->io_lock);
+
+            mutex_lock(&data->lock);
+
+            if(rv && !data->wb_err) {
+                dbglog(DBG_ERROR, "blockdev_ra: error writing %u blocks at "
+                       "%llu\n", (unsigned)data->wb_out.count,
+                       (unsigned long long)data->wb_out.start);
+                data->wb_err = err ? err : EIO;
+            }
+
+            data->wb_out.count = 0;
+            data->wb_out.state = WB_EMPTY;
+            cond_broadcast(&data->cv);
+            continue;
+        }
+
+        for(i = 0, w = NULL; i < RA_WINDOWS; ++i) {
+            if(data->ra[i].state == RA_QUEUED) {
+                w = &data->ra[i];
+                break;
+            }
+        }
+
+        if(!w)
+            break;
+
+        w->state = RA_BUSY;
+        mutex_unlock(&data->lock);
+
+        mutex_lock(&data->io_lock);
+        rv = dev->read_blocks(dev, w->start, w->count, w->buf);
+        mutex_unlock(&data->io_lock);
+
+        mutex_lock(&data->lock);
+
+        /* If the read didn't work, just drop the window. The caller will read
+           the blocks itself and get to see the error then. */
+        w->state = rv ? RA_EMPTY : RA_VALID;
+        cond_broadcast(&data->cv);
+    }
+
+    mutex_unlock(&data->lock);
+}
+
+/* Hand the write-behind buffer off to the worker. Call with the state lock
+   held. */
+static void wb_handoff(ra_devdata_t *data) {
+    uint8_t *tmp;
+
+    if(!data->wb_fill.count)
+        return;
+
+    while(data->wb_out.state != WB_EMPTY)
+        cond_wait(&data->cv, &data->lock);
+
+    tmp = data->wb_out.buf;
+    data->wb_out.buf = data->wb_fill.buf;
+    data->wb_out.start = data->wb_fill.start;
+    data->wb_out.count = data->wb_fill.count;
+    data->wb_out.state = WB_QUEUED;
+
+    data->wb_fill.buf = tmp;
+    data->wb_fill.count = 0;
+
+    thd_worker_wakeup(data->worker);
+}
+
+/* Make sure that any buffered writes to the given range of blocks have made it
+   out to the device. Call with the state lock held. */
+static void wb_sync(ra_devdata_t *data, uint64_t block, size_t count) {
+    if(data->wb_fill.count &&
+       overlaps(block, count, data->wb_fill.start, data->wb_fill.count))
+        wb_handoff(data);
+
+    while(data->wb_out.state != WB_EMPTY &&
+          overlaps(block, count, data->wb_out.start, data->wb_out.count))
+        cond_wait(&data->cv, &data->lock);
+}
+
+/* Throw away any readahead data for the given range of blocks. Call with the
+   state lock held. */
+static void ra_invalidate(ra_devdata_t *data, uint64_t block, size_t count) {
+    int i;
+
+    for(i = 0; i < RA_WINDOWS; ++i) {
+        while(data->ra[i].state == RA_BUSY &&
+              overlaps(block, count, data->ra[i].start, data->ra[i].count))
+            cond_wait(&data->cv, &data->lock);
+
+        if(data->ra[i].state != RA_EMPTY &&
+           overlaps(block, count, data->ra[i].start, data->ra[i].count))
+            data->ra[i].state = RA_EMPTY;
+    }
+}
+
+static ra_window_t *ra_find(ra_devdata_t *data, uint64_t block) {
+    int i;
+
+    for(i = 0; i < RA_WINDOWS; ++i) {
+        if(data->ra[i].state != RA_EMPTY && block >= data->ra[i].start &&
+           block < data->ra[i].start + data->ra[i].count)
+            return &data->ra[i];
+    }
+
+    return NULL;
+}
+
+/* Queue up a readahead of the window starting at the given block, if there
+   isn't one already and there's a window free to do it with. A window is free
+   if it's empty or if it only holds blocks before the current read position.
+   Call with the state lock held. */
+static void ra_queue(ra_devdata_t *data, uint64_t block, uint64_t pos) {
+    ra_window_t *w = NULL;
+    size_t count = data->ra_max;
+    int i;
+
+    if(!count || block >= data->block_count)
+        return;
+
+    if(block + count > data->block_count)
+        count = (size_t)(data->block_count - block);
+
+    /* Don't read around data that hasn't been written out yet. The worker
+       always gets to the write before it gets to the read we queue here. */
+    if(data->wb_fill.count &&
+       overlaps(block, count, data->wb_fill.start, data->wb_fill.count))
+        wb_handoff(data);
+
+    if(ra_find(data, block))
+        return;
+
+    for(i = 0; i < RA_WINDOWS; ++i) {
+        if(data->ra[i].state == RA_EMPTY) {
+            w = &data->ra[i];
+            break;
+        }
+        else if(data->ra[i].state == RA_VALID &&
+                data->ra[i].start + data->ra[i].count <= pos) {
+            w = &data->ra[i];
+        }
+    }
+
+    if(!w)
+        return;
+
+    w->start = block;
+    w->count = count;
+    w->state = RA_QUEUED;
+    thd_worker_wakeup(data->worker);
+}
+
+static int ra_init(kos_blockdev_t *d) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+
+    if(data->dev.init(&data->dev))
+        return -1;
+
+    data->block_count = data->dev.count_blocks(&data->dev);
+
+    return 0;
+}
+
+static int ra_flush(kos_blockdev_t *d) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+    int err, rv;
+
+    mutex_lock(&data->lock);
+
+    wb_handoff(data);
+
+    while(data->wb_out.state != WB_EMPTY)
+        cond_wait(&data->cv, &data->lock);
+
+    err = data->wb_err;
+    data->wb_err = 0;
+
+    mutex_lock(&data->io_lock);
+    rv = data->dev.flush(&data->dev);
+    mutex_unlock(&data->io_lock);
+
+    mutex_unlock(&data->lock);
+
+    if(err) {
+        errno = err;
+        return -1;
+    }
+
+    return rv;
+}
+
+static void ra_free(ra_devdata_t *data) {
+    int i;
+
+    if(data->worker)
+        thd_worker_destroy(data->worker);
+
+    for(i = 0; i < RA_WINDOWS; ++i)
+        free(data->ra[i].buf);
+
+    free(data->wb_fill.buf);
+    free(data->wb_out.buf);
+    cond_destroy(&data->cv);
+    mutex_destroy(&data->io_lock);
+    mutex_destroy(&data->lock);
+    free(data);
+}
+
+static int ra_shutdown(kos_blockdev_t *d) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+    int rv;
+
+    if(ra_flush(d))
+        dbglog(DBG_ERROR, "blockdev_ra: lost writes on shutdown\n");
+
+    /* Make sure the worker is done with the device before shutting it down. */
+    thd_worker_destroy(data->worker);
+    data->worker = NULL;
+
+    rv = data->dev.shutdown(&data->dev);
+    ra_free(data);
+
+    return rv;
+}
+
+static int ra_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                          void *buf) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+    uint8_t *ptr = (uint8_t *)buf;
+    ra_window_t *w;
+    uint64_t pos = block + count;
+    int seq, rv = 0;
+    size_t n;
+
+    mutex_lock(&data->lock);
+
+    wb_sync(data, block, count);
+
+    seq = (block == data->next_seq);
+    data->next_seq = pos;
+
+    while(count) {
+        if(!(w = ra_find(data, block))) {
+            /* Nothing cached, so read the rest in directly. */
+            mutex_lock(&data->io_lock);
+            rv = data->dev.read_blocks(&data->dev, block, count, ptr);
+            mutex_unlock(&data->io_lock);
+            break;
+        }
+
+        if(w->state != RA_VALID) {
+            /* It's on its way in, so wait for it and look again. */
+            cond_wait(&data->cv, &data->lock);
+            continue;
+        }
+
+        n = (size_t)(w->start + w->count - block);
+
+        if(n > count)
+            n = count;
+
+        memcpy(ptr, w->buf + ((block - w->start) << d->l_block_size),
+               n << d->l_block_size);
+        ptr += n << d->l_block_size;
+        block += n;
+        count -= n;
+
+        /* Keep the next window coming while this one gets used up. */
+        if(seq)
+            ra_queue(data, w->start + w->count, pos);
+    }
+
+    if(seq && !rv)
+        ra_queue(data, pos, pos);
+
+    mutex_unlock(&data->lock);
+
+    return rv;
+}
+
+static int ra_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                           const void *buf) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+    wb_buf_t *f = &data->wb_fill;
+    int rv = 0;
+
+    mutex_lock(&data->lock);
+
+    ra_invalidate(data, block, count);
+
+    if(count >= data->wb_max) {
+        /* Too big to bother buffering, so get everything before it out of the
+           way and write it straight through. */
+        wb_handoff(data);
+
+        while(data->wb_out.state != WB_EMPTY)
+            cond_wait(&data->cv, &data->lock);
+
+        mutex_lock(&data->io_lock);
+        rv = data->dev.write_blocks(&data->dev, block, count, buf);
+        mutex_unlock(&data->io_lock);
+    }
+    else {
+        /* Can we add this onto what's already buffered? It can overwrite the
+           buffered blocks or come right after them, but it can't leave a
+           hole. */
+        if(f->count && (block < f->start || block > f->start + f->count ||
+                        block + count > f->start + data->wb_max))
+            wb_handoff(data);
+
+        if(!f->count)
+            f->start = block;
+
+        memcpy(f->buf + ((block - f->start) << d->l_block_size), buf,
+               count << d->l_block_size);
+
+        if(block + count > f->start + f->count)
+            f->count = (size_t)(block + count - f->start);
+
+        if(f->count == data->wb_max)
+            wb_handoff(data);
+    }
+
+    mutex_unlock(&data->lock);
+
+    return rv;
+}
+
+static uint64_t ra_count_blocks(kos_blockdev_t *d) {
+    ra_devdata_t *data = (ra_devdata_t *)d->dev_data;
+
+    return data->dev.count_blocks(&data->dev);
+}
+
+static kos_blockdev_t ra_blockdev = {
+    NULL,                   /* dev_data */
+    0,                      /* l_block_size (filled in from the device) */
+    &ra_init,               /* init */
+    &ra_shutdown,           /* shutdown */
+    &ra_read_blocks,        /* read_blocks */
+    &ra_write_blocks,       /* write_blocks */
+    &ra_count_blocks,       /* count_blocks */
+    &ra_flush               /* flush */
+};
+
+int blockdev_ra_create(kos_blockdev_t *rv, const kos_blockdev_t *dev,
+                       size_t ra_blocks, size_t wb_blocks) {
+    ra_devdata_t *data;
+    kthread_t *thd;
+    size_t ra_sz, wb_sz;
+    int i;
+
+    if(!rv || !dev) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    ra_sz = ra_blocks << dev->l_block_size;
+    wb_sz = wb_blocks << dev->l_block_size;
+
+    if(!(data = (ra_devdata_t *)calloc(1, sizeof(ra_devdata_t)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(&data->dev, dev, sizeof(kos_blockdev_t));
+    mutex_init(&data->lock, MUTEX_TYPE_NORMAL);
+    mutex_init(&data->io_lock, MUTEX_TYPE_NORMAL);
+    cond_init(&data->cv);
+    data->next_seq = (uint64_t)-1;
+    data->ra_max = ra_blocks;
+    data->wb_max = wb_blocks;
+
+    /* The buffers might get handed straight to a DMA engine, so keep them
+       nicely aligned. */
+    for(i = 0; i < RA_WINDOWS && ra_blocks; ++i) {
+        if(!(data->ra[i].buf = (uint8_t *)memalign(32, ra_sz)))
+            goto out_nomem;
+    }
+
+    if(wb_blocks) {
+        if(!(data->wb_fill.buf = (uint8_t *)memalign(32, wb_sz)) ||
+           !(data->wb_out.buf = (uint8_t *)memalign(32, wb_sz)))
+            goto out_nomem;
+    }
+
+    if(!(data->worker = thd_worker_create(ra_worker, data)))
+        goto out_nomem;
+
+    thd = thd_worker_get_thread(data->worker);
+    thd_set_label(thd, "[blockdev_ra]");
+
+    memcpy(rv, &ra_blockdev, sizeof(kos_blockdev_t));
+    rv->dev_data = data;
+    rv->l_block_size = dev->l_block_size;
+
+    return 0;
+
+out_nomem:
+    ra_free(data);
+    errno = ENOMEM;
+    return -1;
+}
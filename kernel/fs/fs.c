@@ -37,6 +37,7 @@ something like this:
 #include <kos/fs.h>
 #include <kos/thread.h>
 #include <kos/mutex.h>
+#include <kos/mempool.h>
 #include <kos/nmmgr.h>
 #include <kos/dbgio.h>
 
@@ -51,13 +52,26 @@ typedef struct fs_hnd {
 /* The global file descriptor table */
 fs_hnd_t * fd_table[FD_SETSIZE] = { NULL };
 
+/* File handles come out of a pool, so opening and closing files doesn't have
+   to go through malloc() every time. */
+static mempool_t fs_hnd_pool = MEMPOOL_INITIALIZER(sizeof(fs_hnd_t), 16, 0, 0);
+
+/* Serializes the seek-based emulation of fs_pread()/fs_pwrite(), so that two
+   threads at least won't fight over the file pointer with each other. */
+static mutex_t fs_pio_mutex = MUTEX_INITIALIZER;
+
 /* For some reason, Newlib doesn't seem to define this function in stdlib.h. */
 extern char *realpath(const char *, char[PATH_MAX]);
 
 
 /* Internal file commands for root dir reading */
 static fs_hnd_t * fs_root_opendir(void) {
-    return calloc(1, sizeof(fs_hnd_t));
+    fs_hnd_t *hnd = mempool_alloc(&fs_hnd_pool);
+
+    if(hnd)
+        memset(hnd, 0, sizeof(fs_hnd_t));
+
+    return hnd;
 }
 
 /* Not thread-safe right now */
@@ -146,7 +160,7 @@ static fs_hnd_t * fs_hnd_open(const char *fn, int mode) {
     if(h == NULL) return NULL;
 
     /* Wrap it up in a structure */
-    hnd = malloc(sizeof(fs_hnd_t));
+    hnd = mempool_alloc(&fs_hnd_pool);
 
     if(hnd == NULL) {
         cur->close(h);
@@ -186,7 +200,7 @@ static int fs_hnd_unref(fs_hnd_t * ref) {
             retval = ref->handler->close(ref->hnd);
         }
 
-        free(ref);
+        mempool_free(&fs_hnd_pool, ref);
     }
     return retval;
 }
@@ -247,7 +261,7 @@ file_t fs_open_handle(vfs_handler_t * vfs, void * vhnd) {
     fs_hnd_t * hnd;
 
     /* Wrap it up in a structure */
-    hnd = malloc(sizeof(fs_hnd_t));
+    hnd = mempool_alloc(&fs_hnd_pool);
 
     if(hnd == NULL) {
         errno = ENOMEM;
@@ -384,6 +398,150 @@ ssize_t fs_write(file_t fd, const void *buffer, size_t cnt) {
     return h->handler->write(h->hnd, buffer, cnt);
 }
 
+/* Emulate a positional read or write for filesystems that don't do them
+   themselves: move the file pointer there, do the I/O, and put it back. */
+static ssize_t fs_pio_emulate(file_t fd, void *buf, size_t cnt,
+                              _off64_t offset, int write) {
+    _off64_t old;
+    ssize_t rv = -1;
+    int err;
+
+    if(offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mutex_lock(&fs_pio_mutex);
+
+    if((old = fs_tell64(fd)) < 0)
+        goto out;
+
+    if(fs_seek64(fd, offset, SEEK_SET) < 0)
+        goto out;
+
+    if(write)
+        rv = fs_write(fd, buf, cnt);
+    else
+        rv = fs_read(fd, buf, cnt);
+
+    err = errno;
+    fs_seek64(fd, old, SEEK_SET);
+    errno = err;
+
+out:
+    mutex_unlock(&fs_pio_mutex);
+    return rv;
+}
+
+ssize_t fs_pread(file_t fd, void *buffer, size_t cnt, _off64_t offset) {
+    fs_hnd_t *h = fs_map_hnd(fd);
+
+    if(h == NULL) return -1;
+
+    if(h->handler == NULL || h->handler->read == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(h->handler->pread)
+        return h->handler->pread(h->hnd, buffer, cnt, offset);
+
+    return fs_pio_emulate(fd, buffer, cnt, offset, 0);
+}
+
+ssize_t fs_pwrite(file_t fd, const void *buffer, size_t cnt,
+                  _off64_t offset) {
+    fs_hnd_t *h = fs_map_hnd(fd);
+
+    if(h == NULL) return -1;
+
+    if(h->handler == NULL || h->handler->write == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(h->handler->pwrite)
+        return h->handler->pwrite(h->hnd, buffer, cnt, offset);
+
+    return fs_pio_emulate(fd, (void *)buffer, cnt, offset, 1);
+}
+
+/* Emulate readv()/writev() one buffer at a time, stopping at the first short
+   transfer just like a single read or write would. */
+static ssize_t fs_iov_emulate(file_t fd, const struct iovec *iov, int iovcnt,
+                              int write) {
+    ssize_t rv, total = 0;
+    int i;
+
+    for(i = 0; i < iovcnt; ++i) {
+        if(!iov[i].iov_len)
+            continue;
+
+        if(write)
+            rv = fs_write(fd, iov[i].iov_base, iov[i].iov_len);
+        else
+            rv = fs_read(fd, iov[i].iov_base, iov[i].iov_len);
+
+        if(rv < 0)
+            return total ? total : -1;
+
+        total += rv;
+
+        if((size_t)rv < iov[i].iov_len)
+            break;
+    }
+
+    return total;
+}
+
+ssize_t fs_readv(file_t fd, const struct iovec *iov, int iovcnt) {
+    fs_hnd_t *h = fs_map_hnd(fd);
+
+    if(h == NULL) return -1;
+
+    if(iovcnt <= 0 || iovcnt > IOV_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(h->handler == NULL || h->handler->read == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(h->handler->readv)
+        return h->handler->readv(h->hnd, iov, iovcnt);
+
+    return fs_iov_emulate(fd, iov, iovcnt, 0);
+}
+
+ssize_t fs_writev(file_t fd, const struct iovec *iov, int iovcnt) {
+    fs_hnd_t *h;
+
+    if(iovcnt <= 0 || iovcnt > IOV_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Let fs_write() deal with stdout/stderr, as above. */
+    if(fd == 1 || fd == 2)
+        return fs_iov_emulate(fd, iov, iovcnt, 1);
+
+    h = fs_map_hnd(fd);
+
+    if(h == NULL) return -1;
+
+    if(h->handler == NULL || h->handler->write == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(h->handler->writev)
+        return h->handler->writev(h->hnd, iov, iovcnt);
+
+    return fs_iov_emulate(fd, iov, iovcnt, 1);
+}
+
 off_t fs_seek(file_t fd, off_t offset, int whence) {
     fs_hnd_t *h = fs_map_hnd(fd);
 
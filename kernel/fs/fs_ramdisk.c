@@ -16,11 +16,15 @@ get as big as the memory available, there's no arbitrary limit.
 
 A note of warning about thread usage here as well. This FS is protected against
 thread contention at a file handle and data structure level. This means that the
-directory structures and the file handles will never become inconsistent. However,
-it is not protected at the individual file level. Because of this limitation, only
-one file handle may be open to an individual file for writing at any given time.
-If the file is already open for reading, it cannot be written to. Likewise, if
-the file is open for writing, you can't open it for reading or writing.
+directory structures and the file handles will never become inconsistent. The
+directory structures and handle table are protected by one mutex, which is only
+held for long enough to look things up. The contents of each file are protected
+by a reader/writer semaphore of their own, so threads reading different files
+(or the same file) don't wait on each other while data is being copied. However,
+only one file handle may be open to an individual file for writing at any given
+time. If the file is already open for reading, it cannot be written to.
+Likewise, if the file is open for writing, you can't open it for reading or
+writing.
 
 So for example, if you wanted to cache an MP3 in the ramdisk, you'd copy the data
 to the ramdisk in write mode, then close the file and let the library re-open it
@@ -33,11 +37,13 @@ cache data from disk rather than as a general purpose file system.
 
 #include <kos/thread.h>
 #include <kos/mutex.h>
+#include <kos/rwsem.h>
 #include <kos/fs_ramdisk.h>
 #include <kos/opts.h>
 #include <malloc.h>
 #include <string.h>
 #include <strings.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -50,6 +56,8 @@ cache data from disk rather than as a general purpose file system.
 char *strdup(const char *);
 #endif
 
+struct rd_dir;
+
 /* File definition */
 typedef struct rd_file {
     char    * name;     /* File name -- allocated */
@@ -59,18 +67,35 @@ typedef struct rd_file {
     int usage;      /* Usage count (unopened is 0) */
 
     /* For the following two members:
-      - In files, this is a block of allocated memory containing the
-        actual file data. Each time we need to expand it beyond its
-        current capacity, we realloc() with enough to hold the new
-        data plus 4k (to avoid realloc thrashing). All files start
-        out with a 1K block of space.
+      - In files that have been mmap()ed or attached, this is a single
+        block of allocated memory containing the actual file data. Each
+        time we need to expand it beyond its current capacity, we at
+        least double its size (to avoid realloc thrashing).
+      - In all other files, this is NULL and the data is in the pages
+        below.
       - In directories, this is just a pointer to an rd_dir struct,
         which is defined below. datasize has no meaning for a
         directory. */
     void    * data;     /* Data block pointer */
     uint32  datasize;   /* Size of data block pointer */
 
+    /* Page table for files without a data block. Each entry points to
+       FS_RAMDISK_PAGE_SIZE bytes of the file, or is NULL for a page that
+       hasn't been written to (which reads back as zeroes). Writing a file
+       a little at a time thus never has to copy what is already there. */
+    uint8   ** pages;   /* Page table -- allocated */
+    uint32  pagecnt;    /* Number of entries in the page table */
+
+    /* Lock for the contents of the file (everything above from size on,
+       other than the type and the lock constants). Held for reading while
+       data is copied out of the file, and for writing while it changes. */
+    rw_semaphore_t  lock;
+
+    struct rd_dir   * parent;   /* Directory the file is in */
+    uint32  hash;               /* Hash of the file name */
+
     LIST_ENTRY(rd_file) dirlist;    /* Directory list entry */
+    LIST_ENTRY(rd_file) hashlist;   /* Directory hash table entry */
 } rd_file_t;
 
 /* Lock constants */
@@ -78,8 +103,19 @@ typedef struct rd_file {
 #define OPENFOR_READ    1   /* Opened read-only */
 #define OPENFOR_WRITE   2   /* Opened read-write */
 
-/* Directory definition -- just basically a list of files we contain */
-typedef LIST_HEAD(rd_dir, rd_file) rd_dir_t;
+#define RD_PAGE_SIZE    FS_RAMDISK_PAGE_SIZE
+
+/* Directory definition -- a list of the files we contain, in the order that
+   readdir() gives them back, and a hash table to find them by name. The hash
+   table doubles in size whenever there are more than two files per bucket. */
+LIST_HEAD(rd_file_list, rd_file);
+
+typedef struct rd_dir {
+    struct rd_file_list files;  /* All files in the directory */
+    struct rd_file_list * hash; /* Hash table -- allocated */
+    uint32  hashsz;             /* Buckets in the hash table (power of two) */
+    uint32  count;              /* Number of files in the directory */
+} rd_dir_t;
 
 /* Pointer to the root diretctory */
 static rd_file_t *root = NULL;
@@ -88,32 +124,102 @@ static rd_dir_t  *rootdir = NULL;
 /********************************************************************************/
 /* File primitives */
 
-/* File handles.. I could probably do this with a linked list, but I'm just
-   too lazy right now. =) */
-static struct {
+/* File handles. The handle table holds pointers to these, and grows as more
+   files are opened at once. A handle is referenced by the table and by each
+   call that is using it, so closing it while another thread is in the middle
+   of reading from it doesn't pull it out from under that thread. */
+typedef struct rd_fh {
     rd_file_t   *file;      /* ramdisk file struct */
     int         dir;        /* >0 if a directory */
-    uint32      ptr;        /* Current read position in bytes */
+    uint32      ptr;        /* Current position (only touched under rd_mutex) */
     dirent_t    dirent;     /* A static dirent to pass back to clients */
     int         omode;      /* Open mode */
-} fh[FS_RAMDISK_MAX_FILES];
+    int         refcnt;     /* References to this handle */
+} rd_fh_t;
+
+static rd_fh_t **fh = NULL;     /* Handle table -- allocated */
+static file_t fh_count = 0;     /* Entries in the handle table */
 
 /* Mutex for file system structs */
 static mutex_t rd_mutex;
 
+/* Hash a file name, ignoring case. */
+static uint32 ramdisk_hash(const char * name, int namelen) {
+    uint32 h = 2166136261UL;
+
+    while(namelen--) {
+        h ^= (uint8)tolower((uint8)*name++);
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
 /* Search a directory for the named file; return the struct if
    we find it. Assumes we hold rd_mutex. */
 static rd_file_t * ramdisk_find(rd_dir_t * parent, const char * name, int namelen) {
     rd_file_t   *f;
+    uint32      h;
 
-    LIST_FOREACH(f, parent, dirlist) {
-        if(!strncasecmp(name, f->name, namelen))
+    if(!parent->hashsz)
+        return NULL;
+
+    h = ramdisk_hash(name, namelen);
+
+    LIST_FOREACH(f, &parent->hash[h & (parent->hashsz - 1)], hashlist) {
+        if(f->hash == h && !strncasecmp(name, f->name, namelen) &&
+           f->name[namelen] == 0)
             return f;
     }
 
     return NULL;
 }
 
+/* Add a file to a directory, growing its hash table if need be. Assumes we
+   hold rd_mutex. */
+static int ramdisk_dir_add(rd_dir_t * dir, rd_file_t * f) {
+    struct rd_file_list *nh;
+    rd_file_t   *i;
+    uint32      sz;
+
+    if(dir->count >= dir->hashsz * 2) {
+        sz = dir->hashsz ? dir->hashsz * 2 : 8;
+
+        if((nh = (struct rd_file_list *)malloc(sizeof(*nh) * sz))) {
+            /* Move everything over to the new table */
+            free(dir->hash);
+            dir->hash = nh;
+            dir->hashsz = sz;
+
+            while(sz--)
+                LIST_INIT(&nh[sz]);
+
+            LIST_FOREACH(i, &dir->files, dirlist) {
+                LIST_INSERT_HEAD(&nh[i->hash & (dir->hashsz - 1)], i,
+                                 hashlist);
+            }
+        }
+        /* A full table still works, but an empty one doesn't. */
+        else if(!dir->hashsz) {
+            return -1;
+        }
+    }
+
+    f->parent = dir;
+    LIST_INSERT_HEAD(&dir->files, f, dirlist);
+    LIST_INSERT_HEAD(&dir->hash[f->hash & (dir->hashsz - 1)], f, hashlist);
+    ++dir->count;
+
+    return 0;
+}
+
+/* Remove a file from the directory it is in. Assumes we hold rd_mutex. */
+static void ramdisk_dir_remove(rd_file_t * f) {
+    LIST_REMOVE(f, dirlist);
+    LIST_REMOVE(f, hashlist);
+    --f->parent->count;
+}
+
 /* Find a path-named file in the ramdisk. There should not be a
    slash at the beginning, nor at the end. Assumes we hold rd_mutex. */
 static rd_file_t * ramdisk_find_path(rd_dir_t * parent, const char * fn, int dir) {
@@ -216,31 +322,189 @@ static rd_file_t * ramdisk_create_file(rd_dir_t * parent, const char * fn, int d
     f->type = dir ? STAT_TYPE_DIR : STAT_TYPE_FILE;
     f->openfor = OPENFOR_NOTHING;
     f->usage = 0;
+    f->data = NULL;
+    f->datasize = 0;
+    f->pages = NULL;
+    f->pagecnt = 0;
+    f->hash = ramdisk_hash(f->name, strlen(f->name));
+
+    /* Files don't get any pages until they're written to */
+    if(dir) {
+        if(!(f->data = malloc(sizeof(rd_dir_t)))) {
+            free(f->name);
+            free(f);
+            return NULL;
+        }
 
-    if(!dir) {
-        f->data = malloc(1024);
-        f->datasize = 1024;
-    }
-    else {
-        f->data = malloc(sizeof(rd_dir_t));
-        f->datasize = 0;
+        memset(f->data, 0, sizeof(rd_dir_t));
+        LIST_INIT(&((rd_dir_t *)f->data)->files);
     }
 
-    if(f->data == NULL) {
+    if(ramdisk_dir_add(pdir, f) < 0) {
+        free(f->data);
         free(f->name);
         free(f);
         return NULL;
     }
 
-    LIST_INSERT_HEAD(pdir, f, dirlist);
+    rwsem_init(&f->lock);
 
     return f;
 }
 
+/* Free all of a file's data, leaving it empty. Assumes we hold rd_mutex, and
+   either the file's lock for writing or that nobody has the file open. */
+static void ramdisk_free_data(rd_file_t *f) {
+    uint32 i;
+
+    for(i = 0; i < f->pagecnt; i++)
+        free(f->pages[i]);
+
+    free(f->pages);
+    free(f->data);
+
+    f->pages = NULL;
+    f->pagecnt = 0;
+    f->data = NULL;
+    f->datasize = 0;
+    f->size = 0;
+}
+
+/* Gather the pages of a file into a single block of memory, so that it can be
+   handed out by mmap() or detach. Assumes we hold the file's lock for
+   writing. */
+static int ramdisk_flatten(rd_file_t *f) {
+    uint8 *blk;
+    uint32 i, n, size = f->size;
+
+    if(f->data)
+        return 0;
+
+    if(!(blk = (uint8 *)malloc(size ? size : RD_PAGE_SIZE))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(i = 0; i < size; i += n) {
+        n = size - i < RD_PAGE_SIZE ? size - i : RD_PAGE_SIZE;
+
+        if(f->pages[i / RD_PAGE_SIZE])
+            memcpy(blk + i, f->pages[i / RD_PAGE_SIZE], n);
+        else
+            memset(blk + i, 0, n);
+    }
+
+    ramdisk_free_data(f);
+    f->data = blk;
+    f->datasize = size ? size : RD_PAGE_SIZE;
+    f->size = size;
+
+    return 0;
+}
+
+/* Look up an open handle. Assumes we hold rd_mutex. */
+static rd_fh_t * ramdisk_fh_lookup(void * h) {
+    file_t fd = (file_t)h;
+
+    if(fd <= 0 || fd >= fh_count)
+        return NULL;
+
+    return fh[fd];
+}
+
+/* Drop a reference to a handle, and if it was the last one, finish closing
+   the file. Assumes we hold rd_mutex. */
+static void ramdisk_fh_put(rd_fh_t * hnd) {
+    rd_file_t *f = hnd->file;
+
+    if(--hnd->refcnt)
+        return;
+
+    /* Decrease the usage count */
+    f->usage--;
+    assert(f->usage >= 0);
+
+    /* If the usage count is back to 0, then no one has the file
+       open. Remove the openfor status. */
+    if(f->usage == 0)
+        f->openfor = OPENFOR_NOTHING;
+
+    free(hnd);
+}
+
+/* Take a reference to an open file (not directory) handle, so that the data
+   can be accessed without holding rd_mutex. If write is non-zero, the file
+   must be open for writing. If pos is non-NULL, the handle's current position
+   is returned in it. Release it with ramdisk_fh_release(). */
+static rd_fh_t * ramdisk_fh_get(void * h, int write, uint32 * pos) {
+    rd_fh_t *hnd;
+
+    mutex_lock(&rd_mutex);
+    hnd = ramdisk_fh_lookup(h);
+
+    if(!hnd || hnd->dir ||
+       (write && hnd->file->openfor != OPENFOR_WRITE)) {
+        mutex_unlock(&rd_mutex);
+        errno = EBADF;
+        return NULL;
+    }
+
+    ++hnd->refcnt;
+
+    if(pos)
+        *pos = hnd->ptr;
+
+    mutex_unlock(&rd_mutex);
+
+    return hnd;
+}
+
+/* Drop a reference taken with ramdisk_fh_get(), first moving the handle's
+   position to *pos if pos is non-NULL. */
+static void ramdisk_fh_release(rd_fh_t * hnd, const uint32 * pos) {
+    mutex_lock(&rd_mutex);
+
+    if(pos)
+        hnd->ptr = *pos;
+
+    ramdisk_fh_put(hnd);
+    mutex_unlock(&rd_mutex);
+}
+
+/* Find a free slot in the handle table, growing it if there isn't one.
+   Assumes we hold rd_mutex. */
+static file_t ramdisk_alloc_fd(void) {
+    rd_fh_t **nfh;
+    file_t fd, cnt;
+
+    /* Slot 0 is never used, since that would look like NULL. */
+    for(fd = 1; fd < fh_count; fd++)
+        if(fh[fd] == NULL)
+            return fd;
+
+    cnt = fh_count ? fh_count * 2 : FS_RAMDISK_MAX_FILES;
+
+    if(cnt < 2)
+        cnt = 2;
+
+    if(!(nfh = (rd_fh_t **)realloc(fh, cnt * sizeof(rd_fh_t *)))) {
+        errno = ENFILE;
+        return -1;
+    }
+
+    memset(nfh + fh_count, 0, (cnt - fh_count) * sizeof(rd_fh_t *));
+    fd = fh_count ? fh_count : 1;
+    fh = nfh;
+    fh_count = cnt;
+
+    return fd;
+}
+
 /* Open a file or directory */
 static void * ramdisk_open(vfs_handler_t * vfs, const char *fn, int mode) {
-    file_t      fd = -1;
+    file_t      fd;
     rd_file_t   *f;
+    rd_fh_t     *hnd;
     int     mm = mode & O_MODE_MASK;
 
     (void)vfs;
@@ -281,49 +545,41 @@ static void * ramdisk_open(vfs_handler_t * vfs, const char *fn, int mode) {
     if(f->type == STAT_TYPE_DIR && (!(mode & O_DIR) || mm != O_RDONLY))
         goto error_out;
 
-    /* Find a free file handle */
-    for(fd = 1; fd < FS_RAMDISK_MAX_FILES; fd++)
-        if(fh[fd].file == NULL)
-            break;
+    /* Is the file already open for write? */
+    if(f->openfor == OPENFOR_WRITE)
+        goto error_out;
 
-    /* Did we find it? */
-    if(fd >= FS_RAMDISK_MAX_FILES) {
-        fd = -1;
+    /* Can't write to a file that's open for reading */
+    if(mm != O_RDONLY && f->openfor == OPENFOR_READ)
         goto error_out;
-    }
 
-    /* Is the file already open for write? */
-    if(f->openfor == OPENFOR_WRITE)
+    /* Find a free file handle */
+    if((fd = ramdisk_alloc_fd()) < 0)
+        goto error_out;
+
+    if(!(hnd = (rd_fh_t *)malloc(sizeof(rd_fh_t))))
         goto error_out;
 
     /* Fill the basic fd structure */
-    fh[fd].file = f;
-    fh[fd].dir = mode & O_DIR;
-    fh[fd].omode = mode;
+    hnd->file = f;
+    hnd->dir = mode & O_DIR;
+    hnd->omode = mode;
+    hnd->refcnt = 1;
+    hnd->ptr = 0;
 
     /* The rest require a bit more thought */
     if(mm == O_RDONLY) {
         f->openfor = OPENFOR_READ;
-        fh[fd].ptr = 0;
     }
     else if((mm & O_RDWR) || (mm & O_WRONLY)) {
-        if(f->openfor == OPENFOR_READ)
-            goto error_out;
-
         f->openfor = OPENFOR_WRITE;
 
         if(mode & O_APPEND)
-            fh[fd].ptr = f->size;
-        /* If we're opening with O_TRUNC, kill the existing contents */
-        else if(mode & O_TRUNC) {
-            free(f->data);
-            f->data = malloc(1024);
-            f->datasize = 1024;
-            f->size = 0;
-            fh[fd].ptr = 0;
-        }
-        else
-            fh[fd].ptr = 0;
+            hnd->ptr = f->size;
+        /* If we're opening with O_TRUNC, kill the existing contents. Nobody
+           else has the file open, so there's no need for its lock. */
+        else if(mode & O_TRUNC)
+            ramdisk_free_data(f);
     }
     else {
         assert_msg(0, "Unknown file mode");
@@ -332,121 +588,326 @@ static void * ramdisk_open(vfs_handler_t * vfs, const char *fn, int mode) {
     /* If we opened a dir, then ptr is actually a pointer to the first
        file entry. */
     if(mode & O_DIR) {
-        fh[fd].ptr = (uint32)LIST_FIRST((rd_dir_t *)f->data);
+        hnd->ptr = (uint32)LIST_FIRST(&((rd_dir_t *)f->data)->files);
     }
 
     /* Increase the usage count */
     f->usage++;
+    fh[fd] = hnd;
 
     /* Should do it... */
     mutex_unlock(&rd_mutex);
     return (void *)fd;
 
 error_out:
-
-    if(fd != -1)
-        fh[fd].file = NULL;
-
     mutex_unlock(&rd_mutex);
     return NULL;
 }
 
 /* Close a file or directory */
 static int ramdisk_close(void * h) {
-    rd_file_t   *f;
-    file_t      fd = (file_t)h;
+    rd_fh_t     *hnd;
 
     mutex_lock(&rd_mutex);
 
     /* Check that the fd is valid */
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL) {
-        f = fh[fd].file;
-        fh[fd].file = NULL;
-
-        /* Decrease the usage count */
-        f->usage--;
-        assert(f->usage >= 0);
-
-        /* If the usage count is back to 0, then no one has the file
-           open. Remove the openfor status. */
-        if(f->usage == 0)
-            f->openfor = OPENFOR_NOTHING;
+    if((hnd = ramdisk_fh_lookup(h))) {
+        fh[(file_t)h] = NULL;
+        ramdisk_fh_put(hnd);
     }
 
     mutex_unlock(&rd_mutex);
     return 0;
 }
 
+/* Copy out of a file from the given position. Assumes we hold the file's lock
+   for reading. */
+static ssize_t ramdisk_read_at(rd_file_t *f, void *buf, size_t bytes,
+                               uint32 pos) {
+    uint8 *page;
+    size_t done, n, off;
+
+    /* Is there enough left? */
+    if(pos >= f->size)
+        return 0;
+
+    if(bytes > f->size - pos)
+        bytes = f->size - pos;
+
+    /* Copy out the requested amount */
+    if(f->data) {
+        memcpy(buf, ((uint8 *)f->data) + pos, bytes);
+        return bytes;
+    }
+
+    for(done = 0; done < bytes; done += n) {
+        off = (pos + done) & (RD_PAGE_SIZE - 1);
+        n = RD_PAGE_SIZE - off;
+
+        if(n > bytes - done)
+            n = bytes - done;
+
+        if((page = f->pages[(pos + done) / RD_PAGE_SIZE]))
+            memcpy((uint8 *)buf + done, page + off, n);
+        else
+            memset((uint8 *)buf + done, 0, n);
+    }
+
+    return bytes;
+}
+
+/* Copy into a file with a single data block at the given position. Assumes
+   we hold the file's lock for writing. */
+static ssize_t ramdisk_write_flat(rd_file_t *f, const void *buf, size_t bytes,
+                                  uint32 pos) {
+    uint32 size;
+    void *np;
+
+    /* Is there enough left? */
+    if((pos + bytes) > f->datasize) {
+        /* We need to realloc the block */
+        size = f->datasize * 2;
+
+        if(size < pos + bytes)
+            size = pos + bytes;
+
+        if(!(np = realloc(f->data, size))) {
+            errno = ENOSPC;
+            return -1;
+        }
+
+        f->data = np;
+        f->datasize = size;
+    }
+
+    /* Don't leave junk in any hole we're leaving behind */
+    if(pos > f->size)
+        memset(((uint8 *)f->data) + f->size, 0, pos - f->size);
+
+    /* Copy in the requested amount */
+    memcpy(((uint8 *)f->data) + pos, buf, bytes);
+
+    if(f->size < pos + bytes)
+        f->size = pos + bytes;
+
+    return bytes;
+}
+
+/* Copy into a file at the given position, growing it if need be. Assumes we
+   hold the file's lock for writing. */
+static ssize_t ramdisk_write_at(rd_file_t *f, const void *buf, size_t bytes,
+                                uint32 pos) {
+    uint32 cnt = (uint32)(((uint64)pos + bytes + RD_PAGE_SIZE - 1) /
+                          RD_PAGE_SIZE);
+    uint8 **np, *page;
+    size_t done, n, off;
+
+    if(f->data)
+        return ramdisk_write_flat(f, buf, bytes, pos);
+
+    /* Make sure the page table reaches far enough */
+    if(cnt > f->pagecnt) {
+        if(cnt < f->pagecnt * 2)
+            cnt = f->pagecnt * 2;
+
+        if(!(np = (uint8 **)realloc(f->pages, cnt * sizeof(uint8 *)))) {
+            errno = ENOSPC;
+            return -1;
+        }
+
+        memset(np + f->pagecnt, 0, (cnt - f->pagecnt) * sizeof(uint8 *));
+        f->pages = np;
+        f->pagecnt = cnt;
+    }
+
+    /* Copy in the requested amount, a page at a time. Holes are left as
+       unallocated pages, and newly allocated pages start out zeroed, so that
+       nothing past the end of the file ever has junk in it. */
+    for(done = 0; done < bytes; done += n) {
+        off = (pos + done) & (RD_PAGE_SIZE - 1);
+        n = RD_PAGE_SIZE - off;
+
+        if(n > bytes - done)
+            n = bytes - done;
+
+        if(!(page = f->pages[(pos + done) / RD_PAGE_SIZE])) {
+            if(!(page = (uint8 *)malloc(RD_PAGE_SIZE)))
+                break;
+
+            if(n < RD_PAGE_SIZE)
+                memset(page, 0, RD_PAGE_SIZE);
+
+            f->pages[(pos + done) / RD_PAGE_SIZE] = page;
+        }
+
+        memcpy(page + off, (const uint8 *)buf + done, n);
+    }
+
+    if(!done && bytes) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if(f->size < pos + done)
+        f->size = pos + done;
+
+    return done;
+}
+
 /* Read from a file */
 static ssize_t ramdisk_read(void * h, void *buf, size_t bytes) {
-    ssize_t rv = -1;
-    file_t  fd = (file_t)h;
+    ssize_t rv;
+    rd_fh_t *hnd;
+    uint32  pos;
 
-    mutex_lock(&rd_mutex);
+    /* Check that the fd is valid */
+    if(!(hnd = ramdisk_fh_get(h, 0, &pos)))
+        return -1;
+
+    rwsem_read_lock(&hnd->file->lock);
+    rv = ramdisk_read_at(hnd->file, buf, bytes, pos);
+    rwsem_read_unlock(&hnd->file->lock);
+
+    pos += rv;
+    ramdisk_fh_release(hnd, &pos);
+    return rv;
+}
+
+/* Write to a file */
+static ssize_t ramdisk_write(void * h, const void *buf, size_t bytes) {
+    ssize_t rv;
+    rd_fh_t *hnd;
+    uint32  pos;
 
     /* Check that the fd is valid */
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && !fh[fd].dir) {
-        /* Is there enough left? */
-        if((fh[fd].ptr + bytes) > fh[fd].file->size)
-            bytes = fh[fd].file->size - fh[fd].ptr;
+    if(!(hnd = ramdisk_fh_get(h, 1, &pos)))
+        return -1;
+
+    rwsem_write_lock(&hnd->file->lock);
+
+    if((rv = ramdisk_write_at(hnd->file, buf, bytes, pos)) > 0)
+        pos += rv;
 
-        /* Copy out the requested amount */
-        memcpy(buf, ((uint8 *)fh[fd].file->data) + fh[fd].ptr, bytes);
-        fh[fd].ptr += bytes;
+    rwsem_write_unlock(&hnd->file->lock);
 
-        rv = bytes;
+    ramdisk_fh_release(hnd, &pos);
+    return rv;
+}
+
+/* Read from a given offset in a file */
+static ssize_t ramdisk_pread(void * h, void *buf, size_t bytes,
+                             _off64_t offset) {
+    ssize_t rv = 0;
+    rd_fh_t *hnd;
+
+    if(offset < 0) {
+        errno = EINVAL;
+        return -1;
     }
 
-    mutex_unlock(&rd_mutex);
+    if(!(hnd = ramdisk_fh_get(h, 0, NULL)))
+        return -1;
+
+    rwsem_read_lock(&hnd->file->lock);
+
+    if(offset < hnd->file->size)
+        rv = ramdisk_read_at(hnd->file, buf, bytes, (uint32)offset);
+
+    rwsem_read_unlock(&hnd->file->lock);
+
+    ramdisk_fh_release(hnd, NULL);
     return rv;
 }
 
-/* Write to a file */
-static ssize_t ramdisk_write(void * h, const void *buf, size_t bytes) {
-    ssize_t rv = -1;
-    file_t  fd = (file_t)h;
+/* Write to a given offset in a file */
+static ssize_t ramdisk_pwrite(void * h, const void *buf, size_t bytes,
+                              _off64_t offset) {
+    ssize_t rv;
+    rd_fh_t *hnd;
 
-    mutex_lock(&rd_mutex);
+    if(offset < 0 || offset + bytes > 0xffffffffULL) {
+        errno = EINVAL;
+        return -1;
+    }
 
-    /* Check that the fd is valid */
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && !fh[fd].dir && fh[fd].file->openfor == OPENFOR_WRITE) {
-        /* Is there enough left? */
-        if((fh[fd].ptr + bytes) > fh[fd].file->datasize) {
-            /* We need to realloc the block */
-            void * np = realloc(fh[fd].file->data, (fh[fd].ptr + bytes) + 4096);
+    if(!(hnd = ramdisk_fh_get(h, 1, NULL)))
+        return -1;
 
-            if(np == NULL)
-                goto error_out;
+    rwsem_write_lock(&hnd->file->lock);
+    rv = ramdisk_write_at(hnd->file, buf, bytes, (uint32)offset);
+    rwsem_write_unlock(&hnd->file->lock);
 
-            fh[fd].file->data = np;
-            fh[fd].file->datasize = (fh[fd].ptr + bytes) + 4096;
-        }
+    ramdisk_fh_release(hnd, NULL);
+    return rv;
+}
+
+/* Read from a file into several buffers */
+static ssize_t ramdisk_readv(void * h, const struct iovec *iov, int iovcnt) {
+    ssize_t rv = 0, n;
+    rd_fh_t *hnd;
+    uint32  pos;
+    int     i;
+
+    if(!(hnd = ramdisk_fh_get(h, 0, &pos)))
+        return -1;
+
+    rwsem_read_lock(&hnd->file->lock);
+
+    for(i = 0; i < iovcnt; ++i) {
+        n = ramdisk_read_at(hnd->file, iov[i].iov_base, iov[i].iov_len, pos);
+        pos += n;
+        rv += n;
+
+        if((size_t)n < iov[i].iov_len)
+            break;
+    }
+
+    rwsem_read_unlock(&hnd->file->lock);
+
+    ramdisk_fh_release(hnd, &pos);
+    return rv;
+}
+
+/* Write to a file from several buffers */
+static ssize_t ramdisk_writev(void * h, const struct iovec *iov, int iovcnt) {
+    ssize_t rv = 0, n;
+    rd_fh_t *hnd;
+    uint32  pos;
+    int     i;
+
+    if(!(hnd = ramdisk_fh_get(h, 1, &pos)))
+        return -1;
+
+    rwsem_write_lock(&hnd->file->lock);
 
-        /* Copy out the requested amount */
-        memcpy(((uint8 *)fh[fd].file->data) + fh[fd].ptr, buf, bytes);
-        fh[fd].ptr += bytes;
+    for(i = 0; i < iovcnt; ++i) {
+        if((n = ramdisk_write_at(hnd->file, iov[i].iov_base, iov[i].iov_len,
+                                 pos)) < 0) {
+            if(!rv)
+                rv = -1;
 
-        if(fh[fd].file->size < fh[fd].ptr) {
-            fh[fd].file->size = fh[fd].ptr;
+            break;
         }
 
-        rv = bytes;
+        pos += n;
+        rv += n;
     }
 
-error_out:
-    mutex_unlock(&rd_mutex);
+    rwsem_write_unlock(&hnd->file->lock);
+
+    ramdisk_fh_release(hnd, &pos);
     return rv;
 }
 
 /* Seek elsewhere in a file */
 static off_t ramdisk_seek(void * h, off_t offset, int whence) {
     off_t   rv = -1;
-    file_t  fd = (file_t)h;
+    rd_fh_t *hnd;
 
     mutex_lock(&rd_mutex);
 
     /* Check that the fd is valid */
-    if(fd >= FS_RAMDISK_MAX_FILES || !fh[fd].file || fh[fd].dir) {
+    if(!(hnd = ramdisk_fh_lookup(h)) || hnd->dir) {
         errno = EBADF;
         mutex_unlock(&rd_mutex);
         return -1;
@@ -461,27 +922,27 @@ static off_t ramdisk_seek(void * h, off_t offset, int whence) {
                 return -1;
             }
 
-            fh[fd].ptr = offset;
+            hnd->ptr = offset;
             break;
 
         case SEEK_CUR:
-            if(offset < 0 && ((uint32)-offset) > fh[fd].ptr) {
+            if(offset < 0 && ((uint32)-offset) > hnd->ptr) {
                 errno = EINVAL;
                 mutex_unlock(&rd_mutex);
                 return -1;
             }
 
-            fh[fd].ptr += offset;
+            hnd->ptr += offset;
             break;
 
         case SEEK_END:
-            if(offset < 0 && ((uint32)-offset) > fh[fd].file->size) {
+            if(offset < 0 && ((uint32)-offset) > hnd->file->size) {
                 errno = EINVAL;
                 mutex_unlock(&rd_mutex);
                 return -1;
             }
 
-            fh[fd].ptr = fh[fd].file->size + offset;
+            hnd->ptr = hnd->file->size + offset;
             break;
 
         default:
@@ -492,9 +953,9 @@ static off_t ramdisk_seek(void * h, off_t offset, int whence) {
 
     /* Check bounds */
     // XXXX: Technically this isn't correct. Fix it sometime.
-    if(fh[fd].ptr > fh[fd].file->size) fh[fd].ptr = fh[fd].file->size;
+    if(hnd->ptr > hnd->file->size) hnd->ptr = hnd->file->size;
 
-    rv = fh[fd].ptr;
+    rv = hnd->ptr;
     mutex_unlock(&rd_mutex);
     return rv;
 }
@@ -502,12 +963,12 @@ static off_t ramdisk_seek(void * h, off_t offset, int whence) {
 /* Tell where in the file we are */
 static off_t ramdisk_tell(void * h) {
     off_t   rv = -1;
-    file_t  fd = (file_t)h;
+    rd_fh_t *hnd;
 
     mutex_lock(&rd_mutex);
 
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && !fh[fd].dir)
-        rv = fh[fd].ptr;
+    if((hnd = ramdisk_fh_lookup(h)) && !hnd->dir)
+        rv = hnd->ptr;
 
     mutex_unlock(&rd_mutex);
     return rv;
@@ -516,12 +977,12 @@ static off_t ramdisk_tell(void * h) {
 /* Tell how big the file is */
 static size_t ramdisk_total(void * h) {
     off_t   rv = -1;
-    file_t  fd = (file_t)h;
+    rd_fh_t *hnd;
 
     mutex_lock(&rd_mutex);
 
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && !fh[fd].dir)
-        rv = fh[fd].file->size;
+    if((hnd = ramdisk_fh_lookup(h)) && !hnd->dir)
+        rv = hnd->file->size;
 
     mutex_unlock(&rd_mutex);
     return rv;
@@ -531,29 +992,29 @@ static size_t ramdisk_total(void * h) {
 static dirent_t *ramdisk_readdir(void * h) {
     rd_file_t   * f;
     dirent_t    * rv = NULL;
-    file_t      fd = (file_t)h;
+    rd_fh_t     * hnd;
 
     mutex_lock(&rd_mutex);
 
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && fh[fd].ptr != 0 && fh[fd].dir) {
+    if((hnd = ramdisk_fh_lookup(h)) && hnd->ptr != 0 && hnd->dir) {
         /* Find the current file and advance to the next */
-        f = (rd_file_t *)fh[fd].ptr;
-        fh[fd].ptr = (uint32)LIST_NEXT(f, dirlist);
+        f = (rd_file_t *)hnd->ptr;
+        hnd->ptr = (uint32)LIST_NEXT(f, dirlist);
 
         /* Copy out the requested data */
-        strcpy(fh[fd].dirent.name, f->name);
-        fh[fd].dirent.time = 0;
+        strcpy(hnd->dirent.name, f->name);
+        hnd->dirent.time = 0;
 
         if(f->type == STAT_TYPE_DIR) {
-            fh[fd].dirent.attr = O_DIR;
-            fh[fd].dirent.size = -1;
+            hnd->dirent.attr = O_DIR;
+            hnd->dirent.size = -1;
         }
         else {
-            fh[fd].dirent.attr = 0;
-            fh[fd].dirent.size = f->size;
+            hnd->dirent.attr = 0;
+            hnd->dirent.size = f->size;
         }
 
-        rv = &fh[fd].dirent;
+        rv = &hnd->dirent;
     }
     else {
         errno = EBADF;
@@ -578,12 +1039,13 @@ static int ramdisk_unlink(vfs_handler_t * vfs, const char *fn) {
     if(f) {
         /* Make sure it's not in use */
         if(f->usage == 0) {
+            /* Remove it from the parent directory */
+            ramdisk_dir_remove(f);
+
             /* Free its data */
             free(f->name);
-            free(f->data);
-
-            /* Remove it from the parent list */
-            LIST_REMOVE(f, dirlist);
+            ramdisk_free_data(f);
+            rwsem_destroy(&f->lock);
 
             /* Free the entry itself */
             free(f);
@@ -597,16 +1059,20 @@ static int ramdisk_unlink(vfs_handler_t * vfs, const char *fn) {
 
 static void * ramdisk_mmap(void * h) {
     void    * rv = NULL;
-    file_t  fd = (file_t)h;
+    rd_fh_t * hnd;
 
-    mutex_lock(&rd_mutex);
+    if(!(hnd = ramdisk_fh_get(h, 0, NULL)))
+        return NULL;
 
-    if(fd < FS_RAMDISK_MAX_FILES && fh[fd].file != NULL && !fh[fd].dir) {
-        rv = fh[fd].file->data;
-    }
+    /* Files are only put into one block of memory when they need to be */
+    rwsem_write_lock(&hnd->file->lock);
 
-    mutex_unlock(&rd_mutex);
+    if(!ramdisk_flatten(hnd->file))
+        rv = hnd->file->data;
 
+    rwsem_write_unlock(&hnd->file->lock);
+
+    ramdisk_fh_release(hnd, NULL);
     return rv;
 }
 
@@ -635,11 +1101,11 @@ static int ramdisk_stat(vfs_handler_t *vfs, const char *path, struct stat *buf,
             buf->st_mode |= S_IFREG;
 
         buf->st_nlink = 1;
-        buf->st_size = f->datasize;
+        buf->st_size = f->size;
         buf->st_blksize = 1024;
-        buf->st_blocks = f->datasize >> 10;
+        buf->st_blocks = f->size >> 10;
 
-        if(f->datasize & 0x3ff)
+        if(f->size & 0x3ff)
             ++buf->st_blocks;
     }
     else {
@@ -652,14 +1118,14 @@ static int ramdisk_stat(vfs_handler_t *vfs, const char *path, struct stat *buf,
 }
 
 static int ramdisk_fcntl(void *h, int cmd, va_list ap) {
-    file_t fd = (file_t)h;
+    rd_fh_t *hnd;
     int rv = -1;
 
     (void)ap;
 
     mutex_lock(&rd_mutex);
 
-    if(fd >= FS_RAMDISK_MAX_FILES || !fh[fd].file) {
+    if(!(hnd = ramdisk_fh_lookup(h))) {
         mutex_unlock(&rd_mutex);
         errno = EBADF;
         return -1;
@@ -667,7 +1133,7 @@ static int ramdisk_fcntl(void *h, int cmd, va_list ap) {
 
     switch(cmd) {
         case F_GETFL:
-            rv = fh[fd].omode;
+            rv = hnd->omode;
             break;
 
         case F_SETFL:
@@ -686,17 +1152,17 @@ static int ramdisk_fcntl(void *h, int cmd, va_list ap) {
 
 static int ramdisk_rewinddir(void * h) {
     int rv = 0;
-    file_t fd = (file_t)h;
+    rd_fh_t *hnd;
 
     mutex_lock(&rd_mutex);
 
-    if(fd >= FS_RAMDISK_MAX_FILES || !fh[fd].file || !fh[fd].dir) {
+    if(!(hnd = ramdisk_fh_lookup(h)) || !hnd->dir) {
         errno = EBADF;
         rv = -1;
     }
     else {
         /* Rewind to the first file. */
-        fh[fd].ptr = (uint32)LIST_FIRST((rd_dir_t *)fh[fd].file->data);
+        hnd->ptr = (uint32)LIST_FIRST(&((rd_dir_t *)hnd->file->data)->files);
     }
 
     mutex_unlock(&rd_mutex);
@@ -705,19 +1171,19 @@ static int ramdisk_rewinddir(void * h) {
 }
 
 static int ramdisk_fstat(void *h, struct stat *buf) {
-    file_t fd = (file_t)h;
+    rd_fh_t *hnd;
     rd_file_t *f;
 
     mutex_lock(&rd_mutex);
 
-    if(fd >= FS_RAMDISK_MAX_FILES || !fh[fd].file) {
+    if(!(hnd = ramdisk_fh_lookup(h))) {
         mutex_unlock(&rd_mutex);
         errno = EBADF;
         return -1;
     }
 
     /* Grab the file itself... */
-    f = fh[fd].file;
+    f = hnd->file;
 
     /* Fill in the structure. */
     memset(buf, 0, sizeof(struct stat));
@@ -730,11 +1196,11 @@ static int ramdisk_fstat(void *h, struct stat *buf) {
         buf->st_mode |= S_IFREG;
 
     buf->st_nlink = 1;
-    buf->st_size = f->datasize;
+    buf->st_size = f->size;
     buf->st_blksize = 1024;
-    buf->st_blocks = f->datasize >> 10;
+    buf->st_blocks = f->size >> 10;
 
-    if(f->datasize & 0x3ff)
+    if(f->size & 0x3ff)
         ++buf->st_blocks;
 
     mutex_unlock(&rd_mutex);
@@ -780,7 +1246,11 @@ static vfs_handler_t vh = {
     NULL,               /* total64 XXX */
     NULL,               /* readlink XXX */
     ramdisk_rewinddir,
-    ramdisk_fstat
+    ramdisk_fstat,
+    ramdisk_pread,
+    ramdisk_pwrite,
+    ramdisk_readv,
+    ramdisk_writev
 };
 
 /* Attach a piece of memory to a file. This works somewhat like open for
@@ -788,6 +1258,7 @@ static vfs_handler_t vh = {
    out with data instead of being blank. */
 int fs_ramdisk_attach(const char * fn, void * obj, size_t size) {
     void        *fd;
+    rd_fh_t     *hnd;
     rd_file_t   *f;
 
     /* First of all, open a file for writing. This'll save us a bunch
@@ -797,12 +1268,23 @@ int fs_ramdisk_attach(const char * fn, void * obj, size_t size) {
     if(fd == NULL)
         return -1;
 
+    /* The handle table can be moved by other threads opening files, so go
+       through a reference to the handle rather than looking in it directly. */
+    if(!(hnd = ramdisk_fh_get(fd, 1, NULL))) {
+        ramdisk_close(fd);
+        return -1;
+    }
+
     /* Ditch the data block we had and replace it with the user one. */
-    f = fh[(int)fd].file;
-    free(f->data);
+    f = hnd->file;
+    rwsem_write_lock(&f->lock);
+    ramdisk_free_data(f);
     f->data = obj;
     f->datasize = size;
     f->size = size;
+    rwsem_write_unlock(&f->lock);
+
+    ramdisk_fh_release(hnd, NULL);
 
     /* Close the file */
     ramdisk_close(fd);
@@ -813,7 +1295,9 @@ int fs_ramdisk_attach(const char * fn, void * obj, size_t size) {
 /* Does the opposite of attach. This again piggybacks on open. */
 int fs_ramdisk_detach(const char * fn, void ** obj, size_t * size) {
     void        *fd;
+    rd_fh_t     *hnd;
     rd_file_t   *f;
+    int         rv;
 
     /* First of all, open a file for reading. This'll save us a bunch
        of duplicated code. */
@@ -826,18 +1310,36 @@ int fs_ramdisk_detach(const char * fn, void ** obj, size_t * size) {
     assert(obj != NULL);
     assert(size != NULL);
 
-    f = fh[(int)fd].file;
-    *obj = f->data;
-    *size = f->size;
+    if(!(hnd = ramdisk_fh_get(fd, 0, NULL))) {
+        ramdisk_close(fd);
+        return -1;
+    }
 
-    /* Ditch the data block we had and replace it with a fake one. */
-    f->data = malloc(64);
-    f->datasize = 64;
-    f->size = 64;
+    /* Other readers might have the file open too, so hold its lock while
+       taking the data away. */
+    f = hnd->file;
+    rwsem_write_lock(&f->lock);
+
+    /* The caller gets the data in one block, so gather it up first. */
+    if(!(rv = ramdisk_flatten(f))) {
+        *obj = f->data;
+        *size = f->size;
+
+        /* The data block is the caller's now, so leave the file empty. */
+        f->data = NULL;
+        f->datasize = 0;
+        f->size = 0;
+    }
+
+    rwsem_write_unlock(&f->lock);
+    ramdisk_fh_release(hnd, NULL);
 
     /* Close the file */
     ramdisk_close(fd);
 
+    if(rv)
+        return -1;
+
     /* Unlink the file */
     ramdisk_unlink(&vh, fn);
 
@@ -873,11 +1375,18 @@ int fs_ramdisk_init(void) {
     root->usage = 0;
     root->data = rootdir;
     root->datasize = 0;
+    root->pages = NULL;
+    root->pagecnt = 0;
+    root->parent = NULL;
+    root->hash = 0;
+    rwsem_init(&root->lock);
 
-    LIST_INIT(rootdir);
+    memset(rootdir, 0, sizeof(rd_dir_t));
+    LIST_INIT(&rootdir->files);
 
     /* Reset fd's */
-    memset(fh, 0, sizeof(fh));
+    fh = NULL;
+    fh_count = 0;
 
     /* Init thread mutexes */
     mutex_init(&rd_mutex, MUTEX_TYPE_NORMAL);
@@ -889,25 +1398,39 @@ int fs_ramdisk_init(void) {
 /* De-init the file system */
 int fs_ramdisk_shutdown(void) {
     rd_file_t *f1, *f2;
+    file_t fd;
 
     /* Test if initted */
     if(rootdir == NULL)
         return -1;
 
+    /* Free any handles that were left open */
+    for(fd = 0; fd < fh_count; fd++)
+        free(fh[fd]);
+
+    free(fh);
+    fh = NULL;
+    fh_count = 0;
+
     /* For now assume there's only the root dir, since mkdir and
        rmdir aren't even implemented... */
-    f1 = LIST_FIRST(rootdir);
+    f1 = LIST_FIRST(&rootdir->files);
 
     while(f1) {
         f2 = LIST_NEXT(f1, dirlist);
         free(f1->name);
-        free(f1->data);
+        ramdisk_free_data(f1);
+        rwsem_destroy(&f1->lock);
         free(f1);
         f1 = f2;
     }
 
+    free(rootdir->hash);
     free(rootdir);
+    free(root->name);
     free(root);
+    rootdir = NULL;
+    root = NULL;
 
     mutex_destroy(&rd_mutex);
     return nmmgr_handler_remove(&vh.nmmgr);
@@ -24,6 +24,7 @@ on sunsite.unc.edu in /pub/Linux/system/recovery/, or as a package under Debian
 #include <malloc.h>
 #include <string.h>
 #include <strings.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
@@ -62,6 +63,39 @@ static uint32 ntohl_32(const void *data) {
 struct rd_image;
 typedef LIST_HEAD(rdi_list, rd_image) rdi_list_t;
 
+/* One slot of a mount's name index. The index maps a directory (by the offset
+   of the first header in its listing) and a case-folded name to the offset of
+   the matching header, so that each path component is a hash probe instead of
+   a walk of the whole directory. */
+typedef struct rd_index_ent {
+    uint32          hash;       /* Hash of (dir, name) */
+    uint32          dir;        /* Offset of the containing directory listing */
+    uint32          hdr;        /* Offset of the entry's header (0 = empty) */
+} rd_index_ent_t;
+
+/* Trailer marking an index written into the image by genromfs -i */
+#define ROMDISK_INDEX_MAGIC         "KOSRDIDX"
+#define ROMDISK_INDEX_TRAILER_SIZE  16
+
+/* spec_info of a regular file that genromfs -z stored as compressed chunks.
+   The file's data then starts with the chunk size and count, followed by a
+   table of count + 1 offsets (from the start of the data) to the chunks,
+   each of which is an LZ4 block, or raw if it didn't shrink. The header's
+   size field is the uncompressed size. */
+#define ROMDISK_SPEC_LZ4            0x4b4c5a34
+#define ROMDISK_MAX_CHUNK           65536
+
+/* One decompressed chunk in a mount's chunk cache. */
+typedef struct rd_chunk {
+    TAILQ_ENTRY(rd_chunk) lru;
+    uint32          data;       /* Offset of the file's data (0 = unused) */
+    uint32          chunk;      /* Chunk number within the file */
+    uint32          len;        /* Bytes of valid data */
+    uint8           * buf;      /* ROMDISK_MAX_CHUNK bytes, or NULL */
+} rd_chunk_t;
+
+TAILQ_HEAD(rd_chunk_list, rd_chunk);
+
 /* A single mounted romdisk image; a pointer to one of these will be in our
    VFS struct for each mount. */
 typedef struct rd_image {
@@ -72,6 +106,16 @@ typedef struct rd_image {
     const romdisk_hdr_t * hdr;      /* Pointer to the header */
     uint32          files;      /* Offset in the image to the files area */
     vfs_handler_t       * vfsh;     /* Our VFS mount struct */
+    rd_index_ent_t      * index;    /* Name index, or NULL if not built */
+    uint32          index_mask; /* Number of index slots - 1 */
+    int         index_ext;  /* Index lives in the image (big endian) */
+
+    /* Cache of decompressed chunks, shared by all of the open compressed
+       files on this image and kept in LRU order, most recently used first.
+       Buffers are allocated the first time a compressed file is read. */
+    struct rd_chunk_list    chunk_lru;
+    rd_chunk_t      chunk_cache[FS_ROMDISK_CACHE_CHUNKS];
+    mutex_t         chunk_mutex;
 } rd_image_t;
 
 /* Global list of mounted romdisks */
@@ -87,6 +131,8 @@ static struct {
     int     dir;        /* >0 if a directory */
     uint32      ptr;        /* Current read position in bytes */
     uint32      size;       /* Length of file in bytes */
+    uint32      chunks;     /* Number of chunks if compressed, else 0 */
+    uint32      chunk_size; /* Uncompressed size of each chunk */
     dirent_t    dirent;     /* A static dirent to pass back to clients */
     rd_image_t  * mnt;      /* Which mount instance are we using? */
 } fh[FS_ROMDISK_MAX_FILES];
@@ -94,6 +140,69 @@ static struct {
 /* Mutex for file handles */
 static mutex_t fh_mutex;
 
+/* Hash a directory listing offset and a filename, ignoring case. */
+static uint32 romdisk_hash(uint32 dir, const char *fn, size_t fnlen) {
+    uint32 h = (2166136261UL ^ dir) * 16777619UL;
+
+    while(fnlen--) {
+        h ^= (uint8)tolower((uint8)*fn++);
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
+/* Read a field of an index slot. Indexes built at mount time are in host
+   order; ones shipped inside the image by genromfs are big endian like the
+   rest of the filesystem. */
+#define INDEX_FIELD(mnt, f) ((mnt)->index_ext ? ntohl_32(&(f)) : (f))
+
+/* Value returned by romdisk_index_find() when the index can't be trusted
+   for a lookup, which then has to walk the directory instead. */
+#define ROMDISK_INDEX_BAD   0xffffffff
+
+/* Look up an entry in the mount's name index. This gives the same answer as
+   the directory walk in romdisk_find_object() below: entries are inserted in
+   directory order, so the first match along the probe sequence is the first
+   match in the directory. An index that came with the image could be
+   anything, so if a slot points outside of the image, or the table has no
+   empty slot to end the probe, ROMDISK_INDEX_BAD is returned. */
+static uint32 romdisk_index_find(rd_image_t * mnt, const char *fn, size_t fnlen, int dir, uint32 offset) {
+    uint32          h, slot, type, hdr, n, full;
+    const rd_index_ent_t    *ent;
+    const romdisk_file_t    *fhdr;
+
+    h = romdisk_hash(offset, fn, fnlen);
+    full = ntohl_32(&mnt->hdr->full_size);
+
+    for(slot = h & mnt->index_mask, n = 0; n <= mnt->index_mask;
+        slot = (slot + 1) & mnt->index_mask, n++) {
+        ent = &mnt->index[slot];
+
+        if(!(hdr = INDEX_FIELD(mnt, ent->hdr)))
+            return 0;
+
+        if(INDEX_FIELD(mnt, ent->hash) != h ||
+           INDEX_FIELD(mnt, ent->dir) != offset)
+            continue;
+
+        if(hdr < mnt->files || hdr > full ||
+           full - hdr < sizeof(romdisk_file_t))
+            return ROMDISK_INDEX_BAD;
+
+        fhdr = (const romdisk_file_t *)(mnt->image + hdr);
+        type = ntohl_32(&fhdr->next_header) & 3;
+
+        if(type != (dir ? 1U : 2U))
+            continue;
+
+        if((strlen(fhdr->filename) == fnlen) && (!strncasecmp(fhdr->filename, fn, fnlen)))
+            return hdr;
+    }
+
+    return ROMDISK_INDEX_BAD;
+}
+
 /* Given a filename and a starting romdisk directory listing (byte offset),
    search for the entry in the directory and return the byte offset to its
    entry. */
@@ -101,6 +210,13 @@ static uint32 romdisk_find_object(rd_image_t * mnt, const char *fn, size_t fnlen
     uint32          i, ni, type;
     const romdisk_file_t    *fhdr;
 
+    if(mnt->index) {
+        i = romdisk_index_find(mnt, fn, fnlen, dir, offset);
+
+        if(i != ROMDISK_INDEX_BAD)
+            return i;
+    }
+
     i = offset;
 
     do {
@@ -189,6 +305,264 @@ static uint32 romdisk_find(rd_image_t * mnt, const char *fn, int dir) {
     }
 }
 
+/* Decode one LZ4 block. Returns the number of bytes produced, or -1 if the
+   block is malformed or doesn't fit in dstlen bytes. */
+static int romdisk_lz4_decode(const uint8 *src, uint32 srclen, uint8 *dst,
+                              uint32 dstlen) {
+    const uint8 *ip = src, *iend = src + srclen, *match;
+    uint8       *op = dst, *oend = dst + dstlen;
+    uint32      len, off;
+    uint8       token;
+
+    while(ip < iend) {
+        token = *ip++;
+
+        /* Literals */
+        if((len = token >> 4) == 15) {
+            do {
+                if(ip >= iend)
+                    return -1;
+
+                len += *ip;
+            }
+            while(*ip++ == 255);
+        }
+
+        if(len > (uint32)(iend - ip) || len > (uint32)(oend - op))
+            return -1;
+
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        /* The last sequence is literals only. */
+        if(ip == iend)
+            break;
+
+        /* Match */
+        if(iend - ip < 2)
+            return -1;
+
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if(!off || off > (uint32)(op - dst))
+            return -1;
+
+        if((len = token & 15) == 15) {
+            do {
+                if(ip >= iend)
+                    return -1;
+
+                len += *ip;
+            }
+            while(*ip++ == 255);
+        }
+
+        len += 4;
+
+        if(len > (uint32)(oend - op))
+            return -1;
+
+        match = op - off;
+
+        if(off >= len) {
+            memcpy(op, match, len);
+            op += len;
+        }
+        else {
+            /* Overlapping copy, which repeats the last off bytes. */
+            while(len--)
+                *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
+
+/* How many bytes of the image are there past an offset? */
+static uint32 romdisk_avail(const rd_image_t *mnt, uint32 off) {
+    uint32      full = ntohl_32(&mnt->hdr->full_size);
+
+    return off < full ? full - off : 0;
+}
+
+/* Check the chunk table of a compressed file that was just opened. */
+static int romdisk_chunk_open(file_t fd) {
+    const uint8 *data = fh[fd].mnt->image + fh[fd].index;
+    uint32      csize, chunks, avail;
+
+    if((avail = romdisk_avail(fh[fd].mnt, fh[fd].index)) < 12)
+        return -1;
+
+    csize = ntohl_32(data);
+    chunks = ntohl_32(data + 4);
+
+    if(!csize || csize > ROMDISK_MAX_CHUNK ||
+       chunks != (fh[fd].size + csize - 1) / csize ||
+       chunks > (avail - 12) / 4)
+        return -1;
+
+    fh[fd].chunks = chunks;
+    fh[fd].chunk_size = csize;
+    return 0;
+}
+
+/* Decompress a chunk of an open file into dst, which must have room for
+   chunk_size bytes. Returns the chunk's length, or -EIO if it is corrupt or
+   runs off the end of the image. */
+static int romdisk_chunk_decode(file_t fd, uint32 chunk, uint8 *dst) {
+    const uint8 *data = fh[fd].mnt->image + fh[fd].index;
+    uint32      start, end, len;
+
+    start = ntohl_32(data + 8 + chunk * 4);
+    end = ntohl_32(data + 12 + chunk * 4);
+    len = fh[fd].size - chunk * fh[fd].chunk_size;
+
+    if(len > fh[fd].chunk_size)
+        len = fh[fd].chunk_size;
+
+    if(end < start || start < 12 + fh[fd].chunks * 4 ||
+       end > romdisk_avail(fh[fd].mnt, fh[fd].index))
+        return -EIO;
+
+    /* Chunks that didn't compress are stored as is. */
+    if(end - start == len) {
+        memcpy(dst, data + start, len);
+        return len;
+    }
+
+    if(romdisk_lz4_decode(data + start, end - start, dst, len) != (int)len)
+        return -EIO;
+
+    return len;
+}
+
+/* Look for a chunk in the cache. Call with the mount's chunk_mutex held. */
+static rd_chunk_t *romdisk_chunk_find(file_t fd, uint32 chunk) {
+    struct rd_chunk_list *list = &fh[fd].mnt->chunk_lru;
+    rd_chunk_t  *c;
+
+    TAILQ_FOREACH(c, list, lru) {
+        if(c->data == fh[fd].index && c->chunk == chunk) {
+            if(c != TAILQ_FIRST(list)) {
+                TAILQ_REMOVE(list, c, lru);
+                TAILQ_INSERT_HEAD(list, c, lru);
+            }
+
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+/* Get a chunk into the cache, evicting the least recently used one if it
+   isn't already there. Call with the mount's chunk_mutex held. */
+static rd_chunk_t *romdisk_chunk_get(file_t fd, uint32 chunk) {
+    struct rd_chunk_list *list = &fh[fd].mnt->chunk_lru;
+    rd_chunk_t  *c;
+    int         len;
+
+    if((c = romdisk_chunk_find(fd, chunk)))
+        return c;
+
+    c = TAILQ_LAST(list, rd_chunk_list);
+    c->data = 0;
+
+    if(!c->buf && !(c->buf = (uint8 *)malloc(ROMDISK_MAX_CHUNK))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if((len = romdisk_chunk_decode(fd, chunk, c->buf)) < 0) {
+        errno = -len;
+        return NULL;
+    }
+
+    c->data = fh[fd].index;
+    c->chunk = chunk;
+    c->len = len;
+
+    TAILQ_REMOVE(list, c, lru);
+    TAILQ_INSERT_HEAD(list, c, lru);
+    return c;
+}
+
+/* Set up the chunk cache of a new mount. */
+static void romdisk_chunk_init(rd_image_t *mnt) {
+    int i;
+
+    TAILQ_INIT(&mnt->chunk_lru);
+    memset(mnt->chunk_cache, 0, sizeof(mnt->chunk_cache));
+
+    for(i = 0; i < FS_ROMDISK_CACHE_CHUNKS; i++)
+        TAILQ_INSERT_TAIL(&mnt->chunk_lru, &mnt->chunk_cache[i], lru);
+
+    mutex_init(&mnt->chunk_mutex, MUTEX_TYPE_NORMAL);
+}
+
+/* Free the chunk cache of an image that is going away. */
+static void romdisk_chunk_free(rd_image_t *mnt) {
+    int i;
+
+    for(i = 0; i < FS_ROMDISK_CACHE_CHUNKS; i++)
+        free(mnt->chunk_cache[i].buf);
+
+    mutex_destroy(&mnt->chunk_mutex);
+}
+
+/* Read from a compressed file. Whole chunks that aren't cached already are
+   decompressed straight into the caller's buffer; partial ones go through
+   the cache, since the rest of the chunk is likely to be read soon. */
+static ssize_t romdisk_read_chunks(file_t fd, uint8 *buf, size_t bytes,
+                                   uint32 pos) {
+    rd_chunk_t  *c;
+    uint32      chunk, coff, clen, n;
+    size_t      done = 0;
+    int         rv;
+
+    mutex_lock(&fh[fd].mnt->chunk_mutex);
+
+    while(done < bytes) {
+        chunk = pos / fh[fd].chunk_size;
+        coff = pos % fh[fd].chunk_size;
+        clen = fh[fd].size - chunk * fh[fd].chunk_size;
+
+        if(clen > fh[fd].chunk_size)
+            clen = fh[fd].chunk_size;
+
+        n = clen - coff;
+
+        if(n > bytes - done)
+            n = bytes - done;
+
+        if(n == clen && !romdisk_chunk_find(fd, chunk)) {
+            if((rv = romdisk_chunk_decode(fd, chunk, buf + done)) < 0) {
+                errno = -rv;
+                break;
+            }
+        }
+        else {
+            if(!(c = romdisk_chunk_get(fd, chunk)))
+                break;
+
+            memcpy(buf + done, c->buf + coff, n);
+        }
+
+        done += n;
+        pos += n;
+    }
+
+    mutex_unlock(&fh[fd].mnt->chunk_mutex);
+
+    /* Report what we did get, if anything. */
+    if(done < bytes && !done)
+        return -1;
+
+    return done;
+}
+
 /* Open a file or directory */
 static void * romdisk_open(vfs_handler_t * vfs, const char *fn, int mode) {
     file_t          fd;
@@ -237,6 +611,15 @@ static void * romdisk_open(vfs_handler_t * vfs, const char *fn, int mode) {
     fh[fd].ptr = 0;
     fh[fd].size = ntohl_32(&fhdr->size);
     fh[fd].mnt = mnt;
+    fh[fd].chunks = 0;
+    fh[fd].chunk_size = 0;
+
+    if(!fh[fd].dir && ntohl_32(&fhdr->spec_info) == ROMDISK_SPEC_LZ4 &&
+       romdisk_chunk_open(fd) < 0) {
+        fh[fd].index = 0;
+        errno = EIO;
+        return NULL;
+    }
 
     return (void *)fd;
 }
@@ -253,9 +636,29 @@ static int romdisk_close(void * h) {
     return 0;
 }
 
+/* Read from a given position in a file, leaving the file pointer alone. The
+   image never changes, so this is safe to do from several threads at once. */
+static ssize_t romdisk_read_at(file_t fd, void *buf, size_t bytes, uint32 pos) {
+    /* Is there enough left? */
+    if(pos >= fh[fd].size)
+        return 0;
+
+    if(bytes > fh[fd].size - pos)
+        bytes = fh[fd].size - pos;
+
+    if(fh[fd].chunks)
+        return romdisk_read_chunks(fd, (uint8 *)buf, bytes, pos);
+
+    /* Copy out the requested amount */
+    memcpy(buf, fh[fd].mnt->image + fh[fd].index + pos, bytes);
+
+    return bytes;
+}
+
 /* Read from a file */
 static ssize_t romdisk_read(void * h, void *buf, size_t bytes) {
     file_t fd = (file_t)h;
+    ssize_t rv;
 
     /* Check that the fd is valid */
     if(fd >= FS_ROMDISK_MAX_FILES || fh[fd].index == 0 || fh[fd].dir) {
@@ -263,15 +666,65 @@ static ssize_t romdisk_read(void * h, void *buf, size_t bytes) {
         return -1;
     }
 
-    /* Is there enough left? */
-    if((fh[fd].ptr + bytes) > fh[fd].size)
-        bytes = fh[fd].size - fh[fd].ptr;
+    if((rv = romdisk_read_at(fd, buf, bytes, fh[fd].ptr)) > 0)
+        fh[fd].ptr += rv;
 
-    /* Copy out the requested amount */
-    memcpy(buf, fh[fd].mnt->image + fh[fd].index + fh[fd].ptr, bytes);
-    fh[fd].ptr += bytes;
+    return rv;
+}
 
-    return bytes;
+/* Read from a given offset in a file */
+static ssize_t romdisk_pread(void * h, void *buf, size_t bytes,
+                             _off64_t offset) {
+    file_t fd = (file_t)h;
+
+    /* Check that the fd is valid */
+    if(fd >= FS_ROMDISK_MAX_FILES || fh[fd].index == 0 || fh[fd].dir) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(offset >= fh[fd].size)
+        return 0;
+
+    return romdisk_read_at(fd, buf, bytes, (uint32)offset);
+}
+
+/* Read from a file into several buffers */
+static ssize_t romdisk_readv(void * h, const struct iovec *iov, int iovcnt) {
+    file_t fd = (file_t)h;
+    ssize_t rv, total = 0;
+    int i;
+
+    /* Check that the fd is valid */
+    if(fd >= FS_ROMDISK_MAX_FILES || fh[fd].index == 0 || fh[fd].dir) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for(i = 0; i < iovcnt; ++i) {
+        rv = romdisk_read_at(fd, iov[i].iov_base, iov[i].iov_len,
+                             fh[fd].ptr + total);
+
+        if(rv < 0) {
+            if(!total)
+                return -1;
+
+            break;
+        }
+
+        total += rv;
+
+        if((size_t)rv < iov[i].iov_len)
+            break;
+    }
+
+    fh[fd].ptr += total;
+    return total;
 }
 
 /* Seek elsewhere in a file */
@@ -401,6 +854,12 @@ static void *romdisk_mmap(void * h) {
         return NULL;
     }
 
+    /* Compressed files have nothing in the image that could be mapped. */
+    if(fh[fd].chunks) {
+        errno = EINVAL;
+        return NULL;
+    }
+
     /* Can't really help the loss of "const" here */
     return (void *)(fh[fd].mnt->image + fh[fd].index);
 }
@@ -479,6 +938,163 @@ static int romdisk_fstat(void *h, struct stat *st) {
     return 0;
 }
 
+/* Walk every directory in the image, calling cb for each file and directory
+   entry along with the offset of the listing that contains it. Returns the
+   number of entries visited, or -1 if the image looks broken. */
+static int romdisk_walk(rd_image_t * mnt, void (*cb)(rd_image_t *, uint32, uint32)) {
+    uint32          *stack, *tmp;
+    uint32          sp = 0, stack_size = 16;
+    uint32          dir, i, ni, type, limit;
+    const romdisk_file_t    *fhdr;
+    int             cnt = 0;
+
+    limit = ntohl_32(&mnt->hdr->full_size);
+
+    if(!(stack = (uint32 *)malloc(stack_size * sizeof(uint32))))
+        return -1;
+
+    stack[sp++] = mnt->files;
+
+    while(sp) {
+        dir = i = stack[--sp];
+
+        while(i != 0) {
+            /* Don't wander outside the image if it is corrupt. */
+            if(i >= limit || cnt > (int)(limit >> 4)) {
+                free(stack);
+                return -1;
+            }
+
+            fhdr = (const romdisk_file_t *)(mnt->image + i);
+            ni = ntohl_32(&fhdr->next_header);
+            type = ni & 7;
+            ni &= 0xfffffff0;
+
+            /* Index what a directory scan could match: the low two bits are
+               all romdisk_find_object() looks at. */
+            if((type & 3) == 1 || (type & 3) == 2) {
+                if(cb)
+                    cb(mnt, dir, i);
+
+                ++cnt;
+            }
+
+            /* Descend into subdirectories, but not "." or "..". */
+            if(type == 1 && strcmp(fhdr->filename, ".") &&
+               strcmp(fhdr->filename, "..")) {
+                if(sp == stack_size) {
+                    stack_size <<= 1;
+                    tmp = (uint32 *)realloc(stack, stack_size * sizeof(uint32));
+
+                    if(!tmp) {
+                        free(stack);
+                        return -1;
+                    }
+
+                    stack = tmp;
+                }
+
+                stack[sp++] = ntohl_32(&fhdr->spec_info);
+            }
+
+            i = ni;
+        }
+    }
+
+    free(stack);
+    return cnt;
+}
+
+static void romdisk_index_insert(rd_image_t * mnt, uint32 dir, uint32 hdr) {
+    const romdisk_file_t    *fhdr;
+    uint32          h, slot;
+
+    fhdr = (const romdisk_file_t *)(mnt->image + hdr);
+    h = romdisk_hash(dir, fhdr->filename, strlen(fhdr->filename));
+
+    for(slot = h & mnt->index_mask; mnt->index[slot].hdr;
+        slot = (slot + 1) & mnt->index_mask)
+        ;
+
+    mnt->index[slot].hash = h;
+    mnt->index[slot].dir = dir;
+    mnt->index[slot].hdr = hdr;
+}
+
+/* Look for an index that genromfs -i placed at the end of the image. The last
+   16 bytes inside full_size are a trailer: an 8 byte magic, then the offset
+   and slot count of the table, both big endian. Returns nonzero if a sane
+   table was found and hooked up. */
+static int romdisk_find_ext_index(rd_image_t * mnt) {
+    const uint8 *trailer;
+    uint32      full, off, slots;
+
+    full = ntohl_32(&mnt->hdr->full_size);
+
+    if(full < mnt->files + ROMDISK_INDEX_TRAILER_SIZE)
+        return 0;
+
+    trailer = mnt->image + full - ROMDISK_INDEX_TRAILER_SIZE;
+
+    if(memcmp(trailer, ROMDISK_INDEX_MAGIC, 8))
+        return 0;
+
+    off = ntohl_32(trailer + 8);
+    slots = ntohl_32(trailer + 12);
+
+    /* Power of two, 4-byte aligned, and entirely between the files and the
+       trailer. Otherwise ignore it and build our own. */
+    full -= ROMDISK_INDEX_TRAILER_SIZE;
+
+    if(slots < 2 || (slots & (slots - 1)) || (off & 3) || off < mnt->files ||
+       off > full || slots > (full - off) / sizeof(rd_index_ent_t)) {
+        dbglog(DBG_WARNING, "fs_romdisk: ignoring bad index in image at %p\n",
+               mnt->image);
+        return 0;
+    }
+
+    mnt->index = (rd_index_ent_t *)(mnt->image + off);
+    mnt->index_mask = slots - 1;
+    mnt->index_ext = 1;
+
+    dbglog(DBG_DEBUG, "fs_romdisk: using prebuilt index with %lu slots\n",
+           slots);
+    return 1;
+}
+
+/* Build the name index for a freshly mounted image. If anything goes wrong,
+   the mount just goes without one. */
+static void romdisk_build_index(rd_image_t * mnt) {
+    int     cnt;
+    uint32  slots = 16;
+
+    mnt->index = NULL;
+    mnt->index_mask = 0;
+    mnt->index_ext = 0;
+
+    if((cnt = romdisk_walk(mnt, NULL)) <= 0)
+        return;
+
+    /* Keep the table at most half full. */
+    while(slots < (uint32)cnt * 2)
+        slots <<= 1;
+
+    if(!(mnt->index = (rd_index_ent_t *)calloc(slots, sizeof(rd_index_ent_t))))
+        return;
+
+    mnt->index_mask = slots - 1;
+
+    if(romdisk_walk(mnt, romdisk_index_insert) != cnt) {
+        free(mnt->index);
+        mnt->index = NULL;
+        mnt->index_mask = 0;
+        return;
+    }
+
+    dbglog(DBG_DEBUG, "fs_romdisk: indexed %d entries in %lu slots\n", cnt,
+           slots);
+}
+
 /* This is a template that will be used for each mount */
 static vfs_handler_t vh = {
     /* Name Handler */
@@ -518,7 +1134,11 @@ static vfs_handler_t vh = {
     NULL,                       /* total64 */
     NULL,                       /* readlink */
     romdisk_rewinddir,
-    romdisk_fstat
+    romdisk_fstat,
+    romdisk_pread,
+    NULL,                       /* pwrite */
+    romdisk_readv,
+    NULL                        /* writev */
 };
 
 /* Are we initialized? */
@@ -569,6 +1189,11 @@ void fs_romdisk_shutdown(void) {
             free((void *)c->image);
 
         nmmgr_handler_remove(&c->vfsh->nmmgr);
+
+        if(!c->index_ext)
+            free(c->index);
+
+        romdisk_chunk_free(c);
         free(c->vfsh);
         free(c);
 
@@ -587,6 +1212,11 @@ void fs_romdisk_shutdown(void) {
    also free it after the unmount. If own_buffer is non-zero, then
    we free the buffer when it is unmounted. */
 int fs_romdisk_mount(const char * mountpoint, const uint8 *img, int own_buffer) {
+    return fs_romdisk_mount_ex(mountpoint, img, own_buffer, 0);
+}
+
+int fs_romdisk_mount_ex(const char * mountpoint, const uint8 *img,
+                        int own_buffer, uint32 flags) {
     const romdisk_hdr_t * hdr;
     rd_image_t      * mnt;
     vfs_handler_t       * vfsh;
@@ -618,11 +1248,25 @@ int fs_romdisk_mount(const char * mountpoint, const uint8 *img, int own_buffer)
     mnt->hdr = hdr;
     mnt->files = sizeof(romdisk_hdr_t)
                  + (strlen(hdr->volume_name) / 16) * 16;
+    mnt->index = NULL;
+    mnt->index_mask = 0;
+    mnt->index_ext = 0;
+
+    /* A prebuilt index costs nothing to use, so take it even if we were asked
+       not to build one. */
+    if(!romdisk_find_ext_index(mnt) && !(flags & FS_ROMDISK_MNT_NOINDEX))
+        romdisk_build_index(mnt);
+
+    romdisk_chunk_init(mnt);
 
     /* Make a VFS struct */
     vfsh = (vfs_handler_t *)malloc(sizeof(vfs_handler_t));
 
     if(vfsh == NULL) {
+        if(!mnt->index_ext)
+            free(mnt->index);
+
+        romdisk_chunk_free(mnt);
         free(mnt);
         errno=ENOMEM;
         return -3;
@@ -677,6 +1321,10 @@ int fs_romdisk_unmount(const char * mountpoint) {
             free((void *)n->image);
 
         /* Free the structs */
+        if(!n->index_ext)
+            free(n->index);
+
+        romdisk_chunk_free(n);
         free(n->vfsh);
         free(n);
     }
@@ -22,8 +22,11 @@
 #include <string.h>
 #include <arch/spinlock.h>
 #include <arch/arch.h>
+#include <arch/irq.h>
 
 #include <kos/opts.h>
+#include <kos/thread.h>
+#include <kos/tls.h>
 
 #undef DEBUG
 
@@ -1676,6 +1679,288 @@ static LIST_HEAD(memctl_list, memctl) block_list;
 
 #endif  /* KM_DEBUG */
 
+/********************** Per-thread small block cache **********************/
+
+/* Small blocks are kept in a per-thread cache of freed chunks, one list per
+   chunk size, so that the common small malloc()/free() pairs never touch the
+   global heap lock. Otherwise, a thread that gets pre-empted while holding
+   mALLOC_MUTEx stalls every other thread that wants memory. Chunks sitting in
+   a cache still look allocated to dlmalloc; the cache only goes back to the
+   locked heap to refill an empty list or to hand back half of a full one.
+
+   The cache is disabled with KM_DBG, since every block there is wrapped up
+   in the debug sentinels. */
+#ifndef KM_DBG
+
+/* Largest chunk size (including the malloc header) that gets cached. */
+#define MCACHE_MAX_SIZE     256
+
+/* Number of chunk size classes; each class is MALLOC_ALIGNMENT bytes. */
+#define MCACHE_CLASSES      (MCACHE_MAX_SIZE / MALLOC_ALIGNMENT + 1)
+
+/* How many chunks each class may hold before half are handed back. */
+#define MCACHE_DEPTH        16
+
+/* How many chunks are taken from the heap at once on a miss. */
+#define MCACHE_REFILL       8
+
+/* These mirror request2size() and chunksize(), which aren't defined yet. */
+#define MCACHE_MINSIZE      ((4 * SIZE_SZ + MALLOC_ALIGN_MASK) & \
+                             ~MALLOC_ALIGN_MASK)
+#define MCACHE_REQ2SIZE(r)  (((r) + SIZE_SZ + MALLOC_ALIGN_MASK < \
+                              MCACHE_MINSIZE) ? MCACHE_MINSIZE : \
+                             ((r) + SIZE_SZ + MALLOC_ALIGN_MASK) & \
+                             ~MALLOC_ALIGN_MASK)
+#define MCACHE_CHUNKSIZE(m) (((INTERNAL_SIZE_T *)(m))[-1] & \
+                             ~(INTERNAL_SIZE_T)0x3)
+
+typedef struct mcache_bin {
+    void *head;         /* Free chunks, linked through their first word */
+    uint32 count;
+} mcache_bin_t;
+
+typedef struct mcache {
+    LIST_ENTRY(mcache) list;
+    malloc_cache_stats_t stats;
+    mcache_bin_t bins[MCACHE_CLASSES];
+} mcache_t;
+
+/* Every live thread cache, plus the totals from caches that have been torn
+   down. Both are protected by mALLOC_MUTEx. */
+static LIST_HEAD(mcache_list, mcache) mcache_caches =
+    LIST_HEAD_INITIALIZER(mcache_caches);
+static malloc_cache_stats_t mcache_retired;
+
+/* The TLS key every thread's cache hangs off of, made by malloc_cache_init()
+   once threading is up. */
+static kthread_key_t mcache_key;
+static int mcache_key_valid = 0;
+
+/* Set while a thread is setting up its cache, since doing so allocates. */
+static int mcache_busy = 0;
+
+/* Hand up to cnt chunks from a bin back to the heap. Assumes the heap lock
+   is held. */
+static void mcache_bin_release(mcache_bin_t *bin, uint32 cnt) {
+    void *m;
+
+    while(cnt-- && (m = bin->head)) {
+        bin->head = *(void **)m;
+        --bin->count;
+        fREe(m);
+    }
+}
+
+/* TLS destructor: give everything back when the thread goes away. */
+static void mcache_destroy(void *data) {
+    mcache_t *mc = (mcache_t *)data;
+    int i;
+
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    for(i = 0; i < MCACHE_CLASSES; ++i)
+        mcache_bin_release(&mc->bins[i], mc->bins[i].count);
+
+    mcache_retired.hits += mc->stats.hits;
+    mcache_retired.misses += mc->stats.misses;
+    mcache_retired.frees += mc->stats.frees;
+    mcache_retired.flushes += mc->stats.flushes;
+
+    LIST_REMOVE(mc, list);
+    fREe(mc);
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+}
+
+/* Find (or create) the calling thread's cache. Interrupts and anything
+   running before threading is up go straight to the heap. */
+static mcache_t *mcache_get(void) {
+    mcache_t *mc;
+    int old, busy;
+
+    if(!mcache_key_valid || !thd_current || irq_inside_int())
+        return NULL;
+
+    if((mc = kthread_getspecific(mcache_key)))
+        return mc;
+
+    /* Setting the cache up calls malloc() (kthread_setspecific() does too),
+       and those calls have to go to the heap rather than back in here. So
+       only one thread does this at a time, and any other thread without a
+       cache yet just uses the heap until it gets its turn. Interrupts are
+       only off long enough to claim the flag. */
+    old = irq_disable();
+    busy = mcache_busy;
+    mcache_busy = 1;
+    irq_restore(old);
+
+    if(busy)
+        return NULL;
+
+    if((mc = (mcache_t *)calloc(1, sizeof(mcache_t)))) {
+        if(kthread_setspecific(mcache_key, mc)) {
+            free(mc);
+            mc = NULL;
+        }
+        else if(MALLOC_PREACTION == 0) {
+            LIST_INSERT_HEAD(&mcache_caches, mc, list);
+
+            if(MALLOC_POSTACTION != 0) {
+            }
+        }
+    }
+
+    mcache_busy = 0;
+    return mc;
+}
+
+/* Try to serve an allocation from the thread cache. Returns NULL if the
+   request should go to the heap as normal. */
+static Void_t *mcache_alloc(size_t bytes) {
+    mcache_t *mc;
+    mcache_bin_t *bin;
+    size_t cs;
+    void *m, *n;
+    int i;
+
+    if(bytes > MCACHE_MAX_SIZE)
+        return NULL;
+
+    cs = MCACHE_REQ2SIZE(bytes);
+
+    if(cs > MCACHE_MAX_SIZE || !(mc = mcache_get()))
+        return NULL;
+
+    bin = &mc->bins[cs / MALLOC_ALIGNMENT];
+
+    if((m = bin->head)) {
+        bin->head = *(void **)m;
+        --bin->count;
+        ++mc->stats.hits;
+        return m;
+    }
+
+    /* Empty: take a batch from the heap, keeping all but one. */
+    ++mc->stats.misses;
+
+    if(MALLOC_PREACTION != 0) {
+        return NULL;
+    }
+
+    m = mALLOc(cs - SIZE_SZ);
+
+    for(i = 1; m && i < MCACHE_REFILL; ++i) {
+        if(!(n = mALLOc(cs - SIZE_SZ)))
+            break;
+
+        *(void **)n = bin->head;
+        bin->head = n;
+        ++bin->count;
+    }
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+
+    return m;
+}
+
+/* Try to put a freed chunk into the thread cache. Returns non-zero if it was
+   taken care of. */
+static int mcache_free(Void_t *m) {
+    mcache_t *mc;
+    mcache_bin_t *bin;
+    size_t cs = MCACHE_CHUNKSIZE(m);
+
+    if(cs > MCACHE_MAX_SIZE || !(mc = mcache_get()))
+        return 0;
+
+    bin = &mc->bins[cs / MALLOC_ALIGNMENT];
+
+    if(bin->count >= MCACHE_DEPTH) {
+        if(MALLOC_PREACTION != 0) {
+            return 0;
+        }
+
+        mcache_bin_release(bin, MCACHE_DEPTH / 2);
+        ++mc->stats.flushes;
+
+        if(MALLOC_POSTACTION != 0) {
+        }
+    }
+
+    *(void **)m = bin->head;
+    bin->head = m;
+    ++bin->count;
+    ++mc->stats.frees;
+
+    return 1;
+}
+
+#endif  /* !KM_DBG */
+
+int malloc_cache_init(void) {
+#ifndef KM_DBG
+    if(kthread_key_create(&mcache_key, mcache_destroy)) {
+        mcache_key_valid = 0;
+        return -1;
+    }
+
+    mcache_key_valid = 1;
+#endif
+
+    return 0;
+}
+
+void malloc_cache_stats(malloc_cache_stats_t *stats) {
+#ifndef KM_DBG
+    mcache_t *mc;
+
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    *stats = mcache_retired;
+
+    LIST_FOREACH(mc, &mcache_caches, list) {
+        stats->hits += mc->stats.hits;
+        stats->misses += mc->stats.misses;
+        stats->frees += mc->stats.frees;
+        stats->flushes += mc->stats.flushes;
+    }
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+#else
+    memset(stats, 0, sizeof(malloc_cache_stats_t));
+#endif
+}
+
+void malloc_cache_flush(void) {
+#ifndef KM_DBG
+    mcache_t *mc;
+    int i;
+
+    if(!mcache_key_valid || !thd_current || irq_inside_int())
+        return;
+
+    if(!(mc = kthread_getspecific(mcache_key)))
+        return;
+
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    for(i = 0; i < MCACHE_CLASSES; ++i)
+        mcache_bin_release(&mc->bins[i], mc->bins[i].count);
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+#endif
+}
+
 Void_t* public_mALLOc(size_t bytes) {
     Void_t* m;
 
@@ -1684,6 +1969,11 @@ Void_t* public_mALLOc(size_t bytes) {
     memctl_t * ctl;
 #endif
 
+#ifndef KM_DBG
+    if((m = mcache_alloc(bytes)))
+        return m;
+#endif
+
     if(MALLOC_PREACTION != 0) {
         return 0;
     }
@@ -1744,6 +2034,11 @@ void public_fREe(Void_t* m) {
     if(m == NULL)
         return;
 
+#ifndef KM_DBG
+    if(mcache_free(m))
+        return;
+#endif
+
     if(MALLOC_PREACTION != 0) {
         return;
     }
@@ -0,0 +1,12 @@
+/* KallistiOS ##version##
+
+   pread.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#include <unistd.h>
+#include <kos/fs.h>
+
+ssize_t pread(int fd, void *buf, size_t nbyte, off_t offset) {
+    return fs_pread(fd, buf, nbyte, offset);
+}
@@ -0,0 +1,12 @@
+/* KallistiOS ##version##
+
+   pwrite.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#include <unistd.h>
+#include <kos/fs.h>
+
+ssize_t pwrite(int fd, const void *buf, size_t nbyte, off_t offset) {
+    return fs_pwrite(fd, buf, nbyte, offset);
+}
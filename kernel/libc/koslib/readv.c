@@ -0,0 +1,12 @@
+/* KallistiOS ##version##
+
+   readv.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#include <sys/uio.h>
+#include <kos/fs.h>
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    return fs_readv(fd, iov, iovcnt);
+}
@@ -0,0 +1,12 @@
+/* KallistiOS ##version##
+
+   writev.c
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#include <sys/uio.h>
+#include <kos/fs.h>
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    return fs_writev(fd, iov, iovcnt);
+}
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 #include <kos/thread.h>
+#include <kos/mempool.h>
 #include <arch/timer.h>
 #include "net_thd.h"
 
@@ -25,6 +26,8 @@ struct thd_cb {
 
 TAILQ_HEAD(thd_cb_queue, thd_cb);
 
+static mempool_t cb_pool = MEMPOOL_INITIALIZER(sizeof(struct thd_cb), 8, 0, 0);
+
 static struct thd_cb_queue cbs;
 static kthread_t *thd;
 static int done = 0;
@@ -59,7 +62,7 @@ int net_thd_add_callback(void (*cb)(void *), void *data, uint64 timeout) {
     struct thd_cb *newcb;
 
     /* Allocate space for the new callback and set it up. */
-    newcb = (struct thd_cb *)malloc(sizeof(struct thd_cb));
+    newcb = (struct thd_cb *)mempool_alloc(&cb_pool);
 
     if(!newcb) {
         errno = ENOMEM;
@@ -92,7 +95,7 @@ int net_thd_del_callback(int cbid) {
     TAILQ_FOREACH(cb, &cbs, thds) {
         if(cb->cbid == cbid) {
             TAILQ_REMOVE(&cbs, cb, thds);
-            free(cb);
+            mempool_free(&cb_pool, cb);
             irq_restore(old);
             return 0;
         }
@@ -15,6 +15,7 @@
 #include <kos/net.h>
 #include <kos/mutex.h>
 #include <kos/genwait.h>
+#include <kos/mempool.h>
 #include <sys/queue.h>
 #include <kos/fs_socket.h>
 #include <arch/irq.h>
@@ -42,11 +43,31 @@ typedef struct {
 } udp_hdr_t;
 #undef packed
 
+/* Datagrams up to this size are stored inside their packet structure rather
+   than in a separate allocation. Bigger ones get their own block, so that
+   small packets don't tie up a full frame's worth of memory each. */
+#define UDP_PKT_INLINE_DATA 256
+
+/* Bigger datagrams that still fit in a single Ethernet frame have their data
+   stored in a block from a second pool. Only reassembled datagrams larger
+   than this go to malloc(). */
+#define UDP_PKT_FRAME_DATA  1472
+
+/* Most packet structures the pool will hold. Past this, they come straight
+   from malloc() and go back to it when freed. */
+#define UDP_PKT_POOL_MAX    64
+
+/* Likewise, for the frame sized data blocks. */
+#define UDP_DATA_POOL_MAX   32
+
 struct udp_pkt {
     TAILQ_ENTRY(udp_pkt) pkt_queue;
     struct sockaddr_in6 from;
     uint8 *data;
     uint16 datasize;
+    uint8 pooled;
+    uint8 data_pooled;
+    uint8 inline_data[UDP_PKT_INLINE_DATA];
 };
 
 TAILQ_HEAD(udp_pkt_queue, udp_pkt);
@@ -321,6 +342,59 @@ static int net_udp_listen(net_socket_t *hnd, int backlog) {
     return -1;
 }
 
+/* Received packets come out of a pool, so that steady-state traffic doesn't
+   have to go through malloc() for every datagram. */
+static mempool_t udp_pkt_pool = MEMPOOL_INITIALIZER(sizeof(struct udp_pkt), 8,
+                                                    UDP_PKT_POOL_MAX, 0);
+static mempool_t udp_data_pool = MEMPOOL_INITIALIZER(UDP_PKT_FRAME_DATA, 4,
+                                                     UDP_DATA_POOL_MAX, 0);
+
+static void net_udp_pkt_release(struct udp_pkt *pkt) {
+    if(pkt->pooled)
+        mempool_free(&udp_pkt_pool, pkt);
+    else
+        free(pkt);
+}
+
+static struct udp_pkt *net_udp_pkt_alloc(uint16 datasize) {
+    struct udp_pkt *pkt;
+    uint8 pooled = 1;
+
+    if(!(pkt = (struct udp_pkt *)mempool_alloc(&udp_pkt_pool))) {
+        if(!(pkt = (struct udp_pkt *)malloc(sizeof(struct udp_pkt))))
+            return NULL;
+
+        pooled = 0;
+    }
+
+    memset(pkt, 0, offsetof(struct udp_pkt, inline_data));
+    pkt->datasize = datasize;
+    pkt->pooled = pooled;
+
+    if(datasize <= UDP_PKT_INLINE_DATA) {
+        pkt->data = pkt->inline_data;
+    }
+    else if(datasize <= UDP_PKT_FRAME_DATA &&
+            (pkt->data = (uint8 *)mempool_alloc(&udp_data_pool))) {
+        pkt->data_pooled = 1;
+    }
+    else if(!(pkt->data = (uint8 *)malloc(datasize))) {
+        net_udp_pkt_release(pkt);
+        return NULL;
+    }
+
+    return pkt;
+}
+
+static void net_udp_pkt_free(struct udp_pkt *pkt) {
+    if(pkt->data_pooled)
+        mempool_free(&udp_data_pool, pkt->data);
+    else if(pkt->data != pkt->inline_data)
+        free(pkt->data);
+
+    net_udp_pkt_release(pkt);
+}
+
 static ssize_t net_udp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
                                 int flags, struct sockaddr *addr,
                                 socklen_t *addr_len) {
@@ -419,8 +493,7 @@ static ssize_t net_udp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
     /* Remove the packet if we're pulling data out of the queue. */
     if(!(flags & MSG_PEEK)) {
         TAILQ_REMOVE(&udpsock->packets, pkt, pkt_queue);
-        free(pkt->data);
-        free(pkt);
+        net_udp_pkt_free(pkt);
     }
 
     mutex_unlock(&udp_mutex);
@@ -656,9 +729,8 @@ static void net_udp_close(net_socket_t *hnd) {
         pkt = it;
         it = it->pkt_queue.tqe_next;
 
-        free(pkt->data);
         TAILQ_REMOVE(&udpsock->packets, pkt, pkt_queue);
-        free(pkt);
+        net_udp_pkt_free(pkt);
     }
 
     LIST_REMOVE(udpsock, sock_list);
@@ -1212,17 +1284,7 @@ static int net_udp_input4(netif_t *src, const ip_hdr_t *ip, const uint8 *data,
             return 0;
         }
 
-        if(!(pkt = (struct udp_pkt *)malloc(sizeof(struct udp_pkt)))) {
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        memset(pkt, 0, sizeof(struct udp_pkt));
-
-        pkt->datasize = size - sizeof(udp_hdr_t);
-
-        if(!(pkt->data = (uint8 *)malloc(pkt->datasize))) {
-            free(pkt);
+        if(!(pkt = net_udp_pkt_alloc(size - sizeof(udp_hdr_t)))) {
             mutex_unlock(&udp_mutex);
             return -1;
         }
@@ -1350,17 +1412,7 @@ static int net_udp_input6(netif_t *src, const ipv6_hdr_t *ip, const uint8 *data,
             return 0;
         }
 
-        if(!(pkt = (struct udp_pkt *)malloc(sizeof(struct udp_pkt)))) {
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        memset(pkt, 0, sizeof(struct udp_pkt));
-
-        pkt->datasize = size - sizeof(udp_hdr_t);
-
-        if(!(pkt->data = (uint8 *)malloc(pkt->datasize))) {
-            free(pkt);
+        if(!(pkt = net_udp_pkt_alloc(size - sizeof(udp_hdr_t)))) {
             mutex_unlock(&udp_mutex);
             return -1;
         }
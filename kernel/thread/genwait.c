@@ -23,52 +23,40 @@
 #include <arch/timer.h>
 #include <kos/genwait.h>
 #include <kos/sem.h>
+#include <kos/opts.h>
+
+#include "timerq.h"
 
 /* Our sleep queues table. This is also modeled after the BSD numbers. I
    figure if they've been using it as long as they have, they must be
-   on to something. :) */
-#define TABLESIZE   128
+   on to something. :)
+
+   Objects are hashed into the table with a multiplicative (Fibonacci) hash
+   of their whole address, so that objects allocated right next to each other
+   (an array of mutexes, for instance) end up spread across the table rather
+   than piling up in the same chain. */
+#if GENWAIT_TABLE_BITS < 1 || GENWAIT_TABLE_BITS > 31
+#error "GENWAIT_TABLE_BITS must be between 1 and 31"
+#endif
+
+#define TABLESIZE   (1 << GENWAIT_TABLE_BITS)
 static TAILQ_HEAD(slpquehead, kthread) slpque[TABLESIZE];
-#define LOOKUP(x)   (((ptr_t)(x) >> 8) & (TABLESIZE - 1))
+#define LOOKUP(x)   (((uint32)(ptr_t)(x) * 0x9E3779B1UL) >> \
+                     (32 - GENWAIT_TABLE_BITS))
+
+/* Per-bucket statistics, see genwait_bucket_stats(). */
+static genwait_bucket_stats_t slpstats[TABLESIZE];
 
 /* Timed event queue. Anything that isn't ready to run yet, but will be
    ready to run at a later time will be placed here. Note that this doesn't
    deal with pre-emptive timeslice context switching, only things that are
    specifically blocked for a timed event (thd_sleep, genwait_wait, etc).
-   This queue is sorted by remaining time (smallest at the front). */
-static struct ktqueue timer_queue;
-
-/* Internal function to insert a thread on the timer queue. Maintains
-   sorting order by wait time. */
-static void tq_insert(kthread_t * thd) {
-    kthread_t * t;
-
-    /* Search for its place; note that new threads will be placed at
-       the end of a group with the same timeout. */
-    TAILQ_FOREACH(t, &timer_queue, timerq) {
-        if(thd->wait_timeout < t->wait_timeout) {
-            TAILQ_INSERT_BEFORE(t, thd, timerq);
-            return;
-        }
-    }
-
-    /* Couldn't find anything scheduled later, put this at the end. */
-    TAILQ_INSERT_TAIL(&timer_queue, thd, timerq);
-}
-
-/* Internal function to remove a thread from the timer queue. */
-static void tq_remove(kthread_t * thd) {
-    TAILQ_REMOVE(&timer_queue, thd, timerq);
-}
-
-/* Returns the top thread on the timer queue (next event). If nothing is
-   queued, we'll return NULL. */
-static kthread_t * tq_next(void) {
-    return TAILQ_FIRST(&timer_queue);
-}
+   This queue is a pairing heap ordered by wait time (see timerq.h). */
+static kthread_t * timer_queue;
 
 int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(void *)) {
     int     old, rv;
+    uint32  hash;
     kthread_t   * me;
 
     /* Twiddle interrupt state */
@@ -89,7 +77,7 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
     if(timeout > 0) {
         /* If we have a timeout, insert us on the timer queue. */
         me->wait_timeout = timer_ms_gettime64() + timeout;
-        tq_insert(me);
+        tq_insert(&timer_queue, me);
     }
     else
         me->wait_timeout = 0;
@@ -97,7 +85,11 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
     me->wait_callback = callback;
 
     /* Insert us on the appropriate wait queue */
-    TAILQ_INSERT_TAIL(&slpque[LOOKUP(obj)], me, thdq);
+    hash = LOOKUP(obj);
+    TAILQ_INSERT_TAIL(&slpque[hash], me, thdq);
+
+    if(++slpstats[hash].waiters > slpstats[hash].max_waiters)
+        slpstats[hash].max_waiters = slpstats[hash].waiters;
 
     /* Block us until we're signaled */
     rv = thd_block_now(&me->context);
@@ -109,13 +101,17 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
 
 /* Removes a thread from its wait queue; assumes ints are disabled. */
 static void genwait_unqueue(kthread_t * thd) {
+    uint32 hash;
+
     if(thd->wait_obj) {
         /* Remove it from the queue */
-        TAILQ_REMOVE(&slpque[LOOKUP(thd->wait_obj)], thd, thdq);
+        hash = LOOKUP(thd->wait_obj);
+        TAILQ_REMOVE(&slpque[hash], thd, thdq);
+        --slpstats[hash].waiters;
 
         /* Also remove it from the timer queue if applicable */
         if(thd->wait_timeout)
-            tq_remove(thd);
+            tq_remove(&timer_queue, thd);
 
         /* Clean up wait stuff */
         thd->wait_obj = NULL;
@@ -133,17 +129,21 @@ int genwait_wake_cnt(void * obj, int cntmax, int err) {
     kthread_t       * t, * nt;
     struct slpquehead   * qp;
     int         cnt, old;
+    uint32      hash;
 
     /* Twiddle interrupt state */
     old = irq_disable();
 
     /* Find the queue */
-    qp = &slpque[LOOKUP(obj)];
+    hash = LOOKUP(obj);
+    qp = &slpque[hash];
+    ++slpstats[hash].wakes;
 
     /* Go through and find any matching entries */
     for(cnt = 0, t = TAILQ_FIRST(qp); t != NULL; t = nt) {
         /* Get the next thread up front */
         nt = TAILQ_NEXT(t, thdq);
+        ++slpstats[hash].scan_steps;
 
         /* Is this thread a match? */
         if(t->wait_obj == obj) {
@@ -195,17 +195,21 @@ int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
     kthread_t *t, *nt;
     struct slpquehead *qp;
     int old, rv = 0;
+    uint32 hash;
 
     /* Twiddle interrupt state */
     old = irq_disable();
 
     /* Find the queue */
-    qp = &slpque[LOOKUP(obj)];
+    hash = LOOKUP(obj);
+    qp = &slpque[hash];
+    ++slpstats[hash].wakes;
 
     /* Go through and find any matching entries */
     for(t = TAILQ_FIRST(qp); t != NULL; t = nt) {
         /* Get the next thread up front */
         nt = TAILQ_NEXT(t, thdq);
+        ++slpstats[hash].scan_steps;
 
         /* Is this thread a match? */
         if(t->wait_obj == obj && t == thd) {
@@ -236,7 +240,7 @@ int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
 void genwait_check_timeouts(uint64 tm) {
     kthread_t   *t;
 
-    t = tq_next();
+    t = tq_next(&timer_queue);
 
     while(t) {
         /* If the next timeout is beyond our current time, then
@@ -256,14 +260,14 @@ void genwait_check_timeouts(uint64 tm) {
         genwait_unqueue(t);
 
         /* Get the next one */
-        t = tq_next();
+        t = tq_next(&timer_queue);
     }
 }
 
 uint64 genwait_next_timeout(void) {
     kthread_t * t;
 
-    t = tq_next();
+    t = tq_next(&timer_queue);
 
     if(t == NULL)
         return 0;
@@ -271,13 +275,48 @@ uint64 genwait_next_timeout(void) {
         return t->wait_timeout;
 }
 
+size_t genwait_bucket_count(void) {
+    return TABLESIZE;
+}
+
+int genwait_bucket_stats(size_t bucket, genwait_bucket_stats_t *stats) {
+    int old;
+
+    if(bucket >= TABLESIZE || !stats) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+    *stats = slpstats[bucket];
+    irq_restore(old);
+
+    return 0;
+}
+
+void genwait_stats_reset(void) {
+    int i, old;
+
+    old = irq_disable();
+
+    for(i = 0; i < TABLESIZE; i++) {
+        slpstats[i].max_waiters = slpstats[i].waiters;
+        slpstats[i].wakes = 0;
+        slpstats[i].scan_steps = 0;
+    }
+
+    irq_restore(old);
+}
+
 int genwait_init(void) {
     int i;
 
     for(i = 0; i < TABLESIZE; i++)
         TAILQ_INIT(&slpque[i]);
 
-    TAILQ_INIT(&timer_queue);
+    memset(slpstats, 0, sizeof(slpstats));
+
+    timer_queue = NULL;
     return 0;
 }
 
@@ -0,0 +1,186 @@
+/* KallistiOS ##version##
+
+   mempool.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+*/
+
+/* Fixed-size object pools. Objects are carved out of slabs obtained from
+   malloc() and kept on a singly linked free list (threaded through the first
+   word of each free object) once they are freed. The free list and the
+   counters are only touched with interrupts disabled, which is all the
+   locking we need on this hardware. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <kos/mempool.h>
+#include <kos/dbglog.h>
+#include <arch/irq.h>
+
+/* Each slab starts with a link to the next slab, padded out so that the
+   objects that follow it stay 8-byte aligned. */
+#define SLAB_HDR_SIZE   8
+
+#define POISON_BYTE     0xA5
+
+int mempool_init(mempool_t *pool, size_t obj_size, size_t per_slab,
+                 size_t max_objs, uint32_t flags) {
+    if(!pool || !obj_size || !per_slab) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+
+    memset(pool, 0, sizeof(mempool_t));
+    pool->obj_size = (obj_size + 7) & ~7;
+    pool->slab_objs = per_slab;
+    pool->max_objs = max_objs;
+    pool->flags = flags;
+
+    return 0;
+}
+
+void mempool_destroy(mempool_t *pool) {
+    void *slab, *next;
+    int old;
+
+    old = irq_disable();
+    slab = pool->slabs;
+
+    if(pool->in_use)
+        dbglog(DBG_WARNING, "mempool_destroy: %u objects still in use\n",
+               (unsigned int)pool->in_use);
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->total = pool->in_use = pool->high_water = 0;
+    irq_restore(old);
+
+    while(slab) {
+        next = *(void **)slab;
+        free(slab);
+        slab = next;
+    }
+}
+
+/* Add another slab's worth of objects to the pool. */
+static int mempool_grow(mempool_t *pool) {
+    size_t cnt, i;
+    uint8_t *slab, *obj;
+    void *first = NULL;
+    int old;
+
+    /* Reserve our share of the object limit up front. */
+    old = irq_disable();
+    cnt = pool->slab_objs;
+
+    if(pool->max_objs) {
+        if(pool->total >= pool->max_objs)
+            cnt = 0;
+        else if(pool->total + cnt > pool->max_objs)
+            cnt = pool->max_objs - pool->total;
+    }
+
+    pool->total += cnt;
+    irq_restore(old);
+
+    if(!cnt) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if(!(slab = (uint8_t *)malloc(SLAB_HDR_SIZE + cnt * pool->obj_size))) {
+        old = irq_disable();
+        pool->total -= cnt;
+        irq_restore(old);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if(pool->flags & MEMPOOL_POISON)
+        memset(slab + SLAB_HDR_SIZE, POISON_BYTE, cnt * pool->obj_size);
+
+    /* Chain the new objects together, last to first. */
+    obj = slab + SLAB_HDR_SIZE + (cnt - 1) * pool->obj_size;
+
+    for(i = 0; i < cnt; ++i, obj -= pool->obj_size) {
+        *(void **)obj = first;
+        first = obj;
+    }
+
+    obj = slab + SLAB_HDR_SIZE + (cnt - 1) * pool->obj_size;
+
+    old = irq_disable();
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+    *(void **)obj = pool->free_list;
+    pool->free_list = first;
+    irq_restore(old);
+
+    return 0;
+}
+
+/* Make sure nobody wrote to an object while it was sitting on the free list.
+   The first word holds the free list link, so it is skipped. */
+static void mempool_check_poison(mempool_t *pool, void *obj) {
+    const uint8_t *p = (const uint8_t *)obj;
+    size_t i;
+
+    for(i = sizeof(void *); i < pool->obj_size; ++i) {
+        if(p[i] != POISON_BYTE) {
+            dbglog(DBG_ERROR, "mempool: object %p in pool %p was modified "
+                   "after being freed (offset %u)\n", obj, (void *)pool,
+                   (unsigned int)i);
+            break;
+        }
+    }
+}
+
+void *mempool_alloc(mempool_t *pool) {
+    void *obj;
+    int old;
+
+    for(;;) {
+        old = irq_disable();
+
+        if((obj = pool->free_list)) {
+            pool->free_list = *(void **)obj;
+
+            if(++pool->in_use > pool->high_water)
+                pool->high_water = pool->in_use;
+
+            irq_restore(old);
+            break;
+        }
+
+        irq_restore(old);
+
+        if(mempool_grow(pool))
+            return NULL;
+    }
+
+    if(pool->flags & MEMPOOL_POISON)
+        mempool_check_poison(pool, obj);
+
+    return obj;
+}
+
+void mempool_free(mempool_t *pool, void *obj) {
+    int old;
+
+    if(!obj)
+        return;
+
+    if(pool->flags & MEMPOOL_POISON)
+        memset(obj, POISON_BYTE, pool->obj_size);
+
+    old = irq_disable();
+    *(void **)obj = pool->free_list;
+    pool->free_list = obj;
+    --pool->in_use;
+    irq_restore(old);
+}
@@ -0,0 +1,156 @@
+/* KallistiOS ##version##
+
+   kernel/thread/runq.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   The scheduler's run queue. This is only used by thread.c, and is kept in
+   a header of its own (with nothing in it but the queue itself) so that it
+   can also be built on a host machine by utils/runqbench.
+
+   The queue is split into one list per priority level, plus a bitmap of
+   which levels currently have threads on them, so that finding the thread
+   that is ready to run next is a find-first-set on the bitmap instead of a
+   walk of every runnable thread.
+
+   Priorities 0 through RUNQ_LEVELS - 2 each get a level of their own. All of
+   the lower priorities (including PRIO_MAX, where the idle thread lives)
+   share the last level, which is kept sorted by priority just like the old
+   single run queue was.
+*/
+
+#ifndef __LOCAL_THREAD_RUNQ_H
+#define __LOCAL_THREAD_RUNQ_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <kos/thread.h>
+
+#define RUNQ_LEVELS     64
+#define RUNQ_MAP_WORDS  (RUNQ_LEVELS / 32)
+
+typedef struct runq {
+    struct ktqueue levels[RUNQ_LEVELS];
+    uint32_t map[RUNQ_MAP_WORDS];
+} runq_t;
+
+/* Which run queue level does a given priority belong in? */
+static inline unsigned int runq_level(prio_t prio) {
+    if((unsigned int)prio < RUNQ_LEVELS - 1)
+        return (unsigned int)prio;
+
+    return RUNQ_LEVELS - 1;
+}
+
+static inline void runq_init(runq_t *rq) {
+    unsigned int i;
+
+    for(i = 0; i < RUNQ_LEVELS; ++i)
+        TAILQ_INIT(&rq->levels[i]);
+
+    memset(rq->map, 0, sizeof(rq->map));
+}
+
+/* Add a thread right after the others of the same priority (front_of_line
+   == 0) or right before them (front_of_line != 0). Does nothing if the thread
+   is already queued. */
+static inline void runq_add(runq_t *rq, kthread_t *t, int front_of_line) {
+    kthread_t *i;
+    struct ktqueue *q;
+    unsigned int lvl;
+    int done;
+
+    if(t->flags & THD_QUEUED)
+        return;
+
+    lvl = runq_level(t->prio);
+    q = &rq->levels[lvl];
+
+    if(lvl < RUNQ_LEVELS - 1) {
+        /* Everything on this level has the same priority, so there's nothing
+           to search for. */
+        if(!front_of_line)
+            TAILQ_INSERT_TAIL(q, t, thdq);
+        else
+            TAILQ_INSERT_HEAD(q, t, thdq);
+    }
+    else {
+        done = 0;
+
+        if(!front_of_line) {
+            /* Look for a thread of lower priority and insert
+               before it. If there is nothing on the level, we'll
+               fall through to the bottom. */
+            TAILQ_FOREACH(i, q, thdq) {
+                if(i->prio > t->prio) {
+                    TAILQ_INSERT_BEFORE(i, t, thdq);
+                    done = 1;
+                    break;
+                }
+            }
+        }
+        else {
+            /* Look for a thread of the same or lower priority and
+               insert before it. If there is nothing on the level,
+               we'll fall through to the bottom. */
+            TAILQ_FOREACH(i, q, thdq) {
+                if(i->prio >= t->prio) {
+                    TAILQ_INSERT_BEFORE(i, t, thdq);
+                    done = 1;
+                    break;
+                }
+            }
+        }
+
+        /* Didn't find one, put it at the end */
+        if(!done)
+            TAILQ_INSERT_TAIL(q, t, thdq);
+    }
+
+    rq->map[lvl >> 5] |= 1UL << (lvl & 31);
+    t->flags |= THD_QUEUED;
+}
+
+/* Remove a thread, if it's queued. */
+static inline void runq_remove(runq_t *rq, kthread_t *t) {
+    unsigned int lvl;
+
+    if(!(t->flags & THD_QUEUED))
+        return;
+
+    lvl = runq_level(t->prio);
+
+    t->flags &= ~THD_QUEUED;
+    TAILQ_REMOVE(&rq->levels[lvl], t, thdq);
+
+    if(TAILQ_EMPTY(&rq->levels[lvl]))
+        rq->map[lvl >> 5] &= ~(1UL << (lvl & 31));
+}
+
+/* Find the highest priority runnable thread, without removing it. The first
+   thread on the first non-empty level is nearly always the one we want. */
+static inline kthread_t *runq_first(runq_t *rq) {
+    kthread_t *t;
+    unsigned int w, lvl;
+    uint32_t bits;
+
+    for(w = 0; w < RUNQ_MAP_WORDS; ++w) {
+        bits = rq->map[w];
+
+        while(bits) {
+            lvl = (w << 5) + __builtin_ctz(bits);
+
+            /* Is it runnable? If not, keep going */
+            TAILQ_FOREACH(t, &rq->levels[lvl], thdq) {
+                if(t->state == STATE_READY)
+                    return t;
+            }
+
+            bits &= bits - 1;
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* !__LOCAL_THREAD_RUNQ_H */
@@ -26,6 +26,8 @@
 #include <arch/timer.h>
 #include <arch/arch.h>
 
+#include "runq.h"
+
 /*
 
 This module supports thread scheduling in KOS. The timer interrupt is used
@@ -59,13 +61,10 @@ static unsigned int thd_sched_ms = 1000 / HZ;
 static struct ktlist thd_list;
 
 /* Run queue. This is more like on a standard time sharing system than the
-   previous versions. The top element of this priority queue should be the
-   thread that is ready to run next. When a thread is scheduled, it will be
-   removed from this queue. When it's de-scheduled, it will be re-inserted
-   by its priority value at the end of its priority group. Note that right
-   now this condition is being broken because sleeping threads are on the
-   same queue. We deal with those in thd_switch below. */
-static struct ktqueue run_queue;
+   previous versions. When a thread is scheduled, it will be removed from this
+   queue. When it's de-scheduled, it will be re-inserted at the end of its
+   priority level. See runq.h for how it's laid out. */
+static runq_t run_queue;
 
 /* The currently executing thread. This thread should not be on any queues. */
 kthread_t *thd_current = NULL;
@@ -147,21 +146,26 @@ int thd_pslist(int (*pf)(const char *fmt, ...)) {
 int thd_pslist_queue(int (*pf)(const char *fmt, ...)) {
     kthread_t *cur;
 
+    unsigned int lvl;
+
     pf("Queued threads:\n");
     pf("addr\t\ttid\tprio\tflags\twait_timeout\tstate     name\n");
-    TAILQ_FOREACH(cur, &run_queue, thdq) {
-        pf("%08lx\t", CONTEXT_PC(cur->context));
-        pf("%d\t", cur->tid);
 
-        if(cur->prio == PRIO_MAX)
-            pf("MAX\t");
-        else
-            pf("%d\t", cur->prio);
+    for(lvl = 0; lvl < RUNQ_LEVELS; ++lvl) {
+        TAILQ_FOREACH(cur, &run_queue.levels[lvl], thdq) {
+            pf("%08lx\t", CONTEXT_PC(cur->context));
+            pf("%d\t", cur->tid);
 
-        pf("%08lx\t", cur->flags);
-        pf("%ld\t\t", (uint32_t)cur->wait_timeout);
-        pf("%10s", thd_state_to_str(cur));
-        pf("%s\n", cur->label);
+            if(cur->prio == PRIO_MAX)
+                pf("MAX\t");
+            else
+                pf("%d\t", cur->prio);
+
+            pf("%08lx\t", cur->flags);
+            pf("%ld\t\t", (uint32_t)cur->wait_timeout);
+            pf("%10s", thd_state_to_str(cur));
+            pf("%s\n", cur->label);
+        }
     }
 
     return 0;
@@ -295,52 +299,12 @@ void thd_exit(void *rv) {
    right before the process group of the same priority (front_of_line!=0).
    See thd_schedule for why this is helpful. */
 void thd_add_to_runnable(kthread_t *t, int front_of_line) {
-    kthread_t *i;
-    int done;
-
-    if(t->flags & THD_QUEUED)
-        return;
-
-    done = 0;
-
-    if(!front_of_line) {
-        /* Look for a thread of lower priority and insert
-           before it. If there is nothing on the run queue, we'll
-           fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio > t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
-                break;
-            }
-        }
-    }
-    else {
-        /* Look for a thread of the same or lower priority and
-           insert before it. If there is nothing on the run queue,
-           we'll fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio >= t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
-                break;
-            }
-        }
-    }
-
-    /* Didn't find one, put it at the end */
-    if(!done)
-        TAILQ_INSERT_TAIL(&run_queue, t, thdq);
-
-    t->flags |= THD_QUEUED;
+    runq_add(&run_queue, t, front_of_line);
 }
 
 /* Removes a thread from the runnable queue, if it's there. */
 int thd_remove_from_runnable(kthread_t *thd) {
-    if(!(thd->flags & THD_QUEUED)) return 0;
-
-    thd->flags &= ~THD_QUEUED;
-    TAILQ_REMOVE(&run_queue, thd, thdq);
+    runq_remove(&run_queue, thd);
     return 0;
 }
 
@@ -599,14 +563,31 @@ int thd_destroy(kthread_t *thd) {
 
 /* Set a thread's priority */
 int thd_set_prio(kthread_t *thd, prio_t prio) {
+    int old;
+
     if(thd == NULL)
         return -1;
 
     if((prio < 0) || (prio > PRIO_MAX))
         return -2;
 
-    /* Set the new priority */
-    thd->prio = prio;
+    /* Set the new priority, moving the thread to its new run queue level if
+       it is currently queued. Interrupts stay off throughout, so that the
+       thread can't be queued between checking for that and setting the
+       priority. */
+    old = irq_disable();
+
+    if(thd->flags & THD_QUEUED) {
+        thd_remove_from_runnable(thd);
+        thd->prio = prio;
+        thd_add_to_runnable(thd, 0);
+    }
+    else {
+        thd->prio = prio;
+    }
+
+    irq_restore(old);
+
     return 0;
 }
 
@@ -660,11 +641,7 @@ void thd_schedule(int front_of_line, uint64_t now) {
     /* Search downwards through the run queue for a runnable thread; if
        we don't find a normal runnable thread, the idle process will
        always be there at the bottom. */
-    TAILQ_FOREACH(thd, &run_queue, thdq) {
-        /* Is it runnable? If not, keep going */
-        if(thd->state == STATE_READY)
-            break;
-    }
+    thd = runq_first(&run_queue);
 
     /* If we didn't already re-enqueue the thread and we are supposed to do so,
        do it now. */
@@ -1020,13 +997,15 @@ int thd_init(void) {
     LIST_INIT(&thd_list);
 
     /* Initialize the run queue */
-    TAILQ_INIT(&run_queue);
+    runq_init(&run_queue);
 
     /* Start off with no "current" thread */
     thd_current = NULL;
 
-    /* Init thread-local storage. */
+    /* Init thread-local storage, and the per-thread malloc caches that are
+       kept in it. */
     kthread_tls_init();
+    malloc_cache_init();
 
     /* Reinitialize thread counter */
     thd_count = 0;
@@ -0,0 +1,124 @@
+/* KallistiOS ##version##
+
+   kernel/thread/timerq.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   The genwait timed event queue. This is only used by genwait.c, and is kept
+   in a header of its own (with nothing in it but the queue itself) so that
+   it can also be built on a host machine by utils/timerqtest.
+
+   The queue is a pairing heap ordered by wait time (smallest at the root),
+   linked through each thread's timerq handle. That makes inserting a new
+   timeout O(1), and removing the next one (or cancelling any other one)
+   O(log n) amortized, without having to allocate anything.
+*/
+
+#ifndef __LOCAL_THREAD_TIMERQ_H
+#define __LOCAL_THREAD_TIMERQ_H
+
+#include <kos/thread.h>
+
+/* Combine two heaps, returning the new root. Both arguments must be roots
+   without any siblings. On a tie, a stays the root. */
+static inline kthread_t * tq_meld(kthread_t * a, kthread_t * b) {
+    kthread_t * t;
+
+    if(a == NULL)
+        return b;
+    else if(b == NULL)
+        return a;
+
+    if(b->wait_timeout < a->wait_timeout) {
+        t = a;
+        a = b;
+        b = t;
+    }
+
+    /* Make b the first child of a */
+    b->timerq.sibling = a->timerq.child;
+
+    if(b->timerq.sibling)
+        b->timerq.sibling->timerq.prev = b;
+
+    b->timerq.prev = a;
+    a->timerq.child = b;
+
+    return a;
+}
+
+/* Combine a list of siblings into a single heap, using the standard two-pass
+   pairing: meld pairs left to right, then meld the results right to left. */
+static inline kthread_t * tq_merge_pairs(kthread_t * first) {
+    kthread_t * a, * b, * next, * pairs = NULL, * root = NULL;
+
+    /* First pass: meld adjacent pairs, collecting them in reverse order. */
+    while(first) {
+        a = first;
+        b = a->timerq.sibling;
+        next = b ? b->timerq.sibling : NULL;
+
+        a->timerq.sibling = a->timerq.prev = NULL;
+
+        if(b)
+            b->timerq.sibling = b->timerq.prev = NULL;
+
+        a = tq_meld(a, b);
+        a->timerq.sibling = pairs;
+        pairs = a;
+        first = next;
+    }
+
+    /* Second pass: meld everything into one heap. */
+    while(pairs) {
+        next = pairs->timerq.sibling;
+        pairs->timerq.sibling = NULL;
+        root = tq_meld(pairs, root);
+        pairs = next;
+    }
+
+    return root;
+}
+
+/* Insert a thread on the queue, by its wait_timeout. */
+static inline void tq_insert(kthread_t ** queue, kthread_t * thd) {
+    thd->timerq.child = NULL;
+    thd->timerq.sibling = NULL;
+    thd->timerq.prev = NULL;
+
+    *queue = tq_meld(*queue, thd);
+}
+
+/* Remove a thread from the queue, wherever it is in it. */
+static inline void tq_remove(kthread_t ** queue, kthread_t * thd) {
+    kthread_t * sub;
+
+    if(thd == *queue) {
+        *queue = tq_merge_pairs(thd->timerq.child);
+    }
+    else {
+        /* Unhook it from its parent or previous sibling... */
+        if(thd->timerq.prev->timerq.child == thd)
+            thd->timerq.prev->timerq.child = thd->timerq.sibling;
+        else
+            thd->timerq.prev->timerq.sibling = thd->timerq.sibling;
+
+        if(thd->timerq.sibling)
+            thd->timerq.sibling->timerq.prev = thd->timerq.prev;
+
+        /* ... and put its children back into the heap. */
+        sub = tq_merge_pairs(thd->timerq.child);
+        *queue = tq_meld(*queue, sub);
+    }
+
+    thd->timerq.child = NULL;
+    thd->timerq.sibling = NULL;
+    thd->timerq.prev = NULL;
+}
+
+/* Returns the top thread on the queue (next event). If nothing is queued,
+   we'll return NULL. */
+static inline kthread_t * tq_next(kthread_t ** queue) {
+    return *queue;
+}
+
+#endif /* !__LOCAL_THREAD_TIMERQ_H */
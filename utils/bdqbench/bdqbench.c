@@ -0,0 +1,439 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/bdqbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Benchmark the block device request queues (kernel/fs/blockdev_queue.c) on
+   a host machine, against a mock device that sleeps for a while on every
+   request, like a DMA transfer that leaves the CPU free until it's done.
+
+   A stream of data is read through in fixed-size requests. Each request's
+   data is then "processed" by spinning the CPU for a while. This is done
+   once with plain blocking read_blocks calls, and then through a queue
+   with different numbers of requests kept in flight, so that the device
+   time and the processing can overlap.
+
+   Before that, it checks that failed requests report the right error, and
+   that a completion callback can resubmit its request to a full queue.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kos/blockdev.h>
+
+#define L_BLOCK_SIZE    9
+#define BLOCK_SIZE      (1 << L_BLOCK_SIZE)
+
+/* The most requests kept in flight. */
+#define MAX_DEPTH       32
+
+/********************************************************************************/
+/* A mock device with artificial latency */
+
+typedef struct mock_data {
+    uint64_t blocks;
+    unsigned latency_us;        /* Time taken by every request */
+    unsigned block_us;          /* Extra time per block */
+    unsigned jitter_us;         /* Up to this much more, at random */
+    int fail;                   /* Fail requests, without setting errno */
+    unsigned seed;
+    uint64_t reads;             /* Requests done */
+} mock_data_t;
+
+static mock_data_t mock;
+static kos_blockdev_t dev;
+
+static void sleep_us(unsigned us) {
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+
+    while(nanosleep(&ts, &ts) < 0 && errno == EINTR) ;
+}
+
+static int mock_init(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int mock_shutdown(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+/* Check a request, then wait for as long as the "hardware" takes to do it. */
+static int mock_access(mock_data_t *m, uint64_t block, size_t count) {
+    unsigned us = m->latency_us + m->block_us * (unsigned)count;
+
+    if(m->fail)
+        return -1;
+
+    if(block + count > m->blocks) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if(m->jitter_us)
+        us += (unsigned)rand_r(&m->seed) % m->jitter_us;
+
+    sleep_us(us);
+    ++m->reads;
+
+    return 0;
+}
+
+static int mock_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                            void *buf) {
+    uint32_t *p = (uint32_t *)buf;
+    size_t i;
+
+    if(mock_access((mock_data_t *)d->dev_data, block, count) < 0)
+        return -1;
+
+    for(i = 0; i < (count << L_BLOCK_SIZE) / 4; ++i)
+        p[i] = (uint32_t)(block * BLOCK_SIZE / 4 + i);
+
+    return 0;
+}
+
+static int mock_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                             const void *buf) {
+    (void)buf;
+    return mock_access((mock_data_t *)d->dev_data, block, count);
+}
+
+static uint64_t mock_count_blocks(kos_blockdev_t *d) {
+    return ((mock_data_t *)d->dev_data)->blocks;
+}
+
+static int mock_flush(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static void mock_create(uint64_t blocks, unsigned latency_us,
+                        unsigned block_us, unsigned jitter_us) {
+    memset(&mock, 0, sizeof(mock));
+    mock.blocks = blocks;
+    mock.latency_us = latency_us;
+    mock.block_us = block_us;
+    mock.jitter_us = jitter_us;
+    mock.seed = 1;
+
+    memset(&dev, 0, sizeof(dev));
+    dev.dev_data = &mock;
+    dev.l_block_size = L_BLOCK_SIZE;
+    dev.init = &mock_init;
+    dev.shutdown = &mock_shutdown;
+    dev.read_blocks = &mock_read_blocks;
+    dev.write_blocks = &mock_write_blocks;
+    dev.count_blocks = &mock_count_blocks;
+    dev.flush = &mock_flush;
+}
+
+/********************************************************************************/
+/* The benchmarks */
+
+static struct timespec t_start;
+static uint64_t reads_start;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void bench_start(void) {
+    reads_start = mock.reads;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print the time taken since bench_start(), the throughput, and how much
+   longer it took than the time the device was busy for (if everything
+   overlapped perfectly, that would be just the processing time). */
+static void bench_end(const char *what, uint64_t bytes, double dev_secs) {
+    double secs = now() - ((double)t_start.tv_sec +
+                           (double)t_start.tv_nsec / 1e9);
+
+    printf("  %-18s %10.2f ms %9.2f MB/s  reads %llu  over device time "
+           "%8.2f ms\n", what, secs * 1000.0,
+           (double)bytes / secs / 1048576.0,
+           (unsigned long long)(mock.reads - reads_start),
+           (secs - dev_secs) * 1000.0);
+}
+
+/* Stand in for doing something with the data, like decoding it. */
+static uint32_t process(const void *buf, size_t len, unsigned cpu_us) {
+    const uint32_t *p = (const uint32_t *)buf;
+    double end = now() + cpu_us / 1e6;
+    uint32_t sum = 0;
+    size_t i;
+
+    for(i = 0; i < len / 4; ++i)
+        sum += p[i];
+
+    while(now() < end) ;
+
+    return sum;
+}
+
+static int bench_sync(uint64_t reqs, size_t count, unsigned cpu_us,
+                      uint8_t *buf, double dev_secs) {
+    uint64_t i;
+
+    bench_start();
+
+    for(i = 0; i < reqs; ++i) {
+        if(dev.read_blocks(&dev, i * count, count, buf) < 0) {
+            perror("read_blocks");
+            return -1;
+        }
+
+        process(buf, count << L_BLOCK_SIZE, cpu_us);
+    }
+
+    bench_end("blocking", (reqs * count) << L_BLOCK_SIZE, dev_secs);
+    return 0;
+}
+
+/* Keep depth requests in flight. Whenever the oldest one is done, process
+   its data and then reuse it for the next part of the stream. */
+static int bench_queue(uint64_t reqs, size_t count, unsigned cpu_us,
+                       size_t depth, uint8_t *bufs, double dev_secs) {
+    kos_blockdev_req_t req[MAX_DEPTH];
+    kos_blockdev_queue_t *q;
+    uint64_t next = 0, done;
+    char what[32];
+    size_t i;
+    int rv = 0;
+
+    if(!(q = blockdev_queue_create(&dev, depth))) {
+        perror("blockdev_queue_create");
+        return -1;
+    }
+
+    memset(req, 0, sizeof(req));
+    bench_start();
+
+    for(i = 0; i < depth && next < reqs; ++i, ++next) {
+        req[i].block = next * count;
+        req[i].count = count;
+        req[i].buf = bufs + ((i * count) << L_BLOCK_SIZE);
+
+        if(blockdev_queue_submit(q, &req[i]) < 0) {
+            perror("blockdev_queue_submit");
+            rv = -1;
+            goto out;
+        }
+    }
+
+    for(done = 0; done < reqs; ++done) {
+        i = (size_t)(done % depth);
+
+        if(blockdev_queue_wait(q, &req[i]) < 0) {
+            perror("blockdev_queue_wait");
+            rv = -1;
+            goto out;
+        }
+
+        process(req[i].buf, count << L_BLOCK_SIZE, cpu_us);
+
+        if(next < reqs) {
+            req[i].block = next++ * count;
+
+            if(blockdev_queue_submit(q, &req[i]) < 0) {
+                perror("blockdev_queue_submit");
+                rv = -1;
+                goto out;
+            }
+        }
+    }
+
+    sprintf(what, "queue depth %lu", (unsigned long)depth);
+    bench_end(what, (reqs * count) << L_BLOCK_SIZE, dev_secs);
+
+out:
+    blockdev_queue_destroy(q);
+    return rv;
+}
+
+/* A device that fails without setting errno must still give EIO, rather
+   than whatever errno was left over from before. errno is per-thread, so
+   leave something in the worker's own errno first, with a request that runs
+   off the end of the device. */
+static int check_errors(void) {
+    kos_blockdev_queue_t *q;
+    kos_blockdev_req_t req[2];
+    uint8_t buf[BLOCK_SIZE];
+    int i;
+
+    if(!(q = blockdev_queue_create(&dev, 1))) {
+        perror("blockdev_queue_create");
+        return -1;
+    }
+
+    memset(req, 0, sizeof(req));
+
+    for(i = 0; i < 2; ++i) {
+        req[i].block = i ? 0 : mock.blocks;
+        req[i].count = 1;
+        req[i].buf = buf;
+        mock.fail = i;
+
+        if(blockdev_queue_submit(q, &req[i]) < 0) {
+            perror("blockdev_queue_submit");
+            break;
+        }
+
+        blockdev_queue_wait(q, &req[i]);
+    }
+
+    mock.fail = 0;
+    blockdev_queue_destroy(q);
+
+    if(req[0].status != EOVERFLOW || req[1].status != EIO) {
+        fprintf(stderr, "failed requests gave status %d and %d, not "
+                "EOVERFLOW and EIO\n", req[0].status, req[1].status);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Callbacks have to be able to keep a queue going by themselves, even one
+   with room for a single request. This one submits its own request again,
+   for the next part of the device, until it has been done CHAIN_LENGTH
+   times. */
+#define CHAIN_LENGTH    8
+
+static kos_blockdev_queue_t *chain_q;
+static int chain_done, chain_failed;
+
+static void chain_callback(kos_blockdev_req_t *req, int status) {
+    if(status || ++chain_done == CHAIN_LENGTH)
+        return;
+
+    ++req->block;
+
+    if(blockdev_queue_submit(chain_q, req) < 0)
+        chain_failed = errno;
+}
+
+static int check_callbacks(void) {
+    kos_blockdev_req_t req;
+    uint8_t buf[BLOCK_SIZE];
+    int rv = 0;
+
+    if(!(chain_q = blockdev_queue_create(&dev, 1))) {
+        perror("blockdev_queue_create");
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.count = 1;
+    req.buf = buf;
+    req.callback = &chain_callback;
+    chain_done = chain_failed = 0;
+
+    if(blockdev_queue_submit(chain_q, &req) < 0) {
+        perror("blockdev_queue_submit");
+        rv = -1;
+    }
+    else if(blockdev_queue_wait(chain_q, &req) < 0) {
+        perror("blockdev_queue_wait");
+        rv = -1;
+    }
+
+    /* Everything has to be finished once the request is, without the queue
+       being full for the callback at any point. */
+    if(!rv && (chain_done != CHAIN_LENGTH || chain_failed ||
+               req.block != CHAIN_LENGTH - 1)) {
+        fprintf(stderr, "callback chain did %d of %d requests (%s)\n",
+                chain_done, CHAIN_LENGTH,
+                chain_failed ? strerror(chain_failed) : "no errors");
+        rv = -1;
+    }
+
+    blockdev_queue_destroy(chain_q);
+    return rv;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-m stream_mb] [-b blocks_per_request] "
+            "[-l latency_us] [-p per_block_us] [-j jitter_us] [-c cpu_us]\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t depths[] = { 1, 2, 4, 8, 16, 32 };
+    unsigned stream_mb = 8, latency_us = 200, block_us = 2, jitter_us = 400;
+    unsigned cpu_us = 300;
+    size_t count = 64, i;
+    uint64_t reqs;
+    uint8_t *bufs;
+    double dev_secs;
+    int opt, rv = 0;
+
+    while((opt = getopt(argc, argv, "m:b:l:p:j:c:")) != -1) {
+        switch(opt) {
+            case 'm': stream_mb = (unsigned)atoi(optarg); break;
+            case 'b': count = (size_t)atoi(optarg); break;
+            case 'l': latency_us = (unsigned)atoi(optarg); break;
+            case 'p': block_us = (unsigned)atoi(optarg); break;
+            case 'j': jitter_us = (unsigned)atoi(optarg); break;
+            case 'c': cpu_us = (unsigned)atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || !stream_mb || !count) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    reqs = ((uint64_t)stream_mb << 20) / (count << L_BLOCK_SIZE);
+
+    if(!reqs) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mock_create(reqs * count, latency_us, block_us, jitter_us);
+
+    if(check_errors() < 0 || check_callbacks() < 0)
+        return 1;
+
+    if(!(bufs = (uint8_t *)malloc((MAX_DEPTH * count) << L_BLOCK_SIZE))) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* On average, how long the device spends on the whole stream */
+    dev_secs = (double)reqs * (latency_us + block_us * count +
+                               jitter_us / 2.0) / 1e6;
+
+    printf("%llu requests of %lu blocks, %u us + %u us/block + up to %u us "
+           "each, %u us of processing each\n", (unsigned long long)reqs,
+           (unsigned long)count, latency_us, block_us, jitter_us, cpu_us);
+    printf("  (device busy for about %.2f ms, processing for %.2f ms)\n",
+           dev_secs * 1000.0, reqs * cpu_us / 1000.0);
+
+    if(bench_sync(reqs, count, cpu_us, bufs, dev_secs) < 0)
+        rv = 1;
+
+    for(i = 0; !rv && i < sizeof(depths) / sizeof(depths[0]); ++i) {
+        if(bench_queue(reqs, count, cpu_us, depths[i], bufs, dev_secs) < 0)
+            rv = 1;
+    }
+
+    free(bufs);
+    return rv;
+}
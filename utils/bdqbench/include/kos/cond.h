@@ -0,0 +1,24 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/include/kos/cond.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/cond.h, on top of pthreads.
+*/
+
+#ifndef __KOS_COND_H
+#define __KOS_COND_H
+
+#include <pthread.h>
+#include <kos/mutex.h>
+
+typedef struct condvar {
+    pthread_cond_t c;
+} condvar_t;
+
+int cond_init(condvar_t *cv);
+int cond_destroy(condvar_t *cv);
+int cond_wait(condvar_t *cv, mutex_t *m);
+int cond_broadcast(condvar_t *cv);
+
+#endif /* __KOS_COND_H */
@@ -0,0 +1,25 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/include/kos/mutex.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/mutex.h, on top of pthreads.
+*/
+
+#ifndef __KOS_MUTEX_H
+#define __KOS_MUTEX_H
+
+#include <pthread.h>
+
+typedef struct mutex {
+    pthread_mutex_t m;
+} mutex_t;
+
+#define MUTEX_TYPE_NORMAL       0
+
+int mutex_init(mutex_t *m, int mtype);
+int mutex_destroy(mutex_t *m);
+int mutex_lock(mutex_t *m);
+int mutex_unlock(mutex_t *m);
+
+#endif /* __KOS_MUTEX_H */
@@ -0,0 +1,16 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/include/kos/thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/thread.h. Only labels are supported.
+*/
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+typedef struct kthread kthread_t;
+
+void thd_set_label(kthread_t *thd, const char *label);
+
+#endif /* __KOS_THREAD_H */
@@ -0,0 +1,23 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/include/kos/worker_thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/worker_thread.h, on top of pthreads. As in KOS, the
+   routine is run once for each wakeup, and wakeups that come in while it is
+   running make it run again once it's done.
+*/
+
+#ifndef __KOS_WORKER_THREAD_H
+#define __KOS_WORKER_THREAD_H
+
+#include <kos/thread.h>
+
+typedef struct kthread_worker kthread_worker_t;
+
+kthread_worker_t *thd_worker_create(void (*routine)(void *), void *data);
+void thd_worker_destroy(kthread_worker_t *thd);
+void thd_worker_wakeup(kthread_worker_t *thd);
+kthread_t *thd_worker_get_thread(kthread_worker_t *thd);
+
+#endif /* __KOS_WORKER_THREAD_H */
@@ -0,0 +1,131 @@
+/* KallistiOS ##version##
+
+   utils/bdqbench/stubs.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Just enough of the KOS threading API, on top of pthreads, for
+   blockdev_queue.c to run on the host.
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <kos/mutex.h>
+#include <kos/cond.h>
+#include <kos/thread.h>
+#include <kos/worker_thread.h>
+
+struct kthread_worker {
+    pthread_t thd;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    int pending;
+    int quit;
+    void (*routine)(void *);
+    void *data;
+};
+
+int mutex_init(mutex_t *m, int mtype) {
+    (void)mtype;
+    return pthread_mutex_init(&m->m, NULL) ? -1 : 0;
+}
+
+int mutex_destroy(mutex_t *m) {
+    return pthread_mutex_destroy(&m->m) ? -1 : 0;
+}
+
+int mutex_lock(mutex_t *m) {
+    return pthread_mutex_lock(&m->m) ? -1 : 0;
+}
+
+int mutex_unlock(mutex_t *m) {
+    return pthread_mutex_unlock(&m->m) ? -1 : 0;
+}
+
+int cond_init(condvar_t *cv) {
+    return pthread_cond_init(&cv->c, NULL) ? -1 : 0;
+}
+
+int cond_destroy(condvar_t *cv) {
+    return pthread_cond_destroy(&cv->c) ? -1 : 0;
+}
+
+int cond_wait(condvar_t *cv, mutex_t *m) {
+    return pthread_cond_wait(&cv->c, &m->m) ? -1 : 0;
+}
+
+int cond_broadcast(condvar_t *cv) {
+    return pthread_cond_broadcast(&cv->c) ? -1 : 0;
+}
+
+void thd_set_label(kthread_t *thd, const char *label) {
+    (void)thd;
+    (void)label;
+}
+
+static void *worker_thd(void *d) {
+    kthread_worker_t *w = (kthread_worker_t *)d;
+
+    pthread_mutex_lock(&w->lock);
+
+    for(;;) {
+        while(!w->pending && !w->quit)
+            pthread_cond_wait(&w->cv, &w->lock);
+
+        if(w->quit)
+            break;
+
+        w->pending = 0;
+        pthread_mutex_unlock(&w->lock);
+        w->routine(w->data);
+        pthread_mutex_lock(&w->lock);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+kthread_worker_t *thd_worker_create(void (*routine)(void *), void *data) {
+    kthread_worker_t *w;
+
+    if(!(w = (kthread_worker_t *)calloc(1, sizeof(kthread_worker_t))))
+        return NULL;
+
+    w->routine = routine;
+    w->data = data;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cv, NULL);
+
+    if(pthread_create(&w->thd, NULL, worker_thd, w)) {
+        pthread_cond_destroy(&w->cv);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+void thd_worker_destroy(kthread_worker_t *thd) {
+    pthread_mutex_lock(&thd->lock);
+    thd->quit = 1;
+    pthread_cond_signal(&thd->cv);
+    pthread_mutex_unlock(&thd->lock);
+
+    pthread_join(thd->thd, NULL);
+    pthread_cond_destroy(&thd->cv);
+    pthread_mutex_destroy(&thd->lock);
+    free(thd);
+}
+
+void thd_worker_wakeup(kthread_worker_t *thd) {
+    pthread_mutex_lock(&thd->lock);
+    thd->pending = 1;
+    pthread_cond_signal(&thd->cv);
+    pthread_mutex_unlock(&thd->lock);
+}
+
+kthread_t *thd_worker_get_thread(kthread_worker_t *thd) {
+    (void)thd;
+    return NULL;
+}
@@ -56,6 +56,10 @@
  * -A N,/name force named file(s) (shell globbing applied against the filenames)
  *       to be aligned on N bytes boundary
  * In both cases, N must be a power of two.
+ * -i    append a name index that the KallistiOS romdisk driver can use
+ *       instead of building its own at mount time
+ * -z    compress regular files in chunks for the KallistiOS romdisk driver
+ * -Z /name  store matching file(s) uncompressed even with -z
  */
 
 /*
@@ -74,6 +78,7 @@
 #include <unistd.h> /* Userland prototypes of the Unix std system calls    */
 #include <fcntl.h>  /* Flag value for file handling functions              */
 #include <time.h>
+#include <ctype.h>
 #if defined(_WIN32) && !defined(__CYGWIN__)
 #   include <getopt.h>
 #   include <winsock2.h>
@@ -138,6 +143,8 @@ struct filenode {
     unsigned int offset;
     unsigned int size;
     unsigned int pad;
+    unsigned char *zdata;
+    unsigned int zsize;
 };
 
 struct aligns {
@@ -192,14 +199,204 @@ void shownode(int level, struct filenode *node, FILE *f) {
     }
 }
 
+/*
+ * Compressed files (-z), for the KallistiOS romdisk driver.
+ *
+ * The file is cut into KOSZ_CHUNK byte chunks, each compressed on its own
+ * as an LZ4 block so that any part of the file can be read back without
+ * decoding what comes before it.  The header's size field keeps the
+ * uncompressed length, spec.info is KOSZ_SPEC, and the data area holds:
+ *
+ *   chunk size (be32) | chunk count (be32) | chunk offsets (be32 * count+1)
+ *
+ * followed by the chunks.  Offsets are from the start of the data area.
+ * A chunk whose stored length equals its uncompressed length is raw.
+ */
+
+#define KOSZ_SPEC       0x4b4c5a34  /* "KLZ4" */
+#define KOSZ_CHUNK      65536
+#define LZ4_HASHBITS    12
+#define LZ4_MINMATCH    4
+#define LZ4_MFLIMIT     12
+#define LZ4_LASTLITS    5
+
+uint32_t lz4_read32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint8_t *lz4_putlen(uint8_t *op, unsigned int len) {
+    for(; len >= 255; len -= 255)
+        *op++ = 255;
+
+    *op++ = len;
+    return op;
+}
+
+/* Emit one sequence; mlen is 0 for the final, literal-only one. Returns the
+   new output pointer, or NULL if it wouldn't fit. */
+uint8_t *lz4_emit(uint8_t *op, uint8_t *oend, const uint8_t *lit,
+                  unsigned int litlen, unsigned int off,
+                  unsigned int mlen) {
+    uint8_t *token = op++;
+
+    if(op + litlen + litlen / 255 + 1 + 2 + mlen / 255 + 1 > oend)
+        return NULL;
+
+    *token = (litlen >= 15 ? 15 : litlen) << 4;
+
+    if(litlen >= 15)
+        op = lz4_putlen(op, litlen - 15);
+
+    memcpy(op, lit, litlen);
+    op += litlen;
+
+    if(!mlen)
+        return op;
+
+    *op++ = off & 0xff;
+    *op++ = off >> 8;
+    mlen -= LZ4_MINMATCH;
+    *token |= mlen >= 15 ? 15 : mlen;
+
+    if(mlen >= 15)
+        op = lz4_putlen(op, mlen - 15);
+
+    return op;
+}
+
+/* Compress one LZ4 block. Returns the compressed length, or -1 if it came
+   out no smaller than dstcap. */
+int lz4_compress(const uint8_t *src, int srclen, uint8_t *dst, int dstcap) {
+    static int table[1 << LZ4_HASHBITS];
+    const uint8_t *ip = src, *anchor = src, *ref;
+    const uint8_t *iend = src + srclen;
+    const uint8_t *mflimit = iend - LZ4_MFLIMIT;
+    const uint8_t *matchlimit = iend - LZ4_LASTLITS;
+    uint8_t *op = dst, *oend = dst + dstcap;
+    uint32_t seq, h;
+    int i, mlen;
+
+    for(i = 0; i < (1 << LZ4_HASHBITS); i++)
+        table[i] = -1;
+
+    while(srclen > LZ4_MFLIMIT && ip < mflimit) {
+        seq = lz4_read32(ip);
+        h = (seq * 2654435761U) >> (32 - LZ4_HASHBITS);
+        ref = table[h] < 0 ? NULL : src + table[h];
+        table[h] = ip - src;
+
+        if(!ref || ip - ref > 65535 || lz4_read32(ref) != seq) {
+            ++ip;
+            continue;
+        }
+
+        for(mlen = LZ4_MINMATCH; ip + mlen < matchlimit &&
+                ip[mlen] == ref[mlen]; mlen++)
+            ;
+
+        op = lz4_emit(op, oend, anchor, ip - anchor, ip - ref, mlen);
+
+        if(!op)
+            return -1;
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    op = lz4_emit(op, oend, anchor, iend - anchor, 0, 0);
+
+    return op ? op - dst : -1;
+}
+
+/* Read and compress a regular file. Leaves the node alone if that wouldn't
+   save at least 1/16th of its size. */
+int compressfile(struct filenode *node) {
+    FILE *in;
+    unsigned char *raw, *z;
+    unsigned int chunks, hdrsize, pos, i, len;
+    int clen;
+
+    if(!node->size)
+        return 0;
+
+    chunks = (node->size + KOSZ_CHUNK - 1) / KOSZ_CHUNK;
+    hdrsize = 8 + 4 * (chunks + 1);
+
+    if(hdrsize >= node->size)
+        return 0;
+
+    raw = malloc(node->size);
+    z = malloc(hdrsize + node->size);
+
+    if(!raw || !z) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    in = fopen(node->realname, "rb");
+
+    if(!in || fread(raw, 1, node->size, in) != node->size) {
+        fprintf(stderr, "error reading '%s'\n", node->realname);
+
+        if(in)
+            fclose(in);
+
+        free(raw);
+        free(z);
+        return -1;
+    }
+
+    fclose(in);
+
+    *(uint32_t *)(z + 0) = htonl(KOSZ_CHUNK);
+    *(uint32_t *)(z + 4) = htonl(chunks);
+    pos = hdrsize;
+
+    for(i = 0; i < chunks; i++) {
+        *(uint32_t *)(z + 8 + 4 * i) = htonl(pos);
+        len = node->size - i * KOSZ_CHUNK;
+
+        if(len > KOSZ_CHUNK)
+            len = KOSZ_CHUNK;
+
+        clen = lz4_compress(raw + i * KOSZ_CHUNK, len, z + pos, len);
+
+        /* Didn't help; store the chunk as is. */
+        if(clen < 0) {
+            memcpy(z + pos, raw + i * KOSZ_CHUNK, len);
+            clen = len;
+        }
+
+        pos += clen;
+    }
+
+    free(raw);
+
+    if(pos > node->size - node->size / 16) {
+        free(z);
+        return 0;
+    }
+
+    *(uint32_t *)(z + 8 + 4 * chunks) = htonl(pos);
+    node->zdata = z;
+    node->zsize = pos;
+    return 0;
+}
+
 /* Dumping functions */
 
 static char bigbuf[4096];
 static char fixbuf[512];
 static int atoffs = 0;
 static int align = 16;
+static int kosindex = 0;
+static int compress = 0;
 struct aligns *alignlist = NULL;
 struct excludes *excludelist = NULL;
+struct excludes *nocomplist = NULL;
 int realbase;
 
 /* helper function to match an exclusion or align pattern */
@@ -377,6 +574,15 @@ int dumpnode(struct filenode *node, FILE *f) {
         dumpdataa(bigbuf, node->size, f);
     }
 #endif
+    else if(S_ISREG(node->modes) && node->zdata) {
+        ri.nextfh |= htonl(ROMFH_REG);
+        ri.spec = htonl(KOSZ_SPEC);
+        dumpri(&ri, node, f);
+        dumpdata(node->zdata, node->zsize, f);
+
+        if(node->zsize & 15)
+            dumpzero(16 - (node->zsize & 15), f);
+    }
     else if(S_ISREG(node->modes)) {
         int offset, len, fd, max, avail;
         ri.nextfh |= htonl(ROMFH_REG);
@@ -447,6 +653,136 @@ int dumpnode(struct filenode *node, FILE *f) {
     return 0;
 }
 
+/*
+ * Optional name index for the KallistiOS romdisk driver (-i).
+ *
+ * The table is an open addressed hash of every file and directory entry,
+ * keyed by the offset of the directory listing that holds it and the
+ * case-folded name, using the same hash and linear probing as the table
+ * fs_romdisk otherwise builds in RAM at mount time.  It goes right after the last
+ * file, followed by a 16 byte trailer ending at full_size:
+ *
+ *   "KOSRDIDX" | table offset (be32) | slot count (be32)
+ *
+ * Each slot is three be32 words: hash, directory offset, header offset,
+ * with a header offset of 0 marking an empty slot.  Readers that don't
+ * know about the index just see some unused bytes at the end of the image.
+ */
+
+#define KOSIDX_MAGIC    "KOSRDIDX"
+#define KOSIDX_TRAILER  16
+#define KOSIDX_ENTSIZE  12
+
+static uint32_t *kosidx = NULL;
+static uint32_t kosidx_slots = 0;
+static uint32_t kosidx_off = 0;
+
+/* The romfs type that dumpnode() writes for this node */
+int nodetype(struct filenode *node) {
+    if(node->orig_link)
+        return ROMFH_HRD;
+    else if(S_ISDIR(node->modes))
+        return ROMFH_DIR;
+    else if(S_ISREG(node->modes))
+        return ROMFH_REG;
+#if !defined(_WIN32) || defined(__CYGWIN__)
+    else if(S_ISLNK(node->modes))
+        return ROMFH_LNK;
+    else if(S_ISCHR(node->modes))
+        return ROMFH_CHR;
+    else if(S_ISBLK(node->modes))
+        return ROMFH_BLK;
+    else if(S_ISFIFO(node->modes))
+        return ROMFH_FIF;
+    else if(S_ISSOCK(node->modes))
+        return ROMFH_SCK;
+#endif
+
+    return ROMFH_HRD;
+}
+
+/* Must match romdisk_hash() in kernel/fs/fs_romdisk.c */
+uint32_t kosidx_hash(uint32_t dir, const char *name) {
+    uint32_t h = (2166136261UL ^ dir) * 16777619UL;
+
+    while(*name) {
+        h ^= (uint8_t)tolower((uint8_t)*name++);
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
+void kosidx_insert(uint32_t dir, struct filenode *node) {
+    uint32_t h, slot;
+
+    h = kosidx_hash(dir, node->name);
+
+    for(slot = h & (kosidx_slots - 1); kosidx[slot * 3 + 2];
+        slot = (slot + 1) & (kosidx_slots - 1))
+        ;
+
+    kosidx[slot * 3 + 0] = htonl(h);
+    kosidx[slot * 3 + 1] = htonl(dir);
+    kosidx[slot * 3 + 2] = htonl(node->offset);
+}
+
+/* Visit the same entries, in the same per-directory order, as the
+   romdisk driver's own walk of the image. */
+int kosidx_walk(struct filenode *node, uint32_t dir, int insert) {
+    struct filenode *p;
+    int type, cnt = 0;
+
+    for(p = node->dirlist.head; p->next; p = p->next) {
+        type = nodetype(p);
+
+        if((type & 3) == ROMFH_DIR || (type & 3) == ROMFH_REG) {
+            if(insert)
+                kosidx_insert(dir, p);
+
+            ++cnt;
+        }
+
+        if(type == ROMFH_DIR && strcmp(p->name, ".") &&
+                strcmp(p->name, "..") && !listisempty(&p->dirlist))
+            cnt += kosidx_walk(p, p->dirlist.head->offset, insert);
+    }
+
+    return cnt;
+}
+
+/* Build the index for an image whose root listing starts at first and whose
+   files end at lastoff. Returns the number of bytes it adds to the image. */
+int kosidx_build(struct filenode *root, int first, int lastoff) {
+    uint32_t cnt;
+
+    cnt = kosidx_walk(root, first, 0);
+
+    /* Keep the table at most half full. */
+    for(kosidx_slots = 16; kosidx_slots < cnt * 2; kosidx_slots <<= 1)
+        ;
+
+    kosidx = (uint32_t *)calloc(kosidx_slots, KOSIDX_ENTSIZE);
+
+    if(!kosidx)
+        return -1;
+
+    kosidx_walk(root, first, 1);
+    kosidx_off = lastoff;
+
+    return kosidx_slots * KOSIDX_ENTSIZE + KOSIDX_TRAILER;
+}
+
+void kosidx_dump(FILE *f) {
+    uint32_t trailer[2];
+
+    dumpdata(kosidx, kosidx_slots * KOSIDX_ENTSIZE, f);
+    dumpdata(KOSIDX_MAGIC, 8, f);
+    trailer[0] = htonl(kosidx_off);
+    trailer[1] = htonl(kosidx_slots);
+    dumpdata(trailer, sizeof(trailer), f);
+}
+
 int dumpall(struct filenode *node, int lastoff, FILE *f) {
     struct romfh ri;
     struct filenode *p;
@@ -465,6 +801,9 @@ int dumpall(struct filenode *node, int lastoff, FILE *f) {
         p = p->next;
     }
 
+    if(kosidx)
+        kosidx_dump(f);
+
     /* Align the whole bunch to ROMBSIZE boundary */
     if(lastoff & 1023)
         dumpzero(1024 - (lastoff & 1023), f);
@@ -538,6 +877,8 @@ struct filenode *newnode(const char *base, const char *name, int curroffset) {
     node->onino = -1;
     node->modes = -1;
     node->size = 0;
+    node->zdata = NULL;
+    node->zsize = 0;
     node->devnode = 0;
     node->orig_link = NULL;
     node->offset = curroffset;
@@ -574,7 +915,8 @@ struct filenode *findnode(struct filenode *node, dev_t dev, ino_t ino) {
 #define ALIGNUP16(x) (((x)+15)&~15)
 
 int spaceneeded(struct filenode *node) {
-    return 16 + ALIGNUP16(strlen(node->name) + 1) + ALIGNUP16(node->size);
+    return 16 + ALIGNUP16(strlen(node->name) + 1) +
+        ALIGNUP16(node->zdata ? node->zsize : node->size);
 }
 
 int alignnode(struct filenode *node, int curroffset, int extraspace) {
@@ -744,6 +1086,18 @@ int processdir(int level, const char *base, const char *dirname, struct stat *sb
         if(S_ISREG(sb->st_mode)) {
             curroffset = alignnode(n, curroffset, spaceneeded(n));
             n->size = sb->st_size;
+
+            /* Files that asked for special alignment are meant to be
+               mapped directly, so those stay uncompressed. */
+            if(compress && findalign(n) == 16) {
+                for(pe = nocomplist; pe; pe = pe->next) {
+                    if(!nodematch(pe->pattern, n))
+                        break;
+                }
+
+                if(!pe && compressfile(n))
+                    return -1;
+            }
         }
         else
             curroffset = alignnode(n, curroffset, 0);
@@ -791,6 +1145,9 @@ void showhelp(const char *argv0) {
     printf("  -a ALIGN               Align regular file data to ALIGN bytes\n");
     printf("  -A ALIGN,PATTERN       Align all objects matching pattern to at least ALIGN bytes\n");
     printf("  -x PATTERN             Exclude all objects matching pattern\n");
+    printf("  -i                     Append a name index for the KallistiOS romdisk driver\n");
+    printf("  -z                     Compress files for the KallistiOS romdisk driver\n");
+    printf("  -Z PATTERN             Don't compress objects matching pattern\n");
     printf("  -h                     Show this help\n");
     printf("\n");
     printf("Report bugs to chexum@shadow.banki.hu\n");
@@ -812,7 +1169,7 @@ int main(int argc, char *argv[]) {
     struct excludes *pe, *pe2;
     FILE *f;
 
-    while((c = getopt(argc, argv, "V:vd:f:ha:A:x:")) != EOF) {
+    while((c = getopt(argc, argv, "V:vd:f:ha:A:x:izZ:")) != EOF) {
         switch(c) {
             case 'd':
                 dir = optarg;
@@ -825,6 +1182,27 @@ int main(int argc, char *argv[]) {
                 break;
             case 'v':
                 verbose = 1;
+                break;
+            case 'i':
+                kosindex = 1;
+                break;
+            case 'z':
+                compress = 1;
+                break;
+            case 'Z':
+                pe = (struct excludes *)malloc(sizeof(*pe) + strlen(optarg) + 1);
+                pe->next = NULL;
+                strcpy(pe->pattern, optarg);
+
+                if(!nocomplist)
+                    nocomplist = pe;
+                else {
+                    for(pe2 = nocomplist; pe2->next; pe2 = pe2->next)
+                        ;
+
+                    pe2->next = pe;
+                }
+
                 break;
             case 'h':
                 showhelp(argv[0]);
@@ -918,6 +1296,17 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if(kosindex) {
+        i = kosidx_build(root, spaceneeded(root), lastoff);
+
+        if(i < 0) {
+            fprintf(stderr, "Out of memory building the name index.\n");
+            return 1;
+        }
+
+        lastoff += i;
+    }
+
     if(verbose)
         shownode(0, root, stderr);
 
@@ -0,0 +1,35 @@
+/* KallistiOS ##version##
+
+   utils/isobench/include/dc/cdrom.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for dc/cdrom.h. There's no drive on the host, so everything
+   fails as if no disc was inserted, and only disc images can be mounted.
+*/
+
+#ifndef __DC_CDROM_H
+#define __DC_CDROM_H
+
+#include <arch/types.h>
+
+#define ERR_OK          0
+#define ERR_NO_DISC     1
+#define ERR_DISC_CHG    2
+#define ERR_SYS         3
+
+#define CD_STATUS_NO_DISC   7
+#define CD_STATUS_OPEN      6
+
+typedef struct {
+    uint32  entry[99];
+    uint32  first, last;
+    uint32  leadout_sector;
+} CDROM_TOC;
+
+int cdrom_reinit(void);
+int cdrom_read_toc(CDROM_TOC *toc_buffer, int session);
+uint32 cdrom_locate_data_track(CDROM_TOC *toc);
+int cdrom_read_sectors(void *buffer, int sector, int cnt);
+int cdrom_get_status(int *status, int *disc_type);
+
+#endif /* __DC_CDROM_H */
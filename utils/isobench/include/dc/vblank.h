@@ -0,0 +1,19 @@
+/* KallistiOS ##version##
+
+   utils/isobench/include/dc/vblank.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for dc/vblank.h. Handlers are never called.
+*/
+
+#ifndef __DC_VBLANK_H
+#define __DC_VBLANK_H
+
+#include <arch/types.h>
+
+typedef void (*asic_evt_handler)(uint32 code, void *data);
+
+int vblank_handler_add(asic_evt_handler hnd, void *data);
+int vblank_handler_remove(int handle);
+
+#endif /* __DC_VBLANK_H */
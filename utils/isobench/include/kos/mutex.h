@@ -0,0 +1,26 @@
+/* KallistiOS ##version##
+
+   utils/isobench/include/kos/mutex.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/mutex.h. Locking does nothing, since the benchmark
+   only has the one thread.
+*/
+
+#ifndef __KOS_MUTEX_H
+#define __KOS_MUTEX_H
+
+#include <kos/thread.h>
+
+typedef struct mutex {
+    int count;
+} mutex_t;
+
+#define MUTEX_TYPE_NORMAL       0
+
+int mutex_init(mutex_t *m, int mtype);
+int mutex_destroy(mutex_t *m);
+int mutex_lock(mutex_t *m);
+int mutex_unlock(mutex_t *m);
+
+#endif /* __KOS_MUTEX_H */
@@ -0,0 +1,823 @@
+/* KallistiOS ##version##
+
+   utils/isobench/isobench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Profile the ISO9660 driver (kernel/arch/dreamcast/fs/fs_iso9660.c) on a
+   host machine. Unlike isotest, this builds the driver itself rather than a
+   copy of it, and runs it against a disc image held in memory through a
+   kos_blockdev_t that counts every read.
+
+   With no image given, a test image is generated twice: once with only
+   ISO9660 names and once with Joliet names as well. It holds a chain of
+   nested directories with a number of small files in each, plus one big
+   file in the root. The following are then timed, each along with the number
+   of reads done on the device:
+
+   - walking the whole tree with readdir,
+   - looking up every file by its full path, first with cold caches and then
+     repeatedly, for a few different inode cache sizes,
+   - reading the biggest file through in small and big chunks, with and
+     without readahead.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <dc/fs_iso9660.h>
+#include <kos/blockdev.h>
+
+#include "isobench.h"
+
+#define SECTOR_SIZE     2048
+#define MOUNT_POINT     "/iso"
+
+/* Size of each of the small files in the generated image. */
+#define SMALL_SIZE      100
+
+/* Default cache sizes, matching the driver's own. */
+#define DEF_ICACHE      16
+#define DEF_DCACHE      16
+#define DEF_RA          8
+
+/********************************************************************************/
+/* A block device reading from an image in memory */
+
+typedef struct mem_data {
+    uint8_t *image;
+    uint32_t sectors;
+    uint64_t reads;                 /* Calls to read_blocks */
+    uint64_t read_blocks;           /* Blocks read */
+} mem_data_t;
+
+static mem_data_t mem;
+static kos_blockdev_t dev;
+
+static int mem_init(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int mem_shutdown(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int mem_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                           void *buf) {
+    mem_data_t *m = (mem_data_t *)d->dev_data;
+
+    if(((block + count) << d->l_block_size) >
+       (uint64_t)m->sectors * SECTOR_SIZE) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    ++m->reads;
+    m->read_blocks += count;
+    memcpy(buf, m->image + (block << d->l_block_size),
+           count << d->l_block_size);
+
+    return 0;
+}
+
+static int mem_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                            const void *buf) {
+    (void)d;
+    (void)block;
+    (void)count;
+    (void)buf;
+    errno = EROFS;
+    return -1;
+}
+
+static uint64_t mem_count_blocks(kos_blockdev_t *d) {
+    mem_data_t *m = (mem_data_t *)d->dev_data;
+
+    return ((uint64_t)m->sectors * SECTOR_SIZE) >> d->l_block_size;
+}
+
+static int mem_flush(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static void mem_create(uint8_t *image, uint32_t sectors, int l_block_size) {
+    memset(&mem, 0, sizeof(mem));
+    mem.image = image;
+    mem.sectors = sectors;
+
+    memset(&dev, 0, sizeof(dev));
+    dev.dev_data = &mem;
+    dev.l_block_size = l_block_size;
+    dev.init = &mem_init;
+    dev.shutdown = &mem_shutdown;
+    dev.read_blocks = &mem_read_blocks;
+    dev.write_blocks = &mem_write_blocks;
+    dev.count_blocks = &mem_count_blocks;
+    dev.flush = &mem_flush;
+}
+
+/********************************************************************************/
+/* Building a test image */
+
+typedef struct node {
+    char name[32];                  /* ISO9660 name */
+    char jname[32];                 /* Joliet name (ASCII only) */
+    int dir;
+    uint32_t extent, size;          /* Data, or the ISO9660 directory */
+    uint32_t jextent, jsize;        /* The Joliet directory */
+    struct node *parent;
+    struct node *children, *last;
+    struct node *next;
+} node_t;
+
+static node_t *new_node(node_t *parent, const char *name, const char *jname,
+                        int dir) {
+    node_t *n = (node_t *)calloc(1, sizeof(node_t));
+
+    if(!n) {
+        perror("calloc");
+        exit(1);
+    }
+
+    strcpy(n->name, name);
+    strcpy(n->jname, jname);
+    n->dir = dir;
+    n->parent = parent ? parent : n;
+
+    if(parent) {
+        if(parent->last)
+            parent->last->next = n;
+        else
+            parent->children = n;
+
+        parent->last = n;
+    }
+
+    return n;
+}
+
+static void free_nodes(node_t *n) {
+    node_t *c, *next;
+
+    for(c = n->children; c; c = next) {
+        next = c->next;
+        free_nodes(c);
+    }
+
+    free(n);
+}
+
+/* The length of a name as stored in a directory record. */
+static int rec_name_len(const node_t *n, int joliet) {
+    if(joliet)
+        return (int)strlen(n->jname) * 2 + (n->dir ? 0 : 4);
+
+    return (int)strlen(n->name);
+}
+
+/* Directory records are padded to an even length. */
+static int rec_len(int name_len) {
+    return 33 + name_len + !(name_len & 1);
+}
+
+static uint32_t dir_size(const node_t *n, int joliet) {
+    const node_t *c;
+    uint32_t sectors = 1;
+    int off = rec_len(1) * 2, len;
+
+    for(c = n->children; c; c = c->next) {
+        len = rec_len(rec_name_len(c, joliet));
+
+        /* Records can't cross a sector boundary */
+        if(off + len > SECTOR_SIZE) {
+            ++sectors;
+            off = 0;
+        }
+
+        off += len;
+    }
+
+    return sectors * SECTOR_SIZE;
+}
+
+static void place_dirs(node_t *n, int joliet, uint32_t *next) {
+    node_t *c;
+
+    if(joliet) {
+        n->jextent = *next;
+        n->jsize = dir_size(n, 1);
+        *next += n->jsize / SECTOR_SIZE;
+    }
+    else {
+        n->extent = *next;
+        n->size = dir_size(n, 0);
+        *next += n->size / SECTOR_SIZE;
+    }
+
+    for(c = n->children; c; c = c->next) {
+        if(c->dir)
+            place_dirs(c, joliet, next);
+    }
+}
+
+/* All of the small files share the one sector of data. */
+static void place_files(node_t *n, uint32_t small) {
+    node_t *c;
+
+    for(c = n->children; c; c = c->next) {
+        if(c->dir) {
+            place_files(c, small);
+        }
+        else if(!c->size) {
+            c->extent = small;
+            c->size = SMALL_SIZE;
+        }
+    }
+}
+
+static void put723(uint8_t *p, uint16_t v) {
+    p[0] = p[3] = (uint8_t)v;
+    p[1] = p[2] = (uint8_t)(v >> 8);
+}
+
+static void put733(uint8_t *p, uint32_t v) {
+    p[0] = p[7] = (uint8_t)v;
+    p[1] = p[6] = (uint8_t)(v >> 8);
+    p[2] = p[5] = (uint8_t)(v >> 16);
+    p[3] = p[4] = (uint8_t)(v >> 24);
+}
+
+static int put_rec(uint8_t *p, uint32_t extent, uint32_t size, int dir,
+                   const uint8_t *name, int name_len) {
+    int len = rec_len(name_len);
+
+    p[0] = (uint8_t)len;
+    put733(p + 2, extent);
+    put733(p + 10, size);
+    p[25] = dir ? 2 : 0;
+    put723(p + 28, 1);
+    p[32] = (uint8_t)name_len;
+    memcpy(p + 33, name, name_len);
+
+    return len;
+}
+
+static void write_dir(uint8_t *img, const node_t *n, int joliet) {
+    const node_t *c;
+    uint8_t *p = img + (joliet ? n->jextent : n->extent) * SECTOR_SIZE;
+    uint8_t name[64];
+    const char *s;
+    int off = 0, len, i;
+
+    off += put_rec(p + off, joliet ? n->jextent : n->extent,
+                   joliet ? n->jsize : n->size, 1, (const uint8_t *)"\0", 1);
+    off += put_rec(p + off, joliet ? n->parent->jextent : n->parent->extent,
+                   joliet ? n->parent->jsize : n->parent->size, 1,
+                   (const uint8_t *)"\1", 1);
+
+    for(c = n->children; c; c = c->next) {
+        len = rec_name_len(c, joliet);
+
+        if(joliet) {
+            for(i = 0, s = c->jname; *s; ++s) {
+                name[i++] = 0;
+                name[i++] = (uint8_t)*s;
+            }
+
+            if(!c->dir)
+                memcpy(name + i, "\0;\0" "1", 4);
+        }
+        else {
+            memcpy(name, c->name, len);
+        }
+
+        if(off + rec_len(len) > SECTOR_SIZE) {
+            p += SECTOR_SIZE;
+            off = 0;
+        }
+
+        if(c->dir)
+            off += put_rec(p + off, joliet ? c->jextent : c->extent,
+                           joliet ? c->jsize : c->size, 1, name, len);
+        else
+            off += put_rec(p + off, c->extent, c->size, 0, name, len);
+    }
+
+    for(c = n->children; c; c = c->next) {
+        if(c->dir)
+            write_dir(img, c, joliet);
+    }
+}
+
+static void write_vd(uint8_t *p, int type, const node_t *root,
+                     uint32_t sectors, int joliet) {
+    p[0] = (uint8_t)type;
+    memcpy(p + 1, "CD001", 5);
+    p[6] = 1;
+
+    if(type == 255)
+        return;
+
+    memset(p + 8, ' ', 64);
+    memcpy(p + 40, "ISOBENCH", 8);
+    put733(p + 80, sectors);
+
+    if(joliet)
+        memcpy(p + 88, "%/E", 3);
+
+    put723(p + 120, 1);
+    put723(p + 124, 1);
+    put723(p + 128, SECTOR_SIZE);
+    put_rec(p + 156, joliet ? root->jextent : root->extent,
+            joliet ? root->jsize : root->size, 1, (const uint8_t *)"\0", 1);
+}
+
+/* Build an image with depth levels of nested directories under the root,
+   each level holding files small files, plus a file of big_mb MB in the
+   root. */
+static uint8_t *make_image(int joliet, int depth, int files, uint32_t big_mb,
+                           uint32_t *sectors) {
+    node_t *root, *cur, *big;
+    uint32_t next, small, i, j;
+    uint8_t *img, *p;
+    char name[32], jname[32];
+
+    root = cur = new_node(NULL, "", "", 1);
+    big = new_node(root, "BIG.BIN;1", "Big file.bin", 0);
+
+    for(i = 0; i <= (uint32_t)depth; ++i) {
+        for(j = 0; j < (uint32_t)files; ++j) {
+            sprintf(name, "F%04u.DAT;1", (unsigned)j);
+            sprintf(jname, "File %04u.dat", (unsigned)j);
+            new_node(cur, name, jname, 0);
+        }
+
+        if(i < (uint32_t)depth) {
+            sprintf(name, "D%02u", (unsigned)i);
+            sprintf(jname, "Dir %02u", (unsigned)i);
+            cur = new_node(cur, name, jname, 1);
+        }
+    }
+
+    /* Sectors 16 to 19 hold the volume descriptors (the driver looks at all
+       of them for a Joliet one), then come the directories, then the data. */
+    next = 20;
+    place_dirs(root, 0, &next);
+
+    if(joliet)
+        place_dirs(root, 1, &next);
+
+    small = next++;
+    big->extent = next;
+    big->size = big_mb << 20;
+    next += big->size / SECTOR_SIZE;
+
+    place_files(root, small);
+
+    if(!(img = (uint8_t *)calloc(next, SECTOR_SIZE))) {
+        perror("calloc");
+        exit(1);
+    }
+
+    write_vd(img + 16 * SECTOR_SIZE, 1, root, next, 0);
+
+    if(joliet) {
+        write_vd(img + 17 * SECTOR_SIZE, 2, root, next, 1);
+        write_vd(img + 18 * SECTOR_SIZE, 255, root, next, 0);
+    }
+    else {
+        write_vd(img + 17 * SECTOR_SIZE, 255, root, next, 0);
+    }
+
+    write_dir(img, root, 0);
+
+    if(joliet)
+        write_dir(img, root, 1);
+
+    memset(img + small * SECTOR_SIZE, 'x', SMALL_SIZE);
+
+    for(i = 0, p = img + big->extent * SECTOR_SIZE; i < big->size; ++i)
+        p[i] = (uint8_t)(i * 7 + (i >> 11));
+
+    free_nodes(root);
+    *sectors = next;
+    return img;
+}
+
+static uint8_t *load_image(const char *fn, uint32_t *sectors) {
+    FILE *fp;
+    long size;
+    uint8_t *img;
+
+    if(!(fp = fopen(fn, "rb"))) {
+        perror(fn);
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if(size < 20 * SECTOR_SIZE) {
+        fprintf(stderr, "%s: too small to be a disc image\n", fn);
+        fclose(fp);
+        return NULL;
+    }
+
+    *sectors = (uint32_t)(size / SECTOR_SIZE);
+
+    if(!(img = (uint8_t *)malloc((size_t)*sectors * SECTOR_SIZE)) ||
+       fread(img, SECTOR_SIZE, *sectors, fp) != *sectors) {
+        fprintf(stderr, "%s: cannot read image\n", fn);
+        free(img);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    return img;
+}
+
+/********************************************************************************/
+/* The benchmarks */
+
+typedef struct file_list {
+    char **paths;
+    size_t count, max;
+    char *biggest;
+    uint32_t biggest_size;
+} file_list_t;
+
+static vfs_handler_t *vfs;
+static struct timespec t_start;
+static uint64_t reads_start, blocks_start;
+
+static int mount(int icache, int dcache, int ra) {
+    if(fs_iso9660_set_cache(icache, dcache, ra) < 0) {
+        perror("fs_iso9660_set_cache");
+        return -1;
+    }
+
+    if(fs_iso9660_mount(MOUNT_POINT, &dev) < 0) {
+        perror("fs_iso9660_mount");
+        return -1;
+    }
+
+    vfs = isobench_find_vfs(MOUNT_POINT);
+    return 0;
+}
+
+static void unmount(void) {
+    fs_iso9660_unmount(MOUNT_POINT);
+    vfs = NULL;
+}
+
+static void bench_start(void) {
+    reads_start = mem.reads;
+    blocks_start = mem.read_blocks;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print the time taken since bench_start(), how many things were done per
+   second (and MB/s, if bytes is non-zero), and the reads done on the device. */
+static void bench_end(const char *what, uint64_t ops, uint64_t bytes) {
+    struct timespec t_end;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    secs = (double)(t_end.tv_sec - t_start.tv_sec) +
+           (double)(t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+    if(secs <= 0.0)
+        secs = 1e-9;
+
+    printf("  %-26s %10.2f ms %12.0f ops/s", what, secs * 1000.0,
+           (double)ops / secs);
+
+    if(bytes)
+        printf(" %9.2f MB/s", (double)bytes / secs / 1048576.0);
+    else
+        printf("               ");
+
+    printf("  reads %llu (%llu blocks)\n",
+           (unsigned long long)(mem.reads - reads_start),
+           (unsigned long long)(mem.read_blocks - blocks_start));
+}
+
+static void add_file(file_list_t *fl, const char *path, uint32_t size) {
+    char **tmp;
+
+    if(fl->count == fl->max) {
+        fl->max = fl->max ? fl->max * 2 : 256;
+
+        if(!(tmp = (char **)realloc(fl->paths, fl->max * sizeof(char *)))) {
+            perror("realloc");
+            exit(1);
+        }
+
+        fl->paths = tmp;
+    }
+
+    fl->paths[fl->count++] = strdup(path);
+
+    if(!fl->biggest || size > fl->biggest_size) {
+        fl->biggest = fl->paths[fl->count - 1];
+        fl->biggest_size = size;
+    }
+}
+
+static void free_files(file_list_t *fl) {
+    size_t i;
+
+    for(i = 0; i < fl->count; ++i)
+        free(fl->paths[i]);
+
+    free(fl->paths);
+    memset(fl, 0, sizeof(file_list_t));
+}
+
+/* Read a whole directory with readdir, then go into each of its
+   subdirectories. The directory is closed before going any deeper, since the
+   driver only has a few file handles. Returns the number of entries seen, or
+   -1 on error. */
+static long walk(const char *path, file_list_t *fl) {
+    void *h;
+    dirent_t *de;
+    char **names = NULL, **tmp, *sub;
+    int *dirs = NULL, *tmpd;
+    uint32_t *sizes = NULL, *tmps;
+    size_t n = 0, max = 0, i;
+    long rv = 0, sub_rv;
+
+    if(!(h = vfs->open(vfs, path, O_RDONLY | O_DIR))) {
+        fprintf(stderr, "cannot open directory %s\n", path);
+        return -1;
+    }
+
+    while((de = vfs->readdir(h))) {
+        if(n == max) {
+            max = max ? max * 2 : 64;
+            tmp = (char **)realloc(names, max * sizeof(char *));
+            tmpd = (int *)realloc(dirs, max * sizeof(int));
+            tmps = (uint32_t *)realloc(sizes, max * sizeof(uint32_t));
+
+            if(!tmp || !tmpd || !tmps) {
+                perror("realloc");
+                exit(1);
+            }
+
+            names = tmp;
+            dirs = tmpd;
+            sizes = tmps;
+        }
+
+        names[n] = strdup(de->name);
+        dirs[n] = !!(de->attr & O_DIR);
+        sizes[n] = (uint32_t)de->size;
+        ++n;
+    }
+
+    vfs->close(h);
+    rv = (long)n;
+
+    for(i = 0; i < n; ++i) {
+        if(!(sub = (char *)malloc(strlen(path) + strlen(names[i]) + 2))) {
+            perror("malloc");
+            exit(1);
+        }
+
+        sprintf(sub, "%s%s%s", path, strcmp(path, "/") ? "/" : "", names[i]);
+
+        if(!dirs[i]) {
+            add_file(fl, sub, sizes[i]);
+        }
+        else if(rv >= 0) {
+            if((sub_rv = walk(sub, fl)) < 0)
+                rv = -1;
+            else
+                rv += sub_rv;
+        }
+
+        free(sub);
+        free(names[i]);
+    }
+
+    free(names);
+    free(dirs);
+    free(sizes);
+
+    return rv;
+}
+
+/* Open and close every file in the list rounds times. */
+static int lookup_all(const file_list_t *fl, int rounds) {
+    void *h;
+    size_t i;
+    int r;
+
+    for(r = 0; r < rounds; ++r) {
+        for(i = 0; i < fl->count; ++i) {
+            if(!(h = vfs->open(vfs, fl->paths[i], O_RDONLY))) {
+                fprintf(stderr, "cannot open %s\n", fl->paths[i]);
+                return -1;
+            }
+
+            vfs->close(h);
+        }
+    }
+
+    return 0;
+}
+
+/* Read the whole of a file through, chunk bytes at a time. */
+static int read_file(const char *path, uint32_t size, size_t chunk) {
+    static uint8_t buf[65536];
+    void *h;
+    uint32_t total = 0;
+    ssize_t rv;
+
+    if(!(h = vfs->open(vfs, path, O_RDONLY))) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+
+    while((rv = vfs->read(h, buf, chunk)) > 0)
+        total += (uint32_t)rv;
+
+    vfs->close(h);
+
+    if(rv < 0 || total != size) {
+        fprintf(stderr, "%s: read %u of %u bytes\n", path, (unsigned)total,
+                (unsigned)size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int run_benchmarks(int rounds) {
+    static const int icache_sizes[] = { 4, 16, 64, 256 };
+    static const size_t chunks[] = { 512, 65536 };
+    static const int ras[] = { 1, DEF_RA };
+    file_list_t fl;
+    char what[64];
+    long entries;
+    size_t i, j;
+
+    memset(&fl, 0, sizeof(fl));
+
+    /* Walking the tree, straight after mounting */
+    if(mount(DEF_ICACHE, DEF_DCACHE, DEF_RA) < 0)
+        return -1;
+
+    bench_start();
+
+    if((entries = walk("/", &fl)) < 0) {
+        unmount();
+        return -1;
+    }
+
+    bench_end("readdir walk", (uint64_t)entries, 0);
+    unmount();
+
+    printf("  (%ld entries, %lu files, biggest %s is %u bytes)\n", entries,
+           (unsigned long)fl.count, fl.biggest ? fl.biggest : "(none)",
+           (unsigned)fl.biggest_size);
+
+    if(!fl.count)
+        goto out;
+
+    /* Looking up every file once with cold caches, then over and over (after
+       one pass to warm them up) with a few different sizes of inode cache. */
+    if(mount(DEF_ICACHE, DEF_DCACHE, DEF_RA) < 0)
+        goto err;
+
+    bench_start();
+
+    if(lookup_all(&fl, 1) < 0)
+        goto err_mnt;
+
+    bench_end("lookup, cold", fl.count, 0);
+    unmount();
+
+    for(i = 0; i < sizeof(icache_sizes) / sizeof(icache_sizes[0]); ++i) {
+        if(mount(icache_sizes[i], DEF_DCACHE, DEF_RA) < 0)
+            goto err;
+
+        if(lookup_all(&fl, 1) < 0)
+            goto err_mnt;
+
+        bench_start();
+
+        if(lookup_all(&fl, rounds) < 0)
+            goto err_mnt;
+
+        sprintf(what, "lookup, icache %d", icache_sizes[i]);
+        bench_end(what, (uint64_t)fl.count * rounds, 0);
+        unmount();
+    }
+
+    /* Reading the biggest file through */
+    for(i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+        for(j = 0; j < sizeof(ras) / sizeof(ras[0]); ++j) {
+            if(mount(DEF_ICACHE, DEF_DCACHE, ras[j]) < 0)
+                goto err;
+
+            bench_start();
+
+            if(read_file(fl.biggest, fl.biggest_size, chunks[i]) < 0)
+                goto err_mnt;
+
+            sprintf(what, "read %luB chunks, ra %d", (unsigned long)chunks[i],
+                    ras[j]);
+            bench_end(what, (fl.biggest_size + chunks[i] - 1) / chunks[i],
+                      fl.biggest_size);
+            unmount();
+        }
+    }
+
+out:
+    free_files(&fl);
+    return 0;
+
+err_mnt:
+    unmount();
+err:
+    free_files(&fl);
+    return -1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-d depth] [-f files] [-b big_mb] [-r rounds] "
+            "[-l log2_block_size] [-v] [image.iso]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    int depth = 6, files = 32, rounds = 20, l_block_size = 11, opt, joliet;
+    uint32_t big_mb = 8, sectors;
+    uint8_t *img;
+    int rv = 0;
+
+    while((opt = getopt(argc, argv, "d:f:b:r:l:v")) != -1) {
+        switch(opt) {
+            case 'd': depth = atoi(optarg); break;
+            case 'f': files = atoi(optarg); break;
+            case 'b': big_mb = (uint32_t)atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'l': l_block_size = atoi(optarg); break;
+            case 'v': isobench_verbose = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    /* The driver converts the whole rest of the path to UCS-2 in a NAME_MAX
+       buffer when looking something up on a Joliet disc, so keep the deepest
+       path (seven bytes per directory, plus the file name) inside that. */
+    if(optind < argc - 1 || depth < 0 || (depth * 7 + 14) * 2 + 2 > NAME_MAX ||
+       files < 0 || files > 9999 || !big_mb || rounds < 1 ||
+       l_block_size < 9 || l_block_size > 11) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fs_iso9660_init();
+
+    if(optind == argc - 1) {
+        if(!(img = load_image(argv[optind], &sectors))) {
+            rv = 1;
+        }
+        else {
+            printf("%s: %u sectors\n", argv[optind], (unsigned)sectors);
+            mem_create(img, sectors, l_block_size);
+
+            if(run_benchmarks(rounds) < 0)
+                rv = 1;
+
+            free(img);
+        }
+    }
+    else {
+        for(joliet = 0; joliet <= 1 && !rv; ++joliet) {
+            img = make_image(joliet, depth, files, big_mb, &sectors);
+            printf("%s image: depth %d, %d files per directory, %u sectors\n",
+                   joliet ? "Joliet" : "ISO9660", depth, files,
+                   (unsigned)sectors);
+            mem_create(img, sectors, l_block_size);
+
+            if(run_benchmarks(rounds) < 0)
+                rv = 1;
+
+            free(img);
+        }
+    }
+
+    fs_iso9660_shutdown();
+    return rv;
+}
@@ -0,0 +1,18 @@
+/* KallistiOS ##version##
+
+   utils/isobench/isobench.h
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#ifndef __ISOBENCH_H
+#define __ISOBENCH_H
+
+#include <kos/fs.h>
+
+/* Non-zero to show all of the driver's debug output. */
+extern int isobench_verbose;
+
+/* Find the VFS handler registered on the given mount point. */
+vfs_handler_t *isobench_find_vfs(const char *mp);
+
+#endif /* __ISOBENCH_H */
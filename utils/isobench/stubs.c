@@ -0,0 +1,132 @@
+/* KallistiOS ##version##
+
+   utils/isobench/stubs.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Just enough of the rest of KOS for fs_iso9660.c to run on the host. The
+   cdrom functions all fail, so only disc images can be used.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <kos/thread.h>
+#include <kos/mutex.h>
+#include <kos/nmmgr.h>
+#include <dc/cdrom.h>
+#include <dc/vblank.h>
+
+#include "isobench.h"
+
+int isobench_verbose = 0;
+
+static nmmgr_handler_t *handlers[8];
+
+void dbglog(int level, const char *fmt, ...) {
+    va_list ap;
+
+    if(!isobench_verbose && level > DBG_ERROR)
+        return;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+int mutex_init(mutex_t *m, int mtype) {
+    (void)mtype;
+    m->count = 0;
+    return 0;
+}
+
+int mutex_destroy(mutex_t *m) {
+    (void)m;
+    return 0;
+}
+
+int mutex_lock(mutex_t *m) {
+    ++m->count;
+    return 0;
+}
+
+int mutex_unlock(mutex_t *m) {
+    --m->count;
+    return 0;
+}
+
+int nmmgr_handler_add(nmmgr_handler_t *hnd) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(!handlers[i]) {
+            handlers[i] = hnd;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int nmmgr_handler_remove(nmmgr_handler_t *hnd) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(handlers[i] == hnd) {
+            handlers[i] = NULL;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+vfs_handler_t *isobench_find_vfs(const char *mp) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(handlers[i] && !strcmp(handlers[i]->pathname, mp))
+            return (vfs_handler_t *)handlers[i];
+    }
+
+    return NULL;
+}
+
+int cdrom_reinit(void) {
+    return ERR_NO_DISC;
+}
+
+int cdrom_read_toc(CDROM_TOC *toc_buffer, int session) {
+    (void)toc_buffer;
+    (void)session;
+    return ERR_NO_DISC;
+}
+
+uint32 cdrom_locate_data_track(CDROM_TOC *toc) {
+    (void)toc;
+    return 0;
+}
+
+int cdrom_read_sectors(void *buffer, int sector, int cnt) {
+    (void)buffer;
+    (void)sector;
+    (void)cnt;
+    return -ERR_NO_DISC;
+}
+
+int cdrom_get_status(int *status, int *disc_type) {
+    *status = CD_STATUS_NO_DISC;
+    *disc_type = 0;
+    return 0;
+}
+
+int vblank_handler_add(asic_evt_handler hnd, void *data) {
+    (void)hnd;
+    (void)data;
+    return 1;
+}
+
+int vblank_handler_remove(int handle) {
+    (void)handle;
+    return 0;
+}
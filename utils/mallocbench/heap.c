@@ -0,0 +1,26 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/heap.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   The KOS allocator (kernel/libc/koslib/malloc.c), with its functions named
+   dlmalloc(), dlfree() and so on, so that it can sit next to the host's own
+   malloc(). Its heap comes out of a fixed arena (see stubs.c), rather than
+   the host's sbrk().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <kos/dbglog.h>
+
+/* The headers are already in, so this only renames calls (like the ones the
+   thread caches make to set themselves up) and not the host's prototypes. */
+#define USE_DL_PREFIX
+#define sbrk            mallocbench_sbrk
+#define malloc(s)       dlmalloc(s)
+#define calloc(n, s)    dlcalloc(n, s)
+#define free(p)         dlfree(p)
+#include "../../kernel/libc/koslib/malloc.c"
@@ -0,0 +1,15 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/arch/arch.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for the Dreamcast's arch/arch.h. Only the page size is
+   needed.
+*/
+
+#ifndef __ARCH_ARCH_H
+#define __ARCH_ARCH_H
+
+#define PAGESIZE        4096
+
+#endif /* __ARCH_ARCH_H */
@@ -0,0 +1,18 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/arch/irq.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for the Dreamcast's arch/irq.h. There are never any
+   interrupts, and disabling them just keeps every other thread out until
+   they're restored, like it would on a single CPU.
+*/
+
+#ifndef __ARCH_IRQ_H
+#define __ARCH_IRQ_H
+
+int irq_inside_int(void);
+int irq_disable(void);
+void irq_restore(int v);
+
+#endif /* __ARCH_IRQ_H */
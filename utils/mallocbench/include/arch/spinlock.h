@@ -0,0 +1,28 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/arch/spinlock.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for the Dreamcast's arch/spinlock.h. As in KOS, a thread
+   that finds the lock taken gives up the CPU until it gets it.
+*/
+
+#ifndef __ARCH_SPINLOCK_H
+#define __ARCH_SPINLOCK_H
+
+#include <sched.h>
+
+typedef volatile int spinlock_t;
+
+#define SPINLOCK_INITIALIZER 0
+
+#define spinlock_lock(A) do { \
+        while(__atomic_test_and_set((A), __ATOMIC_ACQUIRE)) \
+            sched_yield(); \
+    } while(0)
+
+#define spinlock_unlock(A) __atomic_clear((A), __ATOMIC_RELEASE)
+
+#define spinlock_is_locked(A) ( *(A) != 0 )
+
+#endif /* __ARCH_SPINLOCK_H */
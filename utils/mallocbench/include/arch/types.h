@@ -0,0 +1,28 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/arch/types.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for the Dreamcast's arch/types.h.
+*/
+
+#ifndef __ARCH_TYPES_H
+#define __ARCH_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef uint64_t uint64;
+typedef uint32_t uint32;
+typedef uint16_t uint16;
+typedef uint8_t uint8;
+typedef int64_t int64;
+typedef int32_t int32;
+typedef int16_t int16;
+typedef int8_t int8;
+
+typedef uintptr_t ptr_t;
+typedef int64_t _off64_t;
+
+#endif /* __ARCH_TYPES_H */
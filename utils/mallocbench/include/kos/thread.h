@@ -0,0 +1,17 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/kos/thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/thread.h. All that's needed is for thd_current to be
+   set once threading is "up".
+*/
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+typedef struct kthread kthread_t;
+
+extern kthread_t *thd_current;
+
+#endif /* __KOS_THREAD_H */
@@ -0,0 +1,9 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/include/malloc.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Make sure <malloc.h> is the KOS one, rather than the host's.
+*/
+
+#include "../../../include/malloc.h"
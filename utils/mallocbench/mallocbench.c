@@ -0,0 +1,244 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/mallocbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Benchmark the KOS allocator (kernel/libc/koslib/malloc.c) on a host
+   machine, with anywhere from 1 to 32 threads allocating and freeing at
+   once.
+
+   Each thread keeps a handful of blocks live, and over and over frees one at
+   random or allocates another in its place. Most blocks are small enough for
+   the per-thread caches, with the odd bigger one that always goes to the
+   heap. Every block is filled in when it's allocated and checked again when
+   it's freed, so blocks handed out twice get caught.
+
+   This is all done twice for each thread count: first with every allocation
+   going to the locked heap, like before the caches were set up, and then
+   after malloc_cache_init(), with the caches in use.
+
+   The Dreamcast only has the one CPU, so by default the whole thing is kept
+   to a single CPU as well. Then a thread that gets pre-empted while holding
+   the heap lock stalls everyone else, which is what the caches are there to
+   avoid. Use -m to let the threads spread out over every CPU instead.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <malloc.h>
+
+#include "mallocbench.h"
+
+#define MAX_THREADS     32
+
+/* Blocks each thread keeps live at once. */
+#define LIVE_BLOCKS     32
+
+typedef struct worker {
+    pthread_t thd;
+    unsigned long ops;
+    uint32_t seed;
+    int failed;
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+
+static pthread_barrier_t start_barrier;
+
+static uint32_t rand32(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/* Mostly things small enough to be cached, now and then something bigger. */
+static size_t pick_size(uint32_t *seed) {
+    uint32_t r = rand32(seed);
+
+    if(!(r % 16))
+        return 256 + (r >> 8) % 2048;
+
+    return 1 + (r >> 8) % 224;
+}
+
+static void fill(uint8_t *p, size_t size, uint8_t tag) {
+    memset(p, tag, size < 16 ? size : 16);
+    p[size - 1] = tag;
+}
+
+static int check(const uint8_t *p, size_t size, uint8_t tag) {
+    size_t i;
+
+    for(i = 0; i < size && i < 16; ++i) {
+        if(p[i] != tag)
+            return -1;
+    }
+
+    return p[size - 1] == tag ? 0 : -1;
+}
+
+static void *worker_thd(void *arg) {
+    worker_t *w = (worker_t *)arg;
+    uint8_t *blocks[LIVE_BLOCKS] = { NULL };
+    size_t sizes[LIVE_BLOCKS];
+    uint8_t tag = (uint8_t)(w - workers + 1);
+    unsigned long i;
+    int n;
+
+    pthread_barrier_wait(&start_barrier);
+
+    for(i = 0; i < w->ops; ++i) {
+        n = (int)(rand32(&w->seed) % LIVE_BLOCKS);
+
+        if(blocks[n]) {
+            if(check(blocks[n], sizes[n], tag))
+                w->failed = 1;
+
+            dlfree(blocks[n]);
+            blocks[n] = NULL;
+        }
+        else {
+            sizes[n] = pick_size(&w->seed);
+
+            if(!(blocks[n] = (uint8_t *)dlmalloc(sizes[n]))) {
+                w->failed = 1;
+                break;
+            }
+
+            fill(blocks[n], sizes[n], tag);
+        }
+    }
+
+    for(n = 0; n < LIVE_BLOCKS; ++n) {
+        if(blocks[n]) {
+            if(check(blocks[n], sizes[n], tag))
+                w->failed = 1;
+
+            dlfree(blocks[n]);
+        }
+    }
+
+    return NULL;
+}
+
+/* Run the given number of threads, and print how many allocations and frees
+   were done per second, between all of them. */
+static int run(int threads, unsigned long ops) {
+    struct timespec t1, t2;
+    double secs;
+    int i, failed = 0;
+
+    pthread_barrier_init(&start_barrier, NULL, (unsigned)threads + 1);
+
+    for(i = 0; i < threads; ++i) {
+        workers[i].ops = ops;
+        workers[i].seed = (uint32_t)i * 2654435761U + 1;
+        workers[i].failed = 0;
+
+        if(pthread_create(&workers[i].thd, NULL, worker_thd, &workers[i])) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pthread_barrier_wait(&start_barrier);
+
+    for(i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thd, NULL);
+        failed |= workers[i].failed;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    pthread_barrier_destroy(&start_barrier);
+
+    secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+    printf("  %2d threads  %12.0f ops/s  %8.1f ns/op\n", threads,
+           threads * ops / secs, secs * 1e9 / (threads * ops));
+
+    if(failed)
+        fprintf(stderr, "  blocks were corrupted or allocations failed\n");
+
+    return failed ? -1 : 0;
+}
+
+static int run_all(int max_threads, unsigned long ops) {
+    int threads;
+
+    for(threads = 1; threads <= max_threads; threads *= 2) {
+        if(run(threads, ops))
+            return -1;
+    }
+
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-t max_threads] [-n ops_per_thread] [-m]\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    malloc_cache_stats_t st;
+    unsigned long ops = 200000;
+    int max_threads = MAX_THREADS, multi = 0, opt;
+    cpu_set_t cpus;
+
+    while((opt = getopt(argc, argv, "t:n:m")) != -1) {
+        switch(opt) {
+            case 't': max_threads = atoi(optarg); break;
+            case 'n': ops = strtoul(optarg, NULL, 0); break;
+            case 'm': multi = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || max_threads < 1 || max_threads > MAX_THREADS ||
+       !ops) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!multi) {
+        CPU_ZERO(&cpus);
+        CPU_SET(sched_getcpu(), &cpus);
+
+        if(sched_setaffinity(0, sizeof(cpus), &cpus))
+            perror("sched_setaffinity");
+    }
+
+    printf("%lu allocations and frees per thread, %s:\n", ops,
+           multi ? "on every CPU" : "on one CPU");
+
+    printf("Heap only:\n");
+
+    if(run_all(max_threads, ops))
+        return 1;
+
+    if(malloc_cache_init()) {
+        fprintf(stderr, "malloc_cache_init failed\n");
+        return 1;
+    }
+
+    printf("Per-thread caches:\n");
+
+    if(run_all(max_threads, ops))
+        return 1;
+
+    malloc_cache_stats(&st);
+    printf("Cache hits %lu, misses %lu, frees %lu, flushes %lu\n",
+           (unsigned long)st.hits, (unsigned long)st.misses,
+           (unsigned long)st.frees, (unsigned long)st.flushes);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/mallocbench.h
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#ifndef __MALLOCBENCH_H
+#define __MALLOCBENCH_H
+
+#include <stddef.h>
+
+/* Most the KOS heap can grow to. */
+#define ARENA_SIZE      (256 * 1024 * 1024)
+
+/* The KOS allocator, renamed (see heap.c). */
+void *dlmalloc(size_t size);
+void dlfree(void *p);
+
+void *mallocbench_sbrk(ptrdiff_t incr);
+
+#endif /* __MALLOCBENCH_H */
@@ -0,0 +1,113 @@
+/* KallistiOS ##version##
+
+   utils/mallocbench/stubs.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Just enough of the rest of KOS, on top of pthreads, for malloc.c to run on
+   the host, plus the arena its heap is grown into.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <arch/irq.h>
+#include <kos/thread.h>
+#include <kos/tls.h>
+#include <kos/dbglog.h>
+
+#include "mallocbench.h"
+
+/* Threading is always up, as far as malloc.c can tell. */
+static int running;
+kthread_t *thd_current = (kthread_t *)&running;
+
+void dbglog(int level, const char *fmt, ...) {
+    va_list ap;
+
+    (void)level;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int irq_inside_int(void) {
+    return 0;
+}
+
+int irq_disable(void) {
+    pthread_mutex_lock(&irq_lock);
+    return 0;
+}
+
+void irq_restore(int v) {
+    (void)v;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+/* TLS keys go straight onto pthread keys, destructors and all. */
+#define MAX_KEYS        8
+
+static pthread_key_t keys[MAX_KEYS];
+static int key_count;
+
+int kthread_key_create(kthread_key_t *key, void (*destructor)(void *)) {
+    if(key_count == MAX_KEYS || pthread_key_create(&keys[key_count],
+                                                   destructor)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    *key = key_count++;
+    return 0;
+}
+
+void *kthread_getspecific(kthread_key_t key) {
+    if(key < 0 || key >= key_count)
+        return NULL;
+
+    return pthread_getspecific(keys[key]);
+}
+
+int kthread_setspecific(kthread_key_t key, const void *value) {
+    if(key < 0 || key >= key_count) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return pthread_setspecific(keys[key], value) ? -1 : 0;
+}
+
+/* The heap's arena. Only ever called with the heap locked. */
+static uint8_t *arena, *arena_brk;
+
+void *mallocbench_sbrk(ptrdiff_t incr) {
+    void *rv;
+
+    if(!arena) {
+        arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if(arena == MAP_FAILED) {
+            arena = NULL;
+            errno = ENOMEM;
+            return (void *)-1;
+        }
+
+        arena_brk = arena;
+    }
+
+    if(incr > (arena + ARENA_SIZE) - arena_brk || incr < arena - arena_brk) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+
+    rv = arena_brk;
+    arena_brk += incr;
+    return rv;
+}
@@ -0,0 +1,361 @@
+/* KallistiOS ##version##
+
+   utils/pvrmemtest/pvrmemtest.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Randomized test of the PVR texture memory allocator
+   (kernel/arch/dreamcast/hardware/pvr/pvr_mem_tlsf.c), run on a host machine.
+
+   Each run replays a long random trace of allocations (of all sorts of sizes
+   and alignments) and frees against an allocator, and keeps a map of which
+   parts of the pool should belong to what alongside it. After every call it
+   makes sure that:
+
+   - blocks are aligned as asked for, lie inside the pool, and never overlap
+     anything else that's allocated,
+   - the allocator's count of bytes in use (which pvr_mem_available() is
+     worked out from) matches the map,
+   - double frees, and frees of addresses that aren't the start of a block,
+     are refused,
+   - an allocation only fails if it's out of block descriptors, or there's
+     really no free block it could have fit in,
+   - the allocator never touches the heap outside of pvr_tlsf_init() and
+     pvr_tlsf_destroy(), since pvr_mem.c calls it with a spinlock held.
+
+   Every so often, the allocator's own consistency check is run, and once
+   everything has been freed again, the pool has to have merged back into a
+   single free block.
+
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pvr_mem_tlsf.h"
+
+/* Count every call the allocator makes to the heap. */
+static unsigned long heap_calls;
+
+static void *counted_malloc(size_t size) {
+    ++heap_calls;
+    return malloc(size);
+}
+
+static void *counted_calloc(size_t n, size_t size) {
+    ++heap_calls;
+    return calloc(n, size);
+}
+
+static void counted_free(void *p) {
+    ++heap_calls;
+    free(p);
+}
+
+/* The header is already in, and these only match calls, so the free lists
+   and such keep their names. */
+#define malloc(s)       counted_malloc(s)
+#define calloc(n, s)    counted_calloc(n, s)
+#define free(p)         counted_free(p)
+#include "pvr_mem_tlsf.c"
+#undef malloc
+#undef calloc
+#undef free
+
+/* Where the pool is, roughly like it would be with a 640x480 display. */
+#define POOL_BASE       0x05200000
+#define POOL_SIZE       (6 * 1024 * 1024)
+#define POOL_UNITS      (POOL_SIZE >> PVR_TLSF_ALIGN_SHIFT)
+
+/* Most blocks allocated at once. Picking slots at random keeps about half of
+   them full, so this leaves the default number of descriptors enough to go
+   round most of the time. */
+#define SLOTS           1536
+
+typedef struct slot {
+    uint32_t addr;              /* 0 if the slot is empty */
+    uint32_t size;              /* Size rounded up like the allocator does */
+} slot_t;
+
+static slot_t slots[SLOTS];
+static uint16_t owner[POOL_UNITS];      /* Slot number + 1 of each unit */
+
+static uint32_t rng;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+typedef struct results {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long no_space;     /* Failed, no free block big enough */
+    unsigned long no_blocks;    /* Failed, out of descriptors */
+    uint32_t most_blocks;       /* Most descriptors in use at once */
+} results_t;
+
+static int fail(const char *what, unsigned long op) {
+    fprintf(stderr, "  FAILED at operation %lu: %s\n", op, what);
+    return -1;
+}
+
+/* Is there a free block that an allocation of the given size and alignment
+   should definitely have been able to use? The allocator looks for room for
+   the worst case padding, rounded up to the next second level list (which is
+   less than a sixteenth more), so anything at least that big will do. */
+static int should_fit(const pvr_tlsf_t *t, uint32_t size, uint32_t align) {
+    const pvr_tlsf_block_t *b;
+    uint32_t need;
+
+    if(align < PVR_TLSF_ALIGN)
+        align = PVR_TLSF_ALIGN;
+
+    need = (size + PVR_TLSF_ALIGN - 1) & ~(PVR_TLSF_ALIGN - 1);
+    need += align - PVR_TLSF_ALIGN;
+    need += need / 16;
+
+    for(b = t->first; b; b = b->next_phys) {
+        if(b->is_free && b->size >= need)
+            return 1;
+    }
+
+    return 0;
+}
+
+static uint32_t blocks_in_use(const pvr_tlsf_t *t) {
+    const pvr_tlsf_block_t *b;
+    uint32_t n = 0;
+
+    for(b = t->spare; b; b = b->next)
+        ++n;
+
+    return t->max_blocks - n;
+}
+
+static int do_alloc(pvr_tlsf_t *t, int i, unsigned long op, results_t *r) {
+    uint32_t size, align, addr, rsize, u, n;
+
+    /* Mostly smallish textures, with some big ones and the odd zero. */
+    switch(rand32() % 8) {
+        case 0: size = 0; break;
+        case 1: case 2: size = rand32() % (256 * 1024); break;
+        default: size = rand32() % 4096; break;
+    }
+
+    align = 1U << (rand32() % 13);
+    addr = pvr_tlsf_alloc(t, size, align);
+
+    if(!addr) {
+        if(!t->spare || !t->spare->next)
+            ++r->no_blocks;
+        else if(should_fit(t, size, align))
+            return fail("allocation failed with room to spare", op);
+        else
+            ++r->no_space;
+
+        return 0;
+    }
+
+    rsize = size ? (size + PVR_TLSF_ALIGN - 1) & ~(PVR_TLSF_ALIGN - 1) :
+        PVR_TLSF_ALIGN;
+
+    if(addr & (align - 1) || addr & (PVR_TLSF_ALIGN - 1))
+        return fail("misaligned block", op);
+
+    if(addr < POOL_BASE || addr + rsize > POOL_BASE + POOL_SIZE)
+        return fail("block outside of the pool", op);
+
+    u = (addr - POOL_BASE) >> PVR_TLSF_ALIGN_SHIFT;
+
+    for(n = 0; n < rsize >> PVR_TLSF_ALIGN_SHIFT; ++n) {
+        if(owner[u + n])
+            return fail("block overlaps another one", op);
+
+        owner[u + n] = (uint16_t)(i + 1);
+    }
+
+    slots[i].addr = addr;
+    slots[i].size = rsize;
+    ++r->allocs;
+
+    if((n = blocks_in_use(t)) > r->most_blocks)
+        r->most_blocks = n;
+
+    return 0;
+}
+
+static int do_free(pvr_tlsf_t *t, int i, unsigned long op, results_t *r) {
+    uint32_t u, n;
+
+    /* Now and then, try to free from the middle of the block. */
+    if(slots[i].size > PVR_TLSF_ALIGN && !(rand32() % 16) &&
+       !pvr_tlsf_free(t, slots[i].addr + PVR_TLSF_ALIGN))
+        return fail("freed the middle of a block", op);
+
+    if(pvr_tlsf_free(t, slots[i].addr))
+        return fail("couldn't free a used block", op);
+
+    /* And try freeing it twice. */
+    if(!(rand32() % 16) && !pvr_tlsf_free(t, slots[i].addr))
+        return fail("freed a block twice", op);
+
+    u = (slots[i].addr - POOL_BASE) >> PVR_TLSF_ALIGN_SHIFT;
+
+    for(n = 0; n < slots[i].size >> PVR_TLSF_ALIGN_SHIFT; ++n)
+        owner[u + n] = 0;
+
+    slots[i].addr = 0;
+    ++r->frees;
+
+    return 0;
+}
+
+static int run(uint32_t seed, unsigned long ops, uint32_t max_blocks,
+               unsigned long check_every) {
+    pvr_tlsf_t t;
+    pvr_tlsf_stats_t st;
+    results_t r;
+    unsigned long op, calls;
+    uint32_t used = 0, live = 0, addr;
+    int i, err;
+
+    memset(slots, 0, sizeof(slots));
+    memset(owner, 0, sizeof(owner));
+    memset(&r, 0, sizeof(r));
+    rng = seed ? seed : 1;
+
+    if(pvr_tlsf_init(&t, POOL_BASE, POOL_SIZE, max_blocks)) {
+        fprintf(stderr, "pvr_tlsf_init failed\n");
+        return -1;
+    }
+
+    calls = heap_calls;
+
+    for(op = 0; op < ops; ++op) {
+        i = (int)(rand32() % SLOTS);
+
+        if(slots[i].addr) {
+            used -= slots[i].size;
+            --live;
+            err = do_free(&t, i, op, &r);
+        }
+        else {
+            err = do_alloc(&t, i, op, &r);
+
+            if(slots[i].addr) {
+                used += slots[i].size;
+                ++live;
+            }
+        }
+
+        if(err)
+            goto out;
+
+        if(t.used_bytes != used || t.used_count != live) {
+            err = fail("bytes or blocks in use don't add up", op);
+            goto out;
+        }
+
+        if(!(op % check_every)) {
+            if((err = pvr_tlsf_check(&t))) {
+                fprintf(stderr, "  pvr_tlsf_check returned %d\n", err);
+                err = fail("consistency check failed", op);
+                goto out;
+            }
+
+            pvr_tlsf_stats(&t, &st);
+
+            if(st.free != t.size - t.used_bytes) {
+                err = fail("free space doesn't match the free lists", op);
+                goto out;
+            }
+        }
+    }
+
+    /* Free everything, which should leave one big free block. */
+    for(i = 0; i < SLOTS; ++i) {
+        if(slots[i].addr && (err = do_free(&t, i, op, &r)))
+            goto out;
+    }
+
+    pvr_tlsf_stats(&t, &st);
+
+    if(pvr_tlsf_check(&t) || st.free_blocks != 1 || st.free != st.total ||
+       st.used || st.used_blocks) {
+        err = fail("pool didn't merge back together", op);
+        goto out;
+    }
+
+    /* All of which can then be allocated in one go. */
+    if(!(addr = pvr_tlsf_alloc(&t, st.total, PVR_TLSF_ALIGN)) ||
+       pvr_tlsf_free(&t, addr)) {
+        err = fail("couldn't allocate the whole pool", op);
+        goto out;
+    }
+
+    if(heap_calls != calls) {
+        fprintf(stderr, "  %lu calls to the heap\n", heap_calls - calls);
+        err = fail("allocator used the heap after pvr_tlsf_init", op);
+        goto out;
+    }
+
+    printf("  seed %-10lu %lu allocs, %lu frees, %lu failed for space, "
+           "%lu for descriptors, at most %lu of %lu descriptors used\n",
+           (unsigned long)seed, r.allocs, r.frees, r.no_space, r.no_blocks,
+           (unsigned long)r.most_blocks, (unsigned long)t.max_blocks);
+
+out:
+    pvr_tlsf_destroy(&t);
+    return err ? -1 : 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n ops] [-s seeds] [-b max_blocks] "
+            "[-c check_every]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long ops = 400000, check_every = 1000;
+    uint32_t seeds = 5, max_blocks = 2048, seed;
+    int opt, rv = 0;
+
+    while((opt = getopt(argc, argv, "n:s:b:c:")) != -1) {
+        switch(opt) {
+            case 'n': ops = strtoul(optarg, NULL, 0); break;
+            case 's': seeds = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'b': max_blocks = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': check_every = strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || !check_every) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%lu operations per run on a %u byte pool, %lu descriptors:\n",
+           ops, POOL_SIZE, (unsigned long)max_blocks);
+
+    for(seed = 1; seed <= seeds; ++seed) {
+        if(run(seed, ops, max_blocks, check_every))
+            rv = 1;
+    }
+
+    /* Also run out of descriptors plenty of times. */
+    printf("Same again with only 64 descriptors:\n");
+
+    for(seed = 1; seed <= seeds; ++seed) {
+        if(run(seed, ops, 64, check_every))
+            rv = 1;
+    }
+
+    printf(rv ? "FAILED\n" : "All passed\n");
+    return rv;
+}
@@ -0,0 +1,13 @@
+/* KallistiOS ##version##
+
+   utils/ramdiskbench/include/assert.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   The host's assert.h, plus the assert_msg() that KOS's has.
+*/
+
+#include_next <assert.h>
+
+#ifndef assert_msg
+#define assert_msg(e, m) assert((e) && (m))
+#endif
@@ -0,0 +1,27 @@
+/* KallistiOS ##version##
+
+   utils/ramdiskbench/include/kos/rwsem.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/rwsem.h. Locking does nothing, since the benchmark
+   only has the one thread.
+*/
+
+#ifndef __KOS_RWSEM_H
+#define __KOS_RWSEM_H
+
+#include <kos/thread.h>
+
+typedef struct rw_semaphore {
+    int read_count;
+    int write_count;
+} rw_semaphore_t;
+
+int rwsem_init(rw_semaphore_t *s);
+int rwsem_destroy(rw_semaphore_t *s);
+int rwsem_read_lock(rw_semaphore_t *s);
+int rwsem_read_unlock(rw_semaphore_t *s);
+int rwsem_write_lock(rw_semaphore_t *s);
+int rwsem_write_unlock(rw_semaphore_t *s);
+
+#endif /* __KOS_RWSEM_H */
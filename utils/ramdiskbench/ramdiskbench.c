@@ -0,0 +1,257 @@
+/* KallistiOS ##version##
+
+   utils/ramdiskbench/ramdiskbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Benchmark the ramdisk (kernel/fs/fs_ramdisk.c) on a host machine, by
+   streaming a big file into it in small writes.
+
+   A file (8MB by default) is written through the driver in 512-byte writes,
+   read back and checked in the same size of reads, and then mmap()ed, which
+   gathers all of its pages into one block. Each of these is timed.
+
+   For comparison, the same writes are then also done the way the ramdisk
+   used to store files: in one block, grown with realloc() to the new size
+   plus 4KB whenever a write goes past the end of it. This is done with the
+   host's realloc(), which can often grow a big block without copying it, and
+   again with one that always copies, like a heap that has something else
+   allocated right after the block.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <kos/fs_ramdisk.h>
+#include <kos/opts.h>
+
+#include "ramdiskbench.h"
+
+#define MOUNT_POINT     "/ram"
+
+static vfs_handler_t *vfs;
+static struct timespec t_start;
+
+static void bench_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print how long everything since bench_start() took. */
+static void bench_end(const char *name, size_t bytes) {
+    struct timespec t;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    secs = (t.tv_sec - t_start.tv_sec) + (t.tv_nsec - t_start.tv_nsec) / 1e9;
+
+    printf("  %-22s %10.2f ms %10.1f MB/s\n", name, secs * 1e3,
+           bytes / secs / (1024 * 1024));
+}
+
+/* Every chunk is filled differently, so that misplaced ones get noticed. */
+static void fill(uint8_t *buf, size_t cnt, size_t pos) {
+    size_t i;
+
+    for(i = 0; i < cnt; ++i)
+        buf[i] = (uint8_t)((pos + i) * 7 + (pos + i) / 4099);
+}
+
+static int check(const uint8_t *buf, size_t cnt, size_t pos) {
+    size_t i;
+
+    for(i = 0; i < cnt; ++i) {
+        if(buf[i] != (uint8_t)((pos + i) * 7 + (pos + i) / 4099))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int bench_ramdisk(size_t size, size_t chunk, uint8_t *buf) {
+    void *hnd;
+    uint8_t *data;
+    size_t pos;
+    ssize_t n;
+
+    if(!(hnd = vfs->open(vfs, "/big", O_WRONLY | O_CREAT | O_TRUNC))) {
+        fprintf(stderr, "Cannot create file on the ramdisk\n");
+        return -1;
+    }
+
+    bench_start();
+
+    for(pos = 0; pos < size; pos += chunk) {
+        n = size - pos < chunk ? size - pos : chunk;
+        fill(buf, n, pos);
+
+        if(vfs->write(hnd, buf, n) != n) {
+            fprintf(stderr, "Write failed at %zu\n", pos);
+            vfs->close(hnd);
+            return -1;
+        }
+    }
+
+    vfs->close(hnd);
+    bench_end("ramdisk write", size);
+
+    if(!(hnd = vfs->open(vfs, "/big", O_RDONLY))) {
+        fprintf(stderr, "Cannot open file on the ramdisk\n");
+        return -1;
+    }
+
+    if(vfs->total(hnd) != size) {
+        fprintf(stderr, "File is %zu bytes, not %zu\n", vfs->total(hnd),
+                size);
+        vfs->close(hnd);
+        return -1;
+    }
+
+    bench_start();
+
+    for(pos = 0; pos < size; pos += chunk) {
+        n = size - pos < chunk ? size - pos : chunk;
+
+        if(vfs->read(hnd, buf, n) != n || check(buf, n, pos)) {
+            fprintf(stderr, "Read back wrong data at %zu\n", pos);
+            vfs->close(hnd);
+            return -1;
+        }
+    }
+
+    bench_end("ramdisk read", size);
+
+    bench_start();
+    data = (uint8_t *)vfs->mmap(hnd);
+    bench_end("ramdisk mmap", size);
+
+    if(!data || check(data, size, 0)) {
+        fprintf(stderr, "mmap gave the wrong data\n");
+        vfs->close(hnd);
+        return -1;
+    }
+
+    vfs->close(hnd);
+
+    if(vfs->unlink(vfs, "/big")) {
+        fprintf(stderr, "Cannot remove file from the ramdisk\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* realloc(), but always moving the block, like when it can't be grown where
+   it is. */
+static void *copy_realloc(void *old, size_t old_size, size_t size) {
+    void *rv;
+
+    if(!(rv = malloc(size)))
+        return NULL;
+
+    if(old) {
+        memcpy(rv, old, old_size < size ? old_size : size);
+        free(old);
+    }
+
+    return rv;
+}
+
+/* Write the file the way the ramdisk used to. */
+static int bench_blob(const char *name, size_t size, size_t chunk,
+                      uint8_t *buf, int copy) {
+    uint8_t *data = NULL, *tmp;
+    size_t pos, n, datasize = 0;
+
+    bench_start();
+
+    for(pos = 0; pos < size; pos += chunk) {
+        n = size - pos < chunk ? size - pos : chunk;
+        fill(buf, n, pos);
+
+        if(pos + n > datasize) {
+            tmp = copy ? copy_realloc(data, datasize, pos + n + 4096) :
+                realloc(data, pos + n + 4096);
+
+            if(!tmp) {
+                fprintf(stderr, "Out of memory at %zu\n", pos);
+                free(data);
+                return -1;
+            }
+
+            data = tmp;
+            datasize = pos + n + 4096;
+        }
+
+        memcpy(data + pos, buf, n);
+    }
+
+    bench_end(name, size);
+
+    n = check(data, size, 0);
+    free(data);
+
+    if(n) {
+        fprintf(stderr, "Block has the wrong data\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-s size_kb] [-c chunk_size] [-r runs]\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = 8 * 1024 * 1024, chunk = 512;
+    int runs = 3, opt, i;
+    uint8_t *buf;
+
+    while((opt = getopt(argc, argv, "s:c:r:")) != -1) {
+        switch(opt) {
+            case 's': size = strtoul(optarg, NULL, 0) * 1024; break;
+            case 'c': chunk = strtoul(optarg, NULL, 0); break;
+            case 'r': runs = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || !size || !chunk || runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!(buf = (uint8_t *)malloc(chunk))) {
+        perror("malloc");
+        return 1;
+    }
+
+    fs_ramdisk_init();
+
+    if(!(vfs = ramdiskbench_find_vfs(MOUNT_POINT))) {
+        fprintf(stderr, "Ramdisk isn't mounted on " MOUNT_POINT "\n");
+        return 1;
+    }
+
+    printf("%zu bytes in %zu byte writes, %d byte pages:\n", size, chunk,
+           FS_RAMDISK_PAGE_SIZE);
+
+    for(i = 0; i < runs; ++i) {
+        if(bench_ramdisk(size, chunk, buf) ||
+           bench_blob("realloc'd block", size, chunk, buf, 0) ||
+           bench_blob("copied block", size, chunk, buf, 1)) {
+            fs_ramdisk_shutdown();
+            free(buf);
+            return 1;
+        }
+    }
+
+    fs_ramdisk_shutdown();
+    free(buf);
+    return 0;
+}
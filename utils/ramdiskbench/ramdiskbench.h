@@ -0,0 +1,15 @@
+/* KallistiOS ##version##
+
+   utils/ramdiskbench/ramdiskbench.h
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#ifndef __RAMDISKBENCH_H
+#define __RAMDISKBENCH_H
+
+#include <kos/fs.h>
+
+/* Find the VFS handler registered on the given mount point. */
+vfs_handler_t *ramdiskbench_find_vfs(const char *mp);
+
+#endif /* __RAMDISKBENCH_H */
@@ -0,0 +1,25 @@
+/* KallistiOS ##version##
+
+   utils/romdiskbench/include/kos/thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/thread.h. The benchmark only has the one thread.
+*/
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+#include <arch/types.h>
+
+#define DBG_DEAD        0
+#define DBG_CRITICAL    2
+#define DBG_ERROR       3
+#define DBG_WARNING     4
+#define DBG_NOTICE      5
+#define DBG_INFO        6
+#define DBG_DEBUG       7
+#define DBG_KDEBUG      8
+
+void dbglog(int level, const char *fmt, ...);
+
+#endif /* __KOS_THREAD_H */
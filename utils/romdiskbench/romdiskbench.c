@@ -0,0 +1,375 @@
+/* KallistiOS ##version##
+
+   utils/romdiskbench/romdiskbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Benchmark path lookups in the romdisk driver (kernel/fs/fs_romdisk.c) on a
+   host machine, with a directory holding thousands of files.
+
+   A test tree is written out, with one directory full of files (4000 by
+   default), and a few files at the bottom of a chain of nested directories.
+   genromfs turns it into two images, one plain and one with a prebuilt name
+   index (genromfs -i). These are then mounted three ways:
+
+   - the plain image with FS_ROMDISK_MNT_NOINDEX, so every lookup scans the
+     directories along the way,
+   - the plain image, with the name index built when it's mounted,
+   - the image with its own index.
+
+   For each of them, the mount is timed, as are opening every file in the big
+   directory (in a shuffled order, and in a different case than it was
+   written with, since lookups ignore case), opening names that aren't there,
+   and opening the files at the bottom of the nested directories. Each file
+   that's opened is read, to make sure that it's the right one.
+
+   genromfs has to be built first (it's in ../genromfs), or given with -g.
+   The tree and images are left in romdiskbench.d, which "make clean"
+   removes.
+
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <kos/fs_romdisk.h>
+
+#include "romdiskbench.h"
+
+#define WORK_DIR        "romdiskbench.d"
+#define MOUNT_POINT     "/rd"
+
+/* How deep the nested directories go, and how many files are at the
+   bottom. */
+#define DEEP_LEVELS     8
+#define DEEP_FILES      16
+
+/* Times each of the lookups is repeated. */
+#define ROUNDS          8
+
+static vfs_handler_t *vfs;
+static struct timespec t_start;
+
+static void bench_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+/* Print how long each of the ops since bench_start() took on average. */
+static void bench_end(const char *name, unsigned long ops) {
+    struct timespec t;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    ns = (t.tv_sec - t_start.tv_sec) * 1e9 + (t.tv_nsec - t_start.tv_nsec);
+
+    if(ops > 1)
+        printf("  %-18s %10.1f ns/op\n", name, ns / ops);
+    else
+        printf("  %-18s %10.1f us\n", name, ns / 1000);
+}
+
+/********************************************************************************/
+/* Making the images */
+
+static int write_file(const char *path, const char *data) {
+    FILE *fp;
+
+    if(!(fp = fopen(path, "w"))) {
+        perror(path);
+        return -1;
+    }
+
+    fputs(data, fp);
+    fclose(fp);
+    return 0;
+}
+
+static void big_name(char *buf, size_t len, int i) {
+    snprintf(buf, len, "Asset_%05d.Bin", i);
+}
+
+static void deep_dir(char *buf, size_t len) {
+    int i;
+
+    snprintf(buf, len, "/deep");
+
+    for(i = 0; i < DEEP_LEVELS; ++i)
+        snprintf(buf + strlen(buf), len - strlen(buf), "/Level%d", i);
+}
+
+static int make_tree(int files) {
+    char path[512], name[64], dir[256];
+    int i;
+    size_t n;
+
+    if(mkdir(WORK_DIR, 0755) && errno != EEXIST) {
+        perror(WORK_DIR);
+        return -1;
+    }
+
+    /* Start with a clean tree, in case the file count changed. */
+    if(system("rm -rf " WORK_DIR "/root") ||
+       mkdir(WORK_DIR "/root", 0755) || mkdir(WORK_DIR "/root/big", 0755)) {
+        perror(WORK_DIR "/root");
+        return -1;
+    }
+
+    for(i = 0; i < files; ++i) {
+        big_name(name, sizeof(name), i);
+        snprintf(path, sizeof(path), WORK_DIR "/root/big/%s", name);
+
+        if(write_file(path, name))
+            return -1;
+    }
+
+    deep_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), WORK_DIR "/root");
+
+    for(n = 1; n <= strlen(dir); ++n) {
+        if(dir[n] == '/' || !dir[n]) {
+            snprintf(path, sizeof(path), WORK_DIR "/root%.*s", (int)n, dir);
+
+            if(mkdir(path, 0755)) {
+                perror(path);
+                return -1;
+            }
+        }
+    }
+
+    for(i = 0; i < DEEP_FILES; ++i) {
+        snprintf(name, sizeof(name), "File%d.txt", i);
+        snprintf(path, sizeof(path), WORK_DIR "/root%s/%s", dir, name);
+
+        if(write_file(path, name))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int make_image(const char *genromfs, const char *img,
+                      const char *opts) {
+    char cmd[1024];
+
+    snprintf(cmd, sizeof(cmd), "%s %s -f %s -d " WORK_DIR "/root -V bench",
+             genromfs, opts, img);
+
+    if(system(cmd)) {
+        fprintf(stderr, "Running \"%s\" failed\n", cmd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint8 *load_image(const char *fn) {
+    FILE *fp;
+    long size;
+    uint8 *img;
+
+    if(!(fp = fopen(fn, "rb"))) {
+        perror(fn);
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if(!(img = (uint8 *)malloc(size)) || fread(img, 1, size, fp) !=
+       (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", fn);
+        free(img);
+        img = NULL;
+    }
+
+    fclose(fp);
+    return img;
+}
+
+/********************************************************************************/
+/* Lookups */
+
+/* Open a file, and make sure that it holds the name it was written with. */
+static int open_check(const char *path, const char *name) {
+    char buf[64];
+    void *hnd;
+    ssize_t n;
+
+    if(!(hnd = vfs->open(vfs, path, O_RDONLY))) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+
+    n = vfs->read(hnd, buf, sizeof(buf) - 1);
+    vfs->close(hnd);
+
+    if(n < 0 || (size_t)n != strlen(name) || memcmp(buf, name, n)) {
+        fprintf(stderr, "%s has the wrong contents\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void flip_case(char *s) {
+    for(; *s; ++s)
+        *s = isupper((unsigned char)*s) ? tolower((unsigned char)*s) :
+            toupper((unsigned char)*s);
+}
+
+static int bench_lookups(int files, const int *order) {
+    char path[512], name[64], dir[256];
+    void *hnd;
+    int i, r;
+
+    bench_start();
+
+    for(r = 0; r < ROUNDS; ++r) {
+        for(i = 0; i < files; ++i) {
+            big_name(name, sizeof(name), order[i]);
+            snprintf(path, sizeof(path), "/big/%s", name);
+            flip_case(path);
+
+            if(open_check(path, name))
+                return -1;
+        }
+    }
+
+    bench_end("big dir, found", (unsigned long)files * ROUNDS);
+
+    bench_start();
+
+    for(r = 0; r < ROUNDS; ++r) {
+        for(i = 0; i < files; ++i) {
+            snprintf(path, sizeof(path), "/big/Missing_%05d.Bin", order[i]);
+
+            if((hnd = vfs->open(vfs, path, O_RDONLY))) {
+                fprintf(stderr, "Opened %s, which isn't there\n", path);
+                vfs->close(hnd);
+                return -1;
+            }
+        }
+    }
+
+    bench_end("big dir, missing", (unsigned long)files * ROUNDS);
+
+    deep_dir(dir, sizeof(dir));
+    bench_start();
+
+    for(r = 0; r < ROUNDS * 64; ++r) {
+        for(i = 0; i < DEEP_FILES; ++i) {
+            snprintf(name, sizeof(name), "File%d.txt", i);
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+            if(open_check(path, name))
+                return -1;
+        }
+    }
+
+    bench_end("nested dirs", (unsigned long)DEEP_FILES * ROUNDS * 64);
+    return 0;
+}
+
+static int run(const char *title, const uint8 *img, uint32 flags, int files,
+               const int *order) {
+    int rv;
+
+    printf("%s:\n", title);
+
+    bench_start();
+
+    if(fs_romdisk_mount_ex(MOUNT_POINT, img, 0, flags)) {
+        fprintf(stderr, "Cannot mount the image\n");
+        return -1;
+    }
+
+    bench_end("mount", 1);
+
+    if(!(vfs = romdiskbench_find_vfs(MOUNT_POINT))) {
+        fprintf(stderr, "Romdisk isn't mounted on " MOUNT_POINT "\n");
+        return -1;
+    }
+
+    rv = bench_lookups(files, order);
+    fs_romdisk_unmount(MOUNT_POINT);
+
+    return rv;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n files] [-g genromfs] [-v]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *genromfs = "../genromfs/genromfs";
+    uint8 *plain = NULL, *indexed = NULL;
+    int files = 4000, opt, i, j, tmp, rv = 1;
+    int *order;
+    uint32 seed = 1;
+
+    while((opt = getopt(argc, argv, "n:g:v")) != -1) {
+        switch(opt) {
+            case 'n': files = atoi(optarg); break;
+            case 'g': genromfs = optarg; break;
+            case 'v': romdiskbench_verbose = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || files < 1 || files > 99999) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!(order = (int *)malloc(files * sizeof(int)))) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* The same shuffled order every run. */
+    for(i = 0; i < files; ++i)
+        order[i] = i;
+
+    for(i = files - 1; i > 0; --i) {
+        seed = seed * 1103515245 + 12345;
+        j = (int)((seed >> 8) % (uint32)(i + 1));
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    if(make_tree(files) ||
+       make_image(genromfs, WORK_DIR "/plain.img", "") ||
+       make_image(genromfs, WORK_DIR "/indexed.img", "-i") ||
+       !(plain = load_image(WORK_DIR "/plain.img")) ||
+       !(indexed = load_image(WORK_DIR "/indexed.img")))
+        goto out;
+
+    fs_romdisk_init();
+
+    printf("%d files in one directory, %d more %d directories down:\n",
+           files, DEEP_FILES, DEEP_LEVELS + 1);
+
+    if(!run("Scanning directories", plain, FS_ROMDISK_MNT_NOINDEX, files,
+            order) &&
+       !run("Index built at mount", plain, 0, files, order) &&
+       !run("Index from genromfs -i", indexed, 0, files, order))
+        rv = 0;
+
+    fs_romdisk_shutdown();
+
+out:
+    free(plain);
+    free(indexed);
+    free(order);
+    return rv;
+}
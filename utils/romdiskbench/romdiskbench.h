@@ -0,0 +1,18 @@
+/* KallistiOS ##version##
+
+   utils/romdiskbench/romdiskbench.h
+   Copyright (C) 2026 The KOS Team and contributors
+*/
+
+#ifndef __ROMDISKBENCH_H
+#define __ROMDISKBENCH_H
+
+#include <kos/fs.h>
+
+/* Non-zero to show all of the driver's debug output. */
+extern int romdiskbench_verbose;
+
+/* Find the VFS handler registered on the given mount point. */
+vfs_handler_t *romdiskbench_find_vfs(const char *mp);
+
+#endif /* __ROMDISKBENCH_H */
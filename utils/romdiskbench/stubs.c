@@ -0,0 +1,90 @@
+/* KallistiOS ##version##
+
+   utils/romdiskbench/stubs.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Just enough of the rest of KOS for fs_romdisk.c to run on the host.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <kos/thread.h>
+#include <kos/mutex.h>
+#include <kos/nmmgr.h>
+
+#include "romdiskbench.h"
+
+int romdiskbench_verbose = 0;
+
+static nmmgr_handler_t *handlers[8];
+
+void dbglog(int level, const char *fmt, ...) {
+    va_list ap;
+
+    if(!romdiskbench_verbose && level > DBG_ERROR)
+        return;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+int mutex_init(mutex_t *m, int mtype) {
+    (void)mtype;
+    m->count = 0;
+    return 0;
+}
+
+int mutex_destroy(mutex_t *m) {
+    (void)m;
+    return 0;
+}
+
+int mutex_lock(mutex_t *m) {
+    ++m->count;
+    return 0;
+}
+
+int mutex_unlock(mutex_t *m) {
+    --m->count;
+    return 0;
+}
+
+int nmmgr_handler_add(nmmgr_handler_t *hnd) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(!handlers[i]) {
+            handlers[i] = hnd;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int nmmgr_handler_remove(nmmgr_handler_t *hnd) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(handlers[i] == hnd) {
+            handlers[i] = NULL;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+vfs_handler_t *romdiskbench_find_vfs(const char *mp) {
+    size_t i;
+
+    for(i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
+        if(handlers[i] && !strcmp(handlers[i]->pathname, mp))
+            return (vfs_handler_t *)handlers[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,38 @@
+/* KallistiOS ##version##
+
+   utils/runqbench/include/kos/thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/thread.h, with only the parts of a thread that the
+   run queue looks at.
+*/
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+#define PRIO_MAX        4096
+#define PRIO_DEFAULT    10
+
+typedef int prio_t;
+typedef int tid_t;
+
+typedef struct kthread {
+    TAILQ_ENTRY(kthread) thdq;
+    tid_t tid;
+    prio_t prio;
+    uint32_t flags;
+    int state;
+} kthread_t;
+
+TAILQ_HEAD(ktqueue, kthread);
+
+#define THD_QUEUED      2
+
+#define STATE_RUNNING   0x0001
+#define STATE_READY     0x0002
+#define STATE_WAIT      0x0003
+
+#endif /* __KOS_THREAD_H */
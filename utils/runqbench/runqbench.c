@@ -0,0 +1,399 @@
+/* KallistiOS ##version##
+
+   utils/runqbench/runqbench.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Benchmark the scheduler's run queue (kernel/thread/runq.h) on a host
+   machine, against different numbers of runnable threads, and compare it to
+   the single priority-sorted queue that it replaced.
+
+   Only the queue itself is run here, not real threads, so the times are what
+   the scheduler spends on its queue for each of these, leaving out the cost
+   of saving and restoring registers:
+
+   - a context switch: thd_schedule() putting the current thread back on the
+     end of its priority and taking the next one off the front, round robin
+     through all of the runnable threads,
+   - a wakeup: a blocked thread being put back on the queue by genwait, and
+     then a switch to the thread at the front, which then blocks itself.
+
+   With -m, the threads are spread over a handful of priorities instead of
+   all being at PRIO_DEFAULT.
+
+   Before any of that, both queues are put through the same long random
+   sequence of adds (at the front of their priority and at the back, at all
+   sorts of priorities) and removals, and have to agree on the order of the
+   threads on them the whole time.
+
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kernel/thread/runq.h"
+
+#define MAX_THREADS     256
+
+/********************************************************************************/
+/* The old run queue: every runnable thread on one list, sorted by priority */
+
+static struct ktqueue old_queue;
+
+static void old_init(void) {
+    TAILQ_INIT(&old_queue);
+}
+
+static void old_add(kthread_t *t, int front_of_line) {
+    kthread_t *i;
+
+    if(t->flags & THD_QUEUED)
+        return;
+
+    TAILQ_FOREACH(i, &old_queue, thdq) {
+        if(front_of_line ? i->prio >= t->prio : i->prio > t->prio) {
+            TAILQ_INSERT_BEFORE(i, t, thdq);
+            t->flags |= THD_QUEUED;
+            return;
+        }
+    }
+
+    TAILQ_INSERT_TAIL(&old_queue, t, thdq);
+    t->flags |= THD_QUEUED;
+}
+
+static void old_remove(kthread_t *t) {
+    if(!(t->flags & THD_QUEUED))
+        return;
+
+    t->flags &= ~THD_QUEUED;
+    TAILQ_REMOVE(&old_queue, t, thdq);
+}
+
+static kthread_t *old_first(void) {
+    kthread_t *t;
+
+    TAILQ_FOREACH(t, &old_queue, thdq) {
+        if(t->state == STATE_READY)
+            return t;
+    }
+
+    return NULL;
+}
+
+/********************************************************************************/
+/* The new one */
+
+static runq_t new_queue;
+
+static void new_init(void) {
+    runq_init(&new_queue);
+}
+
+static void new_add(kthread_t *t, int front_of_line) {
+    runq_add(&new_queue, t, front_of_line);
+}
+
+static void new_remove(kthread_t *t) {
+    runq_remove(&new_queue, t);
+}
+
+static kthread_t *new_first(void) {
+    return runq_first(&new_queue);
+}
+
+typedef struct queue_ops {
+    const char *name;
+    void (*init)(void);
+    void (*add)(kthread_t *t, int front_of_line);
+    void (*remove)(kthread_t *t);
+    kthread_t *(*first)(void);
+} queue_ops_t;
+
+static const queue_ops_t queues[] = {
+    { "sorted list", old_init, old_add, old_remove, old_first },
+    { "bitmap", new_init, new_add, new_remove, new_first }
+};
+
+#define QUEUE_COUNT     (int)(sizeof(queues) / sizeof(queues[0]))
+
+/********************************************************************************/
+/* A cut down thd_schedule() */
+
+static kthread_t threads[MAX_THREADS + 1];
+static kthread_t *current, *idle;
+
+static uint32_t rng = 1;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void schedule(const queue_ops_t *q, int front_of_line) {
+    kthread_t *t;
+    int enq = current && current->state == STATE_RUNNING;
+
+    if(front_of_line && enq) {
+        current->state = STATE_READY;
+        q->add(current, 1);
+    }
+
+    t = q->first();
+
+    if(!front_of_line && enq) {
+        current->state = STATE_READY;
+        q->add(current, 0);
+
+        if(!t || t == idle)
+            t = current;
+    }
+
+    q->remove(t);
+    t->state = STATE_RUNNING;
+    current = t;
+}
+
+/* Set up count threads plus the idle thread, with all but the first of them
+   on the run queue. That one is running. */
+static void setup(const queue_ops_t *q, int count, int mixed) {
+    int i;
+
+    q->init();
+    memset(threads, 0, sizeof(threads));
+
+    for(i = 0; i <= count; ++i) {
+        threads[i].tid = i + 1;
+        threads[i].prio = mixed ? PRIO_DEFAULT + (int)(rand32() % 8) :
+            PRIO_DEFAULT;
+        threads[i].state = STATE_READY;
+    }
+
+    idle = &threads[count];
+    idle->prio = PRIO_MAX;
+
+    for(i = 1; i <= count; ++i)
+        q->add(&threads[i], 0);
+
+    current = &threads[0];
+    current->state = STATE_RUNNING;
+}
+
+/********************************************************************************/
+/* Checking the two queues against each other */
+
+#define CHECK_THREADS   64
+
+static kthread_t check_threads[QUEUE_COUNT][CHECK_THREADS];
+
+/* Both queues have to hold the same threads, in the same order. */
+static int compare_queues(void) {
+    kthread_t *o, *n = NULL;
+    unsigned int lvl = 0;
+
+    o = TAILQ_FIRST(&old_queue);
+
+    for(;;) {
+        while(!n && lvl < RUNQ_LEVELS)
+            n = TAILQ_FIRST(&new_queue.levels[lvl++]);
+
+        if(!o || !n)
+            return o || n ? -1 : 0;
+
+        if(o->tid != n->tid)
+            return -1;
+
+        o = TAILQ_NEXT(o, thdq);
+        n = TAILQ_NEXT(n, thdq);
+    }
+}
+
+static int check(unsigned long ops) {
+    static const prio_t prios[] = { 0, 1, 5, 10, 10, 10, 11, 31, 32, 62, 63,
+                                    64, 100, PRIO_MAX - 1, PRIO_MAX };
+    kthread_t *o, *n;
+    unsigned long op;
+    int i, q, front;
+    prio_t prio;
+
+    old_init();
+    new_init();
+
+    for(q = 0; q < QUEUE_COUNT; ++q) {
+        for(i = 0; i < CHECK_THREADS; ++i) {
+            memset(&check_threads[q][i], 0, sizeof(kthread_t));
+            check_threads[q][i].tid = i + 1;
+            check_threads[q][i].state = STATE_WAIT;
+        }
+    }
+
+    for(op = 0; op < ops; ++op) {
+        i = (int)(rand32() % CHECK_THREADS);
+        o = &check_threads[0][i];
+        n = &check_threads[1][i];
+
+        switch(rand32() % 4) {
+            case 0:
+            case 1:
+                /* Priorities only change while off the queue, as with
+                   thd_set_prio(). */
+                if(!(o->flags & THD_QUEUED)) {
+                    prio = prios[rand32() % (sizeof(prios) / sizeof(prios[0]))];
+                    o->prio = n->prio = prio;
+                }
+
+                front = rand32() % 3 == 0;
+                o->state = n->state = STATE_READY;
+                old_add(o, front);
+                new_add(n, front);
+                break;
+
+            case 2:
+                old_remove(o);
+                new_remove(n);
+                break;
+
+            case 3:
+                /* Every so often, a thread on the queue isn't ready. */
+                if(o->flags & THD_QUEUED)
+                    o->state = n->state = rand32() % 4 ? STATE_READY :
+                        STATE_WAIT;
+
+                break;
+        }
+
+        o = old_first();
+        n = new_first();
+
+        if((o ? o->tid : 0) != (n ? n->tid : 0) || compare_queues()) {
+            fprintf(stderr, "Run queues disagree after %lu operations\n", op);
+            return -1;
+        }
+    }
+
+    printf("%lu random operations, both queues agree\n", ops);
+    return 0;
+}
+
+/********************************************************************************/
+/* Benchmarks */
+
+static struct timespec t_start;
+
+static void bench_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+static double bench_end(unsigned long ops) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((t.tv_sec - t_start.tv_sec) * 1e9 +
+            (t.tv_nsec - t_start.tv_nsec)) / ops;
+}
+
+/* Round robin through every runnable thread. */
+static double bench_switch(const queue_ops_t *q, int count, int mixed,
+                           unsigned long ops) {
+    unsigned long i;
+
+    setup(q, count, mixed);
+    bench_start();
+
+    for(i = 0; i < ops; ++i)
+        schedule(q, 0);
+
+    return bench_end(ops);
+}
+
+/* Wake up a blocked thread, and switch to the next thread, which blocks and
+   is the next one woken up. The queue stays the same length the whole
+   time. */
+static double bench_wakeup(const queue_ops_t *q, int count, int mixed,
+                           unsigned long ops) {
+    kthread_t *blocked;
+    unsigned long i;
+
+    setup(q, count, mixed);
+    blocked = current;
+    blocked->state = STATE_WAIT;
+    current = NULL;
+    bench_start();
+
+    for(i = 0; i < ops; ++i) {
+        blocked->state = STATE_READY;
+        q->add(blocked, 0);
+
+        schedule(q, 0);
+
+        /* Like a wait in genwait_wait() */
+        blocked = current;
+        blocked->state = STATE_WAIT;
+        current = NULL;
+    }
+
+    return bench_end(ops);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-t max_threads] [-n ops] [-m]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long ops = 1000000;
+    int max_threads = MAX_THREADS, mixed = 0, opt, count, q;
+    double sw[QUEUE_COUNT], wk[QUEUE_COUNT];
+
+    while((opt = getopt(argc, argv, "t:n:m")) != -1) {
+        switch(opt) {
+            case 't': max_threads = atoi(optarg); break;
+            case 'n': ops = strtoul(optarg, NULL, 0); break;
+            case 'm': mixed = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || max_threads < 1 || max_threads > MAX_THREADS ||
+       !ops) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(check(ops))
+        return 1;
+
+    printf("ns per operation, threads at %s:\n",
+           mixed ? "a mix of priorities" : "the same priority");
+    printf("            %-23s %-23s\n", "context switch", "wakeup");
+    printf("  threads");
+
+    for(q = 0; q < 2 * QUEUE_COUNT; ++q)
+        printf(" %11s", queues[q % QUEUE_COUNT].name);
+
+    printf("\n");
+
+    for(count = 1; count <= max_threads; count *= 2) {
+        for(q = 0; q < QUEUE_COUNT; ++q) {
+            sw[q] = bench_switch(&queues[q], count, mixed, ops);
+            wk[q] = bench_wakeup(&queues[q], count, mixed, ops);
+        }
+
+        printf("  %7d", count);
+
+        for(q = 0; q < QUEUE_COUNT; ++q)
+            printf(" %11.1f", sw[q]);
+
+        for(q = 0; q < QUEUE_COUNT; ++q)
+            printf(" %11.1f", wk[q]);
+
+        printf("\n");
+    }
+
+    return 0;
+}
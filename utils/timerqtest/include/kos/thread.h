@@ -0,0 +1,29 @@
+/* KallistiOS ##version##
+
+   utils/timerqtest/include/kos/thread.h
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Host stand-in for kos/thread.h, with only the parts of a thread that the
+   timer queue looks at. The old sorted timer queue's list entry is here too,
+   so that the two can be timed against each other.
+*/
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+typedef struct kthread {
+    struct {
+        struct kthread *child;
+        struct kthread *sibling;
+        struct kthread *prev;
+    } timerq;
+
+    TAILQ_ENTRY(kthread) old_timerq;
+
+    uint64_t wait_timeout;
+} kthread_t;
+
+#endif /* __KOS_THREAD_H */
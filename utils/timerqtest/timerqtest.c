@@ -0,0 +1,380 @@
+/* KallistiOS ##version##
+
+   utils/timerqtest/timerqtest.c
+   Copyright (C) 2026 The KOS Team and contributors
+
+   Stress test and benchmark of the genwait timed event queue
+   (kernel/thread/timerq.h), run on a host machine.
+
+   The tests:
+
+   - thousands of waiters (with lots of identical timeouts) are inserted, and
+     then taken off the top one at a time, which has to give them all back in
+     order,
+   - a long random trace of timed waits starting, being cancelled (as when a
+     waiter is woken up before its timeout) and expiring (as in
+     genwait_check_timeouts()) is run with thousands of waiters at once. The
+     top of the queue has to always be the earliest timeout, and every so
+     often the whole heap is walked to check that its links are consistent,
+     that no child is earlier than its parent, and that it holds exactly the
+     waiters it should.
+
+   Then, for a number of waiters from a handful up to thousands, each of
+   these is timed on both the heap and the sorted list it replaced:
+
+   - cancelling a random waiter and starting a new timed wait,
+   - expiring the earliest waiter and starting a new timed wait.
+
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kernel/thread/timerq.h"
+
+#define MAX_WAITERS     16384
+
+/* Timeouts are picked from this range (in ms) after the current time, so
+   that plenty of them end up the same. */
+#define TIMEOUT_RANGE   2000
+
+static kthread_t waiters[MAX_WAITERS];
+static int queued[MAX_WAITERS];
+
+static kthread_t *queue;
+static uint64_t now;
+
+static uint32_t rng = 1;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int fail(const char *what, unsigned long op) {
+    fprintf(stderr, "  FAILED at operation %lu: %s\n", op, what);
+    return -1;
+}
+
+/********************************************************************************/
+/* Tests */
+
+/* Walk a heap, checking every link on the way, and count what's in it. */
+static int walk(kthread_t *t, kthread_t *parent, unsigned long *count) {
+    kthread_t *prev = parent, *c;
+
+    for(; t; prev = t, t = t->timerq.sibling) {
+        if(t->timerq.prev != prev)
+            return -1;
+
+        if(parent && t->wait_timeout < parent->wait_timeout)
+            return -1;
+
+        if(!queued[t - waiters])
+            return -1;
+
+        ++*count;
+
+        if((c = t->timerq.child) && walk(c, t, count))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int check_heap(unsigned long expect) {
+    unsigned long count = 0;
+
+    if(queue && (queue->timerq.prev || queue->timerq.sibling))
+        return -1;
+
+    if(queue && walk(queue->timerq.child, queue, &count))
+        return -1;
+
+    if(queue && !queued[queue - waiters])
+        return -1;
+
+    return count + (queue ? 1 : 0) == expect ? 0 : -1;
+}
+
+static uint64_t earliest(int count) {
+    uint64_t rv = UINT64_MAX;
+    int i;
+
+    for(i = 0; i < count; ++i) {
+        if(queued[i] && waiters[i].wait_timeout < rv)
+            rv = waiters[i].wait_timeout;
+    }
+
+    return rv;
+}
+
+static void start_wait(int i) {
+    waiters[i].wait_timeout = now + 1 + rand32() % TIMEOUT_RANGE;
+    queued[i] = 1;
+    tq_insert(&queue, &waiters[i]);
+}
+
+static void stop_wait(int i) {
+    tq_remove(&queue, &waiters[i]);
+    queued[i] = 0;
+}
+
+static void reset(void) {
+    memset(waiters, 0, sizeof(waiters));
+    memset(queued, 0, sizeof(queued));
+    queue = NULL;
+    now = 1;
+}
+
+static int test_order(int count) {
+    kthread_t *t;
+    uint64_t last = 0;
+    int i;
+
+    reset();
+
+    for(i = 0; i < count; ++i)
+        start_wait(i);
+
+    if(check_heap(count))
+        return fail("heap is broken after inserting", 0);
+
+    for(i = 0; i < count; ++i) {
+        if(!(t = tq_next(&queue)))
+            return fail("queue ran out early", i);
+
+        if(t->wait_timeout < last)
+            return fail("came out of order", i);
+
+        last = t->wait_timeout;
+        stop_wait(t - waiters);
+    }
+
+    if(tq_next(&queue))
+        return fail("queue isn't empty", count);
+
+    printf("  %d waiters came out in order\n", count);
+    return 0;
+}
+
+static int test_random(int count, unsigned long ops) {
+    kthread_t *t;
+    unsigned long op, live = 0, cancels = 0, expires = 0;
+    uint64_t last = 0;
+    int i;
+
+    reset();
+
+    for(op = 0; op < ops; ++op) {
+        i = (int)(rand32() % count);
+
+        switch(rand32() % 8) {
+            case 0: case 1: case 2:
+                if(!queued[i]) {
+                    start_wait(i);
+                    ++live;
+                }
+
+                break;
+
+            case 3: case 4:
+                if(queued[i]) {
+                    stop_wait(i);
+                    --live;
+                    ++cancels;
+                }
+
+                break;
+
+            default:
+                /* Time passes, and everything that's due expires. New waits
+                   always end after the current time, so waiters have to
+                   expire in order of their timeouts. */
+                now += rand32() % 8;
+
+                while((t = tq_next(&queue)) && t->wait_timeout <= now) {
+                    if(t->wait_timeout < last)
+                        return fail("expired out of order", op);
+
+                    last = t->wait_timeout;
+                    stop_wait(t - waiters);
+                    --live;
+                    ++expires;
+                }
+
+                break;
+        }
+
+        if(!(op % 256) && (tq_next(&queue) ? tq_next(&queue)->wait_timeout :
+                           UINT64_MAX) != earliest(count))
+            return fail("top of the queue isn't the earliest", op);
+
+        if(!(op % 4096) && check_heap(live))
+            return fail("heap is broken", op);
+    }
+
+    if(check_heap(live))
+        return fail("heap is broken at the end", ops);
+
+    printf("  %lu random operations on %d waiters, %lu cancelled, "
+           "%lu expired\n", ops, count, cancels, expires);
+    return 0;
+}
+
+/********************************************************************************/
+/* The old timer queue: a list kept sorted by timeout */
+
+static TAILQ_HEAD(old_queue, kthread) old_queue;
+
+static void old_insert(kthread_t *thd) {
+    kthread_t *i;
+
+    TAILQ_FOREACH(i, &old_queue, old_timerq) {
+        if(i->wait_timeout > thd->wait_timeout) {
+            TAILQ_INSERT_BEFORE(i, thd, old_timerq);
+            return;
+        }
+    }
+
+    TAILQ_INSERT_TAIL(&old_queue, thd, old_timerq);
+}
+
+/********************************************************************************/
+/* Benchmarks */
+
+static struct timespec t_start;
+
+static void bench_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+static double bench_end(unsigned long ops) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((t.tv_sec - t_start.tv_sec) * 1e9 +
+            (t.tv_nsec - t_start.tv_nsec)) / ops;
+}
+
+static void fill(int count, int old) {
+    int i;
+
+    reset();
+    TAILQ_INIT(&old_queue);
+
+    for(i = 0; i < count; ++i) {
+        waiters[i].wait_timeout = now + 1 + rand32() % TIMEOUT_RANGE;
+
+        if(old)
+            old_insert(&waiters[i]);
+        else
+            tq_insert(&queue, &waiters[i]);
+    }
+}
+
+static double bench_cancel(int count, int old, unsigned long ops) {
+    kthread_t *t;
+    unsigned long op;
+
+    fill(count, old);
+    bench_start();
+
+    for(op = 0; op < ops; ++op) {
+        t = &waiters[rand32() % count];
+
+        if(old)
+            TAILQ_REMOVE(&old_queue, t, old_timerq);
+        else
+            tq_remove(&queue, t);
+
+        t->wait_timeout = ++now + rand32() % TIMEOUT_RANGE;
+
+        if(old)
+            old_insert(t);
+        else
+            tq_insert(&queue, t);
+    }
+
+    return bench_end(ops);
+}
+
+static double bench_expire(int count, int old, unsigned long ops) {
+    kthread_t *t;
+    unsigned long op;
+
+    fill(count, old);
+    bench_start();
+
+    for(op = 0; op < ops; ++op) {
+        if(old) {
+            t = TAILQ_FIRST(&old_queue);
+            TAILQ_REMOVE(&old_queue, t, old_timerq);
+        }
+        else {
+            t = tq_next(&queue);
+            tq_remove(&queue, t);
+        }
+
+        now = t->wait_timeout;
+        t->wait_timeout = now + 1 + rand32() % TIMEOUT_RANGE;
+
+        if(old)
+            old_insert(t);
+        else
+            tq_insert(&queue, t);
+    }
+
+    return bench_end(ops);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-w max_waiters] [-n ops]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long ops = 200000;
+    int max_waiters = 4096, opt, count;
+
+    while((opt = getopt(argc, argv, "w:n:")) != -1) {
+        switch(opt) {
+            case 'w': max_waiters = atoi(optarg); break;
+            case 'n': ops = strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if(optind != argc || max_waiters < 1 || max_waiters > MAX_WAITERS ||
+       !ops) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("Tests:\n");
+
+    if(test_order(max_waiters) || test_random(16, ops * 5) ||
+       test_random(max_waiters, ops * 5)) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("ns per operation:\n");
+    printf("           %-23s %-23s\n", "cancel + wait", "expire + wait");
+    printf("  waiters     sorted        heap      sorted        heap\n");
+
+    for(count = 4; count <= max_waiters; count *= 4) {
+        printf("  %7d %11.1f %11.1f", count, bench_cancel(count, 1, ops),
+               bench_cancel(count, 0, ops));
+        printf(" %11.1f %11.1f\n", bench_expire(count, 1, ops),
+               bench_expire(count, 0, ops));
+    }
+
+    return 0;
+}